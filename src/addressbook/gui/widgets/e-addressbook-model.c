@@ -43,6 +43,11 @@ struct _EAddressbookModelPrivate {
 
 	/* Query Results */
 	GPtrArray *contacts;
+	GHashTable *uid_to_index; /* gchar *uid ~> index into contacts */
+
+	/* Rows changed since the last CONTACT_CHANGED emission */
+	GHashTable *pending_changes; /* GUINT_TO_POINTER (index + 1) */
+	guint pending_changes_id;
 
 	/* Signal Handler IDs */
 	gulong create_contact_id;
@@ -83,14 +88,93 @@ static guint signals[LAST_SIGNAL];
 
 G_DEFINE_TYPE (EAddressbookModel, e_addressbook_model, G_TYPE_OBJECT)
 
+static void
+discard_pending_changes (EAddressbookModel *model)
+{
+	if (model->priv->pending_changes_id) {
+		g_source_remove (model->priv->pending_changes_id);
+		model->priv->pending_changes_id = 0;
+	}
+
+	g_hash_table_remove_all (model->priv->pending_changes);
+}
+
 static void
 free_data (EAddressbookModel *model)
 {
 	GPtrArray *array;
 
+	/* Callers announce the whole model changed afterwards. */
+	discard_pending_changes (model);
+
 	array = model->priv->contacts;
 	g_ptr_array_foreach (array, (GFunc) g_object_unref, NULL);
 	g_ptr_array_set_size (array, 0);
+
+	g_hash_table_remove_all (model->priv->uid_to_index);
+}
+
+static gint
+sort_ascending (gconstpointer ca,
+                gconstpointer cb)
+{
+	gint a = *((gint *) ca);
+	gint b = *((gint *) cb);
+
+	return (a == b) ? 0 : (a < b) ? -1 : 1;
+}
+
+/* Emits CONTACT_CHANGED once for each row modified since the last call.
+ * This has to run before any rows get removed, because the pending
+ * indices are not adjusted for the shift. */
+static void
+flush_pending_changes (EAddressbookModel *model)
+{
+	GHashTableIter iter;
+	gpointer key;
+	GArray *indices;
+	guint ii;
+
+	if (model->priv->pending_changes_id) {
+		g_source_remove (model->priv->pending_changes_id);
+		model->priv->pending_changes_id = 0;
+	}
+
+	if (!g_hash_table_size (model->priv->pending_changes))
+		return;
+
+	indices = g_array_sized_new (
+		FALSE, FALSE, sizeof (gint),
+		g_hash_table_size (model->priv->pending_changes));
+
+	g_hash_table_iter_init (&iter, model->priv->pending_changes);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		gint index = GPOINTER_TO_UINT (key) - 1;
+
+		g_array_append_val (indices, index);
+	}
+
+	g_hash_table_remove_all (model->priv->pending_changes);
+
+	g_array_sort (indices, sort_ascending);
+
+	for (ii = 0; ii < indices->len; ii++)
+		g_signal_emit (
+			model, signals[CONTACT_CHANGED], 0,
+			g_array_index (indices, gint, ii));
+
+	g_array_free (indices, TRUE);
+}
+
+static gboolean
+pending_changes_idle_cb (gpointer user_data)
+{
+	EAddressbookModel *model = user_data;
+
+	model->priv->pending_changes_id = 0;
+	flush_pending_changes (model);
+
+	return FALSE;
 }
 
 static void
@@ -179,12 +263,21 @@ view_create_contact_cb (EBookClientView *client_view,
 	guint count;
 	guint index;
 
+	flush_pending_changes (model);
+
 	array = model->priv->contacts;
 	index = array->len;
 	count = g_list_length ((GList *) contact_list);
 
 	while (contact_list != NULL) {
 		EContact *contact = contact_list->data;
+		const gchar *uid;
+
+		uid = e_contact_get_const (contact, E_CONTACT_UID);
+		if (uid != NULL)
+			g_hash_table_insert (
+				model->priv->uid_to_index, g_strdup (uid),
+				GUINT_TO_POINTER (array->len));
 
 		g_ptr_array_add (array, g_object_ref (contact));
 		contact_list = contact_list->next;
@@ -204,56 +297,91 @@ sort_descending (gconstpointer ca,
 	return (a == b) ? 0 : (a < b) ? 1 : -1;
 }
 
+static gboolean
+lookup_uid_index (EAddressbookModel *model,
+                  const gchar *uid,
+                  guint *out_index)
+{
+	gpointer value;
+
+	if (!uid || !g_hash_table_lookup_extended (
+		model->priv->uid_to_index, uid, NULL, &value))
+		return FALSE;
+
+	*out_index = GPOINTER_TO_UINT (value);
+
+	return *out_index < model->priv->contacts->len;
+}
+
 static void
 view_remove_contact_cb (EBookClientView *client_view,
                         const GSList *ids,
                         EAddressbookModel *model)
 {
-	/* XXX we should keep a hash around instead of this O(n*m) loop */
 	const GSList *iter;
 	GArray *indices;
 	GPtrArray *array;
-	gint ii;
+	guint ii, jj;
+
+	/* Pending row indices are about to shift. */
+	flush_pending_changes (model);
 
 	array = model->priv->contacts;
 	indices = g_array_new (FALSE, FALSE, sizeof (gint));
 
 	for (iter = ids; iter != NULL; iter = iter->next) {
 		const gchar *target_uid = iter->data;
+		guint index;
 
-		for (ii = 0; ii < array->len; ii++) {
-			EContact *contact;
-			const gchar *uid;
+		if (!lookup_uid_index (model, target_uid, &index))
+			continue;
 
-			contact = array->pdata[ii];
-			/* check if already removed */
-			if (!contact)
-				continue;
+		g_hash_table_remove (model->priv->uid_to_index, target_uid);
 
-			uid = e_contact_get_const (contact, E_CONTACT_UID);
-			g_return_if_fail (uid != NULL);
+		/* check if already removed */
+		if (!array->pdata[index])
+			continue;
 
-			if (strcmp (uid, target_uid) == 0) {
-				g_object_unref (contact);
-				g_array_append_val (indices, ii);
-				array->pdata[ii] = NULL;
-				break;
-			}
-		}
+		g_object_unref (array->pdata[index]);
+		array->pdata[index] = NULL;
+
+		g_array_append_val (indices, index);
 	}
 
-	/* Sort the 'indices' array in descending order, since
-	 * g_ptr_array_remove_index() shifts subsequent elements
-	 * down one position to fill the gap. */
-	g_array_sort (indices, sort_descending);
+	if (!indices->len) {
+		g_array_free (indices, TRUE);
+		return;
+	}
 
-	for (ii = 0; ii < indices->len; ii++) {
-		gint index;
+	/* Close all the gaps in one pass, re-indexing the contacts
+	 * which moved down, instead of shifting the tail of the array
+	 * once per removed contact. */
+	for (ii = 0, jj = 0; ii < array->len; ii++) {
+		EContact *contact = array->pdata[ii];
+		const gchar *uid;
 
-		index = g_array_index (indices, gint, ii);
-		g_ptr_array_remove_index (array, index);
+		if (!contact)
+			continue;
+
+		if (ii != jj) {
+			array->pdata[jj] = contact;
+
+			uid = e_contact_get_const (contact, E_CONTACT_UID);
+			if (uid != NULL)
+				g_hash_table_insert (
+					model->priv->uid_to_index,
+					g_strdup (uid), GUINT_TO_POINTER (jj));
+		}
+
+		jj++;
 	}
 
+	g_ptr_array_set_size (array, jj);
+
+	/* Listeners expect the indices in descending order, as they
+	 * used to be removed one by one from the end. */
+	g_array_sort (indices, sort_descending);
+
 	g_signal_emit (model, signals[CONTACTS_REMOVED], 0, indices);
 	g_array_free (indices, TRUE);
 
@@ -272,40 +400,35 @@ view_modify_contact_cb (EBookClientView *client_view,
 	while (contact_list != NULL) {
 		EContact *new_contact = contact_list->data;
 		const gchar *target_uid;
-		gint ii;
+		guint index;
 
 		target_uid = e_contact_get_const (new_contact, E_CONTACT_UID);
 		g_warn_if_fail (target_uid != NULL);
 
-		/* skip contacts without UID */
-		if (!target_uid) {
+		/* skip contacts without UID and unknown contacts */
+		if (!lookup_uid_index (model, target_uid, &index) ||
+		    !array->pdata[index]) {
 			contact_list = contact_list->next;
 			continue;
 		}
 
-		for (ii = 0; ii < array->len; ii++) {
-			EContact *old_contact;
-			const gchar *uid;
-
-			old_contact = array->pdata[ii];
-			g_return_if_fail (old_contact != NULL);
-
-			uid = e_contact_get_const (old_contact, E_CONTACT_UID);
-			g_return_if_fail (uid != NULL);
+		g_object_unref (array->pdata[index]);
+		array->pdata[index] = e_contact_duplicate (new_contact);
 
-			if (strcmp (uid, target_uid) != 0)
-				continue;
-
-			g_object_unref (old_contact);
-			array->pdata[ii] = e_contact_duplicate (new_contact);
-
-			g_signal_emit (
-				model, signals[CONTACT_CHANGED], 0, ii);
-			break;
-		}
+		/* Rows modified repeatedly before the main loop gets
+		 * back to us are announced only once. */
+		g_hash_table_add (
+			model->priv->pending_changes,
+			GUINT_TO_POINTER (index + 1));
 
 		contact_list = contact_list->next;
 	}
+
+	if (g_hash_table_size (model->priv->pending_changes) &&
+	    !model->priv->pending_changes_id) {
+		model->priv->pending_changes_id = g_idle_add (
+			pending_changes_idle_cb, model);
+	}
 }
 
 static void
@@ -577,6 +700,8 @@ addressbook_model_finalize (GObject *object)
 	priv = E_ADDRESSBOOK_MODEL_GET_PRIVATE (object);
 
 	g_ptr_array_free (priv->contacts, TRUE);
+	g_hash_table_destroy (priv->uid_to_index);
+	g_hash_table_destroy (priv->pending_changes);
 
 	/* Chain up to parent's finalize() method. */
 	G_OBJECT_CLASS (e_addressbook_model_parent_class)->finalize (object);
@@ -768,6 +893,10 @@ e_addressbook_model_init (EAddressbookModel *model)
 {
 	model->priv = E_ADDRESSBOOK_MODEL_GET_PRIVATE (model);
 	model->priv->contacts = g_ptr_array_new ();
+	model->priv->uid_to_index = g_hash_table_new_full (
+		g_str_hash, g_str_equal, g_free, NULL);
+	model->priv->pending_changes = g_hash_table_new (
+		g_direct_hash, g_direct_equal);
 	model->priv->first_get_view = TRUE;
 }
 
@@ -863,6 +992,8 @@ e_addressbook_model_find (EAddressbookModel *model,
                           EContact *contact)
 {
 	GPtrArray *array;
+	const gchar *uid;
+	guint index;
 	gint ii;
 
 	/* XXX This searches for a particular EContact instance,
@@ -874,6 +1005,17 @@ e_addressbook_model_find (EAddressbookModel *model,
 	g_return_val_if_fail (E_IS_CONTACT (contact), -1);
 
 	array = model->priv->contacts;
+
+	uid = e_contact_get_const (contact, E_CONTACT_UID);
+	if (uid != NULL) {
+		if (lookup_uid_index (model, uid, &index) &&
+		    array->pdata[index] == contact)
+			return index;
+
+		return -1;
+	}
+
+	/* Contacts without UID are not indexed. */
 	for (ii = 0; ii < array->len; ii++) {
 		EContact *candidate = array->pdata[ii];
 
@@ -0,0 +1,223 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Helpers shared by the contact importers */
+
+#include "evolution-config.h"
+
+#include <glib/gi18n.h>
+
+#include "evolution-addressbook-importers.h"
+
+static const gchar *
+contact_importer_describe_contact (EContact *contact)
+{
+	const gchar *text;
+
+	text = e_contact_get_const (contact, E_CONTACT_FILE_AS);
+	if (!text || !*text)
+		text = e_contact_get_const (contact, E_CONTACT_FULL_NAME);
+	if (!text || !*text)
+		text = e_contact_get_const (contact, E_CONTACT_UID);
+
+	return text ? text : "";
+}
+
+/* Adds the 'contacts' to the book in one call. When that fails, they are
+ * added one by one, thus one bad contact does not drop the whole batch.
+ * Each contact gets a UID first, thus those stored before the failure
+ * are recognized as existing ones and are not added twice. Failures of
+ * single contacts are logged. The 'out_uids' receives UIDs in the order
+ * of the 'contacts', with NULL for those not stored; free it with
+ * g_slist_free_full (uids, g_free). Returns FALSE only when cancelled. */
+gboolean
+evolution_contact_importer_add_contacts_sync (EBookClient *book_client,
+                                              GSList *contacts,
+                                              GSList **out_uids,
+                                              GCancellable *cancellable,
+                                              GError **error)
+{
+	GSList *uids = NULL, *link;
+	GError *local_error = NULL;
+
+	g_return_val_if_fail (E_IS_BOOK_CLIENT (book_client), FALSE);
+
+	if (out_uids)
+		*out_uids = NULL;
+
+	if (!contacts)
+		return TRUE;
+
+	for (link = contacts; link; link = g_slist_next (link)) {
+		EContact *contact = link->data;
+
+		if (!e_contact_get_const (contact, E_CONTACT_UID)) {
+			gchar *uid = e_util_generate_uid ();
+
+			e_contact_set (contact, E_CONTACT_UID, uid);
+			g_free (uid);
+		}
+	}
+
+	if (e_book_client_add_contacts_sync (
+		book_client, contacts, E_BOOK_OPERATION_FLAG_NONE,
+		out_uids ? &uids : NULL, cancellable, &local_error)) {
+		if (out_uids)
+			*out_uids = uids;
+		else
+			g_slist_free_full (uids, g_free);
+
+		return TRUE;
+	}
+
+	g_slist_free_full (uids, g_free);
+	uids = NULL;
+
+	if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_propagate_error (error, local_error);
+		return FALSE;
+	}
+
+	g_clear_error (&local_error);
+
+	for (link = contacts; link; link = g_slist_next (link)) {
+		EContact *contact = link->data;
+		gchar *uid = NULL;
+
+		if (!e_book_client_add_contact_sync (
+			book_client, contact, E_BOOK_OPERATION_FLAG_NONE,
+			&uid, cancellable, &local_error)) {
+			if (g_error_matches (local_error, E_BOOK_CLIENT_ERROR, E_BOOK_CLIENT_ERROR_CONTACT_ID_ALREADY_EXISTS)) {
+				/* Stored by the failed batch call */
+				uid = e_contact_get (contact, E_CONTACT_UID);
+			} else if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+				g_slist_free_full (uids, g_free);
+				g_propagate_error (error, local_error);
+				return FALSE;
+			} else {
+				g_warning ("%s: Failed to import contact “%s”: %s", G_STRFUNC,
+					contact_importer_describe_contact (contact),
+					local_error ? local_error->message : "Unknown error");
+			}
+
+			g_clear_error (&local_error);
+		}
+
+		uids = g_slist_prepend (uids, uid);
+	}
+
+	if (out_uids)
+		*out_uids = g_slist_reverse (uids);
+	else
+		g_slist_free_full (uids, g_free);
+
+	return TRUE;
+}
+
+static gpointer
+contact_importer_worker_thread (gpointer user_data)
+{
+	EvolutionContactImporterWorker *worker = user_data;
+
+	worker->func (worker->user_data);
+
+	g_atomic_int_set (&worker->finished, 1);
+
+	return NULL;
+}
+
+static gboolean
+contact_importer_worker_poll_cb (gpointer user_data)
+{
+	EvolutionContactImporterWorker *worker = user_data;
+
+	if (g_atomic_int_get (&worker->finished)) {
+		worker->poll_id = 0;
+
+		/* Can free the worker */
+		worker->done_func (worker->user_data);
+
+		return FALSE;
+	}
+
+	e_import_status (
+		worker->import, worker->target, _("Importing…"),
+		g_atomic_int_get (&worker->percent));
+
+	return TRUE;
+}
+
+/* Runs 'func' in a new thread and calls 'done_func' in the main thread
+ * after it finished; meanwhile the import status shows the percent set
+ * by evolution_contact_importer_worker_set_percent(). The 'done_func'
+ * is expected to call evolution_contact_importer_worker_finish(). */
+gboolean
+evolution_contact_importer_worker_start (EvolutionContactImporterWorker *worker,
+                                         EImport *import,
+                                         EImportTarget *target,
+                                         const gchar *thread_name,
+                                         EvolutionContactImporterFunc func,
+                                         EvolutionContactImporterFunc done_func,
+                                         gpointer user_data,
+                                         GError **error)
+{
+	g_return_val_if_fail (worker != NULL, FALSE);
+	g_return_val_if_fail (func != NULL, FALSE);
+	g_return_val_if_fail (done_func != NULL, FALSE);
+
+	worker->import = import;
+	worker->target = target;
+	worker->func = func;
+	worker->done_func = done_func;
+	worker->user_data = user_data;
+	worker->percent = 0;
+	worker->finished = 0;
+
+	worker->thread = g_thread_try_new (
+		thread_name, contact_importer_worker_thread, worker, error);
+
+	if (!worker->thread)
+		return FALSE;
+
+	worker->poll_id = e_named_timeout_add (
+		100, contact_importer_worker_poll_cb, worker);
+
+	return TRUE;
+}
+
+void
+evolution_contact_importer_worker_set_percent (EvolutionContactImporterWorker *worker,
+                                               gint percent)
+{
+	g_return_if_fail (worker != NULL);
+
+	g_atomic_int_set (&worker->percent, percent);
+}
+
+/* Waits for the thread and stops the polling */
+void
+evolution_contact_importer_worker_finish (EvolutionContactImporterWorker *worker)
+{
+	g_return_if_fail (worker != NULL);
+
+	if (worker->poll_id) {
+		g_source_remove (worker->poll_id);
+		worker->poll_id = 0;
+	}
+
+	if (worker->thread) {
+		g_thread_join (worker->thread);
+		worker->thread = NULL;
+	}
+}
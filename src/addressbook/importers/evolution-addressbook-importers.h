@@ -18,6 +18,9 @@
  */
 
 #include <gtk/gtk.h>
+#include <libebook/libebook.h>
+
+#include <e-util/e-util.h>
 
 struct _EImportImporter *evolution_ldif_importer_peek (void);
 struct _EImportImporter *evolution_vcard_importer_peek (void);
@@ -27,3 +30,40 @@ struct _EImportImporter *evolution_csv_evolution_importer_peek (void);
 
 /* private utility function for importers only */
 GtkWidget *evolution_contact_importer_get_preview_widget (const GSList *contacts);
+
+gboolean evolution_contact_importer_add_contacts_sync (EBookClient *book_client,
+						       GSList *contacts,
+						       GSList **out_uids,
+						       GCancellable *cancellable,
+						       GError **error);
+
+typedef void (* EvolutionContactImporterFunc) (gpointer user_data);
+
+/* Runs the import in a dedicated thread, while the main loop
+ * only polls it for progress and completion. */
+typedef struct _EvolutionContactImporterWorker {
+	EImport *import;
+	EImportTarget *target;
+
+	EvolutionContactImporterFunc func;
+	EvolutionContactImporterFunc done_func;
+	gpointer user_data;
+
+	GThread *thread;
+	guint poll_id;
+
+	gint percent;		/* atomic */
+	gint finished;		/* atomic */
+} EvolutionContactImporterWorker;
+
+gboolean evolution_contact_importer_worker_start (EvolutionContactImporterWorker *worker,
+						  EImport *import,
+						  EImportTarget *target,
+						  const gchar *thread_name,
+						  EvolutionContactImporterFunc func,
+						  EvolutionContactImporterFunc done_func,
+						  gpointer user_data,
+						  GError **error);
+void evolution_contact_importer_worker_set_percent (EvolutionContactImporterWorker *worker,
+						    gint percent);
+void evolution_contact_importer_worker_finish (EvolutionContactImporterWorker *worker);
@@ -53,9 +53,8 @@ typedef struct {
 	EImport *import;
 	EImportTarget *target;
 
-	guint idle_id;
+	EvolutionContactImporterWorker worker;
 
-	gint state;
 	FILE *file;
 	gulong size;
 	gint count;
@@ -65,7 +64,7 @@ typedef struct {
 	GHashTable *fields_map;
 
 	EBookClient *book_client;
-	GSList *contacts;
+	GCancellable *cancellable;
 } CSVImporter;
 
 static gint importer;
@@ -688,11 +687,11 @@ parseLine (CSVImporter *gci,
 	return TRUE;
 }
 
-static EContact *
-getNextCSVEntry (CSVImporter *gci,
-                 FILE *f)
+/* Reads one record, which can span several lines when a quoted value
+ * contains new lines. Returns NULL at the end of the file. */
+static GString *
+csv_read_line (FILE *f)
 {
-	EContact *contact = NULL;
 	GString *line;
 	gint c;
 
@@ -720,33 +719,44 @@ getNextCSVEntry (CSVImporter *gci,
 		g_string_append_c (line, c);
 	}
 
-	if (gci->count == 0 && importer != MOZILLA_IMPORTER) {
-		gci->fields_map = map_fields (line->str, importer);
-		g_string_set_size (line, 0);
-		while (1) {
-			c = fgetc (f);
-			if (c == EOF) {
-				g_string_free (line, TRUE);
-				return NULL;
-			}
-			if (c == '\r')
-				c = fgetc (f);
-			if (c == '\n') {
-				g_string_append_c (line, c);
-				break;
-			}
-			if (c == '"') {
-				g_string_append_c (line, c);
-				c = fgetc (f);
-				while (!feof (f) && c != '"') {
-					g_string_append_c (line, c);
-					c = fgetc (f);
-				}
-			}
-			g_string_append_c (line, c);
-		}
-		gci->count++;
-	}
+	return line;
+}
+
+/* Reads the header line, if the importer has one, and maps its
+ * columns. Returns FALSE at the end of the file. */
+static gboolean
+csv_read_header (CSVImporter *gci,
+                 FILE *f)
+{
+	GString *line;
+
+	if (gci->count != 0 || importer == MOZILLA_IMPORTER)
+		return TRUE;
+
+	line = csv_read_line (f);
+	if (!line)
+		return FALSE;
+
+	gci->fields_map = map_fields (line->str, importer);
+	g_string_free (line, TRUE);
+	gci->count++;
+
+	return TRUE;
+}
+
+static EContact *
+getNextCSVEntry (CSVImporter *gci,
+                 FILE *f)
+{
+	EContact *contact = NULL;
+	GString *line;
+
+	if (!csv_read_header (gci, f))
+		return NULL;
+
+	line = csv_read_line (f);
+	if (!line)
+		return NULL;
 
 	if (line->len == 0) {
 		g_string_free (line, TRUE);
@@ -767,36 +777,108 @@ getNextCSVEntry (CSVImporter *gci,
 	return contact;
 }
 
-static gboolean
-csv_import_contacts (gpointer d)
+/* Number of records mapped and added to the book at once. */
+#define CSV_IMPORT_BATCH_SIZE 256
+
+typedef struct _CSVImportJob {
+	GString *line;
+	EContact *contact;
+} CSVImportJob;
+
+typedef struct _CSVImportBatch {
+	EUtilBatch *mapper; /* maps the jobs */
+
+	CSVImportJob jobs[CSV_IMPORT_BATCH_SIZE];
+	guint n_jobs;
+} CSVImportBatch;
+
+/* Maps one record to a contact; runs in the thread pool. parseLine()
+ * only reads the importer's column map, which is set up by then. */
+static void
+csv_import_map_job_cb (gpointer data,
+                       gpointer user_data)
 {
-	CSVImporter *gci = d;
-	EContact *contact = NULL;
+	CSVImportJob *job = data;
+	CSVImporter *gci = user_data;
+
+	job->contact = e_contact_new ();
+
+	if (!parseLine (gci, job->contact, job->line->str))
+		g_clear_object (&job->contact);
+}
+
+/* Reads the file in batches of records, which are mapped to contacts
+ * in parallel and then added to the book in one call per batch. */
+static void
+csv_import_thread (gpointer user_data)
+{
+	CSVImporter *gci = user_data;
+	CSVImportBatch batch;
+	gboolean eof = FALSE;
+	guint ii;
+
+	if (!csv_read_header (gci, gci->file))
+		return;
+
+	batch.mapper = e_util_batch_new (csv_import_map_job_cb, gci);
 
-	while ((contact = getNextCSVEntry (gci, gci->file))) {
-		gchar *uid = NULL;
+	while (!eof && !g_cancellable_is_cancelled (gci->cancellable)) {
+		GSList *contacts = NULL;
 
-		e_book_client_add_contact_sync (
-			gci->book_client, contact, E_BOOK_OPERATION_FLAG_NONE, &uid, NULL, NULL);
-		if (uid != NULL) {
-			e_contact_set (contact, E_CONTACT_UID, uid);
-			g_free (uid);
+		batch.n_jobs = 0;
+
+		while (batch.n_jobs < CSV_IMPORT_BATCH_SIZE) {
+			GString *line;
+
+			line = csv_read_line (gci->file);
+			if (!line || !line->len) {
+				if (line)
+					g_string_free (line, TRUE);
+				eof = TRUE;
+				break;
+			}
+
+			batch.jobs[batch.n_jobs].line = line;
+			batch.jobs[batch.n_jobs].contact = NULL;
+			batch.n_jobs++;
 		}
-		gci->contacts = g_slist_prepend (gci->contacts, contact);
-	}
-	if (contact == NULL) {
-		gci->state = 1;
-	}
-	if (gci->state == 1) {
-		csv_import_done (gci);
-		return FALSE;
-	}
-	else {
-		e_import_status (
-			gci->import, gci->target, _("Importing…"),
-			ftell (gci->file) * 100 / gci->size);
-		return TRUE;
+
+		for (ii = 0; ii < batch.n_jobs; ii++)
+			e_util_batch_push (batch.mapper, &batch.jobs[ii]);
+
+		e_util_batch_wait (batch.mapper);
+
+		for (ii = batch.n_jobs; ii > 0; ii--) {
+			CSVImportJob *job = &batch.jobs[ii - 1];
+
+			if (job->contact)
+				contacts = g_slist_prepend (contacts, job->contact);
+
+			g_string_free (job->line, TRUE);
+		}
+
+		gci->count += batch.n_jobs;
+
+		if (!g_cancellable_is_cancelled (gci->cancellable))
+			evolution_contact_importer_add_contacts_sync (
+				gci->book_client, contacts, NULL,
+				gci->cancellable, NULL);
+
+		g_slist_free_full (contacts, g_object_unref);
+
+		if (gci->size > 0)
+			evolution_contact_importer_worker_set_percent (
+				&gci->worker,
+				(gint) (ftell (gci->file) * 100 / gci->size));
 	}
+
+	e_util_batch_free (batch.mapper);
+}
+
+static void
+csv_import_thread_done (gpointer user_data)
+{
+	csv_import_done (user_data);
 }
 
 static void
@@ -913,13 +995,11 @@ csv_supported (EImport *ei,
 static void
 csv_import_done (CSVImporter *gci)
 {
-	if (gci->idle_id)
-		g_source_remove (gci->idle_id);
+	evolution_contact_importer_worker_finish (&gci->worker);
 
 	fclose (gci->file);
-	g_object_unref (gci->book_client);
-	g_slist_foreach (gci->contacts, (GFunc) g_object_unref, NULL);
-	g_slist_free (gci->contacts);
+	g_clear_object (&gci->book_client);
+	g_clear_object (&gci->cancellable);
 
 	if (gci->fields_map)
 		g_hash_table_destroy (gci->fields_map);
@@ -940,13 +1020,18 @@ book_client_connect_cb (GObject *source_object,
 
 	client = e_book_client_connect_finish (result, NULL);
 
-	if (client == NULL) {
+	if (client == NULL || g_cancellable_is_cancelled (gci->cancellable)) {
+		g_clear_object (&client);
 		csv_import_done (gci);
 		return;
 	}
 
 	gci->book_client = E_BOOK_CLIENT (client);
-	gci->idle_id = g_idle_add (csv_import_contacts, gci);
+
+	if (!evolution_contact_importer_worker_start (
+		&gci->worker, gci->import, gci->target, "csv-import",
+		csv_import_thread, csv_import_thread_done, gci, NULL))
+		csv_import_done (gci);
 }
 
 static void
@@ -989,6 +1074,7 @@ csv_import (EImport *ei,
 	gci->file = file;
 	gci->fields_map = NULL;
 	gci->count = 0;
+	gci->cancellable = g_cancellable_new ();
 	fseek (file, 0, SEEK_END);
 	gci->size = ftell (file);
 	fseek (file, 0, SEEK_SET);
@@ -1037,7 +1123,7 @@ csv_cancel (EImport *ei,
 	CSVImporter *gci = g_datalist_get_data (&target->data, "csv-data");
 
 	if (gci)
-		gci->state = 1;
+		g_cancellable_cancel (gci->cancellable);
 }
 
 static GtkWidget *
@@ -49,19 +49,19 @@ typedef struct {
 	EImport *import;
 	EImportTarget *target;
 
-	guint idle_id;
+	EvolutionContactImporterWorker worker;
 
+	/* gchar *dn ~> EContact *, with just what a list needs to
+	 * reference the contact, see ldif_index_contact() */
 	GHashTable *dn_contact_hash;
 
-	gint state;		/* 0 - initial scan, 1 - list cards, 2 - cancelled/complete */
 	FILE *file;
 	gulong size;
 
 	EBookClient *book_client;
+	GCancellable *cancellable;
 
-	GSList *contacts;
 	GSList *list_contacts;
-	GSList *list_iterator;
 } LDIFImporter;
 
 static void ldif_import_done (LDIFImporter *gci);
@@ -218,7 +218,7 @@ populate_contact_address (EContactAddress *address,
 }
 
 static gboolean
-parseLine (GHashTable *dn_contact_hash,
+parseLine (gchar **out_dn,
            EContact *contact,
            EContactAddress *work_address,
            EContactAddress *home_address,
@@ -313,11 +313,12 @@ parseLine (GHashTable *dn_contact_hash,
 
 		/* handle objectclass/dn/member out here */
 		if (!field_handled) {
-			if (!g_ascii_strcasecmp (ptr, "dn"))
-				g_hash_table_insert (
-					dn_contact_hash,
-					g_strdup (ldif_value->str), contact);
-			else if (!g_ascii_strcasecmp (ptr, "objectclass") &&
+			if (!g_ascii_strcasecmp (ptr, "dn")) {
+				if (out_dn) {
+					g_free (*out_dn);
+					*out_dn = g_strdup (ldif_value->str);
+				}
+			} else if (!g_ascii_strcasecmp (ptr, "objectclass") &&
 				!g_ascii_strcasecmp (ldif_value->str, "groupofnames")) {
 				e_contact_set (
 					contact, E_CONTACT_IS_LIST,
@@ -349,9 +350,10 @@ parseLine (GHashTable *dn_contact_hash,
 	return TRUE;
 }
 
+/* The entry's DN, if any, is returned in 'out_dn', to be freed. */
 static EContact *
-getNextLDIFEntry (GHashTable *dn_contact_hash,
-                  FILE *f)
+getNextLDIFEntry (FILE *f,
+                  gchar **out_dn)
 {
 	EContact *contact;
 	EContactAddress *work_address, *home_address;
@@ -381,8 +383,10 @@ getNextLDIFEntry (GHashTable *dn_contact_hash,
 
 	buf = str->str;
 	while (buf) {
-		if (!parseLine (dn_contact_hash, contact, work_address, home_address, &buf)) {
+		if (!parseLine (out_dn, contact, work_address, home_address, &buf)) {
 			/* parsing error */
+			if (out_dn)
+				g_clear_pointer (out_dn, g_free);
 			g_string_free (str, TRUE);
 			e_contact_address_free (work_address);
 			e_contact_address_free (home_address);
@@ -430,6 +434,11 @@ resolve_list_card (LDIFImporter *gci,
 		gchar *dn = l->data;
 		EContact *dn_contact = g_hash_table_lookup (gci->dn_contact_hash, dn);
 
+		/* The member was not in the file or failed to import */
+		if (!dn_contact)
+			g_warning ("%s: Contact list “%s” lost its member “%s”, which was not imported",
+				G_STRFUNC, e_contact_get_const (contact, E_CONTACT_FILE_AS), dn);
+
 		/* break list chains here, since we don't support them just yet */
 		if (dn_contact && !e_contact_get (dn_contact, E_CONTACT_IS_LIST)) {
 			EDestination *dest;
@@ -481,73 +490,149 @@ add_to_notes (EContact *contact,
 	g_free (new_text);
 }
 
-static gboolean
-ldif_import_contacts (gpointer d)
+/* Number of contacts added to the book at once. */
+#define LDIF_IMPORT_BATCH_SIZE 100
+
+/* Makes a copy of the parts of a just added contact which are needed
+ * to reference it from a contact list, for the DN index. */
+static EContact *
+ldif_index_contact (EContact *contact,
+                    const gchar *uid)
+{
+	EContact *indexed;
+	EContactName *name;
+	static const EContactField fields[] = {
+		E_CONTACT_FULL_NAME,
+		E_CONTACT_FILE_AS,
+		E_CONTACT_EMAIL_1
+	};
+	guint ii;
+
+	indexed = e_contact_new ();
+
+	e_contact_set (indexed, E_CONTACT_UID, uid);
+
+	for (ii = 0; ii < G_N_ELEMENTS (fields); ii++) {
+		const gchar *value = e_contact_get_const (contact, fields[ii]);
+
+		if (value && *value)
+			e_contact_set (indexed, fields[ii], value);
+	}
+
+	name = e_contact_get (contact, E_CONTACT_NAME);
+	if (name) {
+		e_contact_set (indexed, E_CONTACT_NAME, name);
+		e_contact_name_free (name);
+	}
+
+	if (e_contact_get (contact, E_CONTACT_WANTS_HTML))
+		e_contact_set (indexed, E_CONTACT_WANTS_HTML, GINT_TO_POINTER (TRUE));
+
+	return indexed;
+}
+
+/* Adds the batch of contacts to the book and indexes those with a DN,
+ * so contact lists can reference them. Both lists are freed. */
+static void
+ldif_import_add_batch (LDIFImporter *gci,
+                       GSList *contacts,
+                       GSList *dns)
 {
-	LDIFImporter *gci = d;
+	GSList *uids = NULL, *link, *dn_link, *uid_link;
+
+	contacts = g_slist_reverse (contacts);
+	dns = g_slist_reverse (dns);
+
+	if (contacts && !g_cancellable_is_cancelled (gci->cancellable))
+		evolution_contact_importer_add_contacts_sync (
+			gci->book_client, contacts, &uids,
+			gci->cancellable, NULL);
+
+	for (link = contacts, dn_link = dns, uid_link = uids;
+	     link && dn_link && uid_link;
+	     link = g_slist_next (link), dn_link = g_slist_next (dn_link), uid_link = g_slist_next (uid_link)) {
+		if (dn_link->data && uid_link->data) {
+			g_hash_table_insert (
+				gci->dn_contact_hash, dn_link->data,
+				ldif_index_contact (link->data, uid_link->data));
+			dn_link->data = NULL;
+		}
+	}
+
+	g_slist_free_full (uids, g_free);
+	g_slist_free_full (dns, g_free);
+	g_slist_free_full (contacts, g_object_unref);
+}
+
+/* Reads the file one entry at a time and adds the contacts in batches.
+ * Contact lists are kept till the end, when all the DNs they refer to
+ * are in the index. */
+static void
+ldif_import_thread (gpointer user_data)
+{
+	LDIFImporter *gci = user_data;
+	GSList *batch = NULL, *dns = NULL, *link;
+	guint batch_len = 0;
 	EContact *contact;
-	GSList *iter;
-	gint count = 0;
-
-	/* We process all normal cards immediately and keep the list
-	 * ones till the end */
-
-	if (gci->state == 0) {
-		while (count < 50 && (contact = getNextLDIFEntry (
-			gci->dn_contact_hash, gci->file))) {
-			if (e_contact_get (contact, E_CONTACT_IS_LIST)) {
-				gci->list_contacts = g_slist_prepend (
-					gci->list_contacts, contact);
-			} else {
-				gchar *uid = NULL;
-
-				add_to_notes (contact, E_CONTACT_OFFICE);
-				add_to_notes (contact, E_CONTACT_SPOUSE);
-				add_to_notes (contact, E_CONTACT_BLOG_URL);
-
-				e_book_client_add_contact_sync (
-					gci->book_client,
-					contact, E_BOOK_OPERATION_FLAG_NONE, &uid, NULL, NULL);
-				if (uid != NULL) {
-					e_contact_set (contact, E_CONTACT_UID, uid);
-					g_free (uid);
-				}
-				gci->contacts = g_slist_prepend (gci->contacts, contact);
-			}
-			count++;
+	gchar *dn = NULL;
+
+	while (!g_cancellable_is_cancelled (gci->cancellable) &&
+	       (contact = getNextLDIFEntry (gci->file, &dn)) != NULL) {
+		if (e_contact_get (contact, E_CONTACT_IS_LIST)) {
+			gci->list_contacts = g_slist_prepend (
+				gci->list_contacts, contact);
+			g_free (dn);
+		} else {
+			add_to_notes (contact, E_CONTACT_OFFICE);
+			add_to_notes (contact, E_CONTACT_SPOUSE);
+			add_to_notes (contact, E_CONTACT_BLOG_URL);
+
+			batch = g_slist_prepend (batch, contact);
+			dns = g_slist_prepend (dns, dn);
+			batch_len++;
 		}
-		if (contact == NULL) {
-			gci->state = 1;
-			gci->list_iterator = gci->list_contacts;
+
+		dn = NULL;
+
+		if (batch_len >= LDIF_IMPORT_BATCH_SIZE) {
+			ldif_import_add_batch (gci, batch, dns);
+			batch = NULL;
+			dns = NULL;
+			batch_len = 0;
+
+			if (gci->size > 0)
+				evolution_contact_importer_worker_set_percent (
+					&gci->worker,
+					(gint) (ftell (gci->file) * 100 / gci->size));
 		}
 	}
-	if (gci->state == 1) {
-		for (iter = gci->list_iterator; count < 50 && iter; iter = iter->next) {
-			gchar *uid = NULL;
-
-			contact = iter->data;
-			resolve_list_card (gci, contact);
-			e_book_client_add_contact_sync (
-				gci->book_client, contact, E_BOOK_OPERATION_FLAG_NONE, &uid, NULL, NULL);
-			if (uid != NULL) {
-				e_contact_set (contact, E_CONTACT_UID, uid);
-				g_free (uid);
-			}
-			count++;
+
+	ldif_import_add_batch (gci, batch, dns);
+	batch = NULL;
+	batch_len = 0;
+
+	gci->list_contacts = g_slist_reverse (gci->list_contacts);
+
+	for (link = gci->list_contacts; link && !g_cancellable_is_cancelled (gci->cancellable); link = g_slist_next (link)) {
+		contact = link->data;
+
+		resolve_list_card (gci, contact);
+
+		batch = g_slist_prepend (batch, g_object_ref (contact));
+		if (++batch_len >= LDIF_IMPORT_BATCH_SIZE || !link->next) {
+			ldif_import_add_batch (gci, batch, NULL);
+			batch = NULL;
+			batch_len = 0;
 		}
-		gci->list_iterator = iter;
-		if (iter == NULL)
-			gci->state = 2;
-	}
-	if (gci->state == 2) {
-		ldif_import_done (gci);
-		return FALSE;
-	} else {
-		e_import_status (
-			gci->import, gci->target, _("Importing…"),
-			ftell (gci->file) * 100 / gci->size);
-		return TRUE;
 	}
+
+	g_slist_free_full (batch, g_object_unref);
+}
+
+static void
+ldif_import_thread_done (gpointer user_data)
+{
+	ldif_import_done (user_data);
 }
 
 static void
@@ -657,15 +742,12 @@ ldif_supported (EImport *ei,
 static void
 ldif_import_done (LDIFImporter *gci)
 {
-	if (gci->idle_id)
-		g_source_remove (gci->idle_id);
+	evolution_contact_importer_worker_finish (&gci->worker);
 
 	fclose (gci->file);
-	g_object_unref (gci->book_client);
-	g_slist_foreach (gci->contacts, (GFunc) g_object_unref, NULL);
-	g_slist_foreach (gci->list_contacts, (GFunc) g_object_unref, NULL);
-	g_slist_free (gci->contacts);
-	g_slist_free (gci->list_contacts);
+	g_clear_object (&gci->book_client);
+	g_clear_object (&gci->cancellable);
+	g_slist_free_full (gci->list_contacts, g_object_unref);
 	g_hash_table_destroy (gci->dn_contact_hash);
 
 	e_import_complete (gci->import, gci->target, NULL);
@@ -684,13 +766,18 @@ book_client_connect_cb (GObject *source_object,
 
 	client = e_book_client_connect_finish (result, NULL);
 
-	if (client == NULL) {
+	if (client == NULL || g_cancellable_is_cancelled (gci->cancellable)) {
+		g_clear_object (&client);
 		ldif_import_done (gci);
 		return;
 	}
 
 	gci->book_client = E_BOOK_CLIENT (client);
-	gci->idle_id = g_idle_add (ldif_import_contacts, gci);
+
+	if (!evolution_contact_importer_worker_start (
+		&gci->worker, gci->import, gci->target, "ldif-import",
+		ldif_import_thread, ldif_import_thread_done, gci, NULL))
+		ldif_import_done (gci);
 }
 
 static void
@@ -732,7 +819,8 @@ ldif_import (EImport *ei,
 	gci->dn_contact_hash = g_hash_table_new_full (
 		g_str_hash, g_str_equal,
 		(GDestroyNotify) g_free,
-		(GDestroyNotify) NULL);
+		(GDestroyNotify) g_object_unref);
+	gci->cancellable = g_cancellable_new ();
 
 	source = g_datalist_get_data (&target->data, "ldif-source");
 
@@ -747,7 +835,7 @@ ldif_cancel (EImport *ei,
 	LDIFImporter *gci = g_datalist_get_data (&target->data, "ldif-data");
 
 	if (gci)
-		gci->state = 2;
+		g_cancellable_cancel (gci->cancellable);
 }
 
 static GtkWidget *
@@ -760,7 +848,6 @@ ldif_get_preview (EImport *ei,
 	EContact *contact;
 	EImportTargetURI *s = (EImportTargetURI *) target;
 	gchar *filename;
-	GHashTable *dn_contact_hash;
 	FILE *file;
 
 	filename = g_filename_from_uri (s->uri_src, NULL, NULL);
@@ -777,12 +864,7 @@ ldif_get_preview (EImport *ei,
 		return NULL;
 	}
 
-	dn_contact_hash = g_hash_table_new_full (
-		g_str_hash, g_str_equal,
-		(GDestroyNotify) g_free,
-		(GDestroyNotify) NULL);
-
-	while (contact = getNextLDIFEntry (dn_contact_hash, file), contact != NULL) {
+	while (contact = getNextLDIFEntry (file, NULL), contact != NULL) {
 		if (!e_contact_get (contact, E_CONTACT_IS_LIST)) {
 			add_to_notes (contact, E_CONTACT_OFFICE);
 			add_to_notes (contact, E_CONTACT_SPOUSE);
@@ -792,8 +874,6 @@ ldif_get_preview (EImport *ei,
 		contacts = g_slist_prepend (contacts, contact);
 	}
 
-	g_hash_table_destroy (dn_contact_hash);
-
 	contacts = g_slist_reverse (contacts);
 	preview = evolution_contact_importer_get_preview_widget (contacts);
 
@@ -49,36 +49,35 @@ enum _VCardEncoding {
 
 typedef enum _VCardEncoding VCardEncoding;
 
+/* Number of contacts sent to the address book in one call. */
+#define VCARD_IMPORT_BATCH_SIZE 100
+
 typedef struct {
 	EImport *import;
 	EImportTarget *target;
 
-	guint idle_id;
-
-	gint state;		/* 0 - importing, 1 - cancelled/complete */
-	gint total;
-	gint count;
+	EvolutionContactImporterWorker worker;
 
 	ESource *primary;
 
-	GSList *contactlist;
-	GSList *iterator;
 	EBookClient *book_client;
+	GCancellable *cancellable;
+	GError *error;
 
 	/* when opening book */
-	gchar *contents;
+	gchar *filename;
 	VCardEncoding encoding;
 } VCardImporter;
 
 static void vcard_import_done (VCardImporter *gci);
 
+/* Fixes up attributes of an imported contact. This does not touch
+ * the address book, thus is called from the import thread. */
 static void
-vcard_import_contact (VCardImporter *gci,
-                      EContact *contact)
+vcard_import_fixup_contact (EContact *contact)
 {
 	EContactPhoto *photo;
 	GList *attrs, *attr;
-	gchar *uid = NULL;
 
 	/* Apple's addressbook.app exports PHOTO's without a TYPE
 	 * param, so let's figure out the format here if there's a
@@ -211,43 +210,180 @@ vcard_import_contact (VCardImporter *gci,
 								"OTHER");
 		}
 	}
+}
+
+static void
+vcard_import_flush_batch (VCardImporter *gci,
+                          GSList **pbatch)
+{
+	GSList *batch;
+
+	batch = g_slist_reverse (*pbatch);
+	*pbatch = NULL;
+
+	evolution_contact_importer_add_contacts_sync (
+		gci->book_client, batch, NULL, gci->cancellable, NULL);
+
+	g_slist_free_full (batch, g_object_unref);
+}
+
+static void
+vcard_import_add_card (VCardImporter *gci,
+                       GString *card,
+                       GSList **pbatch,
+                       guint *pbatch_len)
+{
+	EContact *contact;
+
+	contact = e_contact_new_from_vcard (card->str);
+	g_string_truncate (card, 0);
+
+	if (!contact)
+		return;
 
-	/* FIXME Error checking */
-	e_book_client_add_contact_sync (
-		gci->book_client, contact, E_BOOK_OPERATION_FLAG_NONE, &uid, NULL, NULL);
-	if (uid != NULL) {
-		e_contact_set (contact, E_CONTACT_UID, uid);
-		g_free (uid);
+	vcard_import_fixup_contact (contact);
+
+	*pbatch = g_slist_prepend (*pbatch, contact);
+	(*pbatch_len)++;
+
+	if (*pbatch_len >= VCARD_IMPORT_BATCH_SIZE) {
+		vcard_import_flush_batch (gci, pbatch);
+		*pbatch_len = 0;
 	}
 }
 
-static gboolean
-vcard_import_contacts (gpointer data)
+/* Opens the file as a stream of UTF-8 text. */
+static GInputStream *
+vcard_import_open_stream (VCardImporter *gci,
+                          GSeekable **out_seekable,
+                          goffset *out_size)
 {
-	VCardImporter *gci = data;
-	gint count = 0;
-	GSList *iterator = gci->iterator;
-
-	if (gci->state == 0) {
-		while (count < 50 && iterator) {
-			vcard_import_contact (gci, iterator->data);
-			count++;
-			iterator = iterator->next;
-		}
-		gci->count += count;
-		gci->iterator = iterator;
-		if (iterator == NULL)
-			gci->state = 1;
+	GFile *file;
+	GFileInputStream *file_stream;
+	GFileInfo *info;
+	GInputStream *stream;
+	GCharsetConverter *converter = NULL;
+	const gchar *charset = NULL;
+	const gchar *locale_charset = NULL;
+
+	file = g_file_new_for_path (gci->filename);
+	file_stream = g_file_read (file, gci->cancellable, &gci->error);
+	g_object_unref (file);
+
+	if (!file_stream)
+		return NULL;
+
+	info = g_file_input_stream_query_info (
+		file_stream, G_FILE_ATTRIBUTE_STANDARD_SIZE,
+		gci->cancellable, NULL);
+	*out_size = info ? g_file_info_get_size (info) : 0;
+	g_clear_object (&info);
+
+	*out_seekable = G_SEEKABLE (file_stream);
+	stream = G_INPUT_STREAM (file_stream);
+
+	if (gci->encoding == VCARD_ENCODING_UTF16)
+		charset = "UTF-16";
+	else if (gci->encoding == VCARD_ENCODING_LOCALE &&
+		 !g_get_charset (&locale_charset))
+		charset = locale_charset;
+
+	if (charset)
+		converter = g_charset_converter_new ("UTF-8", charset, NULL);
+
+	if (converter) {
+		GInputStream *converted;
+
+		converted = g_converter_input_stream_new (
+			stream, G_CONVERTER (converter));
+		g_object_unref (converter);
+		g_object_unref (stream);
+
+		stream = converted;
 	}
-	if (gci->state == 1) {
-		vcard_import_done (gci);
-		return FALSE;
-	} else {
-		e_import_status (
-			gci->import, gci->target, _("Importing…"),
-			gci->count * 100 / gci->total);
-		return TRUE;
+
+	return stream;
+}
+
+/* Reads the file one vCard at a time, so only the current batch of
+ * contacts is held in memory, regardless of the file size. */
+static void
+vcard_import_thread (gpointer user_data)
+{
+	VCardImporter *gci = user_data;
+	GInputStream *stream;
+	GDataInputStream *data_stream;
+	GSeekable *seekable = NULL;
+	GString *card;
+	GSList *batch = NULL;
+	guint batch_len = 0;
+	goffset size = 0;
+	gboolean in_card = FALSE, after_end = FALSE;
+	gchar *line;
+
+	stream = vcard_import_open_stream (gci, &seekable, &size);
+	if (!stream)
+		return;
+
+	data_stream = g_data_input_stream_new (stream);
+	g_data_input_stream_set_newline_type (
+		data_stream, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+
+	card = g_string_sized_new (1024);
+
+	/* The outer END:VCARD is the one followed by the next BEGIN:VCARD
+	 * or by the end of the file, like in eab_contact_list_from_string(),
+	 * thus an ended card is added only when the next line is seen. */
+	while ((line = g_data_input_stream_read_line (
+		data_stream, NULL, gci->cancellable, NULL)) != NULL) {
+		gboolean is_begin;
+
+		is_begin = g_ascii_strncasecmp (line, "BEGIN:VCARD", 11) == 0;
+
+		if (after_end && is_begin) {
+			vcard_import_add_card (gci, card, &batch, &batch_len);
+			in_card = FALSE;
+			after_end = FALSE;
+
+			if (size > 0)
+				evolution_contact_importer_worker_set_percent (
+					&gci->worker,
+					(gint) (g_seekable_tell (seekable) * 100 / size));
+		} else if (after_end && line[strspn (line, "\t ")]) {
+			/* A nested vCard ended, this one goes on. */
+			after_end = FALSE;
+		}
+
+		if (!in_card && is_begin)
+			in_card = TRUE;
+
+		if (in_card) {
+			g_string_append (card, line);
+			g_string_append_c (card, '\n');
+
+			if (g_ascii_strncasecmp (line, "END:VCARD", 9) == 0)
+				after_end = TRUE;
+		}
+
+		g_free (line);
 	}
+
+	if (after_end && !g_cancellable_is_cancelled (gci->cancellable))
+		vcard_import_add_card (gci, card, &batch, &batch_len);
+
+	if (!g_cancellable_is_cancelled (gci->cancellable))
+		vcard_import_flush_batch (gci, &batch);
+
+	g_slist_free_full (batch, g_object_unref);
+	g_string_free (card, TRUE);
+	g_object_unref (data_stream);
+	g_object_unref (stream);
+}
+
+static void
+vcard_import_thread_done (gpointer user_data)
+{
+	vcard_import_done (user_data);
 }
 
 #define BOM (gunichar2)0xFEFF
@@ -454,14 +590,14 @@ vcard_supported (EImport *ei,
 static void
 vcard_import_done (VCardImporter *gci)
 {
-	if (gci->idle_id)
-		g_source_remove (gci->idle_id);
+	evolution_contact_importer_worker_finish (&gci->worker);
 
-	g_free (gci->contents);
-	g_object_unref (gci->book_client);
-	g_slist_free_full (gci->contactlist, (GDestroyNotify) g_object_unref);
+	g_free (gci->filename);
+	g_clear_object (&gci->book_client);
+	g_clear_object (&gci->cancellable);
 
-	e_import_complete (gci->import, gci->target, NULL);
+	e_import_complete (gci->import, gci->target, gci->error);
+	g_clear_error (&gci->error);
 	g_object_unref (gci->import);
 	g_free (gci);
 }
@@ -476,37 +612,17 @@ book_client_connect_cb (GObject *source_object,
 
 	client = e_book_client_connect_finish (result, NULL);
 
-	if (client == NULL) {
+	if (client == NULL || g_cancellable_is_cancelled (gci->cancellable)) {
+		g_clear_object (&client);
 		vcard_import_done (gci);
 		return;
 	}
 
 	gci->book_client = E_BOOK_CLIENT (client);
 
-	if (gci->encoding == VCARD_ENCODING_UTF16) {
-		gchar *tmp;
-
-		gunichar2 *contents_utf16 = (gunichar2 *) gci->contents;
-		tmp = utf16_to_utf8 (contents_utf16);
-		g_free (gci->contents);
-		gci->contents = tmp;
-
-	} else if (gci->encoding == VCARD_ENCODING_LOCALE) {
-		gchar *tmp;
-		tmp = g_locale_to_utf8 (gci->contents, -1, NULL, NULL, NULL);
-		g_free (gci->contents);
-		gci->contents = tmp;
-	}
-
-	gci->contactlist = eab_contact_list_from_string (gci->contents);
-	g_free (gci->contents);
-	gci->contents = NULL;
-	gci->iterator = gci->contactlist;
-	gci->total = g_slist_length (gci->contactlist);
-
-	if (gci->iterator)
-		gci->idle_id = g_idle_add (vcard_import_contacts, gci);
-	else
+	if (!evolution_contact_importer_worker_start (
+		&gci->worker, gci->import, gci->target, "vcard-import",
+		vcard_import_thread, vcard_import_thread_done, gci, &gci->error))
 		vcard_import_done (gci);
 }
 
@@ -519,7 +635,6 @@ vcard_import (EImport *ei,
 	ESource *source;
 	EImportTargetURI *s = (EImportTargetURI *) target;
 	gchar *filename;
-	gchar *contents;
 	VCardEncoding encoding;
 	GError *error = NULL;
 
@@ -540,21 +655,13 @@ vcard_import (EImport *ei,
 		return;
 	}
 
-	if (!g_file_get_contents (filename, &contents, NULL, &error)) {
-		g_free (filename);
-		e_import_complete (ei, target, error);
-		g_clear_error (&error);
-
-		return;
-	}
-
-	g_free (filename);
 	gci = g_malloc0 (sizeof (*gci));
 	g_datalist_set_data (&target->data, "vcard-data", gci);
 	gci->import = g_object_ref (ei);
 	gci->target = target;
 	gci->encoding = encoding;
-	gci->contents = contents;
+	gci->filename = filename;
+	gci->cancellable = g_cancellable_new ();
 
 	source = g_datalist_get_data (&target->data, "vcard-source");
 
@@ -569,7 +676,7 @@ vcard_cancel (EImport *ei,
 	VCardImporter *gci = g_datalist_get_data (&target->data, "vcard-data");
 
 	if (gci)
-		gci->state = 1;
+		g_cancellable_cancel (gci->cancellable);
 }
 
 static GtkWidget *
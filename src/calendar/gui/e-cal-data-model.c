@@ -18,6 +18,8 @@
 
 #include "evolution-config.h"
 
+#include <string.h>
+
 #include <glib.h>
 #include <glib/gi18n-lib.h>
 
@@ -32,12 +34,14 @@ struct _ECalDataModelPrivate {
 	ECalDataModelSubmitThreadJobFunc submit_thread_job_func;
 	GWeakRef *submit_thread_job_responder;
 	GThreadPool *thread_pool;
+	GThreadPool *expand_pool; /* helps to expand recurrences */
 
 	GRecMutex props_lock;	/* to guard all the below members */
 
 	gboolean disposing;
 	gboolean expand_recurrences;
 	gboolean skip_cancelled;
+	guint max_instances_per_component;
 	gchar *filter;
 	gchar *full_filter;	/* to be used with views */
 	ICalTimezone *zone;
@@ -68,13 +72,48 @@ static guint signals[LAST_SIGNAL];
 
 G_DEFINE_TYPE (ECalDataModel, e_cal_data_model, G_TYPE_OBJECT)
 
+/* Components of a view are indexed by the day of their start; those
+   spanning a week or more are kept aside, thus a range query looks only
+   into the days covered by the range (plus a week before it) and into
+   the long components. */
+#define INDEX_BUCKET_SECONDS (24 * 60 * 60)
+#define INDEX_LONG_SPAN (7 * INDEX_BUCKET_SECONDS)
+
+/* Recurring components expanded by one thread, at least */
+#define EXPAND_MIN_COMPONENTS_PER_THREAD 8
+
+/* Stops endless recurrences from flooding the model */
+#define DEFAULT_MAX_INSTANCES_PER_COMPONENT 5000
+
+typedef struct _ComponentsIndex {
+	GHashTable *buckets; /* gint bucket ~> GHashTable { ComponentData * } */
+	GHashTable *long_components; /* ComponentData * */
+} ComponentsIndex;
+
 typedef struct _ComponentData {
 	ECalComponent *component;
 	time_t instance_start;
 	time_t instance_end;
 	gboolean is_detached;
+
+	/* Set while stored in ViewData::components or ::lost_components */
+	ComponentsIndex *index;
+	const ECalComponentId *id; /* the key in the components table */
+	gboolean is_lost;
 } ComponentData;
 
+/* Instances of a recurring component expanded for a time range; reused
+   for the part of a new time range it covers, while the component itself
+   (its digest), the time zone and the skip-cancelled option are kept. */
+typedef struct _ExpandedRecurrence {
+	gchar *digest;
+	ICalTimezone *zone;
+	gboolean skip_cancelled;
+	time_t range_start;
+	time_t range_end;
+	GSList *instances; /* ComponentData */
+} ExpandedRecurrence;
+
 typedef struct _ViewData {
 	gint ref_count;
 	GRecMutex lock;
@@ -90,10 +129,12 @@ typedef struct _ViewData {
 
 	GHashTable *components; /* ECalComponentId ~> ComponentData */
 	GHashTable *lost_components; /* ECalComponentId ~> ComponentData; when re-running view, valid till 'complete' is received */
+	ComponentsIndex *components_index; /* of both 'components' and 'lost_components' */
 	gboolean received_complete;
 	GSList *to_expand_recurrences; /* ICalComponent */
 	GSList *expanded_recurrences; /* ComponentData */
 	gint pending_expand_recurrences; /* how many is waiting to be processed */
+	GHashTable *expansion_cache; /* gchar *uid ~> ExpandedRecurrence */
 
 	GCancellable *cancellable;
 } ViewData;
@@ -104,6 +145,108 @@ typedef struct _SubscriberData {
 	time_t range_end;
 } SubscriberData;
 
+static gint
+components_index_get_bucket (gint64 tt)
+{
+	gint64 bucket;
+
+	if (tt >= 0)
+		bucket = tt / INDEX_BUCKET_SECONDS;
+	else
+		bucket = (tt - INDEX_BUCKET_SECONDS + 1) / INDEX_BUCKET_SECONDS;
+
+	return (gint) CLAMP (bucket, G_MININT, G_MAXINT);
+}
+
+static ComponentsIndex *
+components_index_new (void)
+{
+	ComponentsIndex *index;
+
+	index = g_new0 (ComponentsIndex, 1);
+	index->buckets = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+		NULL, (GDestroyNotify) g_hash_table_destroy);
+	index->long_components = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	return index;
+}
+
+static void
+components_index_free (ComponentsIndex *index)
+{
+	if (index) {
+		g_hash_table_destroy (index->buckets);
+		g_hash_table_destroy (index->long_components);
+		g_free (index);
+	}
+}
+
+static gboolean
+components_index_is_long (ComponentData *comp_data)
+{
+	return ((gint64) comp_data->instance_end) - ((gint64) comp_data->instance_start) >= INDEX_LONG_SPAN;
+}
+
+static void
+components_index_add (ComponentsIndex *index,
+		      const ECalComponentId *id,
+		      ComponentData *comp_data)
+{
+	g_return_if_fail (index != NULL);
+	g_return_if_fail (comp_data != NULL);
+	g_return_if_fail (comp_data->index == NULL);
+
+	comp_data->index = index;
+	comp_data->id = id;
+	comp_data->is_lost = FALSE;
+
+	if (components_index_is_long (comp_data)) {
+		g_hash_table_add (index->long_components, comp_data);
+	} else {
+		GHashTable *bucket;
+		gpointer key;
+
+		key = GINT_TO_POINTER (components_index_get_bucket (comp_data->instance_start));
+		bucket = g_hash_table_lookup (index->buckets, key);
+
+		if (!bucket) {
+			bucket = g_hash_table_new (g_direct_hash, g_direct_equal);
+			g_hash_table_insert (index->buckets, key, bucket);
+		}
+
+		g_hash_table_add (bucket, comp_data);
+	}
+}
+
+static void
+components_index_remove (ComponentData *comp_data)
+{
+	ComponentsIndex *index = comp_data->index;
+
+	if (!index)
+		return;
+
+	if (components_index_is_long (comp_data)) {
+		g_hash_table_remove (index->long_components, comp_data);
+	} else {
+		GHashTable *bucket;
+		gpointer key;
+
+		key = GINT_TO_POINTER (components_index_get_bucket (comp_data->instance_start));
+		bucket = g_hash_table_lookup (index->buckets, key);
+
+		if (bucket) {
+			g_hash_table_remove (bucket, comp_data);
+
+			if (!g_hash_table_size (bucket))
+				g_hash_table_remove (index->buckets, key);
+		}
+	}
+
+	comp_data->index = NULL;
+	comp_data->id = NULL;
+}
+
 static ComponentData *
 component_data_new (ECalComponent *comp,
 		    time_t instance_start,
@@ -129,6 +272,7 @@ component_data_free (gpointer ptr)
 	ComponentData *comp_data = ptr;
 
 	if (comp_data) {
+		components_index_remove (comp_data);
 		g_object_unref (comp_data->component);
 		g_free (comp_data);
 	}
@@ -200,6 +344,19 @@ component_data_equal (ComponentData *comp_data1,
 	return equal;
 }
 
+static void
+expanded_recurrence_free (gpointer ptr)
+{
+	ExpandedRecurrence *expanded = ptr;
+
+	if (expanded) {
+		g_free (expanded->digest);
+		g_clear_object (&expanded->zone);
+		g_slist_free_full (expanded->instances, component_data_free);
+		g_free (expanded);
+	}
+}
+
 static ViewData *
 view_data_new (ECalClient *client)
 {
@@ -215,6 +372,9 @@ view_data_new (ECalClient *client)
 	view_data->components = g_hash_table_new_full (
 		e_cal_component_id_hash, e_cal_component_id_equal,
 		e_cal_component_id_free, component_data_free);
+	view_data->components_index = components_index_new ();
+	view_data->expansion_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+		g_free, expanded_recurrence_free);
 
 	return view_data;
 }
@@ -266,8 +426,10 @@ view_data_unref (gpointer ptr)
 			g_hash_table_destroy (view_data->components);
 			if (view_data->lost_components)
 				g_hash_table_destroy (view_data->lost_components);
+			components_index_free (view_data->components_index);
 			g_slist_free_full (view_data->to_expand_recurrences, g_object_unref);
 			g_slist_free_full (view_data->expanded_recurrences, component_data_free);
+			g_hash_table_destroy (view_data->expansion_cache);
 			g_rec_mutex_clear (&view_data->lock);
 			g_free (view_data);
 		}
@@ -826,6 +988,8 @@ cal_data_model_process_added_component (ECalDataModel *data_model,
 {
 	ECalComponentId *id, *old_id = NULL;
 	ComponentData *old_comp_data = NULL;
+	gpointer stored_id = NULL;
+	const ECalComponentId *index_id;
 	time_t old_instance_start = (time_t) 0, old_instance_end = (time_t) 0;
 	gboolean comp_data_equal;
 
@@ -870,9 +1034,17 @@ cal_data_model_process_added_component (ECalDataModel *data_model,
 
 	/* Note: old_comp_data is freed or NULL now */
 
+	/* The table keeps its key when replacing a value, freeing the new one */
+	if (g_hash_table_lookup_extended (view_data->components, id, &stored_id, NULL))
+		index_id = stored_id;
+	else
+		index_id = id;
+
 	/* 'id' is stolen by view_data->components */
 	g_hash_table_insert (view_data->components, id, comp_data);
 
+	components_index_add (view_data->components_index, index_id, comp_data);
+
 	if (!comp_data_equal) {
 		if (!old_comp_data) {
 			cal_data_model_foreach_subscriber_in_range (data_model, view_data->client,
@@ -1091,6 +1263,17 @@ typedef struct
 	ICalTimezone *zone;
 	GSList **pexpanded_recurrences;
 	gboolean skip_cancelled;
+
+	GSList **pcache_instances; /* ComponentData to remember */
+
+	/* Instances inside this range are already known */
+	gboolean has_known_range;
+	time_t known_start;
+	time_t known_end;
+
+	guint max_instances; /* 0 means unlimited */
+	guint n_instances;
+	gboolean truncated;
 } GenerateInstancesData;
 
 static gboolean
@@ -1109,6 +1292,11 @@ cal_data_model_instance_generated (ICalComponent *icomp,
 
 	g_return_val_if_fail (gid != NULL, FALSE);
 
+	if (gid->max_instances > 0 && gid->n_instances >= gid->max_instances) {
+		gid->truncated = TRUE;
+		return FALSE;
+	}
+
 	if (gid->skip_cancelled) {
 		ICalProperty *prop;
 
@@ -1156,14 +1344,186 @@ cal_data_model_instance_generated (ICalComponent *icomp,
 	if (end_tt > start_tt)
 		end_tt--;
 
+	if (gid->has_known_range && start_tt <= gid->known_end && end_tt >= gid->known_start) {
+		GSList *link;
+
+		/* Those strictly inside were expanded before, those on
+		   the edges only when the generator included them too */
+		if (start_tt < gid->known_end && end_tt > gid->known_start) {
+			g_object_unref (comp_copy);
+			return TRUE;
+		}
+
+		for (link = *gid->pcache_instances; link; link = g_slist_next (link)) {
+			comp_data = link->data;
+
+			if (comp_data->instance_start == start_tt && comp_data->instance_end == end_tt) {
+				g_object_unref (comp_copy);
+				return TRUE;
+			}
+		}
+	}
+
 	comp_data = component_data_new (comp_copy, start_tt, end_tt, FALSE);
 	*gid->pexpanded_recurrences = g_slist_prepend (*gid->pexpanded_recurrences, comp_data);
+	gid->n_instances++;
+
+	*gid->pcache_instances = g_slist_prepend (*gid->pcache_instances,
+		component_data_new (comp_copy, start_tt, end_tt, FALSE));
 
 	g_object_unref (comp_copy);
 
 	return TRUE;
 }
 
+typedef struct _ExpandRecurrenceJob {
+	ICalComponent *icomp;
+	gchar *digest; /* of the 'icomp' content */
+	ExpandedRecurrence *cached; /* taken from the cache, or NULL */
+	ExpandedRecurrence *expanded; /* to be put into the cache, or NULL */
+	GSList *instances; /* ComponentData for the view */
+} ExpandRecurrenceJob;
+
+typedef struct _ExpandRecurrencesData {
+	ECalClient *client;
+	ViewData *view_data;
+	ICalTimezone *zone;
+	gboolean skip_cancelled;
+	guint max_instances;
+	time_t range_start;
+	time_t range_end;
+
+	ExpandRecurrenceJob *jobs;
+	guint n_jobs;
+	volatile gint next_job;
+
+	/* Workers running in the expand pool */
+	GMutex lock;
+	GCond cond;
+	guint n_workers;
+} ExpandRecurrencesData;
+
+static void
+cal_data_model_expand_recurrence (ExpandRecurrencesData *erd,
+				  ExpandRecurrenceJob *job)
+{
+	ExpandedRecurrence *cached = job->cached;
+	GenerateInstancesData gid;
+	GSList *cache_instances = NULL;
+	gchar *str;
+
+	gid.client = erd->client;
+	gid.zone = erd->zone;
+	gid.pexpanded_recurrences = &job->instances;
+	gid.skip_cancelled = erd->skip_cancelled;
+	gid.pcache_instances = &cache_instances;
+	gid.has_known_range = FALSE;
+	gid.known_start = (time_t) 0;
+	gid.known_end = (time_t) 0;
+	gid.max_instances = erd->max_instances;
+	gid.n_instances = 0;
+	gid.truncated = FALSE;
+
+	/* Any change of the component changes its digest, which
+	   invalidates previously expanded instances */
+	str = i_cal_component_as_ical_string (job->icomp);
+	job->digest = g_compute_checksum_for_string (G_CHECKSUM_SHA1, str ? str : "", -1);
+	g_free (str);
+
+	if (cached && g_strcmp0 (cached->digest, job->digest) == 0 &&
+	    cached->zone == erd->zone &&
+	    (cached->skip_cancelled ? 1 : 0) == (erd->skip_cancelled ? 1 : 0) &&
+	    cached->range_start <= erd->range_end &&
+	    cached->range_end >= erd->range_start) {
+		GSList *link;
+
+		/* Reuse the instances still in the range and expand only
+		   the newly exposed parts of it */
+		for (link = cached->instances; link; link = g_slist_next (link)) {
+			ComponentData *comp_data = link->data;
+
+			if (comp_data && comp_data->instance_start <= erd->range_end &&
+			    comp_data->instance_end >= erd->range_start) {
+				job->instances = g_slist_prepend (job->instances,
+					component_data_new (comp_data->component,
+						comp_data->instance_start, comp_data->instance_end, FALSE));
+				cache_instances = g_slist_prepend (cache_instances, comp_data);
+				link->data = NULL;
+				gid.n_instances++;
+			}
+		}
+
+		gid.has_known_range = TRUE;
+		gid.known_start = cached->range_start;
+		gid.known_end = cached->range_end;
+
+		if (erd->range_start < cached->range_start)
+			e_cal_client_generate_instances_for_object_sync (erd->client, job->icomp,
+				erd->range_start, cached->range_start, NULL,
+				cal_data_model_instance_generated, &gid);
+
+		if (erd->range_end > cached->range_end)
+			e_cal_client_generate_instances_for_object_sync (erd->client, job->icomp,
+				cached->range_end, erd->range_end, NULL,
+				cal_data_model_instance_generated, &gid);
+	} else {
+		e_cal_client_generate_instances_for_object_sync (erd->client, job->icomp,
+			erd->range_start, erd->range_end, NULL,
+			cal_data_model_instance_generated, &gid);
+	}
+
+	g_clear_pointer (&job->cached, expanded_recurrence_free);
+
+	/* A truncated expansion is incomplete, thus it cannot serve
+	   as a base for later range changes */
+	if (gid.truncated) {
+		g_message ("%s: Stopped expanding component '%s' after %u instances",
+			G_STRFUNC, i_cal_component_get_uid (job->icomp), gid.max_instances);
+
+		g_slist_free_full (cache_instances, component_data_free);
+		return;
+	}
+
+	job->expanded = g_new0 (ExpandedRecurrence, 1);
+	job->expanded->digest = g_strdup (job->digest);
+	job->expanded->zone = g_object_ref (erd->zone);
+	job->expanded->skip_cancelled = erd->skip_cancelled;
+	job->expanded->range_start = erd->range_start;
+	job->expanded->range_end = erd->range_end;
+	job->expanded->instances = cache_instances;
+}
+
+static gpointer
+cal_data_model_expand_recurrences_worker (gpointer user_data)
+{
+	ExpandRecurrencesData *erd = user_data;
+	gint ii;
+
+	while (erd->view_data->is_used) {
+		ii = g_atomic_int_add (&erd->next_job, 1);
+		if (ii >= (gint) erd->n_jobs)
+			break;
+
+		cal_data_model_expand_recurrence (erd, &erd->jobs[ii]);
+	}
+
+	return NULL;
+}
+
+static void
+cal_data_model_expand_recurrences_pool_func (gpointer data,
+					     gpointer user_data)
+{
+	ExpandRecurrencesData *erd = data;
+
+	cal_data_model_expand_recurrences_worker (erd);
+
+	g_mutex_lock (&erd->lock);
+	erd->n_workers--;
+	g_cond_broadcast (&erd->cond);
+	g_mutex_unlock (&erd->lock);
+}
+
 static void
 cal_data_model_expand_recurrences_thread (ECalDataModel *data_model,
 					  gpointer user_data)
@@ -1171,32 +1531,43 @@ cal_data_model_expand_recurrences_thread (ECalDataModel *data_model,
 	ECalClient *client = user_data;
 	GSList *to_expand_recurrences, *link;
 	GSList *expanded_recurrences = NULL;
-	time_t range_start, range_end;
+	ExpandRecurrencesData erd;
 	ViewData *view_data;
+	guint ii, n_workers;
 
 	g_return_if_fail (E_IS_CAL_DATA_MODEL (data_model));
 
+	memset (&erd, 0, sizeof (ExpandRecurrencesData));
+
 	LOCK_PROPS ();
 
 	view_data = g_hash_table_lookup (data_model->priv->views, client);
 	if (view_data)
 		view_data_ref (view_data);
 
-	range_start = data_model->priv->range_start;
-	range_end = data_model->priv->range_end;
+	erd.range_start = data_model->priv->range_start;
+	erd.range_end = data_model->priv->range_end;
+	erd.zone = g_object_ref (data_model->priv->zone);
+	erd.skip_cancelled = data_model->priv->skip_cancelled;
+	erd.max_instances = data_model->priv->max_instances_per_component;
 
 	UNLOCK_PROPS ();
 
 	if (!view_data) {
+		g_clear_object (&erd.zone);
 		g_object_unref (client);
 		return;
 	}
 
+	erd.client = client;
+	erd.view_data = view_data;
+
 	view_data_lock (view_data);
 
 	if (!view_data->is_used) {
 		view_data_unlock (view_data);
 		view_data_unref (view_data);
+		g_clear_object (&erd.zone);
 		g_object_unref (client);
 		return;
 	}
@@ -1204,29 +1575,78 @@ cal_data_model_expand_recurrences_thread (ECalDataModel *data_model,
 	to_expand_recurrences = view_data->to_expand_recurrences;
 	view_data->to_expand_recurrences = NULL;
 
-	view_data_unlock (view_data);
+	erd.jobs = g_new0 (ExpandRecurrenceJob, g_slist_length (to_expand_recurrences));
 
-	for (link = to_expand_recurrences; link && view_data->is_used; link = g_slist_next (link)) {
+	for (link = to_expand_recurrences; link; link = g_slist_next (link)) {
 		ICalComponent *icomp = link->data;
-		GenerateInstancesData gid;
+		ExpandRecurrenceJob *job;
+		gpointer orig_key = NULL, cached = NULL;
 
 		if (!icomp)
 			continue;
 
-		gid.client = client;
-		gid.pexpanded_recurrences = &expanded_recurrences;
-		gid.zone = g_object_ref (data_model->priv->zone);
-		gid.skip_cancelled = data_model->priv->skip_cancelled;
+		job = &erd.jobs[erd.n_jobs];
+		erd.n_jobs++;
 
-		e_cal_client_generate_instances_for_object_sync (client, icomp, range_start, range_end, NULL,
-			cal_data_model_instance_generated, &gid);
+		job->icomp = icomp;
 
-		g_clear_object (&gid.zone);
+		if (g_hash_table_lookup_extended (view_data->expansion_cache, i_cal_component_get_uid (icomp), &orig_key, &cached)) {
+			g_hash_table_steal (view_data->expansion_cache, orig_key);
+			g_free (orig_key);
+
+			job->cached = cached;
+		}
 	}
 
-	g_slist_free_full (to_expand_recurrences, g_object_unref);
+	view_data_unlock (view_data);
+
+	g_mutex_init (&erd.lock);
+	g_cond_init (&erd.cond);
+
+	/* The calling thread expands too */
+	n_workers = MIN (g_get_num_processors (), erd.n_jobs / EXPAND_MIN_COMPONENTS_PER_THREAD);
+	for (ii = 1; ii < n_workers; ii++) {
+		g_mutex_lock (&erd.lock);
+		erd.n_workers++;
+		g_mutex_unlock (&erd.lock);
+
+		if (!g_thread_pool_push (data_model->priv->expand_pool, &erd, NULL)) {
+			g_mutex_lock (&erd.lock);
+			erd.n_workers--;
+			g_mutex_unlock (&erd.lock);
+			break;
+		}
+	}
+
+	cal_data_model_expand_recurrences_worker (&erd);
+
+	g_mutex_lock (&erd.lock);
+	while (erd.n_workers > 0)
+		g_cond_wait (&erd.cond, &erd.lock);
+	g_mutex_unlock (&erd.lock);
+
+	g_mutex_clear (&erd.lock);
+	g_cond_clear (&erd.cond);
 
 	view_data_lock (view_data);
+
+	for (ii = 0; ii < erd.n_jobs; ii++) {
+		ExpandRecurrenceJob *job = &erd.jobs[ii];
+
+		if (job->expanded && view_data->is_used) {
+			g_hash_table_insert (view_data->expansion_cache,
+				g_strdup (i_cal_component_get_uid (job->icomp)), job->expanded);
+			job->expanded = NULL;
+		}
+
+		expanded_recurrences = g_slist_concat (job->instances, expanded_recurrences);
+		job->instances = NULL;
+
+		g_clear_pointer (&job->cached, expanded_recurrence_free);
+		g_clear_pointer (&job->expanded, expanded_recurrence_free);
+		g_free (job->digest);
+	}
+
 	if (expanded_recurrences)
 		view_data->expanded_recurrences = g_slist_concat (view_data->expanded_recurrences, expanded_recurrences);
 	if (view_data->is_used) {
@@ -1240,6 +1660,11 @@ cal_data_model_expand_recurrences_thread (ECalDataModel *data_model,
 	}
 
 	view_data_unlock (view_data);
+
+	g_slist_free_full (to_expand_recurrences, g_object_unref);
+	g_free (erd.jobs);
+	g_clear_object (&erd.zone);
+
 	view_data_unref (view_data);
 	g_object_unref (client);
 }
@@ -1315,6 +1740,10 @@ cal_data_model_process_modified_or_added_objects (ECalClientView *view,
 				ICalTime *start_tt = NULL, *end_tt = NULL;
 				time_t instance_start, instance_end;
 
+				/* The series changed, even when its master did not */
+				if (e_cal_util_component_is_instance (icomp))
+					g_hash_table_remove (view_data->expansion_cache, i_cal_component_get_uid (icomp));
+
 				if (data_model->priv->skip_cancelled &&
 				    i_cal_component_get_status (icomp) == I_CAL_STATUS_CANCELLED)
 					continue;
@@ -1423,6 +1852,8 @@ cal_data_model_view_objects_removed (ECalClientView *view,
 			const ECalComponentId *id = link->data;
 
 			if (id) {
+				g_hash_table_remove (view_data->expansion_cache, e_cal_component_id_get_uid (id));
+
 				if (!e_cal_component_id_get_rid (id)) {
 					if (!g_hash_table_contains (gathered_uids, e_cal_component_id_get_uid (id))) {
 						GatherComponentsData gather_data;
@@ -1665,6 +2096,17 @@ cal_data_model_notify_remove_components_cb (gpointer key,
 		cal_data_model_remove_one_view_component_cb, id);
 }
 
+static void
+cal_data_model_mark_lost_cb (gpointer key,
+			     gpointer value,
+			     gpointer user_data)
+{
+	ComponentData *comp_data = value;
+
+	if (comp_data)
+		comp_data->is_lost = TRUE;
+}
+
 static void
 cal_data_model_update_client_view (ECalDataModel *data_model,
 				   ECalClient *client)
@@ -1736,6 +2178,9 @@ cal_data_model_update_client_view (ECalDataModel *data_model,
 		view_data->components = g_hash_table_new_full (
 			(GHashFunc) e_cal_component_id_hash, (GEqualFunc) e_cal_component_id_equal,
 			(GDestroyNotify) e_cal_component_id_free, component_data_free);
+
+		/* The lost components stay in the index */
+		g_hash_table_foreach (view_data->lost_components, cal_data_model_mark_lost_cb, NULL);
 	}
 
 	view_data_unlock (view_data);
@@ -2048,6 +2493,7 @@ cal_data_model_finalize (GObject *object)
 	ECalDataModel *data_model = E_CAL_DATA_MODEL (object);
 
 	g_thread_pool_free (data_model->priv->thread_pool, TRUE, FALSE);
+	g_thread_pool_free (data_model->priv->expand_pool, TRUE, FALSE);
 	g_hash_table_destroy (data_model->priv->clients);
 	g_hash_table_destroy (data_model->priv->views);
 	g_slist_free_full (data_model->priv->subscribers, subscriber_data_free);
@@ -2124,6 +2570,9 @@ e_cal_data_model_init (ECalDataModel *data_model)
 	data_model->priv->main_thread = g_thread_self ();
 	data_model->priv->thread_pool = g_thread_pool_new (
 		cal_data_model_internal_thread_job_func, data_model, 5, FALSE, NULL);
+	data_model->priv->expand_pool = g_thread_pool_new (
+		cal_data_model_expand_recurrences_pool_func, NULL,
+		MAX (g_get_num_processors (), 1), FALSE, NULL);
 
 	data_model->priv->clients = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
 	data_model->priv->views = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, view_data_unref);
@@ -2132,6 +2581,7 @@ e_cal_data_model_init (ECalDataModel *data_model)
 	data_model->priv->disposing = FALSE;
 	data_model->priv->expand_recurrences = FALSE;
 	data_model->priv->skip_cancelled = FALSE;
+	data_model->priv->max_instances_per_component = DEFAULT_MAX_INSTANCES_PER_COMPONENT;
 	data_model->priv->zone = g_object_ref (i_cal_timezone_get_utc_timezone ());
 
 	data_model->priv->views_update_freeze = 0;
@@ -2198,6 +2648,7 @@ e_cal_data_model_new_clone (ECalDataModel *src_data_model)
 
 	e_cal_data_model_set_expand_recurrences (clone, e_cal_data_model_get_expand_recurrences (src_data_model));
 	e_cal_data_model_set_skip_cancelled (clone, e_cal_data_model_get_skip_cancelled (src_data_model));
+	e_cal_data_model_set_max_instances_per_component (clone, e_cal_data_model_get_max_instances_per_component (src_data_model));
 	e_cal_data_model_set_timezone (clone, e_cal_data_model_get_timezone (src_data_model));
 	e_cal_data_model_set_filter (clone, src_data_model->priv->filter);
 
@@ -2383,6 +2834,64 @@ e_cal_data_model_set_skip_cancelled (ECalDataModel *data_model,
 	UNLOCK_PROPS ();
 }
 
+/**
+ * e_cal_data_model_get_max_instances_per_component:
+ * @data_model: an #EDataModel instance
+ *
+ * Obtains how many instances of a single recurring component
+ * the @data_model expands at most. Zero means no limit.
+ *
+ * Returns: Maximum count of instances per recurring component.
+ *
+ * Since: 3.38
+ **/
+guint
+e_cal_data_model_get_max_instances_per_component (ECalDataModel *data_model)
+{
+	guint max_instances;
+
+	g_return_val_if_fail (E_IS_CAL_DATA_MODEL (data_model), 0);
+
+	LOCK_PROPS ();
+
+	max_instances = data_model->priv->max_instances_per_component;
+
+	UNLOCK_PROPS ();
+
+	return max_instances;
+}
+
+/**
+ * e_cal_data_model_set_max_instances_per_component:
+ * @data_model: an #EDataModel instance
+ * @max_instances: maximum count of instances, or 0 for no limit
+ *
+ * Sets how many instances of a single recurring component
+ * the @data_model expands at most. When the limit is reached,
+ * the expansion stops and its result is not cached.
+ *
+ * Since: 3.38
+ **/
+void
+e_cal_data_model_set_max_instances_per_component (ECalDataModel *data_model,
+						  guint max_instances)
+{
+	g_return_if_fail (E_IS_CAL_DATA_MODEL (data_model));
+
+	LOCK_PROPS ();
+
+	if (data_model->priv->max_instances_per_component == max_instances) {
+		UNLOCK_PROPS ();
+		return;
+	}
+
+	data_model->priv->max_instances_per_component = max_instances;
+
+	cal_data_model_rebuild_everything (data_model, TRUE);
+
+	UNLOCK_PROPS ();
+}
+
 /**
  * e_cal_data_model_get_timezone:
  * @data_model: an #EDataModel instance
@@ -2697,6 +3206,92 @@ e_cal_data_model_get_components (ECalDataModel *data_model,
 	return g_slist_reverse (components);
 }
 
+static gboolean
+cal_data_model_component_in_range (ComponentData *comp_data,
+				   time_t in_range_start,
+				   time_t in_range_end)
+{
+	return (in_range_start == in_range_end && in_range_start == (time_t) 0) ||
+		(comp_data->instance_start < in_range_end && comp_data->instance_end > in_range_start) ||
+		(comp_data->instance_start == comp_data->instance_end && comp_data->instance_end == in_range_start);
+}
+
+static gboolean
+cal_data_model_foreach_indexed_set (ECalDataModel *data_model,
+				    ViewData *view_data,
+				    GHashTable *set,
+				    time_t in_range_start,
+				    time_t in_range_end,
+				    ECalDataModelForeachFunc func,
+				    gpointer user_data,
+				    gboolean include_lost_components)
+{
+	GHashTableIter iter;
+	gpointer key;
+
+	g_hash_table_iter_init (&iter, set);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		ComponentData *comp_data = key;
+
+		if (comp_data->is_lost && !include_lost_components)
+			continue;
+
+		if (cal_data_model_component_in_range (comp_data, in_range_start, in_range_end) &&
+		    !func (data_model, view_data->client, comp_data->id, comp_data->component,
+			   comp_data->instance_start, comp_data->instance_end, user_data))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+cal_data_model_foreach_indexed (ECalDataModel *data_model,
+				ViewData *view_data,
+				time_t in_range_start,
+				time_t in_range_end,
+				ECalDataModelForeachFunc func,
+				gpointer user_data,
+				gboolean include_lost_components)
+{
+	ComponentsIndex *index = view_data->components_index;
+	GHashTable *bucket;
+	gint first_bucket, last_bucket;
+	gboolean checked_all;
+
+	checked_all = cal_data_model_foreach_indexed_set (data_model, view_data, index->long_components,
+		in_range_start, in_range_end, func, user_data, include_lost_components);
+
+	first_bucket = components_index_get_bucket (((gint64) in_range_start) - INDEX_LONG_SPAN);
+	last_bucket = components_index_get_bucket (in_range_end);
+
+	if (((gint64) last_bucket) - first_bucket >= g_hash_table_size (index->buckets)) {
+		GHashTableIter iter;
+		gpointer key, value;
+
+		/* Fewer used buckets than the range covers */
+		g_hash_table_iter_init (&iter, index->buckets);
+		while (checked_all && g_hash_table_iter_next (&iter, &key, &value)) {
+			if (GPOINTER_TO_INT (key) < first_bucket || GPOINTER_TO_INT (key) > last_bucket)
+				continue;
+
+			checked_all = cal_data_model_foreach_indexed_set (data_model, view_data, value,
+				in_range_start, in_range_end, func, user_data, include_lost_components);
+		}
+	} else {
+		gint ii;
+
+		for (ii = first_bucket; checked_all && ii <= last_bucket; ii++) {
+			bucket = g_hash_table_lookup (index->buckets, GINT_TO_POINTER (ii));
+			if (bucket)
+				checked_all = cal_data_model_foreach_indexed_set (data_model, view_data, bucket,
+					in_range_start, in_range_end, func, user_data, include_lost_components);
+		}
+	}
+
+	return checked_all;
+}
+
 static gboolean
 cal_data_model_foreach_component (ECalDataModel *data_model,
 				  time_t in_range_start,
@@ -2732,6 +3327,14 @@ cal_data_model_foreach_component (ECalDataModel *data_model,
 
 		view_data_lock (view_data);
 
+		if (!(in_range_start == in_range_end && in_range_start == (time_t) 0)) {
+			checked_all = cal_data_model_foreach_indexed (data_model, view_data,
+				in_range_start, in_range_end, func, user_data, include_lost_components);
+
+			view_data_unlock (view_data);
+			continue;
+		}
+
 		g_hash_table_iter_init (&citer, view_data->components);
 		while (checked_all && g_hash_table_iter_next (&citer, &key, &value)) {
 			ECalComponentId *id = key;
@@ -2740,13 +3343,9 @@ cal_data_model_foreach_component (ECalDataModel *data_model,
 			if (!comp_data)
 				continue;
 
-			if ((in_range_start == in_range_end && in_range_start == (time_t) 0) ||
-			    (comp_data->instance_start < in_range_end && comp_data->instance_end > in_range_start) ||
-			    (comp_data->instance_start == comp_data->instance_end && comp_data->instance_end == in_range_start)) {
-				if (!func (data_model, view_data->client, id, comp_data->component,
-					   comp_data->instance_start, comp_data->instance_end, user_data))
-					checked_all = FALSE;
-			}
+			if (!func (data_model, view_data->client, id, comp_data->component,
+				   comp_data->instance_start, comp_data->instance_end, user_data))
+				checked_all = FALSE;
 		}
 
 		if (include_lost_components && view_data->lost_components) {
@@ -2758,13 +3357,9 @@ cal_data_model_foreach_component (ECalDataModel *data_model,
 				if (!comp_data)
 					continue;
 
-				if ((in_range_start == in_range_end && in_range_start == (time_t) 0) ||
-				    (comp_data->instance_start < in_range_end && comp_data->instance_end > in_range_start) ||
-				    (comp_data->instance_start == comp_data->instance_end && comp_data->instance_end == in_range_start)) {
-					if (!func (data_model, view_data->client, id, comp_data->component,
-						   comp_data->instance_start, comp_data->instance_end, user_data))
-						checked_all = FALSE;
-				}
+				if (!func (data_model, view_data->client, id, comp_data->component,
+					   comp_data->instance_start, comp_data->instance_end, user_data))
+					checked_all = FALSE;
 			}
 		}
 
@@ -107,6 +107,11 @@ gboolean	e_cal_data_model_get_skip_cancelled
 void		e_cal_data_model_set_skip_cancelled
 						(ECalDataModel *data_model,
 						 gboolean expand_recurrences);
+guint		e_cal_data_model_get_max_instances_per_component
+						(ECalDataModel *data_model);
+void		e_cal_data_model_set_max_instances_per_component
+						(ECalDataModel *data_model,
+						 guint max_instances);
 ICalTimezone *	e_cal_data_model_get_timezone	(ECalDataModel *data_model);
 void		e_cal_data_model_set_timezone	(ECalDataModel *data_model,
 						 ICalTimezone *zone);
@@ -27,23 +27,42 @@
 
 #include "evolution-config.h"
 
+#include <string.h>
+
 #include "e-day-view-layout.h"
 
+/* Number of columns tracked by one word of a LayoutGrid row. */
+#define GRID_BITS_PER_WORD (GLIB_SIZEOF_LONG * 8)
+
+/* Grids up to this many words are kept on the stack; this covers the
+ * full 12 * 24 rows with up to 128 columns on 64-bit systems. */
+#define GRID_STACK_WORDS (12 * 24 * 2)
+
+/* Occupancy bitmap of the main canvas: each row is a run of words_per_row
+ * words, where bit 'col' is set when that column is taken by an event.
+ * All rows live in one flat block, so laying out a day costs at most one
+ * allocation, and a free column is found by OR-ing the words of the rows
+ * an event covers, instead of testing one cell at a time. */
+typedef struct _LayoutGrid {
+	gulong *words;
+	gint rows;
+	gint n_cols;
+	gint words_per_row;
+} LayoutGrid;
+
 static void e_day_view_layout_long_event (EDayViewEvent	  *event,
-					  guint8	  *grid,
+					  gulong	  *grid,
 					  gint		   days_shown,
 					  time_t	  *day_starts,
 					  gint		  *rows_in_top_display);
 
-static void e_day_view_layout_day_event (EDayViewEvent    *event,
-					 EBitArray       **grid,
+static gint e_day_view_layout_day_event (EDayViewEvent    *event,
+					 LayoutGrid       *grid,
 					 guint16	  *group_starts,
 					 guint8		  *cols_per_row,
-					 gint		   rows,
-					 gint		   mins_per_row,
-					 gint              max_cols);
+					 gint		   mins_per_row);
 static void e_day_view_expand_day_event (EDayViewEvent    *event,
-					 EBitArray       **grid,
+					 LayoutGrid       *grid,
 					 guint8		  *cols_per_row,
 					 gint		   mins_per_row);
 static void e_day_view_recalc_cols_per_row (gint           rows,
@@ -58,13 +77,14 @@ e_day_view_layout_long_events (GArray *events,
 {
 	EDayViewEvent *event;
 	gint event_num;
-	guint8 *grid;
+	gulong *grid;
 
-	/* This is a temporary 2-d grid which is used to place events.
-	 * Each element is 0 if the position is empty, or 1 if occupied.
+	/* This is a temporary grid which is used to place events. Each
+	 * element is one row, with bit 'day' set if the day is occupied.
 	 * We allocate the maximum size possible here, assuming that each
 	 * event will need its own row. */
-	grid = g_new0 (guint8, events->len * E_DAY_VIEW_MAX_DAYS);
+	G_STATIC_ASSERT (E_DAY_VIEW_MAX_DAYS <= GRID_BITS_PER_WORD);
+	grid = g_new0 (gulong, MAX (events->len, 1));
 
 	/* Reset the number of rows in the top display to 0. It will be
 	 * updated as events are layed out below. */
@@ -86,12 +106,13 @@ e_day_view_layout_long_events (GArray *events,
 
 static void
 e_day_view_layout_long_event (EDayViewEvent *event,
-                              guint8 *grid,
+                              gulong *grid,
                               gint days_shown,
                               time_t *day_starts,
                               gint *rows_in_top_display)
 {
-	gint start_day, end_day, free_row, day, row;
+	gint start_day, end_day, free_row;
+	gulong days_mask;
 
 	event->num_columns = 0;
 
@@ -100,31 +121,65 @@ e_day_view_layout_long_event (EDayViewEvent *event,
 					      &start_day, &end_day))
 		return;
 
+	/* Bits start_day .. end_day inclusive. */
+	days_mask = ((2UL << end_day) - 1) & ~((1UL << start_day) - 1);
+
 	/* Try each row until we find a free one. */
-	row = 0;
-	do {
-		free_row = row;
-		for (day = start_day; day <= end_day; day++) {
-			if (grid[row * E_DAY_VIEW_MAX_DAYS + day]) {
-				free_row = -1;
-				break;
-			}
-		}
-		row++;
-	} while (free_row == -1);
+	for (free_row = 0; grid[free_row] & days_mask; free_row++) {
+		/* empty */
+	}
 
 	event->start_row_or_col = free_row;
 	event->num_columns = 1;
 
 	/* Mark the cells as full. */
-	for (day = start_day; day <= end_day; day++) {
-		grid[free_row * E_DAY_VIEW_MAX_DAYS + day] = 1;
-	}
+	grid[free_row] |= days_mask;
 
 	/* Update the number of rows in the top canvas if necessary. */
 	*rows_in_top_display = MAX (*rows_in_top_display, free_row + 1);
 }
 
+/* Returns the first column in the range [from_col, grid->n_cols) which is
+ * free (or occupied, when 'want_free' is FALSE) in all of the rows
+ * start_row .. end_row, or -1 when there is none. */
+static gint
+layout_grid_find_col (LayoutGrid *grid,
+                      gint start_row,
+                      gint end_row,
+                      gint from_col,
+                      gboolean want_free)
+{
+	gint word, row, bit;
+
+	if (from_col < 0 || from_col >= grid->n_cols)
+		return -1;
+
+	for (word = from_col / GRID_BITS_PER_WORD; word < grid->words_per_row; word++) {
+		gulong bits = 0;
+		gint nth;
+
+		for (row = start_row; row <= end_row; row++)
+			bits |= grid->words[row * grid->words_per_row + word];
+
+		if (want_free)
+			bits = ~bits;
+
+		/* g_bit_nth_lsf() looks at bits above 'nth' only. */
+		if (word == from_col / GRID_BITS_PER_WORD)
+			nth = (from_col % GRID_BITS_PER_WORD) - 1;
+		else
+			nth = -1;
+
+		bit = g_bit_nth_lsf (bits, nth);
+		if (bit != -1) {
+			bit += word * GRID_BITS_PER_WORD;
+			return bit < grid->n_cols ? bit : -1;
+		}
+	}
+
+	return -1;
+}
+
 /* returns maximum number of columns among all rows */
 gint
 e_day_view_layout_day_events (GArray *events,
@@ -135,7 +190,9 @@ e_day_view_layout_day_events (GArray *events,
 {
 	EDayViewEvent *event;
 	gint row, event_num, res;
-	EBitArray **grid;
+	gulong stack_words[GRID_STACK_WORDS];
+	LayoutGrid grid;
+	gsize n_words;
 
 	/* This is a temporary array which keeps track of rows which are
 	 * connected. When an appointment spans multiple rows then the number
@@ -145,9 +202,24 @@ e_day_view_layout_day_events (GArray *events,
 	 * rows. */
 	guint16 group_starts[12 * 24];
 
-	/* This is a temporary 2-d grid which is used to place events.
-	 * Each element is 0 if the position is empty, or 1 if occupied. */
-	grid = g_new0 (EBitArray *, rows);
+	g_return_val_if_fail (rows <= (gint) G_N_ELEMENTS (group_starts), 0);
+
+	/* This is a temporary 2-d grid which is used to place events. No
+	 * event needs more columns than there are events, so that is how
+	 * wide the grid is made, unless max_cols limits it further. */
+	grid.rows = rows;
+	grid.n_cols = MAX (events->len, 1);
+	if (max_cols > 0)
+		grid.n_cols = MIN (grid.n_cols, max_cols);
+	grid.words_per_row = (grid.n_cols + GRID_BITS_PER_WORD - 1) / GRID_BITS_PER_WORD;
+
+	n_words = (gsize) MAX (rows, 0) * grid.words_per_row;
+	if (n_words <= G_N_ELEMENTS (stack_words)) {
+		grid.words = stack_words;
+		memset (stack_words, 0, n_words * sizeof (gulong));
+	} else {
+		grid.words = g_new0 (gulong, n_words);
+	}
 
 	/* Reset the cols_per_row array, and initialize the connected rows so
 	 * that all rows are not connected - each row is the start of a new
@@ -155,21 +227,23 @@ e_day_view_layout_day_events (GArray *events,
 	for (row = 0; row < rows; row++) {
 		cols_per_row[row] = 0;
 		group_starts[row] = row;
-
-		/* row doesn't contain any event at the moment */
-		grid[row] = e_bit_array_new (0);
 	}
 
 	/* Iterate over the events, finding which rows they cover, and putting
 	 * them in the first free column available. Increment the number of
 	 * events in each of the rows it covers, and make sure they are all
-	 * in one group. */
+	 * in one group. The widest row is one past the rightmost column
+	 * any event got placed into. */
+	res = 0;
 	for (event_num = 0; event_num < events->len; event_num++) {
+		gint col;
+
 		event = &g_array_index (events, EDayViewEvent, event_num);
 
-		e_day_view_layout_day_event (
-			event, grid, group_starts,
-			cols_per_row, rows, mins_per_row, max_cols);
+		col = e_day_view_layout_day_event (
+			event, &grid, group_starts,
+			cols_per_row, mins_per_row);
+		res = MAX (res, col + 1);
 	}
 
 	/* Recalculate the number of columns needed in each row. */
@@ -180,35 +254,33 @@ e_day_view_layout_day_events (GArray *events,
 	for (event_num = 0; event_num < events->len; event_num++) {
 		event = &g_array_index (events, EDayViewEvent, event_num);
 		e_day_view_expand_day_event (
-			event, grid, cols_per_row,
+			event, &grid, cols_per_row,
 			mins_per_row);
 	}
 
-	/* Free the grid and compute maximum number of columns used. */
-	res = 0;
-	for (row = 0; row < rows; row++) {
-		res = MAX (res, e_bit_array_bit_count (grid[row]));
-		g_object_unref (grid[row]);
-	}
-	g_free (grid);
+	/* Free the grid. */
+	if (grid.words != stack_words)
+		g_free (grid.words);
 
 	return res;
 }
 
 /* Finds the first free position to place the event in.
  * Increments the number of events in each of the rows it covers, and makes
- * sure they are all in one group. */
-static void
+ * sure they are all in one group. Returns the column the event was placed
+ * into, or -1 when it was not placed. */
+static gint
 e_day_view_layout_day_event (EDayViewEvent *event,
-                             EBitArray **grid,
+                             LayoutGrid *grid,
                              guint16 *group_starts,
                              guint8 *cols_per_row,
-                             gint rows,
-                             gint mins_per_row,
-                             gint max_cols)
+                             gint mins_per_row)
 {
-	gint start_row, end_row, free_col, col, row, group_start;
+	gint start_row, end_row, free_col, row, group_start, rows;
+	gulong col_bit;
+	gint col_word;
 
+	rows = grid->rows;
 	start_row = event->start_minute / mins_per_row;
 	end_row = (event->end_minute - 1) / mins_per_row;
 	if (end_row < start_row)
@@ -218,30 +290,18 @@ e_day_view_layout_day_event (EDayViewEvent *event,
 
 	/* If the event can't currently be seen, just return. */
 	if (start_row >= rows || end_row < 0)
-		return;
+		return -1;
 
 	/* Make sure we don't go outside the visible times. */
 	start_row = CLAMP (start_row, 0, rows - 1);
 	end_row = CLAMP (end_row, 0, rows - 1);
 
-	/* Try each column until we find a free one. */
-	for (col = 0; max_cols <= 0 || col < max_cols; col++) {
-		free_col = col;
-		for (row = start_row; row <= end_row; row++) {
-			if (e_bit_array_bit_count (grid[row]) > col &&
-			    e_bit_array_value_at (grid[row], col)) {
-				free_col = -1;
-				break;
-			}
-		}
-
-		if (free_col != -1)
-			break;
-	}
+	/* Find the first column free in all the rows. */
+	free_col = layout_grid_find_col (grid, start_row, end_row, 0, TRUE);
 
 	/* If we can't find space for the event, just return. */
 	if (free_col == -1)
-		return;
+		return -1;
 
 	/* The event is assigned 1 col initially, but may be expanded later. */
 	event->start_row_or_col = free_col;
@@ -250,18 +310,15 @@ e_day_view_layout_day_event (EDayViewEvent *event,
 	/* Determine the start index of the group. */
 	group_start = group_starts[start_row];
 
+	col_word = free_col / GRID_BITS_PER_WORD;
+	col_bit = 1UL << (free_col % GRID_BITS_PER_WORD);
+
 	/* Increment number of events in each of the rows the event covers.
 	 * We use the cols_per_row array for this. It will be sorted out after
 	 * all the events have been layed out. Also make sure all the rows that
 	 * the event covers are in one group. */
 	for (row = start_row; row <= end_row; row++) {
-		/* resize the array if necessary */
-		if (e_bit_array_bit_count (grid[row]) <= free_col)
-			e_bit_array_insert (
-				grid[row], e_bit_array_bit_count (grid[row]),
-				free_col - e_bit_array_bit_count (grid[row]) + 1);
-
-		e_bit_array_change_one_row (grid[row], free_col, TRUE);
+		grid->words[row * grid->words_per_row + col_word] |= col_bit;
 		cols_per_row[row]++;
 		group_starts[row] = group_start;
 	}
@@ -272,6 +329,8 @@ e_day_view_layout_day_event (EDayViewEvent *event,
 			break;
 		group_starts[row] = group_start;
 	}
+
+	return free_col;
 }
 
 /* For each group of rows, find the max number of events in all the
@@ -300,34 +359,34 @@ e_day_view_recalc_cols_per_row (gint rows,
 /* Expands the event horizontally to fill any free space. */
 static void
 e_day_view_expand_day_event (EDayViewEvent *event,
-                             EBitArray **grid,
+                             LayoutGrid *grid,
                              guint8 *cols_per_row,
                              gint mins_per_row)
 {
-	gint start_row, end_row, col, row;
-	gboolean clashed;
+	gint start_row, end_row, limit, clash_col;
+
+	/* Events which did not get a column are not shown at all. */
+	if (!event->num_columns)
+		return;
 
 	start_row = event->start_minute / mins_per_row;
 	end_row = (event->end_minute - 1) / mins_per_row;
 	if (end_row < start_row)
 		end_row = start_row;
 
-	/* Try each column until we find a free one. */
-	clashed = FALSE;
-	for (col = event->start_row_or_col + 1; col < cols_per_row[start_row]; col++) {
-		for (row = start_row; row <= end_row; row++) {
-			if (e_bit_array_bit_count (grid[row]) > col &&
-			    e_bit_array_value_at (grid[row], col)) {
-				clashed = TRUE;
-				break;
-			}
-		}
+	start_row = CLAMP (start_row, 0, grid->rows - 1);
+	end_row = CLAMP (end_row, 0, grid->rows - 1);
 
-		if (clashed)
-			break;
+	/* Grow up to the first column occupied in any of the rows. */
+	limit = MIN (cols_per_row[start_row], grid->n_cols);
+	clash_col = layout_grid_find_col (
+		grid, start_row, end_row,
+		event->start_row_or_col + 1, FALSE);
+	if (clash_col != -1)
+		limit = MIN (limit, clash_col);
 
-		event->num_columns++;
-	}
+	if (limit > event->start_row_or_col + 1)
+		event->num_columns = limit - event->start_row_or_col;
 }
 
 /* Find the start and end days for the event. */
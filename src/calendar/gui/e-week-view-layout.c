@@ -25,8 +25,17 @@
 #include "e-week-view-layout.h"
 #include "calendar-config.h"
 
+#include <string.h>
+
+/* Number of rows tracked by one word of the layout grid. */
+#define GRID_BITS_PER_WORD (GLIB_SIZEOF_LONG * 8)
+
+/* Number of words holding the rows of one day. */
+#define GRID_WORDS_PER_DAY \
+	((E_WEEK_VIEW_MAX_ROWS_PER_CELL + GRID_BITS_PER_WORD - 1) / GRID_BITS_PER_WORD)
+
 static void e_week_view_layout_event	(EWeekViewEvent	*event,
-					 guint8		*grid,
+					 gulong		*grid,
 					 GArray		*spans,
 					 GArray		*old_spans,
 					 gboolean	 multi_week_view,
@@ -57,15 +66,15 @@ e_week_view_layout_events (GArray *events,
 	EWeekViewEvent *event;
 	EWeekViewEventSpan *span;
 	gint num_days, day, event_num, span_num;
-	guint8 *grid;
 	GArray *spans;
 
 	/* This is a temporary 2-d grid which is used to place events.
-	 * Each element is 0 if the position is empty, or 1 if occupied.
-	 * We allocate the maximum size possible here, assuming that each
-	 * event will need its own row. */
-	grid = g_new0 (guint8, E_WEEK_VIEW_MAX_ROWS_PER_CELL * 7
-		       * E_WEEK_VIEW_MAX_WEEKS);
+	 * Each day is a bitmap of GRID_WORDS_PER_DAY words, with bit 'row'
+	 * set if the position is occupied. It is small enough to live on
+	 * the stack even at the maximum size possible. */
+	gulong grid[GRID_WORDS_PER_DAY * 7 * E_WEEK_VIEW_MAX_WEEKS];
+
+	memset (grid, 0, sizeof (grid));
 
 	/* We create a new array of spans, which will replace the old one. */
 	spans = g_array_new (FALSE, FALSE, sizeof (EWeekViewEventSpan));
@@ -88,9 +97,6 @@ e_week_view_layout_events (GArray *events,
 			rows_per_day);
 	}
 
-	/* Free the grid. */
-	g_free (grid);
-
 	/* Destroy the old spans array, destroying any unused canvas items. */
 	if (old_spans) {
 		for (span_num = 0; span_num < old_spans->len; span_num++) {
@@ -109,7 +115,7 @@ e_week_view_layout_events (GArray *events,
 
 static void
 e_week_view_layout_event (EWeekViewEvent *event,
-                                 guint8 *grid,
+                                 gulong *grid,
                                  GArray *spans,
                                  GArray *old_spans,
                                  gboolean multi_week_view,
@@ -121,6 +127,7 @@ e_week_view_layout_event (EWeekViewEvent *event,
 {
 	gint start_day, end_day, span_start_day, span_end_day, rows_per_cell;
 	gint free_row, row, day, span_num, spans_index, num_spans, days_shown;
+	gint word;
 	EWeekViewEventSpan span, *old_span;
 
 	days_shown = multi_week_view ? weeks_shown * 7 : 7;
@@ -158,27 +165,32 @@ e_week_view_layout_event (EWeekViewEvent *event,
 			"  Span start:%i end:%i\n", span_start_day,
 			span_end_day);
 #endif
-		/* Try each row until we find a free one or we fall off the
-		 * bottom of the available rows. */
-		row = 0;
+		/* Find the first row free in all the days of the span, a word
+		 * of rows at a time, or fall off the bottom of the available
+		 * rows. */
 		free_row = -1;
-		while (free_row == -1 && row < rows_per_cell) {
-			free_row = row;
-			for (day = span_start_day; day <= span_end_day;
-			     day++) {
-				if (grid[day * rows_per_cell + row]) {
-					free_row = -1;
+		for (word = 0; free_row == -1 && word < GRID_WORDS_PER_DAY; word++) {
+			gulong used = 0;
+
+			for (day = span_start_day; day <= span_end_day; day++)
+				used |= grid[day * GRID_WORDS_PER_DAY + word];
+
+			row = g_bit_nth_lsf (~used, -1);
+			if (row != -1) {
+				row += word * GRID_BITS_PER_WORD;
+				if (row < rows_per_cell)
+					free_row = row;
+				else
 					break;
-				}
 			}
-			row++;
-		};
+		}
 
 		if (free_row != -1) {
 			/* Mark the cells as full. */
 			for (day = span_start_day; day <= span_end_day;
 			     day++) {
-				grid[day * rows_per_cell + free_row] = 1;
+				grid[day * GRID_WORDS_PER_DAY + free_row / GRID_BITS_PER_WORD] |=
+					1UL << (free_row % GRID_BITS_PER_WORD);
 				rows_per_day[day] = MAX (
 					rows_per_day[day],
 					free_row + 1);
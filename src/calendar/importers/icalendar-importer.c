@@ -56,6 +56,13 @@ typedef struct {
 	ICalComponent *icomp;
 
 	GCancellable *cancellable;
+
+	/* streamed iCalendar import */
+	gchar *filename;
+	GThread *thread;
+	GError *error;
+	gint percent;		/* atomic */
+	gint finished;		/* atomic */
 } ICalImporter;
 
 typedef struct {
@@ -83,6 +90,8 @@ static const gchar *import_type_strings[] = {
  */
 
 static GtkWidget *ical_get_preview (ICalComponent *icomp);
+static gpointer ical_import_thread (gpointer user_data);
+static gboolean ical_import_poll_cb (gpointer user_data);
 
 static gboolean
 is_icomp_usable (ICalComponent *icomp)
@@ -108,10 +117,15 @@ static void
 ivcal_import_done (ICalImporter *ici,
 		   const GError *error)
 {
+	if (ici->thread)
+		g_thread_join (ici->thread);
+
 	g_clear_object (&ici->cal_client);
 	g_clear_object (&ici->icomp);
 
 	e_import_complete (ici->import, ici->target, error);
+	g_clear_error (&ici->error);
+	g_free (ici->filename);
 	g_object_unref (ici->import);
 	g_object_unref (ici->cancellable);
 	g_free (ici);
@@ -497,13 +511,28 @@ ivcal_connect_cb (GObject *source_object,
 	ici->cal_client = E_CAL_CLIENT (client);
 
 	e_import_status (ici->import, ici->target, _("Importing…"), 0);
-	ici->idle_id = g_idle_add (ivcal_import_items, ici);
+
+	if (ici->filename) {
+		ici->thread = g_thread_try_new (
+			"ical-import", ical_import_thread, ici, &ici->error);
+
+		if (ici->thread)
+			ici->idle_id = e_named_timeout_add (
+				100, ical_import_poll_cb, ici);
+		else
+			ivcal_import_done (ici, ici->error);
+	} else {
+		ici->idle_id = g_idle_add (ivcal_import_items, ici);
+	}
 }
 
+/* Imports either the parsed 'icomp', or streams the iCalendar
+ * file 'filename' in batches; takes ownership of both. */
 static void
 ivcal_import (EImport *ei,
               EImportTarget *target,
-              ICalComponent *icomp)
+              ICalComponent *icomp,
+              gchar *filename)
 {
 	ECalClientSourceType type;
 	ICalImporter *ici = g_malloc0 (sizeof (*ici));
@@ -515,6 +544,7 @@ ivcal_import (EImport *ei,
 	g_object_ref (ei);
 	ici->target = target;
 	ici->icomp = icomp;
+	ici->filename = filename;
 	ici->cal_client = NULL;
 	ici->source_type = type;
 	ici->cancellable = g_cancellable_new ();
@@ -541,13 +571,450 @@ ivcal_cancel (EImport *ei,
  * iCalendar importer functions.
  */
 
+/* Number of components sent to the calendar in one receive_objects call;
+ * a batch is cut only between two UIDs, thus it can be a bit larger, when
+ * a recurring component has its detached instances in the file. */
+#define ICAL_IMPORT_BATCH_SIZE 100
+
+typedef struct _ICalStreamData {
+	ICalImporter *ici;
+	ICalComponentKind wanted_kind;
+
+	/* Properties of the current VCALENDAR, as text */
+	GString *header;
+	ICalComponent *top_level;
+
+	/* gchar *tzid ~> ICalComponent *vtimezone */
+	GHashTable *zones;
+
+	GSList *batch;		/* ICalComponent * */
+	guint batch_len;
+	gchar *batch_uid;	/* UID of the last component in the batch */
+
+	/* Components using a time zone not defined yet, together with
+	 * the other components of the same UID */
+	GSList *deferred;	/* ICalComponent * */
+	GHashTable *deferred_uids;
+} ICalStreamData;
+
+static void
+ical_stream_gather_tzids_cb (ICalParameter *param,
+			     gpointer user_data)
+{
+	GHashTable *tzids = user_data;
+	const gchar *tzid;
+
+	tzid = i_cal_parameter_get_tzid (param);
+	if (tzid && *tzid && !g_hash_table_contains (tzids, tzid))
+		g_hash_table_add (tzids, g_strdup (tzid));
+}
+
+static gint
+ical_stream_compare_uids (gconstpointer ptr1,
+			  gconstpointer ptr2)
+{
+	ICalComponent *icomp1 = (ICalComponent *) ptr1, *icomp2 = (ICalComponent *) ptr2;
+
+	return g_strcmp0 (i_cal_component_get_uid (icomp1), i_cal_component_get_uid (icomp2));
+}
+
+/* Moves components with the 'uid' from the batch to the deferred
+ * components, thus a master object and its detached instances are
+ * sent to the calendar together. */
+static void
+ical_stream_defer_uid (ICalStreamData *sd,
+		       const gchar *uid)
+{
+	GSList *link, *next, *moved = NULL;
+
+	if (!uid)
+		return;
+
+	if (!g_hash_table_contains (sd->deferred_uids, uid))
+		g_hash_table_add (sd->deferred_uids, g_strdup (uid));
+
+	for (link = sd->batch; link; link = next) {
+		next = g_slist_next (link);
+
+		if (g_strcmp0 (i_cal_component_get_uid (link->data), uid) == 0) {
+			moved = g_slist_prepend (moved, link->data);
+			sd->batch = g_slist_delete_link (sd->batch, link);
+			sd->batch_len--;
+		}
+	}
+
+	/* Both lists are in the reverse order */
+	sd->deferred = g_slist_concat (g_slist_reverse (moved), sd->deferred);
+}
+
+/* Returns a new top-level component for the next batch, with the
+ * properties of the VCALENDAR the components come from. */
+static ICalComponent *
+ical_stream_new_top_level (ICalStreamData *sd)
+{
+	if (!sd->top_level) {
+		gchar *str;
+
+		str = g_strconcat (
+			"BEGIN:VCALENDAR\r\n", sd->header->str,
+			"END:VCALENDAR\r\n", NULL);
+		sd->top_level = i_cal_component_new_from_string (str);
+		g_free (str);
+
+		if (sd->top_level &&
+		    i_cal_component_isa (sd->top_level) != I_CAL_VCALENDAR_COMPONENT)
+			g_clear_object (&sd->top_level);
+
+		if (!sd->top_level)
+			sd->top_level = e_cal_util_new_top_level ();
+
+		if (!e_cal_util_component_has_property (sd->top_level, I_CAL_METHOD_PROPERTY))
+			i_cal_component_set_method (sd->top_level, I_CAL_METHOD_PUBLISH);
+	}
+
+	return i_cal_component_clone (sd->top_level);
+}
+
+/* Sends the collected components to the calendar in one call, together
+ * with the VTIMEZONE components they refer to. Returns FALSE on error. */
+static gboolean
+ical_stream_flush_batch (ICalStreamData *sd,
+			 GSList **pbatch)
+{
+	ICalImporter *ici = sd->ici;
+	ICalComponent *vcal;
+	GHashTable *tzids;
+	GHashTableIter iter;
+	gpointer key;
+	GSList *link;
+	gboolean success;
+
+	if (!*pbatch)
+		return TRUE;
+
+	vcal = ical_stream_new_top_level (sd);
+	tzids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	*pbatch = g_slist_reverse (*pbatch);
+
+	for (link = *pbatch; link; link = g_slist_next (link))
+		i_cal_component_foreach_tzid (link->data, ical_stream_gather_tzids_cb, tzids);
+
+	g_hash_table_iter_init (&iter, tzids);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		ICalComponent *vtimezone;
+
+		vtimezone = g_hash_table_lookup (sd->zones, key);
+		if (vtimezone)
+			i_cal_component_take_component (vcal, i_cal_component_clone (vtimezone));
+	}
+
+	for (link = *pbatch; link; link = g_slist_next (link))
+		i_cal_component_take_component (vcal, link->data);
+
+	g_slist_free (*pbatch);
+	*pbatch = NULL;
+
+	success = e_cal_client_receive_objects_sync (
+		ici->cal_client, vcal, E_CAL_OPERATION_FLAG_NONE,
+		ici->cancellable, &ici->error);
+
+	g_hash_table_destroy (tzids);
+	g_object_unref (vcal);
+
+	return success;
+}
+
+/* Takes one complete child component of a VCALENDAR, as text. */
+static gboolean
+ical_stream_add_component (ICalStreamData *sd,
+			   const gchar *str)
+{
+	ICalComponent *icomp;
+	ICalComponentKind kind;
+	GHashTable *tzids;
+	GHashTableIter iter;
+	gpointer key;
+	const gchar *uid;
+	gboolean known = TRUE;
+	gboolean success = TRUE;
+
+	icomp = i_cal_component_new_from_string (str);
+	if (!icomp)
+		return TRUE;
+
+	kind = i_cal_component_isa (icomp);
+
+	if (kind == I_CAL_VTIMEZONE_COMPONENT) {
+		const gchar *tzid;
+		ICalProperty *prop;
+
+		prop = i_cal_component_get_first_property (icomp, I_CAL_TZID_PROPERTY);
+		tzid = prop ? i_cal_property_get_tzid (prop) : NULL;
+
+		if (tzid && *tzid && !g_hash_table_contains (sd->zones, tzid))
+			g_hash_table_insert (sd->zones, g_strdup (tzid), g_object_ref (icomp));
+
+		g_clear_object (&prop);
+		g_object_unref (icomp);
+
+		return TRUE;
+	}
+
+	if (kind != sd->wanted_kind) {
+		g_object_unref (icomp);
+		return TRUE;
+	}
+
+	/* Time zones can follow the components using them; keep such
+	 * components until the whole file is read. */
+	tzids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	i_cal_component_foreach_tzid (icomp, ical_stream_gather_tzids_cb, tzids);
+
+	g_hash_table_iter_init (&iter, tzids);
+	while (known && g_hash_table_iter_next (&iter, &key, NULL)) {
+		known = g_hash_table_contains (sd->zones, key) ||
+			i_cal_timezone_get_builtin_timezone_from_tzid (key) != NULL;
+	}
+
+	g_hash_table_destroy (tzids);
+
+	uid = i_cal_component_get_uid (icomp);
+
+	/* Cut a full batch only before a component of another UID */
+	if (sd->batch_len >= ICAL_IMPORT_BATCH_SIZE && g_strcmp0 (uid, sd->batch_uid) != 0) {
+		sd->batch_len = 0;
+		success = ical_stream_flush_batch (sd, &sd->batch);
+	}
+
+	g_free (sd->batch_uid);
+	sd->batch_uid = g_strdup (uid);
+
+	if (!known || (uid && g_hash_table_contains (sd->deferred_uids, uid))) {
+		ical_stream_defer_uid (sd, uid);
+		sd->deferred = g_slist_prepend (sd->deferred, icomp);
+		return success;
+	}
+
+	sd->batch = g_slist_prepend (sd->batch, icomp);
+	sd->batch_len++;
+
+	return success;
+}
+
+/* Reads the iCalendar file line by line and sends its events or tasks
+ * to the calendar in batches, thus neither the file content nor the
+ * whole component tree is held in memory at once. */
+static gpointer
+ical_import_thread (gpointer user_data)
+{
+	ICalImporter *ici = user_data;
+	ICalStreamData sd;
+	GFile *file;
+	GFileInputStream *file_stream;
+	GFileInfo *info;
+	GDataInputStream *data_stream;
+	GString *child;
+	goffset size;
+	gint depth = 0;
+	gboolean success = TRUE;
+	gchar *line;
+
+	file = g_file_new_for_path (ici->filename);
+	file_stream = g_file_read (file, ici->cancellable, &ici->error);
+	g_object_unref (file);
+
+	if (!file_stream) {
+		g_atomic_int_set (&ici->finished, 1);
+		return NULL;
+	}
+
+	info = g_file_input_stream_query_info (
+		file_stream, G_FILE_ATTRIBUTE_STANDARD_SIZE,
+		ici->cancellable, NULL);
+	size = info ? g_file_info_get_size (info) : 0;
+	g_clear_object (&info);
+
+	memset (&sd, 0, sizeof (ICalStreamData));
+	sd.ici = ici;
+	sd.wanted_kind = ici->source_type == E_CAL_CLIENT_SOURCE_TYPE_TASKS ?
+		I_CAL_VTODO_COMPONENT : I_CAL_VEVENT_COMPONENT;
+	sd.header = g_string_new (NULL);
+	sd.zones = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+	sd.deferred_uids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	child = g_string_sized_new (1024);
+
+	data_stream = g_data_input_stream_new (G_INPUT_STREAM (file_stream));
+	g_data_input_stream_set_newline_type (
+		data_stream, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+
+	/* Folded lines start with a white space, thus never look like
+	 * BEGIN or END; the parser unfolds them within each component. */
+	while (success && (line = g_data_input_stream_read_line (
+		data_stream, NULL, ici->cancellable, NULL)) != NULL) {
+		gboolean is_begin, is_end;
+
+		is_begin = g_ascii_strncasecmp (line, "BEGIN:", 6) == 0;
+		is_end = g_ascii_strncasecmp (line, "END:", 4) == 0;
+
+		if (depth == 0) {
+			if (is_begin && g_ascii_strcasecmp (line + 6, "VCALENDAR") == 0) {
+				g_string_truncate (sd.header, 0);
+				g_clear_object (&sd.top_level);
+				depth = 1;
+			}
+		} else if (depth == 1) {
+			if (is_end) {
+				/* The next VCALENDAR can have different properties. */
+				sd.batch_len = 0;
+				success = ical_stream_flush_batch (&sd, &sd.batch);
+				depth = 0;
+			} else if (is_begin) {
+				g_string_assign (child, line);
+				g_string_append (child, "\r\n");
+				depth = 2;
+			} else {
+				g_string_append (sd.header, line);
+				g_string_append (sd.header, "\r\n");
+			}
+		} else {
+			g_string_append (child, line);
+			g_string_append (child, "\r\n");
+
+			if (is_begin) {
+				depth++;
+			} else if (is_end) {
+				depth--;
+				if (depth == 1) {
+					success = ical_stream_add_component (&sd, child->str);
+					g_string_truncate (child, 0);
+
+					if (size > 0)
+						g_atomic_int_set (
+							&ici->percent,
+							(gint) (g_seekable_tell (G_SEEKABLE (file_stream)) * 100 / size));
+				}
+			}
+		}
+
+		g_free (line);
+	}
+
+	if (success && !g_cancellable_is_cancelled (ici->cancellable))
+		success = ical_stream_flush_batch (&sd, &sd.batch);
+
+	/* Whatever time zones are known by now go with the deferred ones. */
+	if (success && sd.deferred && !g_cancellable_is_cancelled (ici->cancellable)) {
+		GSList *batch = NULL;
+		guint batch_len = 0;
+
+		/* Group them by UID; the sort is stable, thus a master object
+		 * stays in front of its detached instances. */
+		sd.deferred = g_slist_sort (g_slist_reverse (sd.deferred), ical_stream_compare_uids);
+
+		while (success && sd.deferred) {
+			batch = g_slist_prepend (batch, sd.deferred->data);
+			sd.deferred = g_slist_delete_link (sd.deferred, sd.deferred);
+
+			batch_len++;
+
+			if (!sd.deferred || (batch_len >= ICAL_IMPORT_BATCH_SIZE &&
+			    ical_stream_compare_uids (batch->data, sd.deferred->data) != 0)) {
+				success = ical_stream_flush_batch (&sd, &batch);
+				batch_len = 0;
+			}
+		}
+
+		g_slist_free_full (batch, g_object_unref);
+	}
+
+	if (!ici->error)
+		g_cancellable_set_error_if_cancelled (ici->cancellable, &ici->error);
+
+	g_slist_free_full (sd.batch, g_object_unref);
+	g_slist_free_full (sd.deferred, g_object_unref);
+	g_hash_table_destroy (sd.deferred_uids);
+	g_hash_table_destroy (sd.zones);
+	g_free (sd.batch_uid);
+	g_clear_object (&sd.top_level);
+	g_string_free (sd.header, TRUE);
+	g_string_free (child, TRUE);
+	g_object_unref (data_stream);
+	g_object_unref (file_stream);
+
+	g_atomic_int_set (&ici->finished, 1);
+
+	return NULL;
+}
+
+static gboolean
+ical_import_poll_cb (gpointer user_data)
+{
+	ICalImporter *ici = user_data;
+
+	if (g_atomic_int_get (&ici->finished)) {
+		ici->idle_id = 0;
+		ivcal_import_done (ici, ici->error);
+		return FALSE;
+	}
+
+	e_import_status (
+		ici->import, ici->target, _("Importing…"),
+		g_atomic_int_get (&ici->percent));
+
+	return TRUE;
+}
+
+/* Checks whether the file has a VCALENDAR with any VEVENT or VTODO,
+ * without reading more of it than necessary. */
+static gboolean
+ical_file_is_usable (const gchar *filename)
+{
+	GFile *file;
+	GFileInputStream *file_stream;
+	GDataInputStream *data_stream;
+	gboolean in_vcalendar = FALSE, usable = FALSE;
+	gchar *line;
+
+	file = g_file_new_for_path (filename);
+	file_stream = g_file_read (file, NULL, NULL);
+	g_object_unref (file);
+
+	if (!file_stream)
+		return FALSE;
+
+	data_stream = g_data_input_stream_new (G_INPUT_STREAM (file_stream));
+	g_data_input_stream_set_newline_type (
+		data_stream, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+
+	while (!usable && (line = g_data_input_stream_read_line (
+		data_stream, NULL, NULL, NULL)) != NULL) {
+		if (g_ascii_strncasecmp (line, "BEGIN:", 6) == 0) {
+			const gchar *name = line + 6;
+
+			if (g_ascii_strcasecmp (name, "VCALENDAR") == 0)
+				in_vcalendar = TRUE;
+			else if (in_vcalendar)
+				usable = g_ascii_strcasecmp (name, "VEVENT") == 0 ||
+					 g_ascii_strcasecmp (name, "VTODO") == 0;
+		}
+
+		g_free (line);
+	}
+
+	g_object_unref (data_stream);
+	g_object_unref (file_stream);
+
+	return usable;
+}
+
 static gboolean
 ical_supported (EImport *ei,
                 EImportTarget *target,
                 EImportImporter *im)
 {
 	gchar *filename;
-	gchar *contents;
 	gboolean ret = FALSE;
 	EImportTargetURI *s;
 
@@ -565,17 +1032,7 @@ ical_supported (EImport *ei,
 	if (!filename)
 		return FALSE;
 
-	if (g_file_get_contents (filename, &contents, NULL, NULL)) {
-		ICalComponent *icomp;
-
-		icomp = e_cal_util_parse_ics_string (contents);
-		g_free (contents);
-
-		if (icomp) {
-			ret = is_icomp_usable (icomp);
-			g_object_unref (icomp);
-		}
-	}
+	ret = ical_file_is_usable (filename);
 	g_free (filename);
 
 	return ret;
@@ -587,8 +1044,6 @@ ical_import (EImport *ei,
              EImportImporter *im)
 {
 	gchar *filename;
-	gchar *contents;
-	ICalComponent *icomp;
 	GError *error = NULL;
 	EImportTargetURI *s = (EImportTargetURI *) target;
 
@@ -599,21 +1054,7 @@ ical_import (EImport *ei,
 		return;
 	}
 
-	if (!g_file_get_contents (filename, &contents, NULL, &error)) {
-		g_free (filename);
-		e_import_complete (ei, target, error);
-		g_clear_error (&error);
-		return;
-	}
-	g_free (filename);
-
-	icomp = e_cal_util_parse_ics_string (contents);
-	g_free (contents);
-
-	if (icomp)
-		ivcal_import (ei, target, icomp);
-	else
-		e_import_complete (ei, target, error);
+	ivcal_import (ei, target, NULL, filename);
 }
 
 static GtkWidget *
@@ -809,7 +1250,7 @@ vcal_import (EImport *ei,
 	icomp = load_vcalendar_file (filename);
 	g_free (filename);
 	if (icomp)
-		ivcal_import (ei, target, icomp);
+		ivcal_import (ei, target, icomp, NULL);
 	else
 		e_import_complete (ei, target, error);
 }
@@ -68,6 +68,64 @@ static gint special_chars[] = {
 #define is_trailing_garbage(c) (c > 127 || (special_chars[c] & 2))
 #define is_domain_name_char(c) (c < 128 && (special_chars[c] & 4))
 
+/* Byte classes for the bulk copy in e_text_to_html_full(); a byte
+ * without any class bit matching the flags is copied verbatim. */
+enum {
+	BYTE_CLASS_ESCAPE = 1 << 0,	/* control, 8-bit or HTML special */
+	BYTE_CLASS_SPACE = 1 << 1,	/* ' ' */
+	BYTE_CLASS_AT = 1 << 2,		/* '@' */
+	BYTE_CLASS_URL_START = 1 << 3	/* first letter of a URL prefix */
+};
+
+static const guint8 *
+get_byte_classes (void)
+{
+	static guint8 byte_classes[256];
+	static gsize initialized = 0;
+
+	if (g_once_init_enter (&initialized)) {
+		const gchar *url_starts = "cfhmnstw";
+		gint ii;
+
+		for (ii = 0; ii < 256; ii++) {
+			if (ii < 0x20 || ii >= 0x7f ||
+			    ii == '<' || ii == '>' || ii == '&' || ii == '"')
+				byte_classes[ii] = BYTE_CLASS_ESCAPE;
+		}
+
+		byte_classes[' '] = BYTE_CLASS_SPACE;
+		byte_classes['@'] = BYTE_CLASS_AT;
+
+		for (ii = 0; url_starts[ii]; ii++) {
+			byte_classes[(guchar) url_starts[ii]] = BYTE_CLASS_URL_START;
+			byte_classes[(guchar) g_ascii_toupper (url_starts[ii])] = BYTE_CLASS_URL_START;
+		}
+
+		g_once_init_leave (&initialized, 1);
+	}
+
+	return byte_classes;
+}
+
+static gboolean
+has_url_scheme (const guchar *text)
+{
+	static const gchar *schemes[] = {
+		"callto:", "file:", "ftp://", "h323:", "http://", "https://",
+		"mailto:", "news:", "nntp://", "sip:", "tel:", "webcal:"
+	};
+	gchar first = g_ascii_tolower (*text);
+	guint ii;
+
+	for (ii = 0; ii < G_N_ELEMENTS (schemes); ii++) {
+		if (schemes[ii][0] == first &&
+		    !g_ascii_strncasecmp ((const gchar *) text, schemes[ii], strlen (schemes[ii])))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
 /* (http|https|ftp|nntp)://[^ "|/]+\.([^ "|]*[^ ,.!?;:>)\]}`'"|_-])+ */
 /* www\.[A-Za-z0-9.-]+(/([^ "|]*[^ ,.!?;:>)\]}`'"|_-])+)             */
 
@@ -242,9 +300,11 @@ e_text_to_html_full (const gchar *input,
                      guint32 color)
 {
 	const guchar *cur, *next, *linestart;
+	const guint8 *byte_classes;
 	gchar *buffer = NULL;
 	gchar *out = NULL;
 	gint buffer_size = 0, col;
+	guint8 slow_classes;
 	gboolean colored = FALSE, saw_citation = FALSE;
 
 	/* Allocate a translation buffer.  */
@@ -257,6 +317,15 @@ e_text_to_html_full (const gchar *input,
 
 	col = 0;
 
+	byte_classes = get_byte_classes ();
+	slow_classes = BYTE_CLASS_ESCAPE;
+	if (flags & (E_TEXT_TO_HTML_CONVERT_SPACES | E_TEXT_TO_HTML_CONVERT_ALL_SPACES))
+		slow_classes |= BYTE_CLASS_SPACE;
+	if (flags & E_TEXT_TO_HTML_CONVERT_ADDRESSES)
+		slow_classes |= BYTE_CLASS_AT;
+	if (flags & E_TEXT_TO_HTML_CONVERT_URLS)
+		slow_classes |= BYTE_CLASS_URL_START;
+
 	for (cur = linestart = (const guchar *) input; cur && *cur; cur = next) {
 		gunichar u;
 
@@ -288,23 +357,29 @@ e_text_to_html_full (const gchar *input,
 			out += sprintf (out, "&gt; ");
 		}
 
+		/* Copy runs of printable ASCII, which cannot start
+		 * a URL or an address, without any conversion. */
+		if (*cur && !(byte_classes[*cur] & slow_classes)) {
+			gint len;
+
+			next = cur + 1;
+			while (*next && !(byte_classes[*next] & slow_classes))
+				next++;
+
+			len = next - cur;
+			out = check_size (&buffer, &buffer_size, out, len);
+			memcpy (out, cur, len);
+			out += len;
+			col += len;
+			continue;
+		}
+
 		u = g_utf8_get_char ((gchar *) cur);
 		if (g_unichar_isalpha (u) &&
 		    (flags & E_TEXT_TO_HTML_CONVERT_URLS)) {
 			gchar *tmpurl = NULL, *refurl = NULL, *dispurl = NULL;
 
-			if (!g_ascii_strncasecmp ((gchar *) cur, "http://", 7) ||
-			    !g_ascii_strncasecmp ((gchar *) cur, "https://", 8) ||
-			    !g_ascii_strncasecmp ((gchar *) cur, "ftp://", 6) ||
-			    !g_ascii_strncasecmp ((gchar *) cur, "nntp://", 7) ||
-			    !g_ascii_strncasecmp ((gchar *) cur, "mailto:", 7) ||
-			    !g_ascii_strncasecmp ((gchar *) cur, "news:", 5) ||
-			    !g_ascii_strncasecmp ((gchar *) cur, "file:", 5) ||
-			    !g_ascii_strncasecmp ((gchar *) cur, "callto:", 7) ||
-			    !g_ascii_strncasecmp ((gchar *) cur, "h323:", 5) ||
-			    !g_ascii_strncasecmp ((gchar *) cur, "sip:", 4) ||
-			    !g_ascii_strncasecmp ((gchar *) cur, "tel:", 4) ||
-			    !g_ascii_strncasecmp ((gchar *) cur, "webcal:", 7)) {
+			if (has_url_scheme (cur)) {
 				tmpurl = url_extract (&cur, TRUE, (flags & E_TEXT_TO_HTML_URL_IS_WHOLE_TEXT) != 0);
 				if (tmpurl) {
 					refurl = e_text_to_html (tmpurl, 0);
@@ -3442,6 +3442,181 @@ e_util_run_simple_async_result_in_thread (GSimpleAsyncResult *simple,
 	g_mutex_unlock (&thread_pool_mutex);
 }
 
+/**
+ * EUtilBatchFunc:
+ * @job: a job pushed by e_util_batch_push()
+ * @user_data: user data passed to e_util_batch_new()
+ *
+ * Processes one job of an #EUtilBatch.
+ *
+ * Since: 3.38
+ **/
+
+struct _EUtilBatch {
+	EUtilBatchFunc func;
+	gpointer user_data;
+
+	GMutex lock;
+	GCond cond;
+	guint pending;
+};
+
+typedef struct _EUtilBatchJob {
+	EUtilBatch *batch;
+	gpointer job;
+} EUtilBatchJob;
+
+static void
+e_util_batch_job_done (EUtilBatch *batch)
+{
+	g_mutex_lock (&batch->lock);
+	batch->pending--;
+	if (!batch->pending)
+		g_cond_broadcast (&batch->cond);
+	g_mutex_unlock (&batch->lock);
+}
+
+static void
+e_util_batch_thread (gpointer data,
+		     gpointer user_data)
+{
+	EUtilBatchJob *bjob = data;
+	EUtilBatch *batch = bjob->batch;
+
+	batch->func (bjob->job, batch->user_data);
+
+	g_slice_free (EUtilBatchJob, bjob);
+
+	e_util_batch_job_done (batch);
+}
+
+static GThreadPool *
+e_util_batch_get_pool (void)
+{
+	static gsize pool = 0;
+
+	if (g_once_init_enter (&pool)) {
+		GThreadPool *tmp;
+
+		tmp = g_thread_pool_new (
+			e_util_batch_thread, NULL,
+			MAX (g_get_num_processors (), 1),
+			FALSE, NULL);
+
+		g_once_init_leave (&pool, GPOINTER_TO_SIZE (tmp));
+	}
+
+	return GSIZE_TO_POINTER (pool);
+}
+
+/**
+ * e_util_batch_new:
+ * @func: an #EUtilBatchFunc to process the jobs with
+ * @user_data: user data passed to @func
+ *
+ * Creates a new batch of jobs, which are processed by @func in a thread
+ * pool shared by all batches, with as many threads as there are
+ * processors. The jobs are added with e_util_batch_push() and waited
+ * for with e_util_batch_wait(). The @func should not wait for other
+ * batches, because it occupies one of the shared threads.
+ *
+ * Free the returned batch with e_util_batch_free(), when no longer needed.
+ *
+ * Returns: (transfer full): a new #EUtilBatch
+ *
+ * Since: 3.38
+ **/
+EUtilBatch *
+e_util_batch_new (EUtilBatchFunc func,
+		  gpointer user_data)
+{
+	EUtilBatch *batch;
+
+	g_return_val_if_fail (func != NULL, NULL);
+
+	batch = g_slice_new0 (EUtilBatch);
+	batch->func = func;
+	batch->user_data = user_data;
+	g_mutex_init (&batch->lock);
+	g_cond_init (&batch->cond);
+
+	return batch;
+}
+
+/**
+ * e_util_batch_free:
+ * @batch: (nullable): an #EUtilBatch
+ *
+ * Waits for the pending jobs of the @batch and frees it.
+ *
+ * Since: 3.38
+ **/
+void
+e_util_batch_free (EUtilBatch *batch)
+{
+	if (!batch)
+		return;
+
+	e_util_batch_wait (batch);
+
+	g_mutex_clear (&batch->lock);
+	g_cond_clear (&batch->cond);
+	g_slice_free (EUtilBatch, batch);
+}
+
+/**
+ * e_util_batch_push:
+ * @batch: an #EUtilBatch
+ * @job: a job for the @batch function
+ *
+ * Queues the @job for processing in the shared thread pool. When the pool
+ * cannot take it, the @job is processed in the calling thread before
+ * this function returns.
+ *
+ * Since: 3.38
+ **/
+void
+e_util_batch_push (EUtilBatch *batch,
+		   gpointer job)
+{
+	GThreadPool *pool;
+	EUtilBatchJob *bjob;
+
+	g_return_if_fail (batch != NULL);
+
+	g_mutex_lock (&batch->lock);
+	batch->pending++;
+	g_mutex_unlock (&batch->lock);
+
+	bjob = g_slice_new (EUtilBatchJob);
+	bjob->batch = batch;
+	bjob->job = job;
+
+	pool = e_util_batch_get_pool ();
+
+	if (!pool || !g_thread_pool_push (pool, bjob, NULL))
+		e_util_batch_thread (bjob, NULL);
+}
+
+/**
+ * e_util_batch_wait:
+ * @batch: an #EUtilBatch
+ *
+ * Waits until all jobs pushed to the @batch are processed.
+ *
+ * Since: 3.38
+ **/
+void
+e_util_batch_wait (EUtilBatch *batch)
+{
+	g_return_if_fail (batch != NULL);
+
+	g_mutex_lock (&batch->lock);
+	while (batch->pending > 0)
+		g_cond_wait (&batch->cond, &batch->lock);
+	g_mutex_unlock (&batch->lock);
+}
+
 /**
  * e_util_is_running_gnome:
  *
@@ -289,6 +289,18 @@ void		e_util_run_simple_async_result_in_thread
 						(GSimpleAsyncResult *simple,
 						 GSimpleAsyncThreadFunc func,
 						 GCancellable *cancellable);
+
+typedef void	(* EUtilBatchFunc)		(gpointer job,
+						 gpointer user_data);
+
+typedef struct _EUtilBatch EUtilBatch;
+
+EUtilBatch *	e_util_batch_new		(EUtilBatchFunc func,
+						 gpointer user_data);
+void		e_util_batch_free		(EUtilBatch *batch);
+void		e_util_batch_push		(EUtilBatch *batch,
+						 gpointer job);
+void		e_util_batch_wait		(EUtilBatch *batch);
 gboolean	e_util_is_running_gnome		(void);
 gboolean	e_util_is_running_flatpak	(void);
 void		e_util_set_entry_issue_hint	(GtkWidget *entry,
@@ -25,8 +25,19 @@
 #include "e-table-sorter.h"
 #include "e-table-sorting-utils.h"
 
+#define E_TABLE_SORTER_GET_PRIVATE(obj) \
+	(G_TYPE_INSTANCE_GET_PRIVATE \
+	((obj), E_TYPE_TABLE_SORTER, ETableSorterPrivate))
+
 #define d(x)
 
+typedef struct _ETableSorterPrivate ETableSorterPrivate;
+
+struct _ETableSorterPrivate {
+	/* Extracted sort keys, kept until the model changes. */
+	ETableSortKeys *sort_keys;
+};
+
 enum {
 	PROP_0,
 	PROP_SORT_INFO
@@ -43,54 +54,6 @@ G_DEFINE_TYPE_WITH_CODE (
 		E_TYPE_SORTER,
 		e_table_sorter_interface_init))
 
-struct qsort_data {
-	ETableSorter *table_sorter;
-	gpointer *vals;
-	gint cols;
-	gint *ascending;
-	GCompareDataFunc *compare;
-	gpointer cmp_cache;
-};
-
-/* FIXME: Make it not cache the second and later columns (as if anyone cares.) */
-
-static gint
-qsort_callback (gconstpointer data1,
-                gconstpointer data2,
-                gpointer user_data)
-{
-	struct qsort_data *qd = (struct qsort_data *) user_data;
-	gint row1 = *(gint *) data1;
-	gint row2 = *(gint *) data2;
-	gint j;
-	gint sort_count;
-	gint comp_val = 0;
-	gint ascending = 1;
-
-	sort_count =
-		e_table_sort_info_sorting_get_count (
-			qd->table_sorter->sort_info) +
-		e_table_sort_info_grouping_get_count (
-			qd->table_sorter->sort_info);
-
-	for (j = 0; j < sort_count; j++) {
-		comp_val = (*(qd->compare[j]))(qd->vals[qd->cols * row1 + j], qd->vals[qd->cols * row2 + j], qd->cmp_cache);
-		ascending = qd->ascending[j];
-		if (comp_val != 0)
-			break;
-	}
-	if (comp_val == 0) {
-		if (row1 < row2)
-			comp_val = -1;
-		if (row1 > row2)
-			comp_val = 1;
-	}
-	if (!ascending)
-		comp_val = -comp_val;
-
-	return comp_val;
-}
-
 static void
 table_sorter_clean (ETableSorter *table_sorter)
 {
@@ -103,102 +66,53 @@ table_sorter_clean (ETableSorter *table_sorter)
 	table_sorter->needs_sorting = -1;
 }
 
+static void
+table_sorter_free_sort_keys (ETableSorter *table_sorter)
+{
+	ETableSorterPrivate *priv = E_TABLE_SORTER_GET_PRIVATE (table_sorter);
+
+	if (priv->sort_keys) {
+		e_table_sorting_utils_free_sort_keys (priv->sort_keys);
+		priv->sort_keys = NULL;
+	}
+}
+
 static void
 table_sorter_sort (ETableSorter *table_sorter)
 {
+	ETableSorterPrivate *priv = E_TABLE_SORTER_GET_PRIVATE (table_sorter);
 	gint rows;
 	gint i;
-	gint j;
-	gint cols;
-	gint group_cols;
-	struct qsort_data qd;
 
 	if (table_sorter->sorted)
 		return;
 
 	rows = e_table_model_row_count (table_sorter->source);
-	group_cols = e_table_sort_info_grouping_get_count (table_sorter->sort_info);
-	cols = e_table_sort_info_sorting_get_count (table_sorter->sort_info) + group_cols;
 
 	table_sorter->sorted = g_new (int, rows);
 	for (i = 0; i < rows; i++)
 		table_sorter->sorted[i] = i;
 
-	qd.cols = cols;
-	qd.table_sorter = table_sorter;
+	/* The keys are reused when only the sort direction changed. */
+	if (priv->sort_keys &&
+	    !e_table_sorting_utils_sort_keys_match (
+		priv->sort_keys,
+		table_sorter->sort_info,
+		table_sorter->full_header))
+		table_sorter_free_sort_keys (table_sorter);
 
-	qd.vals = g_new (gpointer , rows * cols);
-	qd.ascending = g_new (int, cols);
-	qd.compare = g_new (GCompareDataFunc, cols);
-	qd.cmp_cache = e_table_sorting_utils_create_cmp_cache ();
-
-	for (j = 0; j < cols; j++) {
-		ETableColumnSpecification *spec;
-		ETableCol *col;
-		GtkSortType sort_type;
-
-		if (j < group_cols)
-			spec = e_table_sort_info_grouping_get_nth (
-				table_sorter->sort_info,
-				j, &sort_type);
-		else
-			spec = e_table_sort_info_sorting_get_nth (
-				table_sorter->sort_info,
-				j - group_cols, &sort_type);
-
-		col = e_table_header_get_column_by_spec (
-			table_sorter->full_header, spec);
-		if (col == NULL) {
-			gint last = e_table_header_count (
-				table_sorter->full_header) - 1;
-			col = e_table_header_get_column (
-				table_sorter->full_header, last);
-		}
-
-		for (i = 0; i < rows; i++) {
-			qd.vals[i * cols + j] = e_table_model_value_at (
-				table_sorter->source,
-				col->spec->model_col, i);
-		}
-
-		qd.compare[j] = col->compare;
-		qd.ascending[j] = (sort_type == GTK_SORT_ASCENDING);
-	}
-
-	g_qsort_with_data (table_sorter->sorted, rows, sizeof (gint), qsort_callback, &qd);
-
-	for (j = 0; j < cols; j++) {
-		ETableColumnSpecification *spec;
-		ETableCol *col;
-		GtkSortType sort_type;
-
-		if (j < group_cols)
-			spec = e_table_sort_info_grouping_get_nth (
-				table_sorter->sort_info,
-				j, &sort_type);
-		else
-			spec = e_table_sort_info_sorting_get_nth (
-				table_sorter->sort_info,
-				j - group_cols, &sort_type);
-
-		col = e_table_header_get_column_by_spec (
-			table_sorter->full_header, spec);
-		if (col == NULL) {
-			gint last = e_table_header_count (
-				table_sorter->full_header) - 1;
-			col = e_table_header_get_column (
-				table_sorter->full_header, last);
-		}
-
-		for (i = 0; i < rows; i++) {
-			e_table_model_free_value (table_sorter->source, col->spec->model_col, qd.vals[i * cols + j]);
-		}
-	}
-
-	g_free (qd.vals);
-	g_free (qd.ascending);
-	g_free (qd.compare);
-	e_table_sorting_utils_free_cmp_cache (qd.cmp_cache);
+	if (!priv->sort_keys)
+		priv->sort_keys = e_table_sorting_utils_create_sort_keys (
+			table_sorter->source,
+			table_sorter->sort_info,
+			table_sorter->full_header,
+			TRUE, table_sorter->sorted, rows);
+
+	e_table_sorting_utils_sort_by_keys (
+		priv->sort_keys,
+		table_sorter->sort_info,
+		table_sorter->full_header,
+		table_sorter->sorted, rows);
 }
 
 static void
@@ -223,6 +137,7 @@ static void
 table_sorter_model_changed_cb (ETableModel *table_model,
                                ETableSorter *table_sorter)
 {
+	table_sorter_free_sort_keys (table_sorter);
 	table_sorter_clean (table_sorter);
 }
 
@@ -231,6 +146,7 @@ table_sorter_model_row_changed_cb (ETableModel *table_model,
                                    gint row,
                                    ETableSorter *table_sorter)
 {
+	table_sorter_free_sort_keys (table_sorter);
 	table_sorter_clean (table_sorter);
 }
 
@@ -240,6 +156,7 @@ table_sorter_model_cell_changed_cb (ETableModel *table_model,
                                     gint row,
                                     ETableSorter *table_sorter)
 {
+	table_sorter_free_sort_keys (table_sorter);
 	table_sorter_clean (table_sorter);
 }
 
@@ -249,6 +166,7 @@ table_sorter_model_rows_inserted_cb (ETableModel *table_model,
                                      gint count,
                                      ETableSorter *table_sorter)
 {
+	table_sorter_free_sort_keys (table_sorter);
 	table_sorter_clean (table_sorter);
 }
 
@@ -258,6 +176,7 @@ table_sorter_model_rows_deleted_cb (ETableModel *table_model,
                                     gint count,
                                     ETableSorter *table_sorter)
 {
+	table_sorter_free_sort_keys (table_sorter);
 	table_sorter_clean (table_sorter);
 }
 
@@ -381,6 +300,7 @@ table_sorter_dispose (GObject *object)
 	g_clear_object (&table_sorter->source);
 
 	table_sorter_clean (table_sorter);
+	table_sorter_free_sort_keys (table_sorter);
 
 	/* Chain up to parent's dispose() method. */
 	G_OBJECT_CLASS (e_table_sorter_parent_class)->dispose (object);
@@ -477,6 +397,8 @@ e_table_sorter_class_init (ETableSorterClass *class)
 {
 	GObjectClass *object_class;
 
+	g_type_class_add_private (class, sizeof (ETableSorterPrivate));
+
 	object_class = G_OBJECT_CLASS (class);
 	object_class->set_property = table_sorter_set_property;
 	object_class->get_property = table_sorter_get_property;
@@ -23,6 +23,7 @@
 
 #include "e-table-sorting-utils.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <camel/camel.h>
 
@@ -83,14 +84,6 @@ etsu_compare (ETableModel *source,
 	return comp_val;
 }
 
-typedef struct {
-	gint cols;
-	gpointer *vals;
-	GtkSortType *sort_type;
-	GCompareDataFunc *compare;
-	gpointer cmp_cache;
-} ETableSortClosure;
-
 typedef struct {
 	ETreeModel *tree;
 	ETableSortInfo *sort_info;
@@ -98,30 +91,323 @@ typedef struct {
 	gpointer cmp_cache;
 } ETreeSortClosure;
 
-/* FIXME: Make it not cache the second and later columns (as if anyone cares.) */
+/* Sort keys are extracted from the model once, into typed arrays,
+ * for the columns using the well known compare functions of the
+ * ETableExtras, thus the sort itself does not call into the model
+ * nor through the compare function pointers for them. */
+typedef enum {
+	ETSU_KEY_GENERIC,	/* any other compare function */
+	ETSU_KEY_INTEGER,	/* "integer", "string-integer", "pointer-integer64" */
+	ETSU_KEY_STRING		/* "string", "collate", "stringcase" */
+} ETSUKeyKind;
+
+typedef struct {
+	ETSUKeyKind kind;
+	ETableCol *col;
+	gint64 *integers;
+	const gchar **strings;
+	gpointer *values;
+} ETSUKeyColumn;
+
+struct _ETableSortKeys {
+	ETableModel *table_source;
+	ETreeModel *tree_source;
+	gboolean with_grouping;
+	gint n_slots;
+	gint n_columns;
+	ETSUKeyColumn *columns;
+	GtkSortType *sort_types;
+	GStringChunk *string_chunk;
+	gpointer cmp_cache;
+};
+
+typedef struct {
+	guint64 key;
+	gint index;
+} ETSURadixItem;
+
+typedef struct {
+	ETableSortKeys *sort_keys;
+	gint *map;
+	gint rows;	/* for merge the count of the first run */
+	gint rows2;	/* for merge the count of the second run */
+	gint *dest;	/* for merge the destination of the runs */
+} ETSUSortJob;
+
+/* Count of rows from which the sort is split between threads;
+ * zero means to never sort in parallel. */
+static guint parallel_sort_threshold = 50000;
+
+/* Do not split the rows to smaller parts than this. */
+#define ETSU_MIN_ROWS_PER_THREAD 8192
+
+static ETableCol *
+etsu_get_nth_column (ETableSortInfo *sort_info,
+                     ETableHeader *full_header,
+                     gboolean with_grouping,
+                     gint nth,
+                     GtkSortType *sort_type)
+{
+	ETableColumnSpecification *spec;
+	ETableCol *col;
+	gint group_cols = 0;
+
+	if (with_grouping)
+		group_cols = e_table_sort_info_grouping_get_count (sort_info);
+
+	if (nth < group_cols)
+		spec = e_table_sort_info_grouping_get_nth (
+			sort_info, nth, sort_type);
+	else
+		spec = e_table_sort_info_sorting_get_nth (
+			sort_info, nth - group_cols, sort_type);
+
+	col = e_table_header_get_column_by_spec (full_header, spec);
+	if (col == NULL) {
+		gint last = e_table_header_count (full_header) - 1;
+		col = e_table_header_get_column (full_header, last);
+	}
+
+	return col;
+}
+
+static gint
+etsu_get_n_columns (ETableSortInfo *sort_info,
+                    gboolean with_grouping)
+{
+	gint n_columns;
+
+	n_columns = e_table_sort_info_sorting_get_count (sort_info);
+
+	if (with_grouping)
+		n_columns += e_table_sort_info_grouping_get_count (sort_info);
+
+	return n_columns;
+}
+
+static ETSUKeyKind
+etsu_get_key_kind (ETableCol *col)
+{
+	const gchar *compare = col->spec->compare;
+
+	if (g_strcmp0 (compare, "integer") == 0 ||
+	    g_strcmp0 (compare, "string-integer") == 0 ||
+	    g_strcmp0 (compare, "pointer-integer64") == 0)
+		return ETSU_KEY_INTEGER;
+
+	if (g_strcmp0 (compare, "string") == 0 ||
+	    g_strcmp0 (compare, "collate") == 0 ||
+	    g_strcmp0 (compare, "stringcase") == 0)
+		return ETSU_KEY_STRING;
+
+	return ETSU_KEY_GENERIC;
+}
+
+static gint64
+etsu_value_to_integer (ETableCol *col,
+                       gconstpointer value)
+{
+	const gchar *compare = col->spec->compare;
+
+	if (g_strcmp0 (compare, "string-integer") == 0)
+		return value ? atoi (value) : 0;
+
+	/* unset values sort before set */
+	if (g_strcmp0 (compare, "pointer-integer64") == 0)
+		return value ? *((const gint64 *) value) : G_MININT64;
+
+	return GPOINTER_TO_INT (value);
+}
+
+static const gchar *
+etsu_value_to_string (ETableCol *col,
+                      gconstpointer value,
+                      GStringChunk *string_chunk)
+{
+	const gchar *compare = col->spec->compare;
+	const gchar *key;
+	gchar *tmp;
+
+	if (value == NULL)
+		return NULL;
+
+	if (g_strcmp0 (compare, "string") == 0)
+		return g_string_chunk_insert (string_chunk, value);
+
+	if (g_strcmp0 (compare, "stringcase") == 0) {
+		gchar *folded;
+
+		folded = g_utf8_casefold (value, -1);
+		tmp = g_utf8_collate_key (folded, -1);
+		g_free (folded);
+	} else {
+		tmp = g_utf8_collate_key (value, -1);
+	}
+
+	key = g_string_chunk_insert (string_chunk, tmp);
+
+	g_free (tmp);
+
+	return key;
+}
+
+static void
+etsu_sort_keys_set_value (ETableSortKeys *sort_keys,
+                          ETSUKeyColumn *column,
+                          gint slot,
+                          gpointer value)
+{
+	switch (column->kind) {
+	case ETSU_KEY_INTEGER:
+		column->integers[slot] = etsu_value_to_integer (column->col, value);
+		break;
+	case ETSU_KEY_STRING:
+		column->strings[slot] = etsu_value_to_string (column->col, value, sort_keys->string_chunk);
+		break;
+	case ETSU_KEY_GENERIC:
+		column->values[slot] = value;
+		/* the value is freed together with the keys */
+		return;
+	}
+
+	if (sort_keys->table_source)
+		e_table_model_free_value (sort_keys->table_source, column->col->spec->compare_col, value);
+	else
+		e_tree_model_free_value (sort_keys->tree_source, column->col->spec->compare_col, value);
+}
+
+static ETableSortKeys *
+etsu_sort_keys_new (ETableSortInfo *sort_info,
+                    ETableHeader *full_header,
+                    gboolean with_grouping,
+                    gint n_slots)
+{
+	ETableSortKeys *sort_keys;
+	gint jj;
+
+	sort_keys = g_new0 (ETableSortKeys, 1);
+	sort_keys->with_grouping = with_grouping;
+	sort_keys->n_slots = n_slots;
+	sort_keys->n_columns = etsu_get_n_columns (sort_info, with_grouping);
+	sort_keys->columns = g_new0 (ETSUKeyColumn, sort_keys->n_columns);
+	sort_keys->sort_types = g_new0 (GtkSortType, sort_keys->n_columns);
+	sort_keys->string_chunk = g_string_chunk_new (4096);
+	sort_keys->cmp_cache = e_table_sorting_utils_create_cmp_cache ();
+
+	for (jj = 0; jj < sort_keys->n_columns; jj++) {
+		ETSUKeyColumn *column = &sort_keys->columns[jj];
+
+		column->col = g_object_ref (etsu_get_nth_column (
+			sort_info, full_header, with_grouping, jj, NULL));
+		column->kind = etsu_get_key_kind (column->col);
+
+		switch (column->kind) {
+		case ETSU_KEY_INTEGER:
+			column->integers = g_new0 (gint64, n_slots);
+			break;
+		case ETSU_KEY_STRING:
+			column->strings = g_new0 (const gchar *, n_slots);
+			break;
+		case ETSU_KEY_GENERIC:
+			column->values = g_new0 (gpointer, n_slots);
+			break;
+		}
+	}
+
+	return sort_keys;
+}
+
+static void
+etsu_sort_keys_free (ETableSortKeys *sort_keys)
+{
+	gint ii, jj;
+
+	if (!sort_keys)
+		return;
+
+	for (jj = 0; jj < sort_keys->n_columns; jj++) {
+		ETSUKeyColumn *column = &sort_keys->columns[jj];
+
+		if (column->values) {
+			gint compare_col = column->col->spec->compare_col;
+
+			for (ii = 0; ii < sort_keys->n_slots; ii++) {
+				if (!column->values[ii])
+					continue;
+
+				if (sort_keys->table_source)
+					e_table_model_free_value (sort_keys->table_source, compare_col, column->values[ii]);
+				else
+					e_tree_model_free_value (sort_keys->tree_source, compare_col, column->values[ii]);
+			}
+		}
+
+		g_free (column->integers);
+		g_free (column->strings);
+		g_free (column->values);
+		g_object_unref (column->col);
+	}
+
+	g_clear_object (&sort_keys->table_source);
+	g_clear_object (&sort_keys->tree_source);
+	g_string_chunk_free (sort_keys->string_chunk);
+	e_table_sorting_utils_free_cmp_cache (sort_keys->cmp_cache);
+	g_free (sort_keys->columns);
+	g_free (sort_keys->sort_types);
+	g_free (sort_keys);
+}
 
 static gint
-e_sort_callback (gconstpointer data1,
-                 gconstpointer data2,
-                 gpointer user_data)
+etsu_compare_strings (const gchar *str1,
+                      const gchar *str2)
 {
+	/* the same as the compare functions, NULL sorts after set */
+	if (str1 == NULL || str2 == NULL) {
+		if (str1 == str2)
+			return 0;
+		else
+			return str1 ? -1 : 1;
+	}
+
+	return strcmp (str1, str2);
+}
+
+static gint
+etsu_sort_keys_compare_cb (gconstpointer data1,
+                           gconstpointer data2,
+                           gpointer user_data)
+{
+	ETableSortKeys *sort_keys = user_data;
 	gint row1 = *(gint *) data1;
 	gint row2 = *(gint *) data2;
-	ETableSortClosure *closure = user_data;
-	gint j;
-	gint sort_count = closure->cols;
+	gint jj;
 	gint comp_val = 0;
 	GtkSortType sort_type = GTK_SORT_ASCENDING;
 
-	for (j = 0; j < sort_count; j++) {
-		comp_val = (*(closure->compare[j])) (
-			closure->vals[closure->cols * row1 + j],
-			closure->vals[closure->cols * row2 + j],
-			closure->cmp_cache);
-		sort_type = closure->sort_type[j];
+	for (jj = 0; jj < sort_keys->n_columns; jj++) {
+		ETSUKeyColumn *column = &sort_keys->columns[jj];
+
+		switch (column->kind) {
+		case ETSU_KEY_INTEGER:
+			comp_val = (column->integers[row1] == column->integers[row2]) ? 0 :
+				(column->integers[row1] < column->integers[row2]) ? -1 : 1;
+			break;
+		case ETSU_KEY_STRING:
+			comp_val = etsu_compare_strings (column->strings[row1], column->strings[row2]);
+			break;
+		case ETSU_KEY_GENERIC:
+			comp_val = (*column->col->compare) (
+				column->values[row1],
+				column->values[row2],
+				sort_keys->cmp_cache);
+			break;
+		}
+
+		sort_type = sort_keys->sort_types[jj];
 		if (comp_val != 0)
 			break;
 	}
+
 	if (comp_val == 0) {
 		if (row1 < row2)
 			comp_val = -1;
@@ -135,76 +421,522 @@ e_sort_callback (gconstpointer data1,
 	return comp_val;
 }
 
-void
-e_table_sorting_utils_sort (ETableModel *source,
-                            ETableSortInfo *sort_info,
-                            ETableHeader *full_header,
-                            gint *map_table,
-                            gint rows)
+/* Stable LSD radix sort of the map by a single integer key; the items
+ * are sorted by their index first, to break ties the same way as the
+ * compare callback does. Passes on bytes shared by all keys are skipped,
+ * which is common for dates and sizes. */
+static void
+etsu_radix_sort (const gint64 *integers,
+                 gint *map,
+                 gint rows)
 {
-	gint total_rows;
-	gint i;
-	gint j;
-	gint cols;
-	ETableSortClosure closure;
+	ETSURadixItem *items, *tmp, *swap;
+	gboolean index_ascending = TRUE;
+	gint first_pass, pass, ii;
 
-	g_return_if_fail (E_IS_TABLE_MODEL (source));
-	g_return_if_fail (E_IS_TABLE_SORT_INFO (sort_info));
-	g_return_if_fail (E_IS_TABLE_HEADER (full_header));
+	items = g_new (ETSURadixItem, rows);
+	tmp = g_new (ETSURadixItem, rows);
 
-	total_rows = e_table_model_row_count (source);
-	cols = e_table_sort_info_sorting_get_count (sort_info);
-	closure.cols = cols;
+	for (ii = 0; ii < rows; ii++) {
+		/* flip the sign bit, to have negative values sorted first */
+		items[ii].key = ((guint64) integers[map[ii]]) ^ G_GUINT64_CONSTANT (0x8000000000000000);
+		items[ii].index = map[ii];
 
-	closure.vals = g_new (gpointer, total_rows * cols);
-	closure.sort_type = g_new (GtkSortType, cols);
-	closure.compare = g_new (GCompareDataFunc, cols);
-	closure.cmp_cache = e_table_sorting_utils_create_cmp_cache ();
+		if (ii > 0 && map[ii - 1] > map[ii])
+			index_ascending = FALSE;
+	}
 
-	for (j = 0; j < cols; j++) {
-		ETableColumnSpecification *spec;
-		ETableCol *col;
+	/* passes 0..3 are for the index, 4..11 for the key */
+	first_pass = index_ascending ? 4 : 0;
 
-		spec = e_table_sort_info_sorting_get_nth (
-			sort_info, j, &closure.sort_type[j]);
+	for (pass = first_pass; pass < 12; pass++) {
+		gsize counts[256];
+		gsize offset = 0;
+		guint bucket;
 
-		col = e_table_header_get_column_by_spec (full_header, spec);
-		if (col == NULL) {
-			gint last = e_table_header_count (full_header) - 1;
-			col = e_table_header_get_column (full_header, last);
-		}
+		#define item_byte(_item) ((pass < 4) ? \
+			((((guint32) (_item).index) >> (pass * 8)) & 0xFF) : \
+			(((_item).key >> ((pass - 4) * 8)) & 0xFF))
+
+		memset (counts, 0, sizeof (counts));
+
+		for (ii = 0; ii < rows; ii++)
+			counts[item_byte (items[ii])]++;
 
-		for (i = 0; i < rows; i++) {
-			closure.vals[map_table[i] * cols + j] = e_table_model_value_at (source, col->spec->compare_col, map_table[i]);
+		/* all items share the byte, nothing to reorder */
+		if (counts[item_byte (items[0])] == rows)
+			continue;
+
+		for (bucket = 0; bucket < 256; bucket++) {
+			gsize count = counts[bucket];
+
+			counts[bucket] = offset;
+			offset += count;
 		}
-		closure.compare[j] = col->compare;
+
+		for (ii = 0; ii < rows; ii++)
+			tmp[counts[item_byte (items[ii])]++] = items[ii];
+
+		#undef item_byte
+
+		swap = items;
+		items = tmp;
+		tmp = swap;
 	}
 
+	for (ii = 0; ii < rows; ii++)
+		map[ii] = items[ii].index;
+
+	g_free (items);
+	g_free (tmp);
+}
+
+static void
+etsu_sort_job_sort_thread (gpointer data,
+                           gpointer user_data)
+{
+	ETSUSortJob *job = data;
+
 	g_qsort_with_data (
-		map_table, rows, sizeof (gint), e_sort_callback, &closure);
+		job->map, job->rows, sizeof (gint),
+		etsu_sort_keys_compare_cb, job->sort_keys);
+}
 
-	for (j = 0; j < cols; j++) {
-		ETableColumnSpecification *spec;
-		ETableCol *col;
+static void
+etsu_sort_job_merge_thread (gpointer data,
+                            gpointer user_data)
+{
+	ETSUSortJob *job = data;
+	const gint *run1 = job->map, *run2 = job->map + job->rows;
+	const gint *end1 = run2, *end2 = run2 + job->rows2;
+	gint *dest = job->dest;
+
+	/* the compare callback breaks ties, thus it's never 0 */
+	while (run1 < end1 && run2 < end2) {
+		if (etsu_sort_keys_compare_cb (run1, run2, job->sort_keys) < 0)
+			*dest++ = *run1++;
+		else
+			*dest++ = *run2++;
+	}
 
-		spec = e_table_sort_info_sorting_get_nth (
-			sort_info, j, &closure.sort_type[j]);
+	if (run1 < end1)
+		memcpy (dest, run1, (end1 - run1) * sizeof (gint));
+	else if (run2 < end2)
+		memcpy (dest, run2, (end2 - run2) * sizeof (gint));
+}
 
-		col = e_table_header_get_column_by_spec (full_header, spec);
-		if (col == NULL) {
-			gint last = e_table_header_count (full_header) - 1;
-			col = e_table_header_get_column (full_header, last);
+typedef struct {
+	volatile gint ref_count;
+	ETSUSortJob *jobs;
+	gint n_jobs;
+	volatile gint next_index;
+	GFunc func;
+	GMutex lock;
+	GCond cond;
+	gint n_running;
+	gboolean closed;
+} ETSUSortRun;
+
+static void
+etsu_sort_run_unref (ETSUSortRun *run)
+{
+	if (g_atomic_int_dec_and_test (&run->ref_count)) {
+		g_mutex_clear (&run->lock);
+		g_cond_clear (&run->cond);
+		g_slice_free (ETSUSortRun, run);
+	}
+}
+
+static void
+etsu_sort_run_work (ETSUSortRun *run)
+{
+	gint index;
+
+	while (TRUE) {
+		index = g_atomic_int_add (&run->next_index, 1);
+		if (index >= run->n_jobs)
+			break;
+
+		run->func (&run->jobs[index], NULL);
+	}
+}
+
+static void
+etsu_sort_run_helper_thread (gpointer data,
+                             gpointer user_data)
+{
+	ETSUSortRun *run = data;
+	gboolean closed;
+
+	/* The caller does not wait for helpers, which did not start
+	 * before it ran out of jobs itself. */
+	g_mutex_lock (&run->lock);
+	closed = run->closed;
+	if (!closed)
+		run->n_running++;
+	g_mutex_unlock (&run->lock);
+
+	if (!closed) {
+		etsu_sort_run_work (run);
+
+		g_mutex_lock (&run->lock);
+		run->n_running--;
+		g_cond_signal (&run->cond);
+		g_mutex_unlock (&run->lock);
+	}
+
+	etsu_sort_run_unref (run);
+}
+
+static GThreadPool *
+etsu_sort_get_pool (void)
+{
+	static gsize pool = 0;
+
+	if (g_once_init_enter (&pool)) {
+		GThreadPool *tmp;
+
+		tmp = g_thread_pool_new (
+			etsu_sort_run_helper_thread, NULL,
+			MAX (g_get_num_processors () - 1, 1),
+			FALSE, NULL);
+
+		g_once_init_leave (&pool, GPOINTER_TO_SIZE (tmp));
+	}
+
+	return GSIZE_TO_POINTER (pool);
+}
+
+/* Runs the jobs in the sorting thread pool and in the calling thread.
+ * The calling thread takes the jobs not started yet, thus it never
+ * waits for anything else than the jobs already running. */
+static void
+etsu_run_sort_jobs (ETSUSortJob *jobs,
+                    gint n_jobs,
+                    GFunc func)
+{
+	ETSUSortRun *run;
+	GThreadPool *pool;
+	gint ii;
+
+	run = g_slice_new0 (ETSUSortRun);
+	run->ref_count = 1;
+	run->jobs = jobs;
+	run->n_jobs = n_jobs;
+	run->next_index = 0;
+	run->func = func;
+	g_mutex_init (&run->lock);
+	g_cond_init (&run->cond);
+
+	pool = etsu_sort_get_pool ();
+
+	for (ii = 1; ii < n_jobs && pool; ii++) {
+		g_atomic_int_inc (&run->ref_count);
+
+		if (!g_thread_pool_push (pool, run, NULL)) {
+			g_atomic_int_add (&run->ref_count, -1);
+			break;
 		}
+	}
+
+	etsu_sort_run_work (run);
+
+	g_mutex_lock (&run->lock);
+	run->closed = TRUE;
+	while (run->n_running > 0)
+		g_cond_wait (&run->cond, &run->lock);
+	g_mutex_unlock (&run->lock);
+
+	etsu_sort_run_unref (run);
+}
+
+/* Sorts parts of the map in parallel, then merges the sorted runs,
+ * also in parallel, until there is only one. */
+static void
+etsu_parallel_sort (ETableSortKeys *sort_keys,
+                    gint *map,
+                    gint rows,
+                    gint n_parts)
+{
+	ETSUSortJob *jobs;
+	gint *offsets, *buffer, *src, *dest;
+	gint ii, n_runs;
 
-		for (i = 0; i < rows; i++) {
-			e_table_model_free_value (source, col->spec->compare_col, closure.vals[map_table[i] * cols + j]);
+	jobs = g_new0 (ETSUSortJob, n_parts);
+	offsets = g_new (gint, n_parts + 1);
+
+	for (ii = 0; ii <= n_parts; ii++)
+		offsets[ii] = (gint) (((gint64) rows) * ii / n_parts);
+
+	for (ii = 0; ii < n_parts; ii++) {
+		jobs[ii].sort_keys = sort_keys;
+		jobs[ii].map = map + offsets[ii];
+		jobs[ii].rows = offsets[ii + 1] - offsets[ii];
+	}
+
+	etsu_run_sort_jobs (jobs, n_parts, etsu_sort_job_sort_thread);
+
+	buffer = g_new (gint, rows);
+	src = map;
+	dest = buffer;
+
+	for (n_runs = n_parts; n_runs > 1; n_runs = (n_runs + 1) / 2) {
+		gint n_jobs = 0, *tmp;
+
+		for (ii = 0; ii < n_runs; ii += 2) {
+			ETSUSortJob *job = &jobs[n_jobs++];
+
+			job->sort_keys = sort_keys;
+			job->map = src + offsets[ii];
+			job->rows = offsets[ii + 1] - offsets[ii];
+			/* an odd run is only copied */
+			job->rows2 = (ii + 1 < n_runs) ? offsets[ii + 2] - offsets[ii + 1] : 0;
+			job->dest = dest + offsets[ii];
 		}
+
+		etsu_run_sort_jobs (jobs, n_jobs, etsu_sort_job_merge_thread);
+
+		for (ii = 0; ii < n_jobs; ii++)
+			offsets[ii] = offsets[2 * ii];
+		offsets[n_jobs] = rows;
+
+		tmp = src;
+		src = dest;
+		dest = tmp;
 	}
 
-	g_free (closure.vals);
-	g_free (closure.sort_type);
-	g_free (closure.compare);
-	e_table_sorting_utils_free_cmp_cache (closure.cmp_cache);
+	if (src != map)
+		memcpy (map, src, rows * sizeof (gint));
+
+	g_free (buffer);
+	g_free (offsets);
+	g_free (jobs);
+}
+
+static gint
+etsu_sort_keys_get_n_parallel_parts (ETableSortKeys *sort_keys,
+                                     gint rows)
+{
+	gint jj, n_parts;
+
+	if (!parallel_sort_threshold || (guint) rows < parallel_sort_threshold)
+		return 1;
+
+	/* the generic compare functions can use the shared cmp_cache
+	 * and call into code which is not thread safe */
+	for (jj = 0; jj < sort_keys->n_columns; jj++) {
+		if (sort_keys->columns[jj].kind == ETSU_KEY_GENERIC)
+			return 1;
+	}
+
+	n_parts = MIN (g_get_num_processors (), rows / ETSU_MIN_ROWS_PER_THREAD);
+
+	return MAX (n_parts, 1);
+}
+
+static void
+etsu_sort_keys_sort (ETableSortKeys *sort_keys,
+                     ETableSortInfo *sort_info,
+                     ETableHeader *full_header,
+                     gint *map,
+                     gint rows)
+{
+	gint jj;
+
+	/* the keys do not depend on the sort direction, read it always */
+	for (jj = 0; jj < sort_keys->n_columns; jj++)
+		etsu_get_nth_column (sort_info, full_header, sort_keys->with_grouping, jj, &sort_keys->sort_types[jj]);
+
+	if (rows <= 1)
+		return;
+
+	if (sort_keys->n_columns == 1 && sort_keys->columns[0].kind == ETSU_KEY_INTEGER) {
+		etsu_radix_sort (sort_keys->columns[0].integers, map, rows);
+
+		/* the compare callback negates also the tie break, thus
+		 * the reversed ascending order is the descending order */
+		if (sort_keys->sort_types[0] == GTK_SORT_DESCENDING) {
+			gint ii;
+
+			for (ii = 0; ii < rows / 2; ii++) {
+				gint tmp = map[ii];
+
+				map[ii] = map[rows - ii - 1];
+				map[rows - ii - 1] = tmp;
+			}
+		}
+	} else {
+		gint n_parts;
+
+		n_parts = etsu_sort_keys_get_n_parallel_parts (sort_keys, rows);
+
+		if (n_parts > 1)
+			etsu_parallel_sort (sort_keys, map, rows, n_parts);
+		else
+			g_qsort_with_data (
+				map, rows, sizeof (gint), etsu_sort_keys_compare_cb, sort_keys);
+	}
+}
+
+/**
+ * e_table_sorting_utils_create_sort_keys:
+ * @source: an #ETableModel
+ * @sort_info: an #ETableSortInfo
+ * @full_header: an #ETableHeader
+ * @with_grouping: whether to include the grouping columns of the @sort_info
+ * @map_table: (array length=rows): model rows to extract the keys for
+ * @rows: count of items in the @map_table
+ *
+ * Extracts sort keys of the @map_table rows for the columns the @sort_info
+ * sorts by, thus the rows can be sorted without calling into the @source.
+ * The keys do not depend on the sort direction, thus they can be reused
+ * for sorting by the same columns in the other direction, until
+ * the @source changes.
+ *
+ * Returned pointer should be freed with
+ * e_table_sorting_utils_free_sort_keys().
+ *
+ * Returns: (transfer full): newly created sort keys
+ *
+ * Since: 3.38
+ **/
+ETableSortKeys *
+e_table_sorting_utils_create_sort_keys (ETableModel *source,
+                                        ETableSortInfo *sort_info,
+                                        ETableHeader *full_header,
+                                        gboolean with_grouping,
+                                        const gint *map_table,
+                                        gint rows)
+{
+	ETableSortKeys *sort_keys;
+	gint ii, jj;
+
+	g_return_val_if_fail (E_IS_TABLE_MODEL (source), NULL);
+	g_return_val_if_fail (E_IS_TABLE_SORT_INFO (sort_info), NULL);
+	g_return_val_if_fail (E_IS_TABLE_HEADER (full_header), NULL);
+
+	sort_keys = etsu_sort_keys_new (
+		sort_info, full_header, with_grouping,
+		e_table_model_row_count (source));
+	sort_keys->table_source = g_object_ref (source);
+
+	for (jj = 0; jj < sort_keys->n_columns; jj++) {
+		ETSUKeyColumn *column = &sort_keys->columns[jj];
+
+		for (ii = 0; ii < rows; ii++) {
+			etsu_sort_keys_set_value (sort_keys, column, map_table[ii],
+				e_table_model_value_at (source, column->col->spec->compare_col, map_table[ii]));
+		}
+	}
+
+	return sort_keys;
+}
+
+/**
+ * e_table_sorting_utils_sort_keys_match:
+ * @sort_keys: sort keys created by e_table_sorting_utils_create_sort_keys()
+ * @sort_info: an #ETableSortInfo
+ * @full_header: an #ETableHeader
+ *
+ * Checks whether the @sort_keys can be used to sort by the @sort_info,
+ * which is when it sorts by the same columns as it did when the keys
+ * had been created, regardless of the sort direction.
+ *
+ * Returns: whether the @sort_keys can be used with the @sort_info
+ *
+ * Since: 3.38
+ **/
+gboolean
+e_table_sorting_utils_sort_keys_match (ETableSortKeys *sort_keys,
+                                       ETableSortInfo *sort_info,
+                                       ETableHeader *full_header)
+{
+	gint jj;
+
+	g_return_val_if_fail (sort_keys != NULL, FALSE);
+	g_return_val_if_fail (E_IS_TABLE_SORT_INFO (sort_info), FALSE);
+	g_return_val_if_fail (E_IS_TABLE_HEADER (full_header), FALSE);
+
+	if (sort_keys->table_source && sort_keys->n_slots != e_table_model_row_count (sort_keys->table_source))
+		return FALSE;
+
+	if (sort_keys->n_columns != etsu_get_n_columns (sort_info, sort_keys->with_grouping))
+		return FALSE;
+
+	for (jj = 0; jj < sort_keys->n_columns; jj++) {
+		if (sort_keys->columns[jj].col != etsu_get_nth_column (sort_info, full_header, sort_keys->with_grouping, jj, NULL))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * e_table_sorting_utils_sort_by_keys:
+ * @sort_keys: sort keys created by e_table_sorting_utils_create_sort_keys()
+ * @sort_info: an #ETableSortInfo
+ * @full_header: an #ETableHeader
+ * @map_table: (array length=rows): model rows to sort
+ * @rows: count of items in the @map_table
+ *
+ * Sorts the @map_table, the same way as e_table_sorting_utils_sort() does,
+ * only using the pre-extracted @sort_keys. The @sort_keys should match
+ * the @sort_info, as checked by e_table_sorting_utils_sort_keys_match(),
+ * and contain keys for all the rows of the @map_table.
+ *
+ * Since: 3.38
+ **/
+void
+e_table_sorting_utils_sort_by_keys (ETableSortKeys *sort_keys,
+                                    ETableSortInfo *sort_info,
+                                    ETableHeader *full_header,
+                                    gint *map_table,
+                                    gint rows)
+{
+	g_return_if_fail (sort_keys != NULL);
+	g_return_if_fail (E_IS_TABLE_SORT_INFO (sort_info));
+	g_return_if_fail (E_IS_TABLE_HEADER (full_header));
+
+	etsu_sort_keys_sort (sort_keys, sort_info, full_header, map_table, rows);
+}
+
+/**
+ * e_table_sorting_utils_free_sort_keys:
+ * @sort_keys: sort keys created by e_table_sorting_utils_create_sort_keys()
+ *
+ * Frees the sort keys previously created with
+ * e_table_sorting_utils_create_sort_keys().
+ *
+ * Since: 3.38
+ **/
+void
+e_table_sorting_utils_free_sort_keys (ETableSortKeys *sort_keys)
+{
+	g_return_if_fail (sort_keys != NULL);
+
+	etsu_sort_keys_free (sort_keys);
+}
+
+void
+e_table_sorting_utils_sort (ETableModel *source,
+                            ETableSortInfo *sort_info,
+                            ETableHeader *full_header,
+                            gint *map_table,
+                            gint rows)
+{
+	gpointer sort_keys;
+
+	g_return_if_fail (E_IS_TABLE_MODEL (source));
+	g_return_if_fail (E_IS_TABLE_SORT_INFO (sort_info));
+	g_return_if_fail (E_IS_TABLE_HEADER (full_header));
+
+	sort_keys = e_table_sorting_utils_create_sort_keys (
+		source, sort_info, full_header, FALSE, map_table, rows);
+
+	e_table_sorting_utils_sort_by_keys (
+		sort_keys, sort_info, full_header, map_table, rows);
+
+	e_table_sorting_utils_free_sort_keys (sort_keys);
 }
 
 gboolean
@@ -357,8 +1089,7 @@ e_table_sorting_utils_tree_sort (ETreeModel *source,
                                  ETreePath *map_table,
                                  gint count)
 {
-	ETableSortClosure closure;
-	gint cols;
+	ETableSortKeys *sort_keys;
 	gint i, j;
 	gint *map;
 	ETreePath *map_copy;
@@ -367,31 +1098,16 @@ e_table_sorting_utils_tree_sort (ETreeModel *source,
 	g_return_if_fail (E_IS_TABLE_SORT_INFO (sort_info));
 	g_return_if_fail (E_IS_TABLE_HEADER (full_header));
 
-	cols = e_table_sort_info_sorting_get_count (sort_info);
-	closure.cols = cols;
-
-	closure.vals = g_new (gpointer , count * cols);
-	closure.sort_type = g_new (GtkSortType, cols);
-	closure.compare = g_new (GCompareDataFunc, cols);
-	closure.cmp_cache = e_table_sorting_utils_create_cmp_cache ();
+	sort_keys = etsu_sort_keys_new (sort_info, full_header, FALSE, count);
+	sort_keys->tree_source = g_object_ref (source);
 
-	for (j = 0; j < cols; j++) {
-		ETableColumnSpecification *spec;
-		ETableCol *col;
-
-		spec = e_table_sort_info_sorting_get_nth (
-			sort_info, j, &closure.sort_type[j]);
-
-		col = e_table_header_get_column_by_spec (full_header, spec);
-		if (col == NULL) {
-			gint last = e_table_header_count (full_header) - 1;
-			col = e_table_header_get_column (full_header, last);
-		}
+	for (j = 0; j < sort_keys->n_columns; j++) {
+		ETSUKeyColumn *column = &sort_keys->columns[j];
 
 		for (i = 0; i < count; i++) {
-			closure.vals[i * cols + j] = e_tree_model_sort_value_at (source, map_table[i], col->spec->compare_col);
+			etsu_sort_keys_set_value (sort_keys, column, i,
+				e_tree_model_sort_value_at (source, map_table[i], column->col->spec->compare_col));
 		}
-		closure.compare[j] = col->compare;
 	}
 
 	map = g_new (int, count);
@@ -399,8 +1115,7 @@ e_table_sorting_utils_tree_sort (ETreeModel *source,
 		map[i] = i;
 	}
 
-	g_qsort_with_data (
-		map, count, sizeof (gint), e_sort_callback, &closure);
+	etsu_sort_keys_sort (sort_keys, sort_info, full_header, map, count);
 
 	map_copy = g_new (ETreePath, count);
 	for (i = 0; i < count; i++) {
@@ -410,31 +1125,10 @@ e_table_sorting_utils_tree_sort (ETreeModel *source,
 		map_table[i] = map_copy[map[i]];
 	}
 
-	for (j = 0; j < cols; j++) {
-		ETableColumnSpecification *spec;
-		ETableCol *col;
-
-		spec = e_table_sort_info_sorting_get_nth (
-			sort_info, j, &closure.sort_type[j]);
-
-		col = e_table_header_get_column_by_spec (full_header, spec);
-		if (col == NULL) {
-			gint last = e_table_header_count (full_header) - 1;
-			col = e_table_header_get_column (full_header, last);
-		}
-
-		for (i = 0; i < count; i++) {
-			e_tree_model_free_value (source, col->spec->compare_col, closure.vals[i * cols + j]);
-		}
-	}
-
 	g_free (map);
 	g_free (map_copy);
 
-	g_free (closure.vals);
-	g_free (closure.sort_type);
-	g_free (closure.compare);
-	e_table_sorting_utils_free_cmp_cache (closure.cmp_cache);
+	etsu_sort_keys_free (sort_keys);
 }
 
 /* FIXME: This could be done in time log n instead of time n with a binary search. */
@@ -495,6 +1189,37 @@ e_table_sorting_utils_tree_insert (ETreeModel *source,
 	return end;
 }
 
+/**
+ * e_table_sorting_utils_set_parallel_sort_threshold:
+ * @rows: count of rows, or 0
+ *
+ * Sets the count of rows from which the sorting functions split
+ * the sort between several threads, when the columns to sort by
+ * allow it. Setting 0 disables the parallel sort.
+ *
+ * Since: 3.38
+ **/
+void
+e_table_sorting_utils_set_parallel_sort_threshold (guint rows)
+{
+	parallel_sort_threshold = rows;
+}
+
+/**
+ * e_table_sorting_utils_get_parallel_sort_threshold:
+ *
+ * Returns: the count of rows from which the sorting functions split
+ *    the sort between several threads, or 0 when it is disabled;
+ *    see e_table_sorting_utils_set_parallel_sort_threshold()
+ *
+ * Since: 3.38
+ **/
+guint
+e_table_sorting_utils_get_parallel_sort_threshold (void)
+{
+	return parallel_sort_threshold;
+}
+
 /**
  * e_table_sorting_utils_create_cmp_cache:
  *
@@ -33,6 +33,16 @@
 
 G_BEGIN_DECLS
 
+/**
+ * ETableSortKeys:
+ *
+ * Opaque sort keys, extracted from an #ETableModel by
+ * e_table_sorting_utils_create_sort_keys().
+ *
+ * Since: 3.38
+ **/
+typedef struct _ETableSortKeys ETableSortKeys;
+
 gboolean	e_table_sorting_utils_affects_sort
 						(ETableSortInfo *sort_info,
 						 ETableHeader *full_header,
@@ -77,6 +87,32 @@ gint		e_table_sorting_utils_tree_insert
 						 gint count,
 						 ETreePath path);
 
+ETableSortKeys *
+		e_table_sorting_utils_create_sort_keys
+						(ETableModel *source,
+						 ETableSortInfo *sort_info,
+						 ETableHeader *full_header,
+						 gboolean with_grouping,
+						 const gint *map_table,
+						 gint rows);
+gboolean	e_table_sorting_utils_sort_keys_match
+						(ETableSortKeys *sort_keys,
+						 ETableSortInfo *sort_info,
+						 ETableHeader *full_header);
+void		e_table_sorting_utils_sort_by_keys
+						(ETableSortKeys *sort_keys,
+						 ETableSortInfo *sort_info,
+						 ETableHeader *full_header,
+						 gint *map_table,
+						 gint rows);
+void		e_table_sorting_utils_free_sort_keys
+						(ETableSortKeys *sort_keys);
+
+void		e_table_sorting_utils_set_parallel_sort_threshold
+						(guint rows);
+guint		e_table_sorting_utils_get_parallel_sort_threshold
+						(void);
+
 gpointer	e_table_sorting_utils_create_cmp_cache
 						(void);
 void		e_table_sorting_utils_free_cmp_cache
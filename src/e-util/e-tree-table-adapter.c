@@ -42,17 +42,23 @@
 
 #define d(x)
 
-#define INCREMENT_AMOUNT 100
+typedef struct _node_t node_t;
 
-typedef struct {
+struct _node_t {
 	ETreePath path;
 	guint32 num_visible_children;
-	guint32 index;
+
+	/* position in the row map, see map_merge() */
+	node_t *map_parent;
+	node_t *map_left;
+	node_t *map_right;
+	guint32 map_size;
+	guint32 map_priority;
 
 	guint expanded : 1;
 	guint expandable : 1;
 	guint expandable_set : 1;
-} node_t;
+};
 
 struct _ETreeTableAdapterPrivate {
 	ETreeModel *source_model;
@@ -71,15 +77,12 @@ struct _ETreeTableAdapterPrivate {
 	ETableHeader *header;
 
 	gint n_map;
-	gint n_vals_allocated;
-	node_t **map_table;
+	node_t *map_root;
+	guint32 map_seed;
 	GHashTable *nodes;
 	GNode *root;
 
 	guint root_visible : 1;
-	guint remap_needed : 1;
-
-	gint last_access;
 
 	guint resort_idle_id;
 
@@ -127,54 +130,304 @@ lookup_gnode (ETreeTableAdapter *etta,
 	return gnode;
 }
 
-static void
-resize_map (ETreeTableAdapter *etta,
-            gint size)
+/* The visible rows are kept in an implicit treap threaded through the
+ * node_t structures themselves.  Every map node knows the size of its
+ * subtree, thus both row -> node and node -> row are O(log n) and a run
+ * of rows can be inserted or removed without touching the rest. */
+
+static guint32
+map_next_priority (ETreeTableAdapter *etta)
+{
+	guint32 x = etta->priv->map_seed;
+
+	/* xorshift32; the priorities need to be random, not secure */
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	etta->priv->map_seed = x;
+
+	return x;
+}
+
+static inline guint32
+map_size (node_t *node)
 {
-	if (size > etta->priv->n_vals_allocated) {
-		etta->priv->n_vals_allocated = MAX (etta->priv->n_vals_allocated + INCREMENT_AMOUNT, size);
-		etta->priv->map_table = g_renew (node_t *, etta->priv->map_table, etta->priv->n_vals_allocated);
+	return node ? node->map_size : 0;
+}
+
+static inline void
+map_update (node_t *node)
+{
+	node->map_size = 1 + map_size (node->map_left) + map_size (node->map_right);
+
+	if (node->map_left)
+		node->map_left->map_parent = node;
+	if (node->map_right)
+		node->map_right->map_parent = node;
+}
+
+static node_t *
+map_merge (node_t *left,
+           node_t *right)
+{
+	if (!left)
+		return right;
+	if (!right)
+		return left;
+
+	if (left->map_priority > right->map_priority) {
+		left->map_right = map_merge (left->map_right, right);
+		map_update (left);
+		return left;
 	}
 
-	etta->priv->n_map = size;
+	right->map_left = map_merge (left, right->map_left);
+	map_update (right);
+	return right;
 }
 
+/* Splits @node into the first @count rows and the rest */
 static void
-move_map_elements (ETreeTableAdapter *etta,
-                   gint to,
-                   gint from,
-                   gint count)
+map_split (node_t *node,
+           guint32 count,
+           node_t **left,
+           node_t **right)
 {
-	if (count <= 0 || from >= etta->priv->n_map)
+	guint32 left_size;
+
+	if (!node) {
+		*left = NULL;
+		*right = NULL;
 		return;
-	memmove (etta->priv->map_table + to, etta->priv->map_table + from, count * sizeof (node_t *));
-	etta->priv->remap_needed = TRUE;
+	}
+
+	left_size = map_size (node->map_left);
+
+	if (left_size < count) {
+		map_split (node->map_right, count - left_size - 1, &node->map_right, right);
+		map_update (node);
+		*left = node;
+	} else {
+		map_split (node->map_left, count, left, &node->map_left);
+		map_update (node);
+		*right = node;
+	}
 }
 
-static gint
-fill_map (ETreeTableAdapter *etta,
-          gint index,
-          GNode *gnode)
+static void
+map_set_root (ETreeTableAdapter *etta,
+              node_t *root)
+{
+	if (root)
+		root->map_parent = NULL;
+
+	etta->priv->map_root = root;
+	etta->priv->n_map = map_size (root);
+}
+
+static void
+map_clear (ETreeTableAdapter *etta)
+{
+	map_set_root (etta, NULL);
+}
+
+static void
+collect_map_nodes (ETreeTableAdapter *etta,
+                   GNode *gnode,
+                   gboolean with_self,
+                   GPtrArray *nodes)
 {
 	GNode *p;
 
-	if ((gnode != etta->priv->root) || etta->priv->root_visible)
-		etta->priv->map_table[index++] = gnode->data;
+	if (gnode == etta->priv->root && !etta->priv->root_visible) {
+		/* drop any stale link, to not be found in the map */
+		((node_t *) gnode->data)->map_parent = NULL;
+	} else if (with_self) {
+		g_ptr_array_add (nodes, gnode->data);
+	}
 
 	for (p = gnode->children; p; p = p->next)
-		index = fill_map (etta, index, p);
+		collect_map_nodes (etta, p, TRUE, nodes);
+}
+
+/* Builds a treap of @nodes, in the given order, in linear time */
+static node_t *
+map_build (ETreeTableAdapter *etta,
+           GPtrArray *nodes)
+{
+	node_t **spine, *root;
+	guint ii, n_spine = 0;
+
+	if (!nodes->len)
+		return NULL;
+
+	spine = g_new (node_t *, nodes->len);
+
+	for (ii = 0; ii < nodes->len; ii++) {
+		node_t *node = nodes->pdata[ii], *last = NULL;
+
+		node->map_priority = map_next_priority (etta);
+		node->map_parent = NULL;
+		node->map_left = NULL;
+		node->map_right = NULL;
+
+		/* a node leaving the right spine has its subtree complete */
+		while (n_spine > 0 && spine[n_spine - 1]->map_priority < node->map_priority) {
+			last = spine[--n_spine];
+			map_update (last);
+		}
+
+		node->map_left = last;
+		if (n_spine > 0)
+			spine[n_spine - 1]->map_right = node;
+
+		spine[n_spine++] = node;
+	}
+
+	while (n_spine > 0)
+		map_update (spine[--n_spine]);
+
+	root = spine[0];
 
-	etta->priv->remap_needed = TRUE;
-	return index;
+	g_free (spine);
+
+	return root;
 }
 
+/* Rebuilds the whole map from the node tree */
 static void
-remap_indices (ETreeTableAdapter *etta)
+map_fill (ETreeTableAdapter *etta)
 {
-	gint i;
-	for (i = 0; i < etta->priv->n_map; i++)
-		etta->priv->map_table[i]->index = i;
-	etta->priv->remap_needed = FALSE;
+	GPtrArray *nodes;
+
+	if (!etta->priv->root) {
+		map_clear (etta);
+		return;
+	}
+
+	nodes = g_ptr_array_sized_new (etta->priv->n_map + 1);
+	collect_map_nodes (etta, etta->priv->root, TRUE, nodes);
+	map_set_root (etta, map_build (etta, nodes));
+	g_ptr_array_free (nodes, TRUE);
+}
+
+/* Inserts visible rows of @gnode at @row; returns how many rows were added */
+static gint
+map_insert_subtree (ETreeTableAdapter *etta,
+                    gint row,
+                    GNode *gnode,
+                    gboolean with_self)
+{
+	GPtrArray *nodes;
+	node_t *left, *right;
+	gint count;
+
+	nodes = g_ptr_array_new ();
+	collect_map_nodes (etta, gnode, with_self, nodes);
+	count = nodes->len;
+
+	if (count > 0) {
+		map_split (etta->priv->map_root, row, &left, &right);
+		if (left)
+			left->map_parent = NULL;
+		if (right)
+			right->map_parent = NULL;
+
+		map_set_root (etta, map_merge (map_merge (left, map_build (etta, nodes)), right));
+	}
+
+	g_ptr_array_free (nodes, TRUE);
+
+	return count;
+}
+
+/* Drops the map links of @node and its map subtree, thus the nodes
+ * cannot reach the map anymore, even when inserted again later */
+static void
+map_detach (node_t *node)
+{
+	while (node) {
+		node_t *right = node->map_right;
+
+		map_detach (node->map_left);
+
+		node->map_parent = NULL;
+		node->map_left = NULL;
+		node->map_right = NULL;
+		node->map_size = 1;
+
+		node = right;
+	}
+}
+
+/* The removed nodes are not freed, that is done by kill_gnode(),
+ * which should be called only after the rows are gone from the map. */
+static void
+map_delete_rows (ETreeTableAdapter *etta,
+                 gint row,
+                 gint count)
+{
+	node_t *left, *middle, *right;
+
+	if (count <= 0 || row < 0 || row >= etta->priv->n_map)
+		return;
+
+	map_split (etta->priv->map_root, row, &left, &right);
+	if (right)
+		right->map_parent = NULL;
+	map_split (right, count, &middle, &right);
+	if (left)
+		left->map_parent = NULL;
+	if (right)
+		right->map_parent = NULL;
+
+	map_detach (middle);
+
+	map_set_root (etta, map_merge (left, right));
+}
+
+static gint
+map_row_of_node (ETreeTableAdapter *etta,
+                 node_t *node)
+{
+	node_t *top;
+	gint row;
+
+	row = map_size (node->map_left);
+
+	for (top = node; top->map_parent; top = top->map_parent) {
+		if (top == top->map_parent->map_right)
+			row += map_size (top->map_parent->map_left) + 1;
+	}
+
+	/* not shown, like the invisible root node */
+	if (top != etta->priv->map_root)
+		return -1;
+
+	return row;
+}
+
+static node_t *
+map_node_at_row (ETreeTableAdapter *etta,
+                 gint row)
+{
+	node_t *node = etta->priv->map_root;
+	guint32 index = row;
+
+	while (node) {
+		guint32 left_size = map_size (node->map_left);
+
+		if (index < left_size) {
+			node = node->map_left;
+		} else if (index == left_size) {
+			break;
+		} else {
+			index -= left_size + 1;
+			node = node->map_right;
+		}
+	}
+
+	return node;
 }
 
 static node_t *
@@ -189,24 +442,59 @@ get_node (ETreeTableAdapter *etta,
 	return (node_t *) gnode->data;
 }
 
+/* The sort info to order the children of @gnode with,
+ * or NULL when the children are not sorted */
+static ETableSortInfo *
+get_children_sort_info (ETreeTableAdapter *etta,
+                        GNode *gnode)
+{
+	gint i;
+
+	if (!etta->priv->sort_info || !etta->priv->header ||
+	    e_table_sort_info_sorting_get_count (etta->priv->sort_info) <= 0)
+		return NULL;
+
+	if (!etta->priv->sort_children_ascending || !gnode->parent)
+		return etta->priv->sort_info;
+
+	if (!etta->priv->children_sort_info) {
+		gint len;
+
+		etta->priv->children_sort_info = e_table_sort_info_duplicate (etta->priv->sort_info);
+
+		len = e_table_sort_info_sorting_get_count (etta->priv->children_sort_info);
+
+		for (i = 0; i < len; i++) {
+			ETableColumnSpecification *spec;
+			GtkSortType sort_type;
+
+			spec = e_table_sort_info_sorting_get_nth (etta->priv->children_sort_info, i, &sort_type);
+			if (spec) {
+				if (sort_type == GTK_SORT_DESCENDING)
+					e_table_sort_info_sorting_set_nth (etta->priv->children_sort_info, i, spec, GTK_SORT_ASCENDING);
+			}
+		}
+	}
+
+	return etta->priv->children_sort_info;
+}
+
 static void
 resort_node (ETreeTableAdapter *etta,
              GNode *gnode,
              gboolean recurse)
 {
 	node_t *node = (node_t *) gnode->data;
+	ETableSortInfo *use_sort_info;
 	ETreePath *paths, path;
 	GNode *prev, *curr;
 	gint i, count;
-	gboolean sort_needed;
 
 	g_return_if_fail (node != NULL);
 
 	if (node->num_visible_children == 0)
 		return;
 
-	sort_needed = etta->priv->sort_info && e_table_sort_info_sorting_get_count (etta->priv->sort_info) > 0;
-
 	for (i = 0, path = e_tree_model_node_get_first_child (etta->priv->source_model, node->path); path;
 	     path = e_tree_model_node_get_next (etta->priv->source_model, path), i++);
 
@@ -220,36 +508,9 @@ resort_node (ETreeTableAdapter *etta,
 	     path = e_tree_model_node_get_next (etta->priv->source_model, path), i++)
 		paths[i] = path;
 
-	if (count > 1 && sort_needed) {
-		ETableSortInfo *use_sort_info;
-
-		use_sort_info = etta->priv->sort_info;
-
-		if (etta->priv->sort_children_ascending && gnode->parent) {
-			if (!etta->priv->children_sort_info) {
-				gint len;
-
-				etta->priv->children_sort_info = e_table_sort_info_duplicate (etta->priv->sort_info);
-
-				len = e_table_sort_info_sorting_get_count (etta->priv->children_sort_info);
-
-				for (i = 0; i < len; i++) {
-					ETableColumnSpecification *spec;
-					GtkSortType sort_type;
-
-					spec = e_table_sort_info_sorting_get_nth (etta->priv->children_sort_info, i, &sort_type);
-					if (spec) {
-						if (sort_type == GTK_SORT_DESCENDING)
-							e_table_sort_info_sorting_set_nth (etta->priv->children_sort_info, i, spec, GTK_SORT_ASCENDING);
-					}
-				}
-			}
-
-			use_sort_info = etta->priv->children_sort_info;
-		}
-
+	use_sort_info = get_children_sort_info (etta, gnode);
+	if (use_sort_info)
 		e_table_sorting_utils_tree_sort (etta->priv->source_model, use_sort_info, etta->priv->header, paths, count);
-	}
 
 	prev = NULL;
 	for (i = 0; i < count; i++) {
@@ -338,11 +599,11 @@ delete_node (ETreeTableAdapter *etta,
 		return;
 	}
 
-	to_remove += delete_children (etta, gnode);
-	kill_gnode (gnode, etta);
+	to_remove += ((node_t *) gnode->data)->num_visible_children;
+	map_delete_rows (etta, row, to_remove);
 
-	move_map_elements (etta, row, row + to_remove, etta->priv->n_map - row - to_remove);
-	resize_map (etta, etta->priv->n_map - to_remove);
+	delete_children (etta, gnode);
+	kill_gnode (gnode, etta);
 
 	if (parent_gnode != NULL) {
 		node_t *parent_node = parent_gnode->data;
@@ -354,8 +615,6 @@ delete_node (ETreeTableAdapter *etta,
 			parent_node->expandable = expandable;
 			e_table_model_row_changed (E_TABLE_MODEL (etta), parent_row);
 		}
-
-		resort_node (etta, parent_gnode, FALSE);
 	}
 
 	e_table_model_rows_deleted (E_TABLE_MODEL (etta), row, to_remove);
@@ -370,7 +629,7 @@ create_gnode (ETreeTableAdapter *etta,
 
 	node = g_new0 (node_t, 1);
 	node->path = path;
-	node->index = -1;
+	node->map_size = 1;
 	node->expanded = etta->priv->force_expanded_state == 0 ? e_tree_model_get_expanded_default (etta->priv->source_model) : etta->priv->force_expanded_state > 0;
 	node->expandable = e_tree_model_node_is_expandable (etta->priv->source_model, path);
 	node->expandable_set = 1;
@@ -409,15 +668,14 @@ generate_tree (ETreeTableAdapter *etta,
 {
 	GNode *gnode;
 	node_t *node;
-	gint size;
 
 	e_table_model_pre_change (E_TABLE_MODEL (etta));
 
 	g_return_if_fail (e_tree_model_node_is_root (etta->priv->source_model, path));
 
+	map_clear (etta);
 	if (etta->priv->root)
 		kill_gnode (etta->priv->root, etta);
-	resize_map (etta, 0);
 
 	gnode = create_gnode (etta, path);
 	node = (node_t *) gnode->data;
@@ -427,12 +685,65 @@ generate_tree (ETreeTableAdapter *etta,
 		resort_node (etta, gnode, TRUE);
 
 	etta->priv->root = gnode;
-	size = etta->priv->root_visible ? node->num_visible_children + 1 : node->num_visible_children;
-	resize_map (etta, size);
-	fill_map (etta, 0, gnode);
+	map_fill (etta);
 	e_table_model_changed (E_TABLE_MODEL (etta));
 }
 
+/* Links @gnode among the children of @parent_gnode, which are
+ * already in order, thus a binary search finds its place */
+static void
+insert_child_node (ETreeTableAdapter *etta,
+                   GNode *parent_gnode,
+                   GNode *gnode)
+{
+	ETableSortInfo *use_sort_info;
+	ETreePath *paths, path;
+	GNode *child;
+	gint ii, count, pos;
+
+	use_sort_info = get_children_sort_info (etta, parent_gnode);
+	if (use_sort_info) {
+		count = g_node_n_children (parent_gnode);
+		paths = g_new (ETreePath, count + 1);
+
+		for (ii = 0, child = parent_gnode->children; child; child = child->next, ii++)
+			paths[ii] = ((node_t *) child->data)->path;
+
+		pos = e_table_sorting_utils_tree_insert (
+			etta->priv->source_model, use_sort_info, etta->priv->header,
+			paths, count, ((node_t *) gnode->data)->path);
+
+		g_free (paths);
+
+		g_node_insert (parent_gnode, pos, gnode);
+		return;
+	}
+
+	/* unsorted children follow the source model order */
+	for (path = e_tree_model_node_get_next (etta->priv->source_model, ((node_t *) gnode->data)->path);
+	     path;
+	     path = e_tree_model_node_get_next (etta->priv->source_model, path)) {
+		child = lookup_gnode (etta, path);
+		if (child && child->parent == parent_gnode) {
+			g_node_insert_before (parent_gnode, child, gnode);
+			return;
+		}
+	}
+
+	g_node_append (parent_gnode, gnode);
+}
+
+/* The row of @gnode, or -1 for the hidden root */
+static gint
+map_parent_row (ETreeTableAdapter *etta,
+                GNode *gnode)
+{
+	if (gnode == etta->priv->root && !etta->priv->root_visible)
+		return -1;
+
+	return map_row_of_node (etta, gnode->data);
+}
+
 static void
 insert_node (ETreeTableAdapter *etta,
              ETreePath parent,
@@ -441,7 +752,7 @@ insert_node (ETreeTableAdapter *etta,
 	GNode *gnode, *parent_gnode;
 	node_t *node, *parent_node;
 	gboolean expandable;
-	gint size, row;
+	gint row;
 
 	e_table_model_pre_change (E_TABLE_MODEL (etta));
 
@@ -469,7 +780,7 @@ insert_node (ETreeTableAdapter *etta,
 			e_table_model_pre_change (E_TABLE_MODEL (etta));
 			parent_node->expandable = expandable;
 			parent_node->expandable_set = 1;
-			e_table_model_row_changed (E_TABLE_MODEL (etta), parent_node->index);
+			e_table_model_row_changed (E_TABLE_MODEL (etta), map_row_of_node (etta, parent_node));
 		}
 	}
 
@@ -484,25 +795,25 @@ insert_node (ETreeTableAdapter *etta,
 	if (node->expanded)
 		node->num_visible_children = insert_children (etta, gnode);
 
-	g_node_append (parent_gnode, gnode);
+	/* the existing children stay in place, they are resorted
+	 * only when the sort info changes */
+	insert_child_node (etta, parent_gnode, gnode);
 	update_child_counts (parent_gnode, node->num_visible_children + 1);
-	resort_node (etta, parent_gnode, FALSE);
 	resort_node (etta, gnode, TRUE);
 
-	size = node->num_visible_children + 1;
-	resize_map (etta, etta->priv->n_map + size);
-	if (parent_gnode == etta->priv->root)
-		row = 0;
-	else {
-		gint new_size = parent_node->num_visible_children + 1;
-		gint old_size = new_size - size;
-		row = parent_node->index;
-		move_map_elements (etta, row + new_size, row + old_size, etta->priv->n_map - row - new_size);
+	if (gnode->prev) {
+		node_t *prev_node = gnode->prev->data;
+
+		/* the new row goes right after the previous sibling's subtree */
+		row = map_row_of_node (etta, prev_node) + prev_node->num_visible_children + 1;
+		map_insert_subtree (etta, row, gnode, TRUE);
+	} else {
+		map_insert_subtree (etta, map_parent_row (etta, parent_gnode) + 1, gnode, TRUE);
 	}
-	fill_map (etta, row, parent_gnode);
+
 	e_table_model_rows_inserted (
 		E_TABLE_MODEL (etta),
-		e_tree_table_adapter_row_of_node (etta, path), size);
+		map_row_of_node (etta, node), node->num_visible_children + 1);
 }
 
 typedef struct {
@@ -574,7 +885,7 @@ tree_table_adapter_sort_info_changed_cb (ETableSortInfo *sort_info,
 
 	e_table_model_pre_change (E_TABLE_MODEL (etta));
 	resort_node (etta, etta->priv->root, TRUE);
-	fill_map (etta, 0, etta->priv->root);
+	map_fill (etta);
 	e_table_model_changed (E_TABLE_MODEL (etta));
 }
 
@@ -592,6 +903,7 @@ tree_table_adapter_source_model_rebuilt_cb (ETreeModel *source_model,
 	if (!etta->priv->root)
 		return;
 
+	map_clear (etta);
 	kill_gnode (etta->priv->root, etta);
 	etta->priv->root = NULL;
 
@@ -841,14 +1153,13 @@ tree_table_adapter_finalize (GObject *object)
 	}
 
 	if (priv->root) {
+		map_clear (E_TREE_TABLE_ADAPTER (object));
 		kill_gnode (priv->root, E_TREE_TABLE_ADAPTER (object));
 		priv->root = NULL;
 	}
 
 	g_hash_table_destroy (priv->nodes);
 
-	g_free (priv->map_table);
-
 	/* Chain up to parent's finalize() method. */
 	G_OBJECT_CLASS (e_tree_table_adapter_parent_class)->finalize (object);
 }
@@ -1143,7 +1454,7 @@ e_tree_table_adapter_init (ETreeTableAdapter *etta)
 	etta->priv->nodes = g_hash_table_new (NULL, NULL);
 
 	etta->priv->root_visible = TRUE;
-	etta->priv->remap_needed = TRUE;
+	etta->priv->map_seed = g_random_int () | 1;
 }
 
 ETableModel *
@@ -1224,7 +1535,7 @@ e_tree_table_adapter_set_sort_info (ETreeTableAdapter *etta,
 
 	e_table_model_pre_change (E_TABLE_MODEL (etta));
 	resort_node (etta, etta->priv->root, TRUE);
-	fill_map (etta, 0, etta->priv->root);
+	map_fill (etta);
 	e_table_model_changed (E_TABLE_MODEL (etta));
 }
 
@@ -1255,7 +1566,7 @@ e_tree_table_adapter_set_sort_children_ascending (ETreeTableAdapter *etta,
 
 	e_table_model_pre_change (E_TABLE_MODEL (etta));
 	resort_node (etta, etta->priv->root, TRUE);
-	fill_map (etta, 0, etta->priv->root);
+	map_fill (etta);
 	e_table_model_changed (E_TABLE_MODEL (etta));
 }
 
@@ -1469,8 +1780,6 @@ void
 e_tree_table_adapter_root_node_set_visible (ETreeTableAdapter *etta,
                                             gboolean visible)
 {
-	gint size;
-
 	g_return_if_fail (E_IS_TREE_TABLE_ADAPTER (etta));
 
 	if (etta->priv->root_visible == visible)
@@ -1484,10 +1793,7 @@ e_tree_table_adapter_root_node_set_visible (ETreeTableAdapter *etta,
 		if (root)
 			e_tree_table_adapter_node_set_expanded (etta, root, TRUE);
 	}
-	size = (visible ? 1 : 0) + (etta->priv->root ? ((node_t *) etta->priv->root->data)->num_visible_children : 0);
-	resize_map (etta, size);
-	if (etta->priv->root)
-		fill_map (etta, 0, etta->priv->root);
+	map_fill (etta);
 	e_table_model_changed (E_TABLE_MODEL (etta));
 }
 
@@ -1535,22 +1841,20 @@ e_tree_table_adapter_node_set_expanded (ETreeTableAdapter *etta,
 		update_child_counts (gnode, num_children);
 		if (etta->priv->sort_info && e_table_sort_info_sorting_get_count (etta->priv->sort_info) > 0)
 			resort_node (etta, gnode, TRUE);
-		resize_map (etta, etta->priv->n_map + num_children);
-		move_map_elements (etta, row + 1 + num_children, row + 1, etta->priv->n_map - row - 1 - num_children);
-		fill_map (etta, row, gnode);
 		if (num_children != 0) {
+			map_insert_subtree (etta, row + 1, gnode, FALSE);
 			e_table_model_rows_inserted (E_TABLE_MODEL (etta), row + 1, num_children);
 		} else
 			e_table_model_no_change (E_TABLE_MODEL (etta));
 	} else {
-		gint num_children = delete_children (etta, gnode);
+		gint num_children = node->num_visible_children;
 		if (num_children == 0) {
 			e_table_model_no_change (E_TABLE_MODEL (etta));
 			return;
 		}
-		move_map_elements (etta, row + 1, row + 1 + num_children, etta->priv->n_map - row - 1 - num_children);
+		map_delete_rows (etta, row + 1, num_children);
+		delete_children (etta, gnode);
 		update_child_counts (gnode, - num_children);
-		resize_map (etta, etta->priv->n_map - num_children);
 		e_table_model_rows_deleted (E_TABLE_MODEL (etta), row + 1, num_children);
 	}
 }
@@ -1584,7 +1888,7 @@ e_tree_table_adapter_node_at_row (ETreeTableAdapter *etta,
 	else if (row < 0 || row >= etta->priv->n_map)
 		return NULL;
 
-	return etta->priv->map_table[row]->path;
+	return map_node_at_row (etta, row)->path;
 }
 
 gint
@@ -1599,10 +1903,7 @@ e_tree_table_adapter_row_of_node (ETreeTableAdapter *etta,
 	if (node == NULL)
 		return -1;
 
-	if (etta->priv->remap_needed)
-		remap_indices (etta);
-
-	return node->index;
+	return map_row_of_node (etta, node);
 }
 
 gboolean
@@ -1665,7 +1966,7 @@ e_tree_table_adapter_clear_nodes_silent (ETreeTableAdapter *etta)
 {
 	g_return_if_fail (E_IS_TREE_TABLE_ADAPTER (etta));
 
+	map_clear (etta);
 	if (etta->priv->root)
 		kill_gnode (etta->priv->root, etta);
-	resize_map (etta, 0);
 }
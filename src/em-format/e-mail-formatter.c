@@ -40,6 +40,15 @@
 
 typedef struct _AsyncContext AsyncContext;
 
+struct _EMailFormatterRun {
+	EMailFormatter *formatter;
+	EMailFormatterContext *context;
+	GQueue queue;		/* EMailPart * */
+	GList *link;		/* the next part to format */
+	gboolean started;
+	gboolean finished;
+};
+
 struct _EMailFormatterPrivate {
 	EImageLoadingPolicy image_loading_policy;
 
@@ -379,120 +388,143 @@ e_mail_formatter_constructed (GObject *object)
 	e_extensible_load_extensions (E_EXTENSIBLE (object));
 }
 
-static void
-mail_formatter_run (EMailFormatter *formatter,
-                    EMailFormatterContext *context,
-                    GOutputStream *stream,
-                    GCancellable *cancellable)
+/* Formats the part at the 'link' and returns the link of the next part
+ * to be formatted, or NULL when there is nothing more to be written. */
+static GList *
+mail_formatter_run_part (EMailFormatter *formatter,
+                         EMailFormatterContext *context,
+                         GOutputStream *stream,
+                         GList *link,
+                         GCancellable *cancellable)
 {
-	GQueue queue = G_QUEUE_INIT;
-	GList *head, *link;
-	gchar *hdr;
-	const gchar *string;
+	EMailPart *part = link->data;
+	const gchar *part_id;
+	gboolean ok;
 
-	hdr = e_mail_formatter_get_html_header (formatter);
-	g_output_stream_write_all (
-		stream, hdr, strlen (hdr), NULL, cancellable, NULL);
-	g_free (hdr);
+	part_id = e_mail_part_get_id (part);
 
-	e_mail_part_list_queue_parts (context->part_list, NULL, &queue);
+	if (part->is_hidden && !part->is_error) {
+		if (e_mail_part_id_has_suffix (part, ".rfc822")) {
+			link = e_mail_formatter_find_rfc822_end_iter (link);
+		}
 
-	head = g_queue_peek_head_link (&queue);
+		return link ? g_list_next (link) : NULL;
+	}
 
-	for (link = head; link != NULL; link = g_list_next (link)) {
-		EMailPart *part = link->data;
-		const gchar *part_id;
-		gboolean ok;
+	if (context->mode == E_MAIL_FORMATTER_MODE_PRINTING &&
+	    !e_mail_part_get_is_printable (part))
+		return g_list_next (link);
 
-		part_id = e_mail_part_get_id (part);
+	/* Force formatting as source if needed */
+	if (context->mode != E_MAIL_FORMATTER_MODE_SOURCE) {
+		const gchar *mime_type;
 
-		if (g_cancellable_is_cancelled (cancellable))
-			break;
+		mime_type = e_mail_part_get_mime_type (part);
+		if (mime_type == NULL)
+			return g_list_next (link);
 
-		if (part->is_hidden && !part->is_error) {
-			if (e_mail_part_id_has_suffix (part, ".rfc822")) {
-				link = e_mail_formatter_find_rfc822_end_iter (link);
-			}
+		ok = e_mail_formatter_format_as (
+			formatter, context, part, stream,
+			mime_type, cancellable);
 
-			if (link == NULL)
-				break;
+		/* If the written part was message/rfc822 then
+		 * jump to the end of the message, because content
+		 * of the whole message has been formatted by
+		 * message_rfc822 formatter */
+		if (ok && e_mail_part_id_has_suffix (part, ".rfc822")) {
+			link = e_mail_formatter_find_rfc822_end_iter (link);
 
-			continue;
+			return link ? g_list_next (link) : NULL;
 		}
 
-		if (context->mode == E_MAIL_FORMATTER_MODE_PRINTING &&
-		    !e_mail_part_get_is_printable (part))
-			continue;
+	} else {
+		ok = FALSE;
+	}
 
-		/* Force formatting as source if needed */
-		if (context->mode != E_MAIL_FORMATTER_MODE_SOURCE) {
-			const gchar *mime_type;
+	if (!ok) {
+		/* We don't want to source these */
+		if (e_mail_part_id_has_suffix (part, ".headers"))
+			return g_list_next (link);
 
-			mime_type = e_mail_part_get_mime_type (part);
-			if (mime_type == NULL)
-				continue;
+		e_mail_formatter_format_as (
+			formatter, context, part, stream,
+			"application/vnd.evolution.source", cancellable);
 
-			ok = e_mail_formatter_format_as (
-				formatter, context, part, stream,
-				mime_type, cancellable);
+		/* .message is the entire message. There's nothing more
+		 * to be written. */
+		if (g_strcmp0 (part_id, ".message") == 0)
+			return NULL;
 
-			/* If the written part was message/rfc822 then
-			 * jump to the end of the message, because content
-			 * of the whole message has been formatted by
-			 * message_rfc822 formatter */
-			if (ok && e_mail_part_id_has_suffix (part, ".rfc822")) {
-				link = e_mail_formatter_find_rfc822_end_iter (link);
+		/* If we just wrote source of a rfc822 message, then jump
+		 * behind the message (otherwise source of all parts
+		 * would be rendered twice) */
+		if (e_mail_part_id_has_suffix (part, ".rfc822")) {
 
-				if (link == NULL)
+			do {
+				part = link->data;
+				if (e_mail_part_id_has_suffix (part, ".rfc822.end"))
 					break;
 
-				continue;
-			}
+				link = g_list_next (link);
+			} while (link != NULL);
 
-		} else {
-			ok = FALSE;
+			if (link == NULL)
+				return NULL;
 		}
+	}
 
-		if (!ok) {
-			/* We don't want to source these */
-			if (e_mail_part_id_has_suffix (part, ".headers"))
-				continue;
+	return g_list_next (link);
+}
 
-			e_mail_formatter_format_as (
-				formatter, context, part, stream,
-				"application/vnd.evolution.source", cancellable);
+static void
+mail_formatter_write_html_header (EMailFormatter *formatter,
+                                  GOutputStream *stream,
+                                  GCancellable *cancellable)
+{
+	gchar *hdr;
 
-			/* .message is the entire message. There's nothing more
-			 * to be written. */
-			if (g_strcmp0 (part_id, ".message") == 0)
-				break;
+	hdr = e_mail_formatter_get_html_header (formatter);
+	g_output_stream_write_all (
+		stream, hdr, strlen (hdr), NULL, cancellable, NULL);
+	g_free (hdr);
+}
 
-			/* If we just wrote source of a rfc822 message, then jump
-			 * behind the message (otherwise source of all parts
-			 * would be rendered twice) */
-			if (e_mail_part_id_has_suffix (part, ".rfc822")) {
+static void
+mail_formatter_write_html_footer (GOutputStream *stream,
+                                  GCancellable *cancellable)
+{
+	const gchar *string;
 
-				do {
-					part = link->data;
-					if (e_mail_part_id_has_suffix (part, ".rfc822.end"))
-						break;
+	string = "</body></html>";
+	g_output_stream_write_all (
+		stream, string, strlen (string),
+		NULL, cancellable, NULL);
+}
+
+static void
+mail_formatter_run (EMailFormatter *formatter,
+                    EMailFormatterContext *context,
+                    GOutputStream *stream,
+                    GCancellable *cancellable)
+{
+	GQueue queue = G_QUEUE_INIT;
+	GList *link;
 
-					link = g_list_next (link);
-				} while (link != NULL);
+	mail_formatter_write_html_header (formatter, stream, cancellable);
 
-				if (link == NULL)
-					break;
-			}
-		}
+	e_mail_part_list_queue_parts (context->part_list, NULL, &queue);
+
+	link = g_queue_peek_head_link (&queue);
+
+	while (link != NULL && !g_cancellable_is_cancelled (cancellable)) {
+		link = mail_formatter_run_part (
+			formatter, context, stream, link, cancellable);
 	}
 
 	while (!g_queue_is_empty (&queue))
 		g_object_unref (g_queue_pop_head (&queue));
 
-	string = "</body></html>";
-	g_output_stream_write_all (
-		stream, string, strlen (string),
-		NULL, cancellable, NULL);
+	mail_formatter_write_html_footer (stream, cancellable);
 }
 
 static void
@@ -873,6 +905,131 @@ e_mail_formatter_format_sync (EMailFormatter *formatter,
 	mail_formatter_free_context (context);
 }
 
+/**
+ * e_mail_formatter_run_new:
+ * @formatter: an #EMailFormatter
+ * @part_list: an #EMailPartList to format
+ * @flags: #EMailFormatterHeaderFlags
+ * @mode: an #EMailFormatterMode
+ *
+ * Prepares the @part_list to be formatted in steps, with
+ * e_mail_formatter_run_step(), thus the output can be used
+ * while the rest of the parts is being formatted.
+ *
+ * Returns: (transfer full): a new #EMailFormatterRun; free it
+ *    with e_mail_formatter_run_free(), when no longer needed.
+ **/
+EMailFormatterRun *
+e_mail_formatter_run_new (EMailFormatter *formatter,
+                          EMailPartList *part_list,
+                          EMailFormatterHeaderFlags flags,
+                          EMailFormatterMode mode)
+{
+	EMailFormatterRun *run;
+
+	g_return_val_if_fail (E_IS_MAIL_FORMATTER (formatter), NULL);
+	g_return_val_if_fail (E_IS_MAIL_PART_LIST (part_list), NULL);
+
+	run = g_slice_new0 (EMailFormatterRun);
+	run->formatter = g_object_ref (formatter);
+	run->context = mail_formatter_create_context (formatter, part_list, mode, flags);
+	g_queue_init (&run->queue);
+
+	return run;
+}
+
+/**
+ * e_mail_formatter_run_step:
+ * @run: an #EMailFormatterRun
+ * @stream: a #GOutputStream to write to
+ * @budget: how long, in microseconds, the step can take
+ * @cancellable: (nullable): optional #GCancellable object, or %NULL
+ *
+ * Writes the next parts of the @run into the @stream, until the @budget
+ * is exceeded; at least one part is written. The first step writes the
+ * HTML header too and the last step the HTML footer. Each step can write
+ * into a different stream.
+ *
+ * Formatters which override the run() method are run in one step.
+ *
+ * Returns: whether there is anything left to be formatted
+ **/
+gboolean
+e_mail_formatter_run_step (EMailFormatterRun *run,
+                           GOutputStream *stream,
+                           gint64 budget,
+                           GCancellable *cancellable)
+{
+	EMailFormatterClass *class;
+	gint64 deadline;
+
+	g_return_val_if_fail (run != NULL, FALSE);
+	g_return_val_if_fail (G_IS_OUTPUT_STREAM (stream), FALSE);
+
+	if (run->finished)
+		return FALSE;
+
+	class = E_MAIL_FORMATTER_GET_CLASS (run->formatter);
+	g_return_val_if_fail (class != NULL, FALSE);
+	g_return_val_if_fail (class->run != NULL, FALSE);
+
+	if (class->run != mail_formatter_run) {
+		class->run (run->formatter, run->context, stream, cancellable);
+		run->finished = TRUE;
+
+		return FALSE;
+	}
+
+	deadline = g_get_monotonic_time () + budget;
+
+	if (!run->started) {
+		mail_formatter_write_html_header (run->formatter, stream, cancellable);
+
+		e_mail_part_list_queue_parts (run->context->part_list, NULL, &run->queue);
+		run->link = g_queue_peek_head_link (&run->queue);
+		run->started = TRUE;
+	}
+
+	while (run->link != NULL && !g_cancellable_is_cancelled (cancellable)) {
+		run->link = mail_formatter_run_part (
+			run->formatter, run->context, stream,
+			run->link, cancellable);
+
+		if (g_get_monotonic_time () >= deadline)
+			break;
+	}
+
+	if (run->link != NULL && !g_cancellable_is_cancelled (cancellable))
+		return TRUE;
+
+	mail_formatter_write_html_footer (stream, cancellable);
+	run->finished = TRUE;
+
+	return FALSE;
+}
+
+/**
+ * e_mail_formatter_run_free:
+ * @run: (nullable): an #EMailFormatterRun, or %NULL
+ *
+ * Frees the @run, created by e_mail_formatter_run_new(). An unfinished
+ * @run is abandoned.
+ **/
+void
+e_mail_formatter_run_free (EMailFormatterRun *run)
+{
+	if (!run)
+		return;
+
+	while (!g_queue_is_empty (&run->queue))
+		g_object_unref (g_queue_pop_head (&run->queue));
+
+	mail_formatter_free_context (run->context);
+	g_object_unref (run->formatter);
+
+	g_slice_free (EMailFormatterRun, run);
+}
+
 static void
 mail_formatter_format_thread (GSimpleAsyncResult *simple,
                               GObject *source_object,
@@ -116,6 +116,19 @@ gboolean	e_mail_formatter_format_finish	(EMailFormatter *formatter,
 						 GAsyncResult *result,
 						 GError **error);
 
+typedef struct _EMailFormatterRun EMailFormatterRun;
+
+EMailFormatterRun *
+		e_mail_formatter_run_new	(EMailFormatter *formatter,
+						 EMailPartList *part_list,
+						 EMailFormatterHeaderFlags flags,
+						 EMailFormatterMode mode);
+gboolean	e_mail_formatter_run_step	(EMailFormatterRun *run,
+						 GOutputStream *stream,
+						 gint64 budget,
+						 GCancellable *cancellable);
+void		e_mail_formatter_run_free	(EMailFormatterRun *run);
+
 gboolean	e_mail_formatter_format_as	(EMailFormatter *formatter,
 						 EMailFormatterContext *context,
 						 EMailPart *part,
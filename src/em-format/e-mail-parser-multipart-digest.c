@@ -38,81 +38,89 @@ static const gchar *parser_mime_types[] = {
 	NULL
 };
 
-static gboolean
-empe_mp_digest_parse (EMailParserExtension *extension,
-                      EMailParser *parser,
-                      CamelMimePart *part,
-                      GString *part_id,
-                      GCancellable *cancellable,
-                      GQueue *out_mail_parts)
+static void
+empe_mp_digest_parse_subpart (EMailParser *parser,
+                              CamelMimePart *subpart,
+                              gint index,
+                              GString *part_id,
+                              GCancellable *cancellable,
+                              GQueue *out_mail_parts,
+                              gpointer user_data)
 {
-	CamelMultipart *mp;
-	gint i, nparts, len;
-
-	mp = (CamelMultipart *) camel_medium_get_content ((CamelMedium *) part);
-
-	if (!CAMEL_IS_MULTIPART (mp))
-		return e_mail_parser_parse_part_as (
-			parser, part, part_id,
-			"application/vnd.evolution.source",
-			cancellable, out_mail_parts);
+	CamelContentType *ct;
+	gchar *cts;
+	gint len;
 
 	len = part_id->len;
-	nparts = camel_multipart_get_number (mp);
-	for (i = 0; i < nparts; i++) {
-		CamelMimePart *subpart;
-		CamelContentType *ct;
-		gchar *cts;
+	g_string_append_printf (part_id, ".digest.%d", index);
 
-		subpart = camel_multipart_get_part (mp, i);
+	ct = camel_mime_part_get_content_type (subpart);
 
-		if (!subpart)
-			continue;
+	/* According to RFC this shouldn't happen, but who knows... */
+	if (ct && !camel_content_type_is (ct, "message", "rfc822")) {
+		cts = camel_content_type_simple (ct);
 
-		g_string_append_printf (part_id, ".digest.%d", i);
+		e_mail_parser_parse_part_as (
+			parser, subpart, part_id, cts,
+			cancellable, out_mail_parts);
 
-		ct = camel_mime_part_get_content_type (subpart);
+		g_free (cts);
+	} else {
+		GQueue work_queue = G_QUEUE_INIT;
+		EMailPart *mail_part;
+		gboolean wrap_as_attachment;
 
-		/* According to RFC this shouldn't happen, but who knows... */
-		if (ct && !camel_content_type_is (ct, "message", "rfc822")) {
-			cts = camel_content_type_simple (ct);
+		e_mail_parser_parse_part_as (
+			parser, subpart, part_id, "message/rfc822",
+			cancellable, &work_queue);
 
-			e_mail_parser_parse_part_as (
-				parser, subpart, part_id, cts,
-				cancellable, out_mail_parts);
+		mail_part = g_queue_peek_head (&work_queue);
 
-			g_free (cts);
-		} else {
-			GQueue work_queue = G_QUEUE_INIT;
-			EMailPart *mail_part;
-			gboolean wrap_as_attachment;
+		wrap_as_attachment =
+			(mail_part != NULL) &&
+			!e_mail_part_get_is_attachment (mail_part);
 
-			e_mail_parser_parse_part_as (
-				parser, subpart, part_id, "message/rfc822",
-				cancellable, &work_queue);
+		/* Force the message to be collapsable */
+		if (wrap_as_attachment)
+			e_mail_parser_wrap_as_attachment (
+				parser, subpart, part_id, &work_queue);
 
-			mail_part = g_queue_peek_head (&work_queue);
+		mail_part = g_queue_peek_head (&work_queue);
 
-			wrap_as_attachment =
-				(mail_part != NULL) &&
-				!e_mail_part_get_is_attachment (mail_part);
+		/* Force the message to be expanded */
+		if (mail_part != NULL)
+			mail_part->force_inline = TRUE;
 
-			/* Force the message to be collapsable */
-			if (wrap_as_attachment)
-				e_mail_parser_wrap_as_attachment (
-					parser, subpart, part_id, &work_queue);
+		e_queue_transfer (&work_queue, out_mail_parts);
+	}
 
-			mail_part = g_queue_peek_head (&work_queue);
+	g_string_truncate (part_id, len);
+}
+
+static gboolean
+empe_mp_digest_parse (EMailParserExtension *extension,
+                      EMailParser *parser,
+                      CamelMimePart *part,
+                      GString *part_id,
+                      GCancellable *cancellable,
+                      GQueue *out_mail_parts)
+{
+	CamelMultipart *mp;
 
-			/* Force the message to be expanded */
-			if (mail_part != NULL)
-				mail_part->force_inline = TRUE;
+	mp = (CamelMultipart *) camel_medium_get_content ((CamelMedium *) part);
 
-			e_queue_transfer (&work_queue, out_mail_parts);
-		}
+	if (!CAMEL_IS_MULTIPART (mp))
+		return e_mail_parser_parse_part_as (
+			parser, part, part_id,
+			"application/vnd.evolution.source",
+			cancellable, out_mail_parts);
 
-		g_string_truncate (part_id, len);
-	}
+	/* Digest entries are independent messages,
+	 * thus large ones can be parsed concurrently. */
+	e_mail_parser_parse_subparts (
+		parser, mp, part_id,
+		empe_mp_digest_parse_subpart, NULL,
+		cancellable, out_mail_parts);
 
 	return TRUE;
 }
@@ -80,6 +80,196 @@ empe_mp_mixed_maybe_update_message_info_headers (EMailParser *parser,
 	g_object_unref (part_list);
 }
 
+typedef struct _MixedParseData {
+	CamelMimePart *part;
+	CamelMimePart *pgp_encrypted;
+	CamelMimePart *pgp_octet_stream;
+} MixedParseData;
+
+static void
+empe_mp_mixed_parse_subpart (EMailParser *parser,
+                             CamelMimePart *subpart,
+                             gint index,
+                             GString *part_id,
+                             GCancellable *cancellable,
+                             GQueue *out_mail_parts,
+                             gpointer user_data)
+{
+	MixedParseData *data = user_data;
+	GQueue work_queue = G_QUEUE_INIT;
+	EMailPart *mail_part;
+	CamelContentType *ct;
+	gboolean handled;
+	gint len;
+
+	len = part_id->len;
+
+	if (subpart == data->pgp_encrypted ||
+	    subpart == data->pgp_octet_stream) {
+		/* Garbled PGP enctryped message by an Exchange server; show it
+		   at the position, where the pgp-encrypted part is. */
+		if (subpart == data->pgp_encrypted &&
+		    data->pgp_encrypted && data->pgp_octet_stream) {
+			CamelMultipart *encrypted;
+			CamelMimePart *tmp_part;
+
+			encrypted = CAMEL_MULTIPART (camel_multipart_encrypted_new ());
+			camel_data_wrapper_set_mime_type (CAMEL_DATA_WRAPPER (encrypted), "multipart/encrypted; protocol=\"application/pgp-encrypted\"");
+			camel_multipart_add_part (encrypted, data->pgp_encrypted);
+			camel_multipart_add_part (encrypted, data->pgp_octet_stream);
+
+			tmp_part = camel_mime_part_new ();
+			camel_mime_part_set_content_type (tmp_part, "multipart/encrypted; protocol=\"application/pgp-encrypted\"");
+			camel_medium_set_content (CAMEL_MEDIUM (tmp_part), CAMEL_DATA_WRAPPER (encrypted));
+
+			g_string_append (part_id, ".mixed-as-pgp-encrypted");
+
+			e_mail_parser_parse_part_as (parser, tmp_part, part_id,
+				"multipart/encrypted", cancellable, out_mail_parts);
+
+			g_string_truncate (part_id, len);
+
+			g_object_unref (tmp_part);
+			g_object_unref (encrypted);
+		}
+		return;
+	}
+
+	if (index == 0 && g_str_has_suffix (part_id->str, ".encrypted-pgp")) {
+		ct = camel_mime_part_get_content_type (subpart);
+		if (ct && camel_content_type_is (ct, "text", "rfc822-headers") &&
+		    camel_content_type_param (ct, "protected-headers")) {
+			ct = camel_mime_part_get_content_type (data->part);
+			if (ct && camel_content_type_param (ct, "protected-headers")) {
+				const gchar *subject;
+
+				/* The multipart/mixed contains some of the original headers */
+				subject = camel_medium_get_header (CAMEL_MEDIUM (data->part), "Subject");
+				if (subject) {
+					empe_mp_mixed_maybe_update_message_info_headers (parser, part_id->str, subject, cancellable);
+
+					/* Skip the text/rfc822-headers part, it's not needed to be shown */
+					return;
+				}
+			}
+		}
+	}
+
+	g_string_append_printf (part_id, ".mixed.%d", index);
+
+	handled = FALSE;
+	ct = camel_mime_part_get_content_type (subpart);
+	if (ct)
+		ct = camel_content_type_ref (ct);
+
+	if (!e_mail_parser_get_parsers_for_part (parser, subpart)) {
+		const gchar *snoop_type;
+		CamelContentType *snoop_ct = NULL;
+
+		snoop_type = e_mail_part_snoop_type (subpart);
+		if (snoop_type)
+			snoop_ct = camel_content_type_decode (snoop_type);
+
+		if (snoop_ct && snoop_ct->type && snoop_ct->subtype && (
+		    !ct || g_ascii_strcasecmp (snoop_ct->type, ct->type) != 0 ||
+		    g_ascii_strcasecmp (snoop_ct->subtype, ct->subtype) != 0)) {
+			CamelStream *mem_stream;
+
+			mem_stream = camel_stream_mem_new ();
+			if (camel_data_wrapper_decode_to_stream_sync (
+				camel_medium_get_content (CAMEL_MEDIUM (subpart)),
+				mem_stream, cancellable, NULL)) {
+				CamelMimePart *opart;
+				CamelDataWrapper *dw;
+
+				g_seekable_seek (G_SEEKABLE (mem_stream), 0, G_SEEK_SET, cancellable, NULL);
+
+				opart = camel_mime_part_new ();
+
+				dw = camel_data_wrapper_new ();
+				camel_data_wrapper_set_mime_type (dw, snoop_type);
+				if (camel_data_wrapper_construct_from_stream_sync (dw, mem_stream, cancellable, NULL)) {
+					const gchar *disposition;
+
+					camel_medium_set_content (CAMEL_MEDIUM (opart), dw);
+
+					/* Copy Content-Disposition header, if available */
+					disposition = camel_medium_get_header (CAMEL_MEDIUM (subpart), "Content-Disposition");
+					if (disposition)
+						camel_medium_set_header (CAMEL_MEDIUM (opart), "Content-Disposition", disposition);
+
+					/* Copy also any existing parameters of the Content-Type, like 'name' or 'charset'. */
+					if (ct && ct->params) {
+						CamelHeaderParam *param;
+						for (param = ct->params; param; param = param->next) {
+							camel_content_type_set_param (snoop_ct, param->name, param->value);
+						}
+					}
+
+					camel_content_type_set_param (snoop_ct, E_MAIL_PART_X_EVOLUTION_GUESSED, "1");
+					camel_data_wrapper_set_mime_type_field (CAMEL_DATA_WRAPPER (opart), snoop_ct);
+
+					handled = e_mail_parser_parse_part (parser, opart, part_id, cancellable, &work_queue);
+					if (handled) {
+						camel_content_type_unref (ct);
+						ct = camel_content_type_ref (snoop_ct);
+					}
+				}
+
+				g_object_unref (opart);
+				g_object_unref (dw);
+			}
+
+			g_object_unref (mem_stream);
+		}
+
+		if (snoop_ct)
+			camel_content_type_unref (snoop_ct);
+	}
+
+	if (!handled) {
+		handled = e_mail_parser_parse_part (
+			parser, subpart, part_id, cancellable, &work_queue);
+	}
+
+	mail_part = g_queue_peek_head (&work_queue);
+
+	/* Display parts with CID as attachments
+	 * (unless they already are attachments).
+	 * Show also hidden attachments with CID,
+	 * because this is multipart/mixed,
+	 * not multipart/related. */
+	if (mail_part != NULL &&
+	    e_mail_part_get_cid (mail_part) != NULL &&
+	    (!e_mail_part_get_is_attachment (mail_part) ||
+	     mail_part->is_hidden)) {
+
+		e_mail_parser_wrap_as_attachment (
+			parser, subpart, part_id, &work_queue);
+
+	/* Force messages to be expandable */
+	} else if ((mail_part == NULL && !handled) ||
+	    (camel_content_type_is (ct, "message", "*") &&
+	     mail_part != NULL &&
+	     !e_mail_part_get_is_attachment (mail_part))) {
+
+		e_mail_parser_wrap_as_attachment (
+			parser, subpart, part_id, &work_queue);
+
+		mail_part = g_queue_peek_head (&work_queue);
+
+		if (mail_part != NULL)
+			mail_part->force_inline = TRUE;
+	}
+
+	e_queue_transfer (&work_queue, out_mail_parts);
+
+	g_string_truncate (part_id, len);
+
+	if (ct)
+		camel_content_type_unref (ct);
+}
+
 static gboolean
 empe_mp_mixed_parse (EMailParserExtension *extension,
                      EMailParser *parser,
@@ -90,7 +280,8 @@ empe_mp_mixed_parse (EMailParserExtension *extension,
 {
 	CamelMultipart *mp;
 	CamelMimePart *pgp_encrypted = NULL, *pgp_octet_stream = NULL;
-	gint i, nparts, len;
+	MixedParseData data;
+	gint i, nparts;
 
 	mp = (CamelMultipart *) camel_medium_get_content ((CamelMedium *) part);
 
@@ -100,7 +291,6 @@ empe_mp_mixed_parse (EMailParserExtension *extension,
 			"application/vnd.evolution.source",
 			cancellable, out_mail_parts);
 
-	len = part_id->len;
 	nparts = camel_multipart_get_number (mp);
 
 	if ((nparts == 2 || nparts == 3) &&
@@ -137,180 +327,16 @@ empe_mp_mixed_parse (EMailParserExtension *extension,
 		}
 	}
 
-	for (i = 0; i < nparts; i++) {
-		GQueue work_queue = G_QUEUE_INIT;
-		EMailPart *mail_part;
-		CamelMimePart *subpart;
-		CamelContentType *ct;
-		gboolean handled;
-
-		subpart = camel_multipart_get_part (mp, i);
-
-		if (subpart == pgp_encrypted ||
-		    subpart == pgp_octet_stream) {
-			/* Garbled PGP enctryped message by an Exchange server; show it
-			   at the position, where the pgp-encrypted part is. */
-			if (subpart == pgp_encrypted &&
-			    pgp_encrypted && pgp_octet_stream) {
-				CamelMultipart *encrypted;
-				CamelMimePart *tmp_part;
-
-				encrypted = CAMEL_MULTIPART (camel_multipart_encrypted_new ());
-				camel_data_wrapper_set_mime_type (CAMEL_DATA_WRAPPER (encrypted), "multipart/encrypted; protocol=\"application/pgp-encrypted\"");
-				camel_multipart_add_part (encrypted, pgp_encrypted);
-				camel_multipart_add_part (encrypted, pgp_octet_stream);
-
-				tmp_part = camel_mime_part_new ();
-				camel_mime_part_set_content_type (tmp_part, "multipart/encrypted; protocol=\"application/pgp-encrypted\"");
-				camel_medium_set_content (CAMEL_MEDIUM (tmp_part), CAMEL_DATA_WRAPPER (encrypted));
-
-				g_string_append (part_id, ".mixed-as-pgp-encrypted");
+	data.part = part;
+	data.pgp_encrypted = pgp_encrypted;
+	data.pgp_octet_stream = pgp_octet_stream;
 
-				e_mail_parser_parse_part_as (parser, tmp_part, part_id,
-					"multipart/encrypted", cancellable, out_mail_parts);
-
-				g_string_truncate (part_id, len);
-
-				g_object_unref (tmp_part);
-				g_object_unref (encrypted);
-			}
-			continue;
-		}
-
-		if (i == 0 && g_str_has_suffix (part_id->str, ".encrypted-pgp")) {
-			ct = camel_mime_part_get_content_type (subpart);
-			if (ct && camel_content_type_is (ct, "text", "rfc822-headers") &&
-			    camel_content_type_param (ct, "protected-headers")) {
-				ct = camel_mime_part_get_content_type (part);
-				if (ct && camel_content_type_param (ct, "protected-headers")) {
-					const gchar *subject;
-
-					/* The multipart/mixed contains some of the original headers */
-					subject = camel_medium_get_header (CAMEL_MEDIUM (part), "Subject");
-					if (subject) {
-						empe_mp_mixed_maybe_update_message_info_headers (parser, part_id->str, subject, cancellable);
-
-						/* Skip the text/rfc822-headers part, it's not needed to be shown */
-						continue;
-					}
-				}
-			}
-		}
-
-		g_string_append_printf (part_id, ".mixed.%d", i);
-
-		handled = FALSE;
-		ct = camel_mime_part_get_content_type (subpart);
-		if (ct)
-			ct = camel_content_type_ref (ct);
-
-		if (!e_mail_parser_get_parsers_for_part (parser, subpart)) {
-			const gchar *snoop_type;
-			CamelContentType *snoop_ct = NULL;
-
-			snoop_type = e_mail_part_snoop_type (subpart);
-			if (snoop_type)
-				snoop_ct = camel_content_type_decode (snoop_type);
-
-			if (snoop_ct && snoop_ct->type && snoop_ct->subtype && (
-			    !ct || g_ascii_strcasecmp (snoop_ct->type, ct->type) != 0 ||
-			    g_ascii_strcasecmp (snoop_ct->subtype, ct->subtype) != 0)) {
-				CamelStream *mem_stream;
-
-				mem_stream = camel_stream_mem_new ();
-				if (camel_data_wrapper_decode_to_stream_sync (
-					camel_medium_get_content (CAMEL_MEDIUM (subpart)),
-					mem_stream, cancellable, NULL)) {
-					CamelMimePart *opart;
-					CamelDataWrapper *dw;
-
-					g_seekable_seek (G_SEEKABLE (mem_stream), 0, G_SEEK_SET, cancellable, NULL);
-
-					opart = camel_mime_part_new ();
-
-					dw = camel_data_wrapper_new ();
-					camel_data_wrapper_set_mime_type (dw, snoop_type);
-					if (camel_data_wrapper_construct_from_stream_sync (dw, mem_stream, cancellable, NULL)) {
-						const gchar *disposition;
-
-						camel_medium_set_content (CAMEL_MEDIUM (opart), dw);
-
-						/* Copy Content-Disposition header, if available */
-						disposition = camel_medium_get_header (CAMEL_MEDIUM (subpart), "Content-Disposition");
-						if (disposition)
-							camel_medium_set_header (CAMEL_MEDIUM (opart), "Content-Disposition", disposition);
-
-						/* Copy also any existing parameters of the Content-Type, like 'name' or 'charset'. */
-						if (ct && ct->params) {
-							CamelHeaderParam *param;
-							for (param = ct->params; param; param = param->next) {
-								camel_content_type_set_param (snoop_ct, param->name, param->value);
-							}
-						}
-
-						camel_content_type_set_param (snoop_ct, E_MAIL_PART_X_EVOLUTION_GUESSED, "1");
-						camel_data_wrapper_set_mime_type_field (CAMEL_DATA_WRAPPER (opart), snoop_ct);
-
-						handled = e_mail_parser_parse_part (parser, opart, part_id, cancellable, &work_queue);
-						if (handled) {
-							camel_content_type_unref (ct);
-							ct = camel_content_type_ref (snoop_ct);
-						}
-					}
-
-					g_object_unref (opart);
-					g_object_unref (dw);
-				}
-
-				g_object_unref (mem_stream);
-			}
-
-			if (snoop_ct)
-				camel_content_type_unref (snoop_ct);
-		}
-
-		if (!handled) {
-			handled = e_mail_parser_parse_part (
-				parser, subpart, part_id, cancellable, &work_queue);
-		}
-
-		mail_part = g_queue_peek_head (&work_queue);
-
-		/* Display parts with CID as attachments
-		 * (unless they already are attachments).
-		 * Show also hidden attachments with CID,
-		 * because this is multipart/mixed,
-		 * not multipart/related. */
-		if (mail_part != NULL &&
-		    e_mail_part_get_cid (mail_part) != NULL &&
-		    (!e_mail_part_get_is_attachment (mail_part) ||
-		     mail_part->is_hidden)) {
-
-			e_mail_parser_wrap_as_attachment (
-				parser, subpart, part_id, &work_queue);
-
-		/* Force messages to be expandable */
-		} else if ((mail_part == NULL && !handled) ||
-		    (camel_content_type_is (ct, "message", "*") &&
-		     mail_part != NULL &&
-		     !e_mail_part_get_is_attachment (mail_part))) {
-
-			e_mail_parser_wrap_as_attachment (
-				parser, subpart, part_id, &work_queue);
-
-			mail_part = g_queue_peek_head (&work_queue);
-
-			if (mail_part != NULL)
-				mail_part->force_inline = TRUE;
-		}
-
-		e_queue_transfer (&work_queue, out_mail_parts);
-
-		g_string_truncate (part_id, len);
-
-		if (ct)
-			camel_content_type_unref (ct);
-	}
+	/* Subparts of multipart/mixed do not depend on each other,
+	 * thus large ones can be parsed concurrently. */
+	e_mail_parser_parse_subparts (
+		parser, mp, part_id,
+		empe_mp_mixed_parse_subpart, &data,
+		cancellable, out_mail_parts);
 
 	return TRUE;
 }
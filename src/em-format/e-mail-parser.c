@@ -79,6 +79,30 @@ GType e_mail_parser_application_smime_get_type (void);
 
 static gpointer parent_class;
 
+/* Multiparts whose subparts hold less than this many bytes in total
+ * are parsed sequentially; zero disables parallel parsing entirely. */
+static gsize parallel_parse_threshold = 128 * 1024;
+
+typedef struct _ParallelParse {
+	volatile gint ref_count;
+
+	EMailParser *parser;
+	CamelMultipart *multipart;
+	const gchar *part_id;
+	EMailParserSubpartFunc func;
+	gpointer user_data;
+	GCancellable *cancellable;
+
+	GQueue *queues; /* one per subpart, merged in document order */
+	gint n_parts;
+	volatile gint next_index;
+
+	GMutex lock;
+	GCond cond;
+	gint n_running;
+	gboolean closed;
+} ParallelParse;
+
 static void
 mail_parser_move_security_before_headers (GQueue *part_queue)
 {
@@ -707,6 +731,283 @@ e_mail_parser_parse_part_as (EMailParser *parser,
 	return mime_part_handled;
 }
 
+static void
+parallel_parse_unref (ParallelParse *pp)
+{
+	if (g_atomic_int_dec_and_test (&pp->ref_count)) {
+		g_mutex_clear (&pp->lock);
+		g_cond_clear (&pp->cond);
+		g_slice_free (ParallelParse, pp);
+	}
+}
+
+static void
+parallel_parse_work (ParallelParse *pp)
+{
+	GString *part_id;
+	gint index;
+
+	part_id = g_string_new (pp->part_id);
+
+	while (TRUE) {
+		CamelMimePart *subpart;
+
+		index = g_atomic_int_add (&pp->next_index, 1);
+		if (index >= pp->n_parts)
+			break;
+
+		if (g_cancellable_is_cancelled (pp->cancellable))
+			continue;
+
+		subpart = camel_multipart_get_part (pp->multipart, index);
+		if (subpart)
+			pp->func (
+				pp->parser, subpart, index, part_id,
+				pp->cancellable, &pp->queues[index],
+				pp->user_data);
+	}
+
+	g_string_free (part_id, TRUE);
+}
+
+static void
+parallel_parse_helper_thread (gpointer data,
+                              gpointer user_data)
+{
+	ParallelParse *pp = data;
+	gboolean closed;
+
+	/* The caller stops waiting for helpers which did not start
+	 * before it ran out of subparts itself, thus a busy pool
+	 * cannot block nested multiparts on each other. */
+	g_mutex_lock (&pp->lock);
+	closed = pp->closed;
+	if (!closed)
+		pp->n_running++;
+	g_mutex_unlock (&pp->lock);
+
+	if (!closed) {
+		parallel_parse_work (pp);
+
+		g_mutex_lock (&pp->lock);
+		pp->n_running--;
+		g_cond_signal (&pp->cond);
+		g_mutex_unlock (&pp->lock);
+	}
+
+	parallel_parse_unref (pp);
+}
+
+static GThreadPool *
+parallel_parse_get_pool (void)
+{
+	static gsize pool = 0;
+
+	if (g_once_init_enter (&pool)) {
+		GThreadPool *tmp;
+
+		tmp = g_thread_pool_new (
+			parallel_parse_helper_thread, NULL,
+			MAX (g_get_num_processors () - 1, 1),
+			FALSE, NULL);
+
+		g_once_init_leave (&pool, GPOINTER_TO_SIZE (tmp));
+	}
+
+	return GSIZE_TO_POINTER (pool);
+}
+
+/* Adds the decoded size of 'dw' to 'total', including parts of nested
+ * multiparts and attached messages, like those of a forwarded digest;
+ * stops once the 'total' reaches the 'limit'. */
+static void
+mail_parser_add_content_size (CamelDataWrapper *dw,
+                              gsize limit,
+                              gsize *total)
+{
+	if (!dw || *total >= limit)
+		return;
+
+	if (CAMEL_IS_MULTIPART (dw)) {
+		CamelMultipart *multipart = CAMEL_MULTIPART (dw);
+		guint ii, n_parts;
+
+		n_parts = camel_multipart_get_number (multipart);
+
+		for (ii = 0; ii < n_parts && *total < limit; ii++) {
+			CamelMimePart *subpart;
+
+			subpart = camel_multipart_get_part (multipart, ii);
+			if (subpart)
+				mail_parser_add_content_size (CAMEL_DATA_WRAPPER (subpart), limit, total);
+		}
+	} else if (CAMEL_IS_MEDIUM (dw)) {
+		/* A MIME part or an attached message */
+		mail_parser_add_content_size (camel_medium_get_content (CAMEL_MEDIUM (dw)), limit, total);
+	} else {
+		GByteArray *ba;
+
+		ba = camel_data_wrapper_get_byte_array (dw);
+		if (ba)
+			*total += ba->len;
+	}
+}
+
+static gint
+mail_parser_count_parallel_helpers (CamelMultipart *multipart,
+                                    gint n_parts)
+{
+	gsize total = 0;
+	gint ii, n_helpers;
+
+	if (!parallel_parse_threshold || n_parts < 2 ||
+	    g_get_num_processors () < 2)
+		return 0;
+
+	/* Extensions may expect to run in the thread the parsing
+	 * was started from, when that is the main thread. */
+	if (e_util_is_main_thread (NULL))
+		return 0;
+
+	for (ii = 0; ii < n_parts && total < parallel_parse_threshold; ii++) {
+		CamelMimePart *subpart;
+
+		subpart = camel_multipart_get_part (multipart, ii);
+		if (subpart)
+			mail_parser_add_content_size (CAMEL_DATA_WRAPPER (subpart), parallel_parse_threshold, &total);
+	}
+
+	if (total < parallel_parse_threshold)
+		return 0;
+
+	n_helpers = MIN (n_parts, (gint) g_get_num_processors ()) - 1;
+
+	return MAX (n_helpers, 0);
+}
+
+/**
+ * e_mail_parser_parse_subparts:
+ * @parser: an #EMailParser
+ * @multipart: a #CamelMultipart
+ * @part_id: a #GString with the part ID of @multipart
+ * @func: an #EMailParserSubpartFunc called for each subpart
+ * @user_data: user data passed to @func
+ * @cancellable: (nullable): a #GCancellable of the ongoing parse operation
+ * @out_mail_parts: a #GQueue to add the resulting #EMailPart-s to
+ *
+ * Calls @func for each subpart of @multipart, which parses the subpart
+ * into its own queue. When the subparts are large enough and the parsing
+ * does not run in the main thread, the subparts are parsed concurrently,
+ * in which case @func receives its own copy of @part_id and it should not
+ * touch state shared with other subparts. Either way the parsed parts are
+ * added to @out_mail_parts in document order.
+ **/
+void
+e_mail_parser_parse_subparts (EMailParser *parser,
+                              CamelMultipart *multipart,
+                              GString *part_id,
+                              EMailParserSubpartFunc func,
+                              gpointer user_data,
+                              GCancellable *cancellable,
+                              GQueue *out_mail_parts)
+{
+	ParallelParse *pp;
+	GThreadPool *pool;
+	gint ii, n_parts, n_helpers;
+
+	g_return_if_fail (E_IS_MAIL_PARSER (parser));
+	g_return_if_fail (CAMEL_IS_MULTIPART (multipart));
+	g_return_if_fail (part_id != NULL);
+	g_return_if_fail (func != NULL);
+	g_return_if_fail (out_mail_parts != NULL);
+
+	n_parts = camel_multipart_get_number (multipart);
+	n_helpers = mail_parser_count_parallel_helpers (multipart, n_parts);
+
+	if (n_helpers == 0) {
+		for (ii = 0; ii < n_parts; ii++) {
+			CamelMimePart *subpart;
+
+			subpart = camel_multipart_get_part (multipart, ii);
+			if (subpart)
+				func (
+					parser, subpart, ii, part_id,
+					cancellable, out_mail_parts,
+					user_data);
+		}
+
+		return;
+	}
+
+	pp = g_slice_new0 (ParallelParse);
+	pp->ref_count = 1;
+	pp->parser = parser;
+	pp->multipart = multipart;
+	pp->part_id = part_id->str;
+	pp->func = func;
+	pp->user_data = user_data;
+	pp->cancellable = cancellable;
+	pp->queues = g_new0 (GQueue, n_parts);
+	pp->n_parts = n_parts;
+	pp->next_index = 0;
+	g_mutex_init (&pp->lock);
+	g_cond_init (&pp->cond);
+
+	pool = parallel_parse_get_pool ();
+
+	for (ii = 0; ii < n_helpers; ii++) {
+		g_atomic_int_inc (&pp->ref_count);
+
+		if (!g_thread_pool_push (pool, pp, NULL)) {
+			g_atomic_int_add (&pp->ref_count, -1);
+			break;
+		}
+	}
+
+	/* The calling thread takes subparts as well, which guarantees
+	 * progress even when no helper gets a thread from the pool. */
+	parallel_parse_work (pp);
+
+	g_mutex_lock (&pp->lock);
+	pp->closed = TRUE;
+	while (pp->n_running > 0)
+		g_cond_wait (&pp->cond, &pp->lock);
+	g_mutex_unlock (&pp->lock);
+
+	for (ii = 0; ii < n_parts; ii++)
+		e_queue_transfer (&pp->queues[ii], out_mail_parts);
+
+	g_free (pp->queues);
+	pp->queues = NULL;
+
+	parallel_parse_unref (pp);
+}
+
+/**
+ * e_mail_parser_set_parallel_parse_threshold:
+ * @bytes: minimum size of multipart content to parse in parallel
+ *
+ * Sets how many bytes the subparts of a multipart need to hold in total
+ * for e_mail_parser_parse_subparts() to parse them concurrently.
+ * Setting zero disables parallel parsing.
+ **/
+void
+e_mail_parser_set_parallel_parse_threshold (gsize bytes)
+{
+	parallel_parse_threshold = bytes;
+}
+
+/**
+ * e_mail_parser_get_parallel_parse_threshold:
+ *
+ * Returns: the threshold set by e_mail_parser_set_parallel_parse_threshold()
+ **/
+gsize
+e_mail_parser_get_parallel_parse_threshold (void)
+{
+	return parallel_parse_threshold;
+}
+
 void
 e_mail_parser_error (EMailParser *parser,
                      GQueue *out_mail_parts,
@@ -51,6 +51,27 @@ struct _EMailParser {
 	EMailParserPrivate *priv;
 };
 
+/**
+ * EMailParserSubpartFunc:
+ * @parser: an #EMailParser
+ * @subpart: a subpart of the multipart being parsed
+ * @index: index of @subpart within the multipart
+ * @part_id: a #GString with the part ID of the multipart; it should be
+ *    left unchanged when the function returns
+ * @cancellable: (nullable): a #GCancellable of the ongoing parse operation
+ * @out_mail_parts: a #GQueue to add the parsed #EMailPart-s to
+ * @user_data: user data passed to e_mail_parser_parse_subparts()
+ *
+ * Parses one subpart for e_mail_parser_parse_subparts().
+ **/
+typedef void	(*EMailParserSubpartFunc)	(EMailParser *parser,
+						 CamelMimePart *subpart,
+						 gint index,
+						 GString *part_id,
+						 GCancellable *cancellable,
+						 GQueue *out_mail_parts,
+						 gpointer user_data);
+
 struct _EMailParserClass {
 	GObjectClass parent_class;
 
@@ -97,6 +118,18 @@ gboolean	e_mail_parser_parse_part_as	(EMailParser *parser,
 						 GCancellable *cancellable,
 						 GQueue *out_mail_parts);
 
+void		e_mail_parser_parse_subparts	(EMailParser *parser,
+						 CamelMultipart *multipart,
+						 GString *part_id,
+						 EMailParserSubpartFunc func,
+						 gpointer user_data,
+						 GCancellable *cancellable,
+						 GQueue *out_mail_parts);
+void		e_mail_parser_set_parallel_parse_threshold
+						(gsize bytes);
+gsize		e_mail_parser_get_parallel_parse_threshold
+						(void);
+
 void		e_mail_parser_error		(EMailParser *parser,
 						 GQueue *out_mail_parts,
 						 const gchar *format,
@@ -29,7 +29,14 @@ struct _EMailPartListPrivate {
 	gchar *message_uid;
 
 	GQueue queue;
-	GMutex queue_lock;
+	GRWLock queue_lock;
+
+	/* Indexes of the parts in the queue; the first part wins */
+	GHashTable *parts_by_id;	/* const gchar *id ~> EMailPart * */
+	GHashTable *parts_by_cid;	/* gchar *cid ~> EMailPart * */
+
+	/* The parser options stamp, when added to the registry */
+	gint options_stamp;
 };
 
 enum {
@@ -44,6 +51,32 @@ G_DEFINE_TYPE (EMailPartList, e_mail_part_list, G_TYPE_OBJECT)
 static CamelObjectBag *registry = NULL;
 G_LOCK_DEFINE_STATIC (registry);
 
+/* The registry references its part lists weakly, thus the cache keeps
+ * the recently used ones alive, within these limits */
+#define CACHE_MAX_ITEMS 32
+#define CACHE_MAX_BYTES (64 * 1024 * 1024)
+
+/* Estimated size of a part list without a known message size */
+#define CACHE_DEFAULT_ITEM_BYTES (256 * 1024)
+
+/* Cache lookups between two statistics prints with CAMEL_DEBUG=emformat:cache */
+#define CACHE_STATS_INTERVAL 100
+
+typedef struct _CacheItem {
+	EMailPartList *part_list;
+	gsize n_bytes;
+} CacheItem;
+
+/* Changed with the parser options; registered part lists with
+ * a different stamp were parsed with other options, thus are stale */
+static volatile gint parser_options_stamp = 0;
+
+static GQueue cache_items = G_QUEUE_INIT; /* CacheItem *, the most recent first */
+static gsize cache_bytes = 0;
+static guint cache_hits = 0;
+static guint cache_misses = 0;
+G_LOCK_DEFINE_STATIC (cache);
+
 static void
 mail_part_list_set_folder (EMailPartList *part_list,
                            CamelFolder *folder)
@@ -158,10 +191,12 @@ mail_part_list_dispose (GObject *object)
 		priv->message = NULL;
 	}
 
-	g_mutex_lock (&priv->queue_lock);
+	g_rw_lock_writer_lock (&priv->queue_lock);
+	g_hash_table_remove_all (priv->parts_by_id);
+	g_hash_table_remove_all (priv->parts_by_cid);
 	while (!g_queue_is_empty (&priv->queue))
 		g_object_unref (g_queue_pop_head (&priv->queue));
-	g_mutex_unlock (&priv->queue_lock);
+	g_rw_lock_writer_unlock (&priv->queue_lock);
 
 	/* Chain up to parent's dispose() method. */
 	G_OBJECT_CLASS (e_mail_part_list_parent_class)->dispose (object);
@@ -177,7 +212,9 @@ mail_part_list_finalize (GObject *object)
 	g_free (priv->message_uid);
 
 	g_warn_if_fail (g_queue_is_empty (&priv->queue));
-	g_mutex_clear (&priv->queue_lock);
+	g_hash_table_destroy (priv->parts_by_id);
+	g_hash_table_destroy (priv->parts_by_cid);
+	g_rw_lock_clear (&priv->queue_lock);
 
 	/* Chain up to parent's finalize() method. */
 	G_OBJECT_CLASS (e_mail_part_list_parent_class)->finalize (object);
@@ -238,7 +275,11 @@ e_mail_part_list_init (EMailPartList *part_list)
 {
 	part_list->priv = E_MAIL_PART_LIST_GET_PRIVATE (part_list);
 
-	g_mutex_init (&part_list->priv->queue_lock);
+	g_rw_lock_init (&part_list->priv->queue_lock);
+
+	/* The part IDs are construct-only, thus they can be borrowed */
+	part_list->priv->parts_by_id = g_hash_table_new (g_str_hash, g_str_equal);
+	part_list->priv->parts_by_cid = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 }
 
 EMailPartList *
@@ -287,26 +328,54 @@ void
 e_mail_part_list_add_part (EMailPartList *part_list,
                            EMailPart *part)
 {
+	const gchar *id, *cid;
+
 	g_return_if_fail (E_IS_MAIL_PART_LIST (part_list));
 	g_return_if_fail (E_IS_MAIL_PART (part));
 
-	g_mutex_lock (&part_list->priv->queue_lock);
+	g_rw_lock_writer_lock (&part_list->priv->queue_lock);
 
 	g_queue_push_tail (
 		&part_list->priv->queue,
 		g_object_ref (part));
 
-	g_mutex_unlock (&part_list->priv->queue_lock);
+	id = e_mail_part_get_id (part);
+	if (id && !g_hash_table_contains (part_list->priv->parts_by_id, id))
+		g_hash_table_insert (part_list->priv->parts_by_id, (gpointer) id, part);
+
+	cid = e_mail_part_get_cid (part);
+	if (cid && !g_hash_table_contains (part_list->priv->parts_by_cid, cid))
+		g_hash_table_insert (part_list->priv->parts_by_cid, g_strdup (cid), part);
+
+	g_rw_lock_writer_unlock (&part_list->priv->queue_lock);
 
 	e_mail_part_set_part_list (part, part_list);
 }
 
+/* Finds the first part with the 'cid' in the queue. This is needed when
+ * the indexed part had changed its content ID after being added, or some
+ * part got the 'cid' after being added. Call with the lock held. */
+static EMailPart *
+mail_part_list_find_by_cid_locked (EMailPartList *part_list,
+                                   const gchar *cid)
+{
+	GList *link;
+
+	for (link = g_queue_peek_head_link (&part_list->priv->queue); link; link = g_list_next (link)) {
+		EMailPart *candidate = E_MAIL_PART (link->data);
+
+		if (g_strcmp0 (e_mail_part_get_cid (candidate), cid) == 0)
+			return candidate;
+	}
+
+	return NULL;
+}
+
 EMailPart *
 e_mail_part_list_ref_part (EMailPartList *part_list,
                            const gchar *part_id)
 {
 	EMailPart *match = NULL;
-	GList *head, *link;
 	gboolean by_cid;
 
 	g_return_val_if_fail (E_IS_MAIL_PART_LIST (part_list), NULL);
@@ -314,26 +383,38 @@ e_mail_part_list_ref_part (EMailPartList *part_list,
 
 	by_cid = (g_ascii_strncasecmp (part_id, "cid:", 4) == 0);
 
-	g_mutex_lock (&part_list->priv->queue_lock);
+	g_rw_lock_reader_lock (&part_list->priv->queue_lock);
 
-	head = g_queue_peek_head_link (&part_list->priv->queue);
+	if (by_cid) {
+		EMailPart *candidate;
 
-	for (link = head; link != NULL; link = g_list_next (link)) {
-		EMailPart *candidate = E_MAIL_PART (link->data);
-		const gchar *candidate_id;
-
-		if (by_cid)
-			candidate_id = e_mail_part_get_cid (candidate);
-		else
-			candidate_id = e_mail_part_get_id (candidate);
+		candidate = g_hash_table_lookup (part_list->priv->parts_by_cid, part_id);
 
-		if (g_strcmp0 (candidate_id, part_id) == 0) {
+		if (candidate && g_strcmp0 (e_mail_part_get_cid (candidate), part_id) == 0)
 			match = g_object_ref (candidate);
-			break;
-		}
+	} else {
+		match = g_hash_table_lookup (part_list->priv->parts_by_id, part_id);
+		if (match)
+			g_object_ref (match);
 	}
 
-	g_mutex_unlock (&part_list->priv->queue_lock);
+	g_rw_lock_reader_unlock (&part_list->priv->queue_lock);
+
+	/* The content IDs can change, thus verify with the queue */
+	if (by_cid && !match) {
+		g_rw_lock_writer_lock (&part_list->priv->queue_lock);
+
+		match = mail_part_list_find_by_cid_locked (part_list, part_id);
+
+		if (match) {
+			g_hash_table_insert (part_list->priv->parts_by_cid, g_strdup (part_id), match);
+			g_object_ref (match);
+		} else {
+			g_hash_table_remove (part_list->priv->parts_by_cid, part_id);
+		}
+
+		g_rw_lock_writer_unlock (&part_list->priv->queue_lock);
+	}
 
 	return match;
 }
@@ -364,10 +445,14 @@ e_mail_part_list_queue_parts (EMailPartList *part_list,
 	g_return_val_if_fail (E_IS_MAIL_PART_LIST (part_list), FALSE);
 	g_return_val_if_fail (result_queue != NULL, FALSE);
 
-	g_mutex_lock (&part_list->priv->queue_lock);
+	g_rw_lock_reader_lock (&part_list->priv->queue_lock);
 
 	link = g_queue_peek_head_link (&part_list->priv->queue);
 
+	/* Nothing to queue for an unknown part */
+	if (part_id != NULL && !g_hash_table_contains (part_list->priv->parts_by_id, part_id))
+		link = NULL;
+
 	if (part_id != NULL) {
 		for (; link != NULL; link = g_list_next (link)) {
 			EMailPart *candidate = E_MAIL_PART (link->data);
@@ -391,7 +476,7 @@ e_mail_part_list_queue_parts (EMailPartList *part_list,
 		parts_queued++;
 	}
 
-	g_mutex_unlock (&part_list->priv->queue_lock);
+	g_rw_lock_reader_unlock (&part_list->priv->queue_lock);
 
 	return parts_queued;
 }
@@ -409,13 +494,292 @@ e_mail_part_list_is_empty (EMailPartList *part_list)
 
 	g_return_val_if_fail (E_IS_MAIL_PART_LIST (part_list), TRUE);
 
-	g_mutex_lock (&part_list->priv->queue_lock);
+	g_rw_lock_reader_lock (&part_list->priv->queue_lock);
 	is_empty = g_queue_is_empty (&part_list->priv->queue);
-	g_mutex_unlock (&part_list->priv->queue_lock);
+	g_rw_lock_reader_unlock (&part_list->priv->queue_lock);
 
 	return is_empty;
 }
 
+/* The parsed content, with decoded parts, is roughly twice the message */
+static gsize
+mail_part_list_estimate_size (EMailPartList *part_list)
+{
+	CamelMessageInfo *info;
+	gsize n_bytes = 0;
+
+	if (part_list->priv->folder && part_list->priv->message_uid) {
+		info = camel_folder_get_message_info (part_list->priv->folder, part_list->priv->message_uid);
+		if (info) {
+			n_bytes = 2 * camel_message_info_get_size (info);
+			g_object_unref (info);
+		}
+	}
+
+	return n_bytes > 0 ? n_bytes : CACHE_DEFAULT_ITEM_BYTES;
+}
+
+/**
+ * e_mail_part_list_cache_hold:
+ * @part_list: an #EMailPartList
+ *
+ * Marks the @part_list as recently used and keeps it alive in the cache
+ * of parsed messages, thus it can be found in the registry even when no
+ * one else references it. The least recently used part lists are released
+ * when the cache exceeds its item count or memory budget.
+ **/
+void
+e_mail_part_list_cache_hold (EMailPartList *part_list)
+{
+	GQueue released = G_QUEUE_INIT;
+	CacheItem *item = NULL;
+	GList *link;
+	gsize n_bytes;
+
+	g_return_if_fail (E_IS_MAIL_PART_LIST (part_list));
+
+	/* Reads the folder summary, thus not under the lock */
+	n_bytes = mail_part_list_estimate_size (part_list);
+
+	G_LOCK (cache);
+
+	for (link = g_queue_peek_head_link (&cache_items); link; link = g_list_next (link)) {
+		item = link->data;
+
+		if (item->part_list == part_list) {
+			g_queue_unlink (&cache_items, link);
+			g_list_free (link);
+			break;
+		}
+
+		item = NULL;
+	}
+
+	if (!item) {
+		item = g_slice_new (CacheItem);
+		item->part_list = g_object_ref (part_list);
+		item->n_bytes = n_bytes;
+
+		cache_bytes += item->n_bytes;
+	}
+
+	g_queue_push_head (&cache_items, item);
+
+	/* Keep at least the just used part list */
+	while (g_queue_get_length (&cache_items) > 1 &&
+	       (g_queue_get_length (&cache_items) > CACHE_MAX_ITEMS || cache_bytes > CACHE_MAX_BYTES)) {
+		item = g_queue_pop_tail (&cache_items);
+		cache_bytes -= item->n_bytes;
+		g_queue_push_tail (&released, item);
+	}
+
+	G_UNLOCK (cache);
+
+	/* Release outside of the lock, the finalization can take time */
+	while (!g_queue_is_empty (&released)) {
+		item = g_queue_pop_head (&released);
+		g_object_unref (item->part_list);
+		g_slice_free (CacheItem, item);
+	}
+}
+
+/**
+ * e_mail_part_list_cache_clear:
+ *
+ * Releases all part lists held by the cache of parsed messages. It is
+ * meant for changes which can make the parsed content stale, like when
+ * a folder or an account is removed, or a certificate is imported.
+ **/
+void
+e_mail_part_list_cache_clear (void)
+{
+	GQueue released = G_QUEUE_INIT;
+
+	G_LOCK (cache);
+	released = cache_items;
+	g_queue_init (&cache_items);
+	cache_bytes = 0;
+	G_UNLOCK (cache);
+
+	while (!g_queue_is_empty (&released)) {
+		CacheItem *item = g_queue_pop_head (&released);
+
+		g_object_unref (item->part_list);
+		g_slice_free (CacheItem, item);
+	}
+}
+
+/**
+ * e_mail_part_list_cache_invalidate:
+ *
+ * Marks all parsed messages as stale, thus they are parsed again when
+ * requested from the registry next time. It is meant to be called when
+ * options of the parser or of its extensions change, which change the
+ * resulting part lists, like the preference of the plain text parts.
+ **/
+void
+e_mail_part_list_cache_invalidate (void)
+{
+	g_atomic_int_inc (&parser_options_stamp);
+
+	e_mail_part_list_cache_clear ();
+}
+
+/**
+ * e_mail_part_list_cache_get_stats:
+ * @out_hits: (out) (optional): return location for the number of cache hits
+ * @out_misses: (out) (optional): return location for the number of cache misses
+ * @out_n_items: (out) (optional): return location for the number of held part lists
+ * @out_n_bytes: (out) (optional): return location for the estimated size of held part lists
+ *
+ * Returns statistics of the cache of parsed messages, as counted
+ * by e_mail_part_list_registry_reserve() and e_mail_part_list_registry_get().
+ **/
+void
+e_mail_part_list_cache_get_stats (guint *out_hits,
+                                  guint *out_misses,
+                                  guint *out_n_items,
+                                  gsize *out_n_bytes)
+{
+	G_LOCK (cache);
+
+	if (out_hits)
+		*out_hits = cache_hits;
+	if (out_misses)
+		*out_misses = cache_misses;
+	if (out_n_items)
+		*out_n_items = g_queue_get_length (&cache_items);
+	if (out_n_bytes)
+		*out_n_bytes = cache_bytes;
+
+	G_UNLOCK (cache);
+}
+
+static void
+mail_part_list_cache_count (EMailPartList *part_list)
+{
+	gboolean print_stats;
+
+	G_LOCK (cache);
+
+	if (part_list)
+		cache_hits++;
+	else
+		cache_misses++;
+
+	print_stats = ((cache_hits + cache_misses) % CACHE_STATS_INTERVAL) == 0;
+
+	G_UNLOCK (cache);
+
+	if (part_list)
+		e_mail_part_list_cache_hold (part_list);
+
+	if (print_stats && camel_debug_start ("emformat:cache")) {
+		guint hits = 0, misses = 0, n_items = 0;
+		gsize n_bytes = 0;
+
+		e_mail_part_list_cache_get_stats (&hits, &misses, &n_items, &n_bytes);
+
+		printf ("Parsed message cache: %u hits, %u misses, %u items, %" G_GSIZE_FORMAT " bytes\n",
+			hits, misses, n_items, n_bytes);
+
+		camel_debug_end ();
+	}
+}
+
+/* Removes the 'part_list' from the registry and unrefs it, when it was
+ * parsed with other parser options than the current; returns whether
+ * it did so */
+static gboolean
+mail_part_list_registry_drop_stale (EMailPartList *part_list)
+{
+	if (part_list->priv->options_stamp == g_atomic_int_get (&parser_options_stamp))
+		return FALSE;
+
+	camel_object_bag_remove (e_mail_part_list_get_registry (), part_list);
+	g_object_unref (part_list);
+
+	return TRUE;
+}
+
+/**
+ * e_mail_part_list_registry_reserve:
+ * @mail_uri: a mail URI, as built by e_mail_part_build_uri()
+ *
+ * Calls camel_object_bag_reserve() on the registry, counting cache
+ * hits and misses. A found part list is marked as recently used; on
+ * a miss the caller is expected to parse the message and add it with
+ * e_mail_part_list_registry_add(), or abort the reservation.
+ *
+ * Returns: (transfer full) (nullable): a referenced #EMailPartList,
+ *    or %NULL, when the @mail_uri had been reserved
+ **/
+EMailPartList *
+e_mail_part_list_registry_reserve (const gchar *mail_uri)
+{
+	EMailPartList *part_list;
+
+	g_return_val_if_fail (mail_uri != NULL, NULL);
+
+	part_list = camel_object_bag_reserve (e_mail_part_list_get_registry (), mail_uri);
+
+	/* Once the stale one is removed, the reservation succeeds */
+	while (part_list && mail_part_list_registry_drop_stale (part_list))
+		part_list = camel_object_bag_reserve (e_mail_part_list_get_registry (), mail_uri);
+
+	mail_part_list_cache_count (part_list);
+
+	return part_list;
+}
+
+/**
+ * e_mail_part_list_registry_get:
+ * @mail_uri: a mail URI, as built by e_mail_part_build_uri()
+ *
+ * Calls camel_object_bag_get() on the registry, counting cache hits
+ * and misses. A found part list is marked as recently used.
+ *
+ * Returns: (transfer full) (nullable): a referenced #EMailPartList, or %NULL
+ **/
+EMailPartList *
+e_mail_part_list_registry_get (const gchar *mail_uri)
+{
+	EMailPartList *part_list;
+
+	g_return_val_if_fail (mail_uri != NULL, NULL);
+
+	part_list = camel_object_bag_get (e_mail_part_list_get_registry (), mail_uri);
+
+	if (part_list && mail_part_list_registry_drop_stale (part_list))
+		part_list = NULL;
+
+	mail_part_list_cache_count (part_list);
+
+	return part_list;
+}
+
+/**
+ * e_mail_part_list_registry_add:
+ * @mail_uri: a mail URI, as built by e_mail_part_build_uri()
+ * @part_list: an #EMailPartList
+ *
+ * Adds the @part_list into the registry, with camel_object_bag_add(),
+ * and holds it in the cache of parsed messages.
+ **/
+void
+e_mail_part_list_registry_add (const gchar *mail_uri,
+                               EMailPartList *part_list)
+{
+	g_return_if_fail (mail_uri != NULL);
+	g_return_if_fail (E_IS_MAIL_PART_LIST (part_list));
+
+	part_list->priv->options_stamp = g_atomic_int_get (&parser_options_stamp);
+
+	camel_object_bag_add (e_mail_part_list_get_registry (), mail_uri, part_list);
+
+	e_mail_part_list_cache_hold (part_list);
+}
+
 /**
  * e_mail_part_list_get_registry:
  *
@@ -75,6 +75,20 @@ gboolean	e_mail_part_list_is_empty	(EMailPartList *part_list);
 
 CamelObjectBag *
 		e_mail_part_list_get_registry	(void);
+EMailPartList *	e_mail_part_list_registry_reserve
+						(const gchar *mail_uri);
+EMailPartList *	e_mail_part_list_registry_get	(const gchar *mail_uri);
+void		e_mail_part_list_registry_add	(const gchar *mail_uri,
+						 EMailPartList *part_list);
+void		e_mail_part_list_cache_hold	(EMailPartList *part_list);
+void		e_mail_part_list_cache_clear	(void);
+void		e_mail_part_list_cache_invalidate
+						(void);
+void		e_mail_part_list_cache_get_stats
+						(guint *out_hits,
+						 guint *out_misses,
+						 guint *out_n_items,
+						 gsize *out_n_bytes);
 
 G_END_DECLS
 
@@ -24,6 +24,7 @@
 #include "e-cert-db.h"
 #endif
 
+#include "e-mail-part-list.h"
 #include "e-mail-part-secure-button.h"
 
 G_DEFINE_TYPE (EMailPartSecureButton, e_mail_part_secure_button, E_TYPE_MAIL_PART)
@@ -98,6 +99,9 @@ secure_button_import_certificate (GtkWindow *parent,
 
 		g_clear_error (&error);
 	} else {
+		/* Signature states of the parsed messages can change */
+		e_mail_part_list_cache_clear ();
+
 		e_web_view_jsc_set_element_disabled (WEBKIT_WEB_VIEW (web_view),
 			iframe_id, element_id, TRUE,
 			e_web_view_get_cancellable (web_view));
@@ -20,6 +20,7 @@
 #include "e-mail-folder-utils.h"
 
 #include <glib/gi18n-lib.h>
+#include <sqlite3.h>
 
 #include <libedataserver/libedataserver.h>
 
@@ -31,6 +32,18 @@
 /* User-Agent header value */
 #define USER_AGENT ("Evolution " VERSION VERSION_SUBSTRING " " VERSION_COMMENT)
 
+/* Folder data key of the { message UID : content digest } table */
+#define MESSAGE_DIGESTS_KEY "e-mail-message-digests"
+
+/* Store data key of the CamelDB with the persistent digest index */
+#define MESSAGE_DIGESTS_DB_KEY "e-mail-message-digests-db"
+
+/* File name of the digest index, in the user cache directory of the store */
+#define MESSAGE_DIGESTS_DB_FILENAME "message-digests.db"
+
+/* Guards the message digest tables of all folders */
+G_LOCK_DEFINE_STATIC (message_digests);
+
 typedef struct _AsyncContext AsyncContext;
 
 struct _AsyncContext {
@@ -658,6 +671,339 @@ mail_folder_find_duplicate_messages_thread (GSimpleAsyncResult *simple,
 		g_simple_async_result_take_error (simple, error);
 }
 
+static gchar *
+emfu_compute_message_digest_sync (CamelMimeMessage *message,
+                                  GCancellable *cancellable)
+{
+	CamelDataWrapper *content;
+	CamelStream *stream;
+	GByteArray *buffer;
+	gchar *digest = NULL;
+
+	/* Generate a digest string from the message's content. */
+	content = camel_medium_get_content (CAMEL_MEDIUM (message));
+
+	if (content == NULL)
+		return NULL;
+
+	stream = camel_stream_mem_new ();
+
+	if (camel_data_wrapper_decode_to_stream_sync (content, stream, cancellable, NULL) >= 0) {
+		guint data_len;
+
+		/* The CamelStreamMem owns the buffer. */
+		buffer = camel_stream_mem_get_byte_array (
+			CAMEL_STREAM_MEM (stream));
+
+		data_len = buffer ? buffer->len : 0;
+
+		/* Strip trailing white-spaces and empty lines */
+		while (data_len > 0 && g_ascii_isspace (buffer->data[data_len - 1]))
+			data_len--;
+
+		if (data_len > 0)
+			digest = g_compute_checksum_for_data (G_CHECKSUM_SHA256, buffer->data, data_len);
+	}
+
+	g_object_unref (stream);
+
+	return digest;
+}
+
+/* Returns the digest index of the 'store', opening it when needed,
+ * or NULL when it cannot be opened. The index lives as long as the store. */
+static CamelDB *
+emfu_digests_get_db (CamelStore *store)
+{
+	/* Marks a store whose index cannot be opened */
+	static gint failed_db;
+	CamelDB *db;
+	gpointer data;
+	gchar *filename;
+	GError *local_error = NULL;
+
+	G_LOCK (message_digests);
+
+	data = g_object_get_data (G_OBJECT (store), MESSAGE_DIGESTS_DB_KEY);
+
+	if (data) {
+		G_UNLOCK (message_digests);
+
+		return data == &failed_db ? NULL : data;
+	}
+
+	filename = g_build_filename (
+		camel_service_get_user_cache_dir (CAMEL_SERVICE (store)),
+		MESSAGE_DIGESTS_DB_FILENAME, NULL);
+
+	db = camel_db_new (filename, &local_error);
+
+	if (db) {
+		camel_db_command (db,
+			"CREATE TABLE IF NOT EXISTS digests "
+			"(folder TEXT, uid TEXT, digest TEXT, PRIMARY KEY (folder, uid))",
+			&local_error);
+
+		if (local_error)
+			g_clear_object (&db);
+	}
+
+	if (local_error) {
+		g_warning ("%s: Failed to open '%s': %s", G_STRFUNC, filename, local_error->message);
+		g_clear_error (&local_error);
+	}
+
+	/* Remember a failure as well, thus it is not retried on each message */
+	if (db)
+		g_object_set_data_full (G_OBJECT (store), MESSAGE_DIGESTS_DB_KEY, db, g_object_unref);
+	else
+		g_object_set_data (G_OBJECT (store), MESSAGE_DIGESTS_DB_KEY, &failed_db);
+
+	G_UNLOCK (message_digests);
+
+	g_free (filename);
+
+	return db;
+}
+
+/* Call with the lock held */
+static void
+emfu_digests_remember_locked (CamelFolder *folder,
+                              const gchar *message_uid,
+                              const gchar *digest)
+{
+	GHashTable *digests;
+
+	digests = g_object_get_data (G_OBJECT (folder), MESSAGE_DIGESTS_KEY);
+
+	if (!digests) {
+		digests = g_hash_table_new_full (
+			(GHashFunc) g_str_hash,
+			(GEqualFunc) g_str_equal,
+			(GDestroyNotify) camel_pstring_free,
+			(GDestroyNotify) g_free);
+
+		g_object_set_data_full (
+			G_OBJECT (folder), MESSAGE_DIGESTS_KEY, digests,
+			(GDestroyNotify) g_hash_table_destroy);
+	}
+
+	g_hash_table_insert (
+		digests, (gpointer) camel_pstring_strdup (message_uid),
+		g_strdup (digest));
+}
+
+static gint
+emfu_digests_found_cb (gpointer data,
+                       gint ncol,
+                       gchar **colvalues,
+                       gchar **colnames)
+{
+	gchar **pdigest = data;
+
+	if (ncol > 0 && !*pdigest)
+		*pdigest = g_strdup (colvalues[0] ? colvalues[0] : "");
+
+	return 0;
+}
+
+/* Returns the digest of the message, an empty string for a message
+ * without content, or NULL when it is not known yet. The in-memory
+ * table is consulted first, then the index of the store. */
+static gchar *
+emfu_digests_lookup (CamelFolder *folder,
+                     const gchar *message_uid)
+{
+	GHashTable *digests;
+	CamelDB *db;
+	const gchar *cached = NULL;
+	gchar *digest = NULL;
+
+	G_LOCK (message_digests);
+
+	digests = g_object_get_data (G_OBJECT (folder), MESSAGE_DIGESTS_KEY);
+	if (digests && g_hash_table_lookup_extended (digests, message_uid, NULL, (gpointer *) &cached))
+		digest = g_strdup (cached);
+
+	G_UNLOCK (message_digests);
+
+	if (digest)
+		return digest;
+
+	db = emfu_digests_get_db (camel_folder_get_parent_store (folder));
+
+	if (db) {
+		gchar *stmt;
+
+		stmt = sqlite3_mprintf (
+			"SELECT digest FROM digests WHERE folder=%Q AND uid=%Q",
+			camel_folder_get_full_name (folder), message_uid);
+		camel_db_select (db, stmt, emfu_digests_found_cb, &digest, NULL);
+		sqlite3_free (stmt);
+	}
+
+	if (digest) {
+		G_LOCK (message_digests);
+		emfu_digests_remember_locked (folder, message_uid, digest);
+		G_UNLOCK (message_digests);
+	}
+
+	return digest;
+}
+
+/* Stores the 'digest' in memory and in the index; an empty
+ * string stands for a message without content */
+static void
+emfu_digests_store (CamelFolder *folder,
+                    const gchar *message_uid,
+                    const gchar *digest)
+{
+	CamelDB *db;
+
+	G_LOCK (message_digests);
+	emfu_digests_remember_locked (folder, message_uid, digest);
+	G_UNLOCK (message_digests);
+
+	db = emfu_digests_get_db (camel_folder_get_parent_store (folder));
+
+	if (db) {
+		gchar *stmt;
+
+		stmt = sqlite3_mprintf (
+			"INSERT OR REPLACE INTO digests (folder, uid, digest) VALUES (%Q, %Q, %Q)",
+			camel_folder_get_full_name (folder), message_uid, digest);
+		camel_db_command (db, stmt, NULL);
+		sqlite3_free (stmt);
+	}
+}
+
+/**
+ * e_mail_folder_dup_message_digest_sync:
+ * @folder: a #CamelFolder
+ * @message_uid: a message UID in @folder
+ * @allow_download: whether the message can be downloaded
+ * @cancellable: optional #GCancellable object, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Returns a SHA-256 digest of the content of the message @message_uid,
+ * as used to detect duplicate messages. The digest is remembered in an
+ * index in the cache directory of the account, thus it is computed only
+ * once per message, including messages without any content. When it was
+ * not computed yet and the message is not available locally, it is
+ * downloaded only if @allow_download is %TRUE.
+ *
+ * Returns: a newly allocated digest string, or %NULL when it is not
+ *    available or on error; free it with g_free(), when no longer needed
+ **/
+gchar *
+e_mail_folder_dup_message_digest_sync (CamelFolder *folder,
+                                       const gchar *message_uid,
+                                       gboolean allow_download,
+                                       GCancellable *cancellable,
+                                       GError **error)
+{
+	CamelMimeMessage *message;
+	gchar *digest;
+
+	g_return_val_if_fail (CAMEL_IS_FOLDER (folder), NULL);
+	g_return_val_if_fail (message_uid != NULL, NULL);
+
+	digest = emfu_digests_lookup (folder, message_uid);
+
+	if (digest) {
+		/* An empty string stands for a message without content */
+		if (!*digest)
+			g_clear_pointer (&digest, g_free);
+
+		return digest;
+	}
+
+	message = camel_folder_get_message_cached (folder, message_uid, cancellable);
+
+	if (!message && allow_download)
+		message = camel_folder_get_message_sync (
+			folder, message_uid, cancellable, error);
+
+	if (CAMEL_IS_MIME_MESSAGE (message))
+		digest = emfu_compute_message_digest_sync (message, cancellable);
+
+	/* A cancelled digest computation is not an empty content */
+	if (CAMEL_IS_MIME_MESSAGE (message) && !g_cancellable_is_cancelled (cancellable))
+		emfu_digests_store (folder, message_uid, digest ? digest : "");
+
+	g_clear_object (&message);
+
+	return digest;
+}
+
+/**
+ * e_mail_folder_update_message_digests_sync:
+ * @folder: a #CamelFolder
+ * @changes: a #CamelFolderChangeInfo of the @folder
+ * @cancellable: optional #GCancellable object, or %NULL
+ *
+ * Updates the index of message digests, as used by
+ * e_mail_folder_dup_message_digest_sync(), with the @changes: removed
+ * messages are dropped from it and added messages, which are available
+ * locally, are digested. Nothing is downloaded.
+ **/
+void
+e_mail_folder_update_message_digests_sync (CamelFolder *folder,
+                                           CamelFolderChangeInfo *changes,
+                                           GCancellable *cancellable)
+{
+	CamelDB *db;
+	guint ii;
+
+	g_return_if_fail (CAMEL_IS_FOLDER (folder));
+	g_return_if_fail (changes != NULL);
+
+	if (CAMEL_IS_VEE_FOLDER (folder))
+		return;
+
+	db = emfu_digests_get_db (camel_folder_get_parent_store (folder));
+
+	if (changes->uid_removed && changes->uid_removed->len > 0) {
+		GHashTable *digests;
+
+		G_LOCK (message_digests);
+
+		digests = g_object_get_data (G_OBJECT (folder), MESSAGE_DIGESTS_KEY);
+
+		for (ii = 0; digests && ii < changes->uid_removed->len; ii++)
+			g_hash_table_remove (digests, changes->uid_removed->pdata[ii]);
+
+		G_UNLOCK (message_digests);
+
+		if (db) {
+			camel_db_begin_transaction (db, NULL);
+
+			for (ii = 0; ii < changes->uid_removed->len; ii++) {
+				gchar *stmt;
+
+				stmt = sqlite3_mprintf (
+					"DELETE FROM digests WHERE folder=%Q AND uid=%Q",
+					camel_folder_get_full_name (folder),
+					(const gchar *) changes->uid_removed->pdata[ii]);
+				camel_db_add_to_transaction (db, stmt, NULL);
+				sqlite3_free (stmt);
+			}
+
+			camel_db_end_transaction (db, NULL);
+		}
+	}
+
+	for (ii = 0; changes->uid_added && ii < changes->uid_added->len &&
+	     !g_cancellable_is_cancelled (cancellable); ii++) {
+		gchar *digest;
+
+		/* Only reads the digest or a locally available message */
+		digest = e_mail_folder_dup_message_digest_sync (
+			folder, changes->uid_added->pdata[ii], FALSE, cancellable, NULL);
+		g_free (digest);
+	}
+}
+
 static GHashTable *
 emfu_get_messages_hash_sync (CamelFolder *folder,
                              GPtrArray *message_uids,
@@ -665,7 +1011,6 @@ emfu_get_messages_hash_sync (CamelFolder *folder,
                              GError **error)
 {
 	GHashTable *hash_table;
-	CamelMimeMessage *message;
 	guint ii;
 
 	g_return_val_if_fail (CAMEL_IS_FOLDER (folder), NULL);
@@ -690,62 +1035,26 @@ emfu_get_messages_hash_sync (CamelFolder *folder,
 
 	for (ii = 0; ii < message_uids->len; ii++) {
 		const gchar *uid;
+		gchar *digest;
 		gint percent;
+		GError *local_error = NULL;
 
 		uid = g_ptr_array_index (message_uids, ii);
 		percent = ((ii + 1) * 100) / message_uids->len;
 
-		message = camel_folder_get_message_sync (
-			folder, uid, cancellable, error);
+		digest = e_mail_folder_dup_message_digest_sync (
+			folder, uid, TRUE, cancellable, &local_error);
 
 		camel_operation_progress (cancellable, percent);
 
-		if (CAMEL_IS_MIME_MESSAGE (message)) {
-			CamelDataWrapper *content;
-			gchar *digest = NULL;
-
-			/* Generate a digest string from the message's content. */
-			content = camel_medium_get_content (CAMEL_MEDIUM (message));
-
-			if (content != NULL) {
-				CamelStream *stream;
-				GByteArray *buffer;
-				gssize n_bytes;
-
-				stream = camel_stream_mem_new ();
-
-				n_bytes = camel_data_wrapper_decode_to_stream_sync (
-					content, stream, cancellable, error);
-
-				if (n_bytes >= 0) {
-					guint data_len;
-
-					/* The CamelStreamMem owns the buffer. */
-					buffer = camel_stream_mem_get_byte_array (
-						CAMEL_STREAM_MEM (stream));
-					g_return_val_if_fail (buffer != NULL, NULL);
-
-					data_len = buffer->len;
-
-					/* Strip trailing white-spaces and empty lines */
-					while (data_len > 0 && g_ascii_isspace (buffer->data[data_len - 1]))
-						data_len--;
-
-					if (data_len > 0)
-						digest = g_compute_checksum_for_data (G_CHECKSUM_SHA256, buffer->data, data_len);
-				}
-
-				g_object_unref (stream);
-			}
-
-			g_hash_table_insert (
-				hash_table, g_strdup (uid), digest);
-			g_object_unref (message);
-		} else {
+		if (local_error != NULL) {
+			g_propagate_error (error, local_error);
 			g_hash_table_destroy (hash_table);
 			hash_table = NULL;
 			break;
 		}
+
+		g_hash_table_insert (hash_table, g_strdup (uid), digest);
 	}
 
 	camel_operation_pop_message (cancellable);
@@ -762,6 +1071,7 @@ e_mail_folder_find_duplicate_messages_sync (CamelFolder *folder,
 	GQueue trash = G_QUEUE_INIT;
 	GHashTable *hash_table;
 	GHashTable *unique_ids;
+	GArray *unique_id_keys;
 	GHashTableIter iter;
 	gpointer key, value;
 
@@ -778,10 +1088,16 @@ e_mail_folder_find_duplicate_messages_sync (CamelFolder *folder,
 	camel_operation_push_message (
 		cancellable, _("Scanning messages for duplicates"));
 
+	/* There is at most one unique ID per message, thus the array
+	 * never grows and the hash table keys can point into it. */
+	unique_id_keys = g_array_sized_new (
+		FALSE, FALSE, sizeof (gint64),
+		g_hash_table_size (hash_table));
+
 	unique_ids = g_hash_table_new_full (
 		(GHashFunc) g_int64_hash,
 		(GEqualFunc) g_int64_equal,
-		(GDestroyNotify) g_free,
+		(GDestroyNotify) NULL,
 		(GDestroyNotify) g_free);
 
 	g_hash_table_iter_init (&iter, hash_table);
@@ -792,6 +1108,7 @@ e_mail_folder_find_duplicate_messages_sync (CamelFolder *folder,
 		CamelMessageInfo *info;
 		gboolean duplicate;
 		const gchar *digest;
+		gint64 id;
 
 		info = camel_folder_get_message_info (folder, key);
 		if (!info)
@@ -817,19 +1134,17 @@ e_mail_folder_find_duplicate_messages_sync (CamelFolder *folder,
 
 		/* Determine if the message a duplicate. */
 
-		value = g_hash_table_lookup (unique_ids, &message_id.id.id);
+		id = (gint64) message_id.id.id;
+		value = g_hash_table_lookup (unique_ids, &id);
 		duplicate = (value != NULL) && g_str_equal (digest, value);
 
 		if (!duplicate) {
-			gint64 *v_int64;
+			g_array_append_val (unique_id_keys, id);
 
-			/* XXX Might be better to create a GArray
-			 *     of 64-bit integers and have the hash
-			 *     table keys point to array elements. */
-			v_int64 = g_new0 (gint64, 1);
-			*v_int64 = (gint64) message_id.id.id;
-
-			g_hash_table_insert (unique_ids, v_int64, g_strdup (digest));
+			g_hash_table_insert (
+				unique_ids,
+				&g_array_index (unique_id_keys, gint64, unique_id_keys->len - 1),
+				g_strdup (digest));
 			g_queue_push_tail (&trash, key);
 		}
 
@@ -843,6 +1158,7 @@ e_mail_folder_find_duplicate_messages_sync (CamelFolder *folder,
 	camel_operation_pop_message (cancellable);
 
 	g_hash_table_destroy (unique_ids);
+	g_array_unref (unique_id_keys);
 
 	return hash_table;
 }
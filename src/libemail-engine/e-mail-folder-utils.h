@@ -78,6 +78,17 @@ CamelMimePart *	e_mail_folder_build_attachment_finish
 						 gchar **fwd_subject,
 						 GError **error);
 
+gchar *		e_mail_folder_dup_message_digest_sync
+						(CamelFolder *folder,
+						 const gchar *message_uid,
+						 gboolean allow_download,
+						 GCancellable *cancellable,
+						 GError **error);
+void		e_mail_folder_update_message_digests_sync
+						(CamelFolder *folder,
+						 CamelFolderChangeInfo *changes,
+						 GCancellable *cancellable);
+
 GHashTable *	e_mail_folder_find_duplicate_messages_sync
 						(CamelFolder *folder,
 						 GPtrArray *message_uids,
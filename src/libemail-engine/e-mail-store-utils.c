@@ -28,6 +28,8 @@ typedef struct _AsyncContext AsyncContext;
 
 struct _AsyncContext {
 	gchar *full_name;
+	gboolean headers_only;
+	GHashTable *hash_table;
 };
 
 static void
@@ -35,6 +37,9 @@ async_context_free (AsyncContext *context)
 {
 	g_free (context->full_name);
 
+	if (context->hash_table != NULL)
+		g_hash_table_unref (context->hash_table);
+
 	g_slice_free (AsyncContext, context);
 }
 
@@ -402,6 +407,351 @@ e_mail_store_prepare_for_offline_finish (CamelStore *store,
 	return !g_simple_async_result_propagate_error (simple, error);
 }
 
+typedef struct _DuplicateEntry {
+	gint64 message_id; /* hash table key */
+	CamelFolder *folder;
+	gchar *uid;
+	gchar *digest;
+	gboolean digest_known;
+	gchar *subject;
+	gint64 date_sent;
+} DuplicateEntry;
+
+static DuplicateEntry *
+duplicate_entry_new (CamelFolder *folder,
+                     CamelMessageInfo *info,
+                     gboolean headers_only)
+{
+	DuplicateEntry *entry;
+
+	entry = g_slice_new0 (DuplicateEntry);
+	entry->message_id = (gint64) camel_message_info_get_message_id (info);
+	entry->folder = g_object_ref (folder);
+	entry->uid = g_strdup (camel_message_info_get_uid (info));
+
+	if (headers_only) {
+		entry->subject = g_strdup (camel_message_info_get_subject (info));
+		entry->date_sent = camel_message_info_get_date_sent (info);
+	}
+
+	return entry;
+}
+
+static void
+duplicate_entry_free (gpointer ptr)
+{
+	DuplicateEntry *entry = ptr;
+
+	if (entry) {
+		g_object_unref (entry->folder);
+		g_free (entry->uid);
+		g_free (entry->digest);
+		g_free (entry->subject);
+		g_slice_free (DuplicateEntry, entry);
+	}
+}
+
+static void
+mail_store_collect_folder_names (CamelFolderInfo *folder_info,
+                                 GPtrArray *full_names)
+{
+	while (folder_info != NULL) {
+		if ((folder_info->flags & (CAMEL_FOLDER_NOSELECT | CAMEL_FOLDER_VIRTUAL)) == 0)
+			g_ptr_array_add (full_names, g_strdup (folder_info->full_name));
+
+		mail_store_collect_folder_names (folder_info->child, full_names);
+
+		folder_info = folder_info->next;
+	}
+}
+
+/* The digest is computed at most once per entry, even when it is empty */
+static gboolean
+mail_store_ensure_digest_sync (DuplicateEntry *entry,
+                               GCancellable *cancellable,
+                               GError **error)
+{
+	GError *local_error = NULL;
+
+	if (entry->digest_known)
+		return TRUE;
+
+	entry->digest = e_mail_folder_dup_message_digest_sync (
+		entry->folder, entry->uid, TRUE, cancellable, &local_error);
+
+	if (local_error) {
+		g_propagate_error (error, local_error);
+		return FALSE;
+	}
+
+	entry->digest_known = TRUE;
+
+	return TRUE;
+}
+
+/* Compares the message with each distinct message seen earlier with
+ * the same Message-ID. Contents are digested only for such collisions,
+ * thus most of the messages are never downloaded. */
+static gboolean
+mail_store_is_duplicate_sync (GPtrArray *originals,
+                              DuplicateEntry *entry,
+                              gboolean headers_only,
+                              GCancellable *cancellable,
+                              GError **error)
+{
+	guint ii;
+
+	if (!headers_only) {
+		if (!mail_store_ensure_digest_sync (entry, cancellable, error))
+			return FALSE;
+
+		/* Messages without content are never duplicates */
+		if (!entry->digest)
+			return FALSE;
+	}
+
+	for (ii = 0; ii < originals->len; ii++) {
+		DuplicateEntry *original = g_ptr_array_index (originals, ii);
+
+		if (headers_only) {
+			if (entry->date_sent == original->date_sent &&
+			    g_strcmp0 (entry->subject, original->subject) == 0)
+				return TRUE;
+
+			continue;
+		}
+
+		if (!mail_store_ensure_digest_sync (original, cancellable, error))
+			return FALSE;
+
+		if (g_strcmp0 (entry->digest, original->digest) == 0)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* Searches all folders of the @store for messages with the same
+ * Message-ID and content as an earlier message.  The first copy is
+ * not reported.  With @headers_only the message content is not
+ * compared, only the Date and Subject, thus nothing is downloaded.
+ *
+ * Returns a hash table of { CamelFolder : GPtrArray of message UIDs },
+ * or %NULL on error. */
+GHashTable *
+e_mail_store_find_duplicate_messages_sync (CamelStore *store,
+                                           gboolean headers_only,
+                                           GCancellable *cancellable,
+                                           GError **error)
+{
+	CamelFolderInfo *folder_info;
+	GHashTable *duplicates;
+	GHashTable *originals;
+	GPtrArray *full_names;
+	guint ii;
+	gboolean success = TRUE;
+
+	g_return_val_if_fail (CAMEL_IS_STORE (store), NULL);
+
+	folder_info = camel_store_get_folder_info_sync (
+		store, NULL,
+		CAMEL_STORE_FOLDER_INFO_RECURSIVE |
+		CAMEL_STORE_FOLDER_INFO_NO_VIRTUAL,
+		cancellable, error);
+
+	if (folder_info == NULL)
+		return NULL;
+
+	full_names = g_ptr_array_new_with_free_func (g_free);
+	mail_store_collect_folder_names (folder_info, full_names);
+	camel_folder_info_free (folder_info);
+
+	/* { CamelFolder : GPtrArray of message UIDs } */
+	duplicates = g_hash_table_new_full (
+		(GHashFunc) g_direct_hash,
+		(GEqualFunc) g_direct_equal,
+		(GDestroyNotify) g_object_unref,
+		(GDestroyNotify) g_ptr_array_unref);
+
+	/* { Message-ID : GPtrArray of distinct DuplicateEntry } */
+	originals = g_hash_table_new_full (
+		(GHashFunc) g_int64_hash,
+		(GEqualFunc) g_int64_equal,
+		(GDestroyNotify) NULL,
+		(GDestroyNotify) g_ptr_array_unref);
+
+	camel_operation_push_message (
+		cancellable, _("Scanning folders for duplicates"));
+
+	for (ii = 0; ii < full_names->len && success; ii++) {
+		CamelFolder *folder;
+		GPtrArray *uids;
+		GPtrArray *folder_duplicates = NULL;
+		guint jj;
+
+		folder = camel_store_get_folder_sync (
+			store, g_ptr_array_index (full_names, ii), 0,
+			cancellable, error);
+
+		if (folder == NULL) {
+			success = FALSE;
+			break;
+		}
+
+		if (camel_folder_get_folder_summary (folder))
+			camel_folder_summary_prepare_fetch_all (
+				camel_folder_get_folder_summary (folder), NULL);
+
+		uids = camel_folder_get_uids (folder);
+		camel_folder_sort_uids (folder, uids);
+
+		for (jj = 0; jj < uids->len && success; jj++) {
+			CamelMessageInfo *info;
+			DuplicateEntry *entry;
+			GPtrArray *same_id;
+			GError *local_error = NULL;
+
+			info = camel_folder_get_message_info (
+				folder, g_ptr_array_index (uids, jj));
+
+			if (!info)
+				continue;
+
+			/* Skip messages without Message-ID and those
+			 * marked for deletion. */
+			if (camel_message_info_get_message_id (info) == 0 ||
+			    (camel_message_info_get_flags (info) & CAMEL_MESSAGE_DELETED) != 0) {
+				g_clear_object (&info);
+				continue;
+			}
+
+			entry = duplicate_entry_new (folder, info, headers_only);
+			same_id = g_hash_table_lookup (originals, &entry->message_id);
+
+			if (!same_id) {
+				same_id = g_ptr_array_new_with_free_func (duplicate_entry_free);
+				g_ptr_array_add (same_id, entry);
+
+				/* The first entry is never removed, thus it can hold the key */
+				g_hash_table_insert (originals, &entry->message_id, same_id);
+			} else if (mail_store_is_duplicate_sync (same_id, entry, headers_only, cancellable, &local_error)) {
+				if (!folder_duplicates) {
+					folder_duplicates = g_ptr_array_new_with_free_func (g_free);
+
+					g_hash_table_insert (
+						duplicates,
+						g_object_ref (folder),
+						folder_duplicates);
+				}
+
+				g_ptr_array_add (folder_duplicates, g_strdup (entry->uid));
+				duplicate_entry_free (entry);
+			} else if (local_error != NULL) {
+				g_propagate_error (error, local_error);
+				duplicate_entry_free (entry);
+				success = FALSE;
+			} else {
+				/* A distinct message, later copies can match it too */
+				g_ptr_array_add (same_id, entry);
+			}
+
+			g_clear_object (&info);
+		}
+
+		camel_folder_free_uids (folder, uids);
+		g_object_unref (folder);
+
+		camel_operation_progress (
+			cancellable, (ii + 1) * 100 / full_names->len);
+	}
+
+	camel_operation_pop_message (cancellable);
+
+	g_hash_table_destroy (originals);
+	g_ptr_array_unref (full_names);
+
+	if (!success) {
+		g_hash_table_destroy (duplicates);
+		duplicates = NULL;
+	}
+
+	return duplicates;
+}
+
+/* Helper for e_mail_store_find_duplicate_messages() */
+static void
+mail_store_find_duplicate_messages_thread (GSimpleAsyncResult *simple,
+                                           GObject *source_object,
+                                           GCancellable *cancellable)
+{
+	AsyncContext *context;
+	GError *local_error = NULL;
+
+	context = g_simple_async_result_get_op_res_gpointer (simple);
+
+	context->hash_table = e_mail_store_find_duplicate_messages_sync (
+		CAMEL_STORE (source_object),
+		context->headers_only,
+		cancellable, &local_error);
+
+	if (local_error != NULL)
+		g_simple_async_result_take_error (simple, local_error);
+}
+
+void
+e_mail_store_find_duplicate_messages (CamelStore *store,
+                                      gboolean headers_only,
+                                      gint io_priority,
+                                      GCancellable *cancellable,
+                                      GAsyncReadyCallback callback,
+                                      gpointer user_data)
+{
+	GSimpleAsyncResult *simple;
+	AsyncContext *context;
+
+	g_return_if_fail (CAMEL_IS_STORE (store));
+
+	context = g_slice_new0 (AsyncContext);
+	context->headers_only = headers_only;
+
+	simple = g_simple_async_result_new (
+		G_OBJECT (store), callback, user_data,
+		e_mail_store_find_duplicate_messages);
+
+	g_simple_async_result_set_check_cancellable (simple, cancellable);
+
+	g_simple_async_result_set_op_res_gpointer (
+		simple, context, (GDestroyNotify) async_context_free);
+
+	g_simple_async_result_run_in_thread (
+		simple, mail_store_find_duplicate_messages_thread,
+		io_priority, cancellable);
+
+	g_object_unref (simple);
+}
+
+GHashTable *
+e_mail_store_find_duplicate_messages_finish (CamelStore *store,
+                                             GAsyncResult *result,
+                                             GError **error)
+{
+	GSimpleAsyncResult *simple;
+	AsyncContext *context;
+
+	g_return_val_if_fail (
+		g_simple_async_result_is_valid (
+		result, G_OBJECT (store),
+		e_mail_store_find_duplicate_messages), NULL);
+
+	simple = G_SIMPLE_ASYNC_RESULT (result);
+	context = g_simple_async_result_get_op_res_gpointer (simple);
+
+	if (g_simple_async_result_propagate_error (simple, error))
+		return NULL;
+
+	return g_hash_table_ref (context->hash_table);
+}
+
 static gboolean
 mail_store_save_setup_key (CamelStore *store,
 			   ESource *source,
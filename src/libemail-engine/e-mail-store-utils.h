@@ -78,6 +78,23 @@ gboolean	e_mail_store_prepare_for_offline_finish
 						 GAsyncResult *result,
 						 GError **error);
 
+GHashTable *	e_mail_store_find_duplicate_messages_sync
+						(CamelStore *store,
+						 gboolean headers_only,
+						 GCancellable *cancellable,
+						 GError **error);
+void		e_mail_store_find_duplicate_messages
+						(CamelStore *store,
+						 gboolean headers_only,
+						 gint io_priority,
+						 GCancellable *cancellable,
+						 GAsyncReadyCallback callback,
+						 gpointer user_data);
+GHashTable *	e_mail_store_find_duplicate_messages_finish
+						(CamelStore *store,
+						 GAsyncResult *result,
+						 GError **error);
+
 gboolean	e_mail_store_save_initial_setup_sync
 						(CamelStore *store,
 						 GHashTable *save_setup,
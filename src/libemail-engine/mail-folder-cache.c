@@ -73,6 +73,12 @@ struct _MailFolderCachePrivate {
 
 	GQueue local_folder_uris;
 	GQueue remote_folder_uris;
+
+	/* Updates waiting to be emitted in the main_context */
+	GMutex updates_lock;
+	GQueue updates;			/* UpdateClosure * */
+	GHashTable *updates_by_folder;	/* UpdateClosure *, pending unread updates */
+	gboolean updates_scheduled;
 };
 
 enum {
@@ -138,6 +144,9 @@ struct _FolderInfo {
 
 	GWeakRef folder;
 	gulong folder_changed_handler_id;
+
+	/* Latest received date of a new message, guarded by 'lock' */
+	time_t latest_received;
 };
 
 struct _AsyncContext {
@@ -154,7 +163,7 @@ struct _UpdateClosure {
 	 * AVAILABLE, DELETED, RENAMED, UNAVAILABLE */
 	guint signal_id;
 
-	gboolean new_messages;
+	gint new_messages;
 
 	gchar *full_name;
 	gchar *oldfull;
@@ -502,6 +511,59 @@ update_closure_free (UpdateClosure *closure)
 	g_slice_free (UpdateClosure, closure);
 }
 
+/* Hashes the closure by its folder, for updates_by_folder */
+static guint
+update_closure_hash (gconstpointer ptr)
+{
+	const UpdateClosure *closure = ptr;
+
+	return g_direct_hash (closure->store) ^ g_str_hash (closure->full_name);
+}
+
+static gboolean
+update_closure_equal (gconstpointer ptr1,
+                      gconstpointer ptr2)
+{
+	const UpdateClosure *closure1 = ptr1;
+	const UpdateClosure *closure2 = ptr2;
+
+	return closure1->store == closure2->store &&
+		g_strcmp0 (closure1->full_name, closure2->full_name) == 0;
+}
+
+/* Merges a later unread/changed update 'src' of the same folder into 'dest' */
+static void
+update_closure_merge (UpdateClosure *dest,
+                      UpdateClosure *src)
+{
+	dest->unread = src->unread;
+
+	if (src->new_messages > 0) {
+		if (dest->new_messages <= 0) {
+			g_free (dest->msg_uid);
+			g_free (dest->msg_sender);
+			g_free (dest->msg_subject);
+
+			dest->msg_uid = src->msg_uid;
+			dest->msg_sender = src->msg_sender;
+			dest->msg_subject = src->msg_subject;
+
+			src->msg_uid = NULL;
+			src->msg_sender = NULL;
+			src->msg_subject = NULL;
+
+			dest->new_messages = src->new_messages;
+		} else {
+			/* More than one new message, the details are not used */
+			g_clear_pointer (&dest->msg_uid, g_free);
+			g_clear_pointer (&dest->msg_sender, g_free);
+			g_clear_pointer (&dest->msg_subject, g_free);
+
+			dest->new_messages += src->new_messages;
+		}
+	}
+}
+
 static void
 mail_folder_cache_check_connection_status_cb (CamelStore *store,
 					      GParamSpec *param,
@@ -697,130 +759,211 @@ mail_folder_cache_check_connection_status_cb (CamelStore *store,
 	store_info_unref (store_info);
 }
 
-static gboolean
-mail_folder_cache_update_idle_cb (gpointer user_data)
+static void
+mail_folder_cache_emit_update (MailFolderCache *cache,
+                               UpdateClosure *closure)
 {
-	MailFolderCache *cache;
-	UpdateClosure *closure;
-
-	closure = (UpdateClosure *) user_data;
-
 	/* Sanity checks. */
-	g_return_val_if_fail (closure->full_name != NULL, FALSE);
+	g_return_if_fail (closure->full_name != NULL);
 
-	cache = g_weak_ref_get (&closure->cache);
-
-	if (cache != NULL) {
-		if (closure->signal_id == signals[FOLDER_DELETED]) {
-			g_signal_emit (
-				cache,
-				closure->signal_id, 0,
-				closure->store,
-				closure->full_name);
-		}
+	if (closure->signal_id == signals[FOLDER_DELETED]) {
+		g_signal_emit (
+			cache,
+			closure->signal_id, 0,
+			closure->store,
+			closure->full_name);
+	}
 
-		if (closure->signal_id == signals[FOLDER_UNAVAILABLE]) {
-			g_signal_emit (
-				cache,
-				closure->signal_id, 0,
-				closure->store,
-				closure->full_name);
-		}
+	if (closure->signal_id == signals[FOLDER_UNAVAILABLE]) {
+		g_signal_emit (
+			cache,
+			closure->signal_id, 0,
+			closure->store,
+			closure->full_name);
+	}
 
-		if (closure->signal_id == signals[FOLDER_AVAILABLE]) {
-			g_signal_emit (
-				cache,
-				closure->signal_id, 0,
-				closure->store,
-				closure->full_name);
-		}
+	if (closure->signal_id == signals[FOLDER_AVAILABLE]) {
+		g_signal_emit (
+			cache,
+			closure->signal_id, 0,
+			closure->store,
+			closure->full_name);
+	}
 
-		if (closure->signal_id == signals[FOLDER_RENAMED]) {
-			g_signal_emit (
-				cache,
-				closure->signal_id, 0,
-				closure->store,
-				closure->oldfull,
-				closure->full_name);
-		}
+	if (closure->signal_id == signals[FOLDER_RENAMED]) {
+		g_signal_emit (
+			cache,
+			closure->signal_id, 0,
+			closure->store,
+			closure->oldfull,
+			closure->full_name);
+	}
 
-		/* update unread counts */
+	/* update unread counts */
+	g_signal_emit (
+		cache,
+		signals[FOLDER_UNREAD_UPDATED], 0,
+		closure->store,
+		closure->full_name,
+		closure->unread);
+
+	/* XXX The old code excluded this on FOLDER_RENAMED.
+	 *     Not sure if that was intentional (if so it was
+	 *     very subtle!) but we'll preserve the behavior.
+	 *     If it turns out to be a bug then just remove
+	 *     the signal_id check. */
+	if (closure->signal_id != signals[FOLDER_RENAMED]) {
 		g_signal_emit (
 			cache,
-			signals[FOLDER_UNREAD_UPDATED], 0,
+			signals[FOLDER_CHANGED], 0,
+			closure->store,
+			closure->full_name,
+			closure->new_messages,
+			closure->msg_uid,
+			closure->msg_sender,
+			closure->msg_subject);
+	}
+
+	if (CAMEL_IS_VEE_STORE (closure->store) &&
+	   (closure->signal_id == signals[FOLDER_AVAILABLE] ||
+	    closure->signal_id == signals[FOLDER_RENAMED])) {
+		/* Normally the vfolder store takes care of the
+		 * folder_opened event itself, but we add folder to
+		 * the noting system later, thus we do not know about
+		 * search folders to update them in a tree, thus
+		 * ensure their changes will be tracked correctly. */
+		CamelFolder *folder;
+
+		/* FIXME camel_store_get_folder_sync() may block. */
+		folder = camel_store_get_folder_sync (
 			closure->store,
 			closure->full_name,
-			closure->unread);
-
-		/* XXX The old code excluded this on FOLDER_RENAMED.
-		 *     Not sure if that was intentional (if so it was
-		 *     very subtle!) but we'll preserve the behavior.
-		 *     If it turns out to be a bug then just remove
-		 *     the signal_id check. */
-		if (closure->signal_id != signals[FOLDER_RENAMED]) {
-			g_signal_emit (
-				cache,
-				signals[FOLDER_CHANGED], 0,
-				closure->store,
-				closure->full_name,
-				closure->new_messages,
-				closure->msg_uid,
-				closure->msg_sender,
-				closure->msg_subject);
+			0, NULL, NULL);
+
+		if (folder != NULL) {
+			mail_folder_cache_note_folder (cache, folder);
+			g_object_unref (folder);
 		}
+	}
+}
 
-		if (CAMEL_IS_VEE_STORE (closure->store) &&
-		   (closure->signal_id == signals[FOLDER_AVAILABLE] ||
-		    closure->signal_id == signals[FOLDER_RENAMED])) {
-			/* Normally the vfolder store takes care of the
-			 * folder_opened event itself, but we add folder to
-			 * the noting system later, thus we do not know about
-			 * search folders to update them in a tree, thus
-			 * ensure their changes will be tracked correctly. */
-			CamelFolder *folder;
-
-			/* FIXME camel_store_get_folder_sync() may block. */
-			folder = camel_store_get_folder_sync (
-				closure->store,
-				closure->full_name,
-				0, NULL, NULL);
-
-			if (folder != NULL) {
-				mail_folder_cache_note_folder (cache, folder);
-				g_object_unref (folder);
-			}
+/* Emits the queued updates in batches, giving up the main loop
+ * after UPDATE_IDLE_BUDGET, thus the UI is redrawn in the meantime. */
+#define UPDATE_IDLE_BUDGET (10 * G_TIME_SPAN_MILLISECOND)
+
+static gboolean
+mail_folder_cache_update_idle_cb (gpointer user_data)
+{
+	MailFolderCache *cache;
+	gint64 deadline;
+
+	cache = g_weak_ref_get (user_data);
+	if (!cache)
+		return FALSE;
+
+	deadline = g_get_monotonic_time () + UPDATE_IDLE_BUDGET;
+
+	while (TRUE) {
+		UpdateClosure *closure;
+
+		g_mutex_lock (&cache->priv->updates_lock);
+
+		closure = g_queue_pop_head (&cache->priv->updates);
+
+		if (!closure) {
+			cache->priv->updates_scheduled = FALSE;
+			g_mutex_unlock (&cache->priv->updates_lock);
+			break;
 		}
 
-		g_object_unref (cache);
+		if (g_hash_table_lookup (cache->priv->updates_by_folder, closure) == closure)
+			g_hash_table_remove (cache->priv->updates_by_folder, closure);
+
+		g_mutex_unlock (&cache->priv->updates_lock);
+
+		mail_folder_cache_emit_update (cache, closure);
+		update_closure_free (closure);
+
+		if (g_get_monotonic_time () >= deadline) {
+			g_object_unref (cache);
+			return TRUE;
+		}
 	}
 
+	g_object_unref (cache);
+
 	return FALSE;
 }
 
 static void
 mail_folder_cache_submit_update (UpdateClosure *closure)
 {
-	GMainContext *main_context;
 	MailFolderCache *cache;
-	GSource *idle_source;
+	UpdateClosure *pending, *merged = NULL;
 
 	g_return_if_fail (closure != NULL);
 
 	cache = g_weak_ref_get (&closure->cache);
 	g_return_if_fail (cache != NULL);
 
-	main_context = mail_folder_cache_ref_main_context (cache);
+	g_mutex_lock (&cache->priv->updates_lock);
 
-	idle_source = g_idle_source_new ();
-	g_source_set_callback (
-		idle_source,
-		mail_folder_cache_update_idle_cb,
-		closure,
-		(GDestroyNotify) update_closure_free);
-	g_source_attach (idle_source, main_context);
-	g_source_unref (idle_source);
+	if (closure->signal_id == 0) {
+		/* Repeated unread updates of the same folder are merged */
+		pending = g_hash_table_lookup (cache->priv->updates_by_folder, closure);
+		if (pending) {
+			update_closure_merge (pending, closure);
+			merged = closure;
+			closure = NULL;
+		} else {
+			g_hash_table_add (cache->priv->updates_by_folder, closure);
+		}
+	} else {
+		/* Keep the order of updates around the folder
+		 * being added, removed or renamed. */
+		pending = g_hash_table_lookup (cache->priv->updates_by_folder, closure);
+		if (pending)
+			g_hash_table_remove (cache->priv->updates_by_folder, pending);
 
-	g_main_context_unref (main_context);
+		if (closure->oldfull) {
+			UpdateClosure old_key;
+
+			old_key.store = closure->store;
+			old_key.full_name = closure->oldfull;
+
+			pending = g_hash_table_lookup (cache->priv->updates_by_folder, &old_key);
+			if (pending)
+				g_hash_table_remove (cache->priv->updates_by_folder, pending);
+		}
+	}
+
+	if (closure)
+		g_queue_push_tail (&cache->priv->updates, closure);
+
+	if (!cache->priv->updates_scheduled) {
+		GMainContext *main_context;
+		GSource *idle_source;
+
+		cache->priv->updates_scheduled = TRUE;
+
+		main_context = mail_folder_cache_ref_main_context (cache);
+
+		idle_source = g_idle_source_new ();
+		g_source_set_callback (
+			idle_source,
+			mail_folder_cache_update_idle_cb,
+			e_weak_ref_new (cache),
+			(GDestroyNotify) e_weak_ref_free);
+		g_source_attach (idle_source, main_context);
+		g_source_unref (idle_source);
+
+		g_main_context_unref (main_context);
+	}
+
+	g_mutex_unlock (&cache->priv->updates_lock);
+
+	if (merged)
+		update_closure_free (merged);
 
 	g_object_unref (cache);
 }
@@ -941,25 +1084,165 @@ update_1folder (MailFolderCache *cache,
 #define IGNORE_THREAD_VALUE_IN_PROGRESS	GINT_TO_POINTER (2)
 #define IGNORE_THREAD_VALUE_DONE	GINT_TO_POINTER (3)
 
+/* Indexes of one set of added messages, thus the ignore-thread state of
+ * each of them is decided with hash lookups instead of a folder search */
+typedef struct _NewMailBatch {
+	CamelFolder *folder;
+	GHashTable *added_uids;		/* gchar *uid ~> IGNORE_THREAD_VALUE_... */
+	GHashTable *added_ids;		/* guint64 *message_id ~> gchar *uid */
+	GHashTable *ignored_ids;	/* guint64 *message_id, with the ignore-thread flag;
+					   NULL until needed */
+} NewMailBatch;
+
+static guint64 *
+new_mail_batch_dup_id (guint64 message_id)
+{
+	guint64 *dup;
+
+	dup = g_new (guint64, 1);
+	*dup = message_id;
+
+	return dup;
+}
+
+static void
+new_mail_batch_add_ignored_id (NewMailBatch *batch,
+			       guint64 message_id)
+{
+	if (message_id && !g_hash_table_contains (batch->ignored_ids, &message_id))
+		g_hash_table_add (batch->ignored_ids, new_mail_batch_dup_id (message_id));
+}
+
+static void
+new_mail_batch_init (NewMailBatch *batch,
+		     CamelFolder *folder,
+		     GPtrArray *uids)
+{
+	guint ii;
+
+	batch->folder = folder;
+	batch->added_uids = g_hash_table_new_full (g_str_hash, g_str_equal, (GDestroyNotify) camel_pstring_free, NULL);
+	batch->added_ids = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
+	batch->ignored_ids = NULL;
+
+	for (ii = 0; ii < uids->len; ii++) {
+		const gchar *uid = uids->pdata[ii];
+		CamelMessageInfo *info;
+		guint64 message_id;
+
+		if (!uid)
+			continue;
+
+		uid = camel_pstring_strdup (uid);
+		g_hash_table_insert (batch->added_uids, (gpointer) uid, IGNORE_THREAD_VALUE_TODO);
+
+		info = camel_folder_get_message_info (folder, uid);
+		if (!info)
+			continue;
+
+		message_id = camel_message_info_get_message_id (info);
+		if (message_id)
+			g_hash_table_insert (batch->added_ids, new_mail_batch_dup_id (message_id), (gpointer) uid);
+
+		g_clear_object (&info);
+	}
+}
+
+static void
+new_mail_batch_clear (NewMailBatch *batch)
+{
+	g_clear_pointer (&batch->ignored_ids, g_hash_table_destroy);
+	g_hash_table_destroy (batch->added_ids);
+	g_hash_table_destroy (batch->added_uids);
+}
+
+/* Collects message IDs of all messages in the folder with the ignore-thread
+ * flag, which is usually a small set, with one search for the whole batch */
 static gboolean
-folder_cache_check_ignore_thread (CamelFolder *folder,
+new_mail_batch_ensure_ignored_ids (NewMailBatch *batch,
+				   GCancellable *cancellable,
+				   GError **error)
+{
+	GPtrArray *uids;
+	guint ii;
+
+	if (batch->ignored_ids)
+		return TRUE;
+
+	uids = camel_folder_search_by_expression (batch->folder, "(match-all (user-flag \"ignore-thread\"))", cancellable, error);
+	if (!uids)
+		return FALSE;
+
+	batch->ignored_ids = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
+
+	for (ii = 0; ii < uids->len; ii++) {
+		CamelMessageInfo *info;
+		guint64 message_id;
+
+		info = camel_folder_get_message_info (batch->folder, uids->pdata[ii]);
+		if (!info)
+			continue;
+
+		new_mail_batch_add_ignored_id (batch, camel_message_info_get_message_id (info));
+
+		g_clear_object (&info);
+	}
+
+	camel_folder_search_free (batch->folder, uids);
+
+	return TRUE;
+}
+
+static gboolean
+folder_cache_has_message_id (CamelFolder *folder,
+			     guint64 message_id,
+			     GCancellable *cancellable,
+			     GError **error)
+{
+	CamelSummaryMessageID msgid;
+	GPtrArray *uids;
+	gchar *expr;
+	gboolean found;
+
+	msgid.id.id = message_id;
+
+	expr = g_strdup_printf ("(match-all (= \"msgid\" \"%lu %lu\"))",
+		(gulong) msgid.id.part.hi,
+		(gulong) msgid.id.part.lo);
+
+	uids = camel_folder_search_by_expression (folder, expr, cancellable, error);
+	found = uids && uids->len > 0;
+
+	if (uids)
+		camel_folder_search_free (folder, uids);
+	g_free (expr);
+
+	return found;
+}
+
+static gboolean
+folder_cache_check_ignore_thread (NewMailBatch *batch,
 				  CamelMessageInfo *info,
-				  GHashTable *added_uids, /* gchar *uid ~> IGNORE_THREAD_VALUE_... */
 				  GCancellable *cancellable,
 				  GError **error)
 {
 	GArray *references;
-	gboolean has_ignore_thread = FALSE, first_ignore_thread = FALSE, found_first_msgid = FALSE;
+	gpointer state;
+	gboolean has_ignore_thread = FALSE;
+	gboolean ignore_thread;
 	guint64 first_msgid;
-	GString *expr = NULL;
+	const gchar *uid;
 	guint ii;
 
-	g_return_val_if_fail (CAMEL_IS_FOLDER (folder), FALSE);
+	g_return_val_if_fail (batch != NULL, FALSE);
 	g_return_val_if_fail (info != NULL, FALSE);
-	g_return_val_if_fail (added_uids != NULL, FALSE);
 	g_return_val_if_fail (camel_message_info_get_uid (info) != NULL, FALSE);
 
-	if (g_hash_table_lookup (added_uids, camel_message_info_get_uid (info)) == IGNORE_THREAD_VALUE_DONE)
+	uid = camel_message_info_get_uid (info);
+	state = g_hash_table_lookup (batch->added_uids, uid);
+
+	/* Already decided, or a reference loop */
+	if (state == IGNORE_THREAD_VALUE_DONE || state == IGNORE_THREAD_VALUE_IN_PROGRESS)
 		return camel_message_info_get_user_flag (info, "ignore-thread");
 
 	references = camel_message_info_dup_references (info);
@@ -969,88 +1252,69 @@ folder_cache_check_ignore_thread (CamelFolder *folder,
 		return FALSE;
 	}
 
-	first_msgid = g_array_index (references, guint64, 0);
-
-	for (ii = 0; ii < references->len; ii++) {
-		CamelSummaryMessageID msgid;
-
-		msgid.id.id = g_array_index (references, guint64, ii);
-		if (!msgid.id.id)
-			continue;
-
-		if (!expr)
-			expr = g_string_new ("(match-all (or ");
-
-		g_string_append_printf (expr, "(= \"msgid\" \"%lu %lu\")",
-			(gulong) msgid.id.part.hi,
-			(gulong) msgid.id.part.lo);
+	if (!new_mail_batch_ensure_ignored_ids (batch, cancellable, error)) {
+		g_array_unref (references);
+		return FALSE;
 	}
 
-	if (expr) {
-		GPtrArray *uids;
-
-		g_string_append (expr, "))");
+	if (state)
+		g_hash_table_insert (batch->added_uids, (gpointer) camel_pstring_strdup (uid), IGNORE_THREAD_VALUE_IN_PROGRESS);
 
-		uids = camel_folder_search_by_expression (folder, expr->str, cancellable, error);
-		if (uids) {
-			for (ii = 0; ii < uids->len; ii++) {
-				const gchar *refruid = uids->pdata[ii];
-				CamelMessageInfo *refrinfo;
-				gpointer cached_value;
-
-				refrinfo = camel_folder_get_message_info (folder, refruid);
-				if (!refrinfo)
-					continue;
-
-				/* This is for cases when a subthread is received and the order of UIDs
-				   doesn't match the order in the thread (parent before child). */
-				cached_value = g_hash_table_lookup (added_uids, refruid);
-				if (cached_value == IGNORE_THREAD_VALUE_TODO) {
-					GError *local_error = NULL;
+	/* This is for cases when a subthread is received and the order of UIDs
+	   doesn't match the order in the thread (parent before child). */
+	for (ii = 0; ii < references->len; ii++) {
+		guint64 msgid = g_array_index (references, guint64, ii);
+		const gchar *refruid;
+		CamelMessageInfo *refrinfo;
 
-					/* To avoid infinite recursion */
-					g_hash_table_insert (added_uids, (gpointer) camel_pstring_strdup (refruid), IGNORE_THREAD_VALUE_IN_PROGRESS);
+		if (!msgid)
+			continue;
 
-					if (folder_cache_check_ignore_thread (folder, refrinfo, added_uids, cancellable, &local_error))
-						camel_message_info_set_user_flag (refrinfo, "ignore-thread", TRUE);
+		refruid = g_hash_table_lookup (batch->added_ids, &msgid);
+		if (!refruid || g_hash_table_lookup (batch->added_uids, refruid) != IGNORE_THREAD_VALUE_TODO)
+			continue;
 
-					if (local_error) {
-						g_clear_error (&local_error);
-					} else {
-						cached_value = IGNORE_THREAD_VALUE_DONE;
-						g_hash_table_insert (added_uids, (gpointer) camel_pstring_strdup (refruid), IGNORE_THREAD_VALUE_DONE);
-					}
-				}
+		refrinfo = camel_folder_get_message_info (batch->folder, refruid);
+		if (!refrinfo)
+			continue;
 
-				if (!cached_value)
-					cached_value = IGNORE_THREAD_VALUE_DONE;
+		if (folder_cache_check_ignore_thread (batch, refrinfo, cancellable, NULL)) {
+			camel_message_info_set_user_flag (refrinfo, "ignore-thread", TRUE);
+			new_mail_batch_add_ignored_id (batch, msgid);
+		}
 
-				if (first_msgid && camel_message_info_get_message_id (refrinfo) == first_msgid) {
-					/* The first msgid in the references is In-Reply-To, which is the master;
-					   the rest is just a guess. */
-					first_ignore_thread = camel_message_info_get_user_flag (refrinfo, "ignore-thread");
-					found_first_msgid = first_ignore_thread || cached_value == IGNORE_THREAD_VALUE_DONE;
+		g_hash_table_insert (batch->added_uids, (gpointer) camel_pstring_strdup (refruid), IGNORE_THREAD_VALUE_DONE);
 
-					if (found_first_msgid) {
-						g_clear_object (&refrinfo);
-						break;
-					}
-				}
+		g_clear_object (&refrinfo);
+	}
 
-				has_ignore_thread = has_ignore_thread || camel_message_info_get_user_flag (refrinfo, "ignore-thread");
+	first_msgid = g_array_index (references, guint64, 0);
 
-				g_clear_object (&refrinfo);
-			}
+	for (ii = 0; ii < references->len && !has_ignore_thread; ii++) {
+		guint64 msgid = g_array_index (references, guint64, ii);
 
-			camel_folder_search_free (folder, uids);
-		}
+		has_ignore_thread = msgid && g_hash_table_contains (batch->ignored_ids, &msgid);
+	}
 
-		g_string_free (expr, TRUE);
+	if (!has_ignore_thread) {
+		ignore_thread = FALSE;
+	} else if (first_msgid && g_hash_table_contains (batch->ignored_ids, &first_msgid)) {
+		ignore_thread = TRUE;
+	} else if (first_msgid) {
+		/* The first msgid in the references is In-Reply-To, which is the master;
+		   the rest is just a guess, used only when the master is not known. */
+		ignore_thread = !g_hash_table_contains (batch->added_ids, &first_msgid) &&
+			!folder_cache_has_message_id (batch->folder, first_msgid, cancellable, error);
+	} else {
+		ignore_thread = TRUE;
 	}
 
+	if (state)
+		g_hash_table_insert (batch->added_uids, (gpointer) camel_pstring_strdup (uid), IGNORE_THREAD_VALUE_DONE);
+
 	g_array_unref (references);
 
-	return (found_first_msgid && first_ignore_thread) || (!found_first_msgid && has_ignore_thread);
+	return ignore_thread;
 }
 
 static void
@@ -1060,10 +1324,8 @@ folder_cache_process_folder_changes_thread (CamelFolder *folder,
 					    GError **error,
 					    gpointer user_data)
 {
-	static GHashTable *last_newmail_per_folder = NULL;
-	static GMutex last_newmail_per_folder_mutex;
 	MailFolderCache *cache = user_data;
-	time_t latest_received, new_latest_received;
+	time_t latest_received = 0, new_latest_received;
 	CamelFolder *local_drafts;
 	CamelFolder *local_outbox;
 	CamelFolder *local_sent;
@@ -1085,16 +1347,15 @@ folder_cache_process_folder_changes_thread (CamelFolder *folder,
 	parent_store = camel_folder_get_parent_store (folder);
 	session = camel_service_ref_session (CAMEL_SERVICE (parent_store));
 
-	g_mutex_lock (&last_newmail_per_folder_mutex);
-	if (last_newmail_per_folder == NULL)
-		last_newmail_per_folder = g_hash_table_new (
-			g_direct_hash, g_direct_equal);
-
-	/* it's fine to hash them by folder pointer here */
-	latest_received = GPOINTER_TO_INT (
-		g_hash_table_lookup (last_newmail_per_folder, folder));
+	/* The latest new message date is kept per folder, under its own lock */
+	folder_info = mail_folder_cache_ref_folder_info (
+		cache, parent_store, full_name);
+	if (folder_info != NULL) {
+		g_mutex_lock (&folder_info->lock);
+		latest_received = folder_info->latest_received;
+		g_mutex_unlock (&folder_info->lock);
+	}
 	new_latest_received = latest_received;
-	g_mutex_unlock (&last_newmail_per_folder_mutex);
 
 	local_drafts = e_mail_session_get_local_folder (
 		E_MAIL_SESSION (session), E_MAIL_LOCAL_FOLDER_DRAFTS);
@@ -1108,19 +1369,12 @@ folder_cache_process_folder_changes_thread (CamelFolder *folder,
 	    && folder != local_outbox
 	    && folder != local_sent
 	    && changes && (changes->uid_added->len > 0)) {
-		GHashTable *added_uids; /* gchar *uid ~> IGNORE_THREAD_VALUE_... */
+		NewMailBatch batch;
 
 		/* The messages can be received in a wrong order (by UID), the same as the In-Reply-To
 		   message can be a new message here, in which case it might not be already updated,
 		   thus remember which messages are added and eventually update them when needed. */
-		added_uids = g_hash_table_new_full (g_str_hash, g_str_equal, (GDestroyNotify) camel_pstring_free, NULL);
-
-		for (i = 0; i < changes->uid_added->len; i++) {
-			const gchar *uid = changes->uid_added->pdata[i];
-
-			if (uid)
-				g_hash_table_insert (added_uids, (gpointer) camel_pstring_strdup (uid), IGNORE_THREAD_VALUE_TODO);
-		}
+		new_mail_batch_init (&batch, folder, changes->uid_added);
 
 		/* for each added message, check to see that it is
 		 * brand new, not junk and not already deleted */
@@ -1133,10 +1387,13 @@ folder_cache_process_folder_changes_thread (CamelFolder *folder,
 				flags = camel_message_info_get_flags (info);
 				if (((flags & CAMEL_MESSAGE_SEEN) == 0) &&
 				    ((flags & CAMEL_MESSAGE_DELETED) == 0) &&
-				    folder_cache_check_ignore_thread (folder, info, added_uids, cancellable, &local_error)) {
+				    folder_cache_check_ignore_thread (&batch, info, cancellable, &local_error)) {
 					camel_message_info_set_flags (info, CAMEL_MESSAGE_SEEN, CAMEL_MESSAGE_SEEN);
 					camel_message_info_set_user_flag (info, "ignore-thread", TRUE);
 					flags = flags | CAMEL_MESSAGE_SEEN;
+
+					/* Replies to it later in the batch are ignored too */
+					new_mail_batch_add_ignored_id (&batch, camel_message_info_get_message_id (info));
 				}
 
 				if (((flags & CAMEL_MESSAGE_SEEN) == 0) &&
@@ -1150,14 +1407,11 @@ folder_cache_process_folder_changes_thread (CamelFolder *folder,
 						uid = g_strdup (camel_message_info_get_uid (info));
 						sender = g_strdup (camel_message_info_get_from (info));
 						subject = g_strdup (camel_message_info_get_subject (info));
-					} else {
-						g_free (uid);
-						g_free (sender);
-						g_free (subject);
-
-						uid = NULL;
-						sender = NULL;
-						subject = NULL;
+					} else if (new == 2) {
+						/* The notification shows details of a single message only */
+						g_clear_pointer (&uid, g_free);
+						g_clear_pointer (&sender, g_free);
+						g_clear_pointer (&subject, g_free);
 					}
 				}
 
@@ -1170,20 +1424,20 @@ folder_cache_process_folder_changes_thread (CamelFolder *folder,
 			}
 		}
 
-		g_hash_table_destroy (added_uids);
+		new_mail_batch_clear (&batch);
 	}
 
-	if (new > 0) {
-		g_mutex_lock (&last_newmail_per_folder_mutex);
-		g_hash_table_insert (
-			last_newmail_per_folder, folder,
-			GINT_TO_POINTER (new_latest_received));
-		g_mutex_unlock (&last_newmail_per_folder_mutex);
-	}
+	/* Keep the duplicate detection index current */
+	e_mail_folder_update_message_digests_sync (folder, changes, cancellable);
 
-	folder_info = mail_folder_cache_ref_folder_info (
-		cache, parent_store, full_name);
 	if (folder_info != NULL) {
+		if (new > 0) {
+			g_mutex_lock (&folder_info->lock);
+			if (new_latest_received > folder_info->latest_received)
+				folder_info->latest_received = new_latest_received;
+			g_mutex_unlock (&folder_info->lock);
+		}
+
 		update_1folder (
 			cache, folder_info, new,
 			uid, sender, subject, NULL);
@@ -1562,6 +1816,11 @@ mail_folder_cache_finalize (GObject *object)
 	while (!g_queue_is_empty (&priv->remote_folder_uris))
 		g_free (g_queue_pop_head (&priv->remote_folder_uris));
 
+	g_hash_table_destroy (priv->updates_by_folder);
+	while (!g_queue_is_empty (&priv->updates))
+		update_closure_free (g_queue_pop_head (&priv->updates));
+	g_mutex_clear (&priv->updates_lock);
+
 	/* Chain up to parent's finalize() method. */
 	G_OBJECT_CLASS (mail_folder_cache_parent_class)->finalize (object);
 }
@@ -1891,6 +2150,11 @@ mail_folder_cache_init (MailFolderCache *cache)
 
 	g_queue_init (&cache->priv->local_folder_uris);
 	g_queue_init (&cache->priv->remote_folder_uris);
+
+	g_mutex_init (&cache->priv->updates_lock);
+	g_queue_init (&cache->priv->updates);
+	cache->priv->updates_by_folder = g_hash_table_new (
+		update_closure_hash, update_closure_equal);
 }
 
 MailFolderCache *
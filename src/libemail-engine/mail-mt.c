@@ -319,10 +319,15 @@ static GAsyncQueue *main_loop_queue = NULL;
 static GAsyncQueue *msg_reply_queue = NULL;
 static GThread *main_thread = NULL;
 
+/* How long mail_msg_idle_cb() can run before giving way to redraws */
+#define MAIL_MSG_IDLE_BUDGET (10 * G_TIME_SPAN_MILLISECOND)
+
 static gboolean
 mail_msg_idle_cb (void)
 {
 	MailMsg *msg;
+	gint64 deadline;
+	gboolean done = TRUE;
 
 	g_return_val_if_fail (main_loop_queue != NULL, FALSE);
 	g_return_val_if_fail (msg_reply_queue != NULL, FALSE);
@@ -330,6 +335,9 @@ mail_msg_idle_cb (void)
 	G_LOCK (idle_source_id);
 	idle_source_id = 0;
 	G_UNLOCK (idle_source_id);
+
+	deadline = g_get_monotonic_time () + MAIL_MSG_IDLE_BUDGET;
+
 	/* check the main loop queue */
 	while ((msg = g_async_queue_try_pop (main_loop_queue)) != NULL) {
 		GCancellable *cancellable;
@@ -346,15 +354,35 @@ mail_msg_idle_cb (void)
 		if (msg->info->done != NULL)
 			msg->info->done (msg);
 		mail_msg_unref (msg);
+
+		if (g_get_monotonic_time () >= deadline) {
+			done = FALSE;
+			break;
+		}
 	}
 
 	/* check the reply queue */
-	while ((msg = g_async_queue_try_pop (msg_reply_queue)) != NULL) {
+	while (done && (msg = g_async_queue_try_pop (msg_reply_queue)) != NULL) {
 		if (msg->info->done != NULL)
 			msg->info->done (msg);
 		mail_msg_check_error (msg);
 		mail_msg_unref (msg);
+
+		if (g_get_monotonic_time () >= deadline)
+			done = FALSE;
 	}
+
+	/* Out of budget; continue after the pending redraws, unless
+	 * something pushed meanwhile had scheduled it already. */
+	if (!done) {
+		G_LOCK (idle_source_id);
+		if (idle_source_id == 0)
+			idle_source_id = g_idle_add_full (
+				G_PRIORITY_DEFAULT_IDLE,
+				(GSourceFunc) mail_msg_idle_cb, NULL, NULL);
+		G_UNLOCK (idle_source_id);
+	}
+
 	return FALSE;
 }
 
@@ -420,19 +448,426 @@ mail_msg_compare (const MailMsg *msg1,
 	return (priority1 < priority2) ? 1 : -1;
 }
 
+/* **************************************** */
+
+/* The messages are run by a single set of worker threads.  Each message
+ * is queued in a lane; the unordered lane runs as many messages at once
+ * as there are allowed workers, any other lane runs one message at a
+ * time, in order.  An idle worker picks the best message of any lane,
+ * thus a busy lane blocks only its own messages.
+ *
+ * Waiting messages age: each MAIL_MSG_AGING_INTERVAL spent in the queue
+ * counts as one priority level, thus low priority messages do not starve.
+ * As all messages age at the same rate, this is a static sort key. */
+
+#define MAIL_MSG_AGING_INTERVAL (5 * G_USEC_PER_SEC)
+#define MAIL_MSG_WORKER_IDLE_TIMEOUT (15 * G_USEC_PER_SEC)
+#define MAIL_MSG_STATS_INTERVAL (10 * G_USEC_PER_SEC)
+
+typedef struct _MailMsgLane MailMsgLane;
+typedef struct _MailMsgJob MailMsgJob;
+typedef struct _MailMsgStats MailMsgStats;
+
+struct _MailMsgLane {
+	gpointer store;		/* not referenced, NULL for the shared lanes */
+	GQueue queue;		/* MailMsgJob *, ordered by 'sort_key' */
+	gint max_running;
+	gint n_running;
+};
+
+struct _MailMsgJob {
+	MailMsg *msg;
+	MailMsgLane *lanes[2];	/* the second is set when ordered in two lanes */
+	gint64 queued_time;
+	gint64 sort_key;
+};
+
+struct _MailMsgStats {
+	gchar *desc;
+	guint n_queued;
+	guint n_running;
+	guint64 n_done;
+	gint64 wait_time;	/* in microseconds, a sum */
+	gint64 max_wait_time;
+	gint64 run_time;	/* in microseconds, a sum */
+};
+
+static GMutex sched_lock;
+static GCond sched_cond;
+static GPtrArray *sched_lanes;		/* MailMsgLane * */
+static GHashTable *sched_store_lanes;	/* CamelStore * ~> MailMsgLane * */
+static GHashTable *sched_stats;		/* MailMsgInfo * ~> MailMsgStats * */
+static MailMsgLane *sched_unordered_lane;
+static MailMsgLane *sched_fast_lane;
+static MailMsgLane *sched_slow_lane;
+static guint sched_n_threads;
+static guint sched_n_idle;
+static gint64 sched_stats_printed;
+
+static MailMsgLane *
+sched_lane_new (gpointer store,
+                gint max_running)
+{
+	MailMsgLane *lane;
+
+	lane = g_slice_new0 (MailMsgLane);
+	lane->store = store;
+	lane->max_running = max_running;
+	g_queue_init (&lane->queue);
+
+	g_ptr_array_add (sched_lanes, lane);
+
+	return lane;
+}
+
+static gpointer
+sched_init_once (gpointer data)
+{
+	gint max_threads;
+
+	/* Most of the operations wait on the network or the disk,
+	 * thus allow more of them than there are processors. */
+	max_threads = CLAMP (g_get_num_processors () * 2, 4, 16);
+
+	sched_lanes = g_ptr_array_new ();
+	sched_store_lanes = g_hash_table_new (g_direct_hash, g_direct_equal);
+	sched_stats = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	sched_unordered_lane = sched_lane_new (NULL, max_threads);
+	sched_fast_lane = sched_lane_new (NULL, 1);
+	sched_slow_lane = sched_lane_new (NULL, 1);
+
+	return NULL;
+}
+
+static MailMsgStats *
+sched_get_stats_locked (MailMsgInfo *info)
+{
+	MailMsgStats *stats;
+
+	stats = g_hash_table_lookup (sched_stats, info);
+	if (!stats) {
+		stats = g_new0 (MailMsgStats, 1);
+		g_hash_table_insert (sched_stats, info, stats);
+	}
+
+	return stats;
+}
+
+static gboolean
+sched_lane_can_run (MailMsgLane *lane)
+{
+	return lane->n_running < lane->max_running && !g_queue_is_empty (&lane->queue);
+}
+
+/* A job ordered in two lanes runs only when it is first in both of them */
+static gboolean
+sched_job_can_run (MailMsgJob *job)
+{
+	guint ii;
+
+	for (ii = 0; ii < G_N_ELEMENTS (job->lanes) && job->lanes[ii]; ii++) {
+		MailMsgLane *lane = job->lanes[ii];
+
+		if (lane->n_running >= lane->max_running ||
+		    g_queue_peek_head (&lane->queue) != job)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* How many of the queued messages can run right now */
+static guint
+sched_count_runnable_locked (void)
+{
+	guint ii, count = 0;
+
+	for (ii = 0; ii < sched_lanes->len; ii++) {
+		MailMsgLane *lane = g_ptr_array_index (sched_lanes, ii);
+		MailMsgJob *head;
+
+		if (!sched_lane_can_run (lane))
+			continue;
+
+		head = g_queue_peek_head (&lane->queue);
+
+		if (!head->lanes[1])
+			count += MIN (g_queue_get_length (&lane->queue), lane->max_running - lane->n_running);
+		else if (head->lanes[0] == lane && sched_job_can_run (head))
+			count++;
+	}
+
+	return count;
+}
+
+static MailMsgJob *
+sched_pick_job_locked (void)
+{
+	MailMsgJob *best = NULL;
+	guint ii;
+
+	for (ii = 0; ii < sched_lanes->len; ii++) {
+		MailMsgLane *lane = g_ptr_array_index (sched_lanes, ii);
+		MailMsgJob *head;
+
+		if (!sched_lane_can_run (lane))
+			continue;
+
+		head = g_queue_peek_head (&lane->queue);
+
+		if (sched_job_can_run (head) && (!best || head->sort_key < best->sort_key))
+			best = head;
+	}
+
+	if (!best)
+		return NULL;
+
+	for (ii = 0; ii < G_N_ELEMENTS (best->lanes) && best->lanes[ii]; ii++) {
+		best->lanes[ii]->n_running++;
+		g_queue_pop_head (&best->lanes[ii]->queue);
+	}
+
+	return best;
+}
+
+static void
+sched_lane_maybe_free_locked (MailMsgLane *lane)
+{
+	if (!lane->store || lane->n_running > 0 || !g_queue_is_empty (&lane->queue))
+		return;
+
+	g_hash_table_remove (sched_store_lanes, lane->store);
+	g_ptr_array_remove_fast (sched_lanes, lane);
+	g_slice_free (MailMsgLane, lane);
+}
+
+/* With CAMEL_DEBUG=mail:stats the counters are printed
+ * at most once per MAIL_MSG_STATS_INTERVAL */
+static void
+sched_maybe_print_stats (void)
+{
+	gboolean print;
+	gint64 now;
+
+	if (!camel_debug ("mail:stats"))
+		return;
+
+	now = g_get_monotonic_time ();
+
+	g_mutex_lock (&sched_lock);
+	print = !sched_stats_printed || now - sched_stats_printed >= MAIL_MSG_STATS_INTERVAL;
+	if (print)
+		sched_stats_printed = now;
+	g_mutex_unlock (&sched_lock);
+
+	if (print) {
+		gchar *stats;
+
+		stats = mail_msg_dup_stats ();
+
+		if (camel_debug_start ("mail:stats")) {
+			printf ("%s", stats);
+			camel_debug_end ();
+		}
+
+		g_free (stats);
+	}
+}
+
+static void
+sched_run_job (MailMsgJob *job)
+{
+	MailMsg *msg = job->msg;
+	MailMsgStats *stats;
+	gchar *desc = NULL;
+	gboolean need_desc;
+	gint64 started;
+	guint ii;
+
+	started = g_get_monotonic_time ();
+
+	g_mutex_lock (&sched_lock);
+
+	stats = sched_get_stats_locked (msg->info);
+	stats->n_queued--;
+	stats->n_running++;
+	stats->wait_time += started - job->queued_time;
+	stats->max_wait_time = MAX (stats->max_wait_time, started - job->queued_time);
+
+	need_desc = !stats->desc && msg->info->desc;
+
+	g_mutex_unlock (&sched_lock);
+
+	if (need_desc) {
+		desc = msg->info->desc (msg);
+
+		g_mutex_lock (&sched_lock);
+		if (!stats->desc) {
+			stats->desc = desc;
+			desc = NULL;
+		}
+		g_mutex_unlock (&sched_lock);
+
+		g_free (desc);
+	}
+
+	mail_msg_proxy (msg);
+
+	g_mutex_lock (&sched_lock);
+
+	stats->n_running--;
+	stats->n_done++;
+	stats->run_time += g_get_monotonic_time () - started;
+
+	for (ii = 0; ii < G_N_ELEMENTS (job->lanes) && job->lanes[ii]; ii++) {
+		MailMsgLane *lane = job->lanes[ii];
+
+		lane->n_running--;
+
+		/* This worker may pick a message of another lane */
+		if (sched_n_idle > 0 && sched_lane_can_run (lane))
+			g_cond_broadcast (&sched_cond);
+
+		sched_lane_maybe_free_locked (lane);
+	}
+
+	g_mutex_unlock (&sched_lock);
+
+	g_slice_free (MailMsgJob, job);
+
+	sched_maybe_print_stats ();
+}
+
 static gpointer
-create_thread_pool (gpointer data)
+sched_worker_thread (gpointer user_data)
 {
-	GThreadPool *thread_pool;
-	gint max_threads = GPOINTER_TO_INT (data);
+	g_mutex_lock (&sched_lock);
+
+	while (TRUE) {
+		MailMsgJob *job;
+
+		job = sched_pick_job_locked ();
+
+		if (job) {
+			g_mutex_unlock (&sched_lock);
+			sched_run_job (job);
+			g_mutex_lock (&sched_lock);
+		} else {
+			gint64 end_time;
+			gboolean signalled;
+
+			end_time = g_get_monotonic_time () + MAIL_MSG_WORKER_IDLE_TIMEOUT;
 
-	/* once created, run forever */
-	thread_pool = g_thread_pool_new (
-		(GFunc) mail_msg_proxy, NULL, max_threads, FALSE, NULL);
-	g_thread_pool_set_sort_function (
-		thread_pool, (GCompareDataFunc) mail_msg_compare, NULL);
+			sched_n_idle++;
+			signalled = g_cond_wait_until (&sched_cond, &sched_lock, end_time);
+			sched_n_idle--;
 
-	return thread_pool;
+			if (!signalled && !sched_count_runnable_locked ())
+				break;
+		}
+	}
+
+	sched_n_threads--;
+
+	g_mutex_unlock (&sched_lock);
+
+	return NULL;
+}
+
+static void
+sched_lane_insert (MailMsgLane *lane,
+                   MailMsgJob *job)
+{
+	GList *link;
+
+	/* Most messages have the same priority, thus search from the tail.
+	 * Equal keys keep the push order, thus all lanes order the jobs the
+	 * same way and a job in two lanes cannot wait for itself. */
+	for (link = g_queue_peek_tail_link (&lane->queue); link; link = g_list_previous (link)) {
+		MailMsgJob *queued = link->data;
+
+		if (queued->sort_key <= job->sort_key)
+			break;
+	}
+
+	if (link)
+		g_queue_insert_after (&lane->queue, link, job);
+	else
+		g_queue_push_head (&lane->queue, job);
+}
+
+/* Runs the queued messages in the calling thread, used when
+ * there is no worker thread and none could be created */
+static void
+sched_run_here (void)
+{
+	MailMsgJob *job;
+
+	g_mutex_lock (&sched_lock);
+
+	while (!sched_n_threads && (job = sched_pick_job_locked ()) != NULL) {
+		g_mutex_unlock (&sched_lock);
+		sched_run_job (job);
+		g_mutex_lock (&sched_lock);
+	}
+
+	g_mutex_unlock (&sched_lock);
+}
+
+/* The 'other_lane' can be NULL; when set, the message runs only
+ * after the earlier messages of both lanes are done. Returns FALSE
+ * when no worker thread can run the message, then the caller runs
+ * it with sched_run_here(), after it unlocks the sched_lock. */
+static gboolean
+sched_push (MailMsg *msg,
+            MailMsgLane *lane,
+            MailMsgLane *other_lane)
+{
+	MailMsgJob *job;
+
+	/* Called with the sched_lock held */
+
+	job = g_slice_new0 (MailMsgJob);
+	job->msg = msg;
+	job->lanes[0] = lane;
+	job->lanes[1] = other_lane != lane ? other_lane : NULL;
+	job->queued_time = g_get_monotonic_time ();
+	job->sort_key = job->queued_time - (gint64) msg->priority * MAIL_MSG_AGING_INTERVAL;
+
+	sched_lane_insert (job->lanes[0], job);
+	if (job->lanes[1])
+		sched_lane_insert (job->lanes[1], job);
+
+	sched_get_stats_locked (msg->info)->n_queued++;
+
+	if (sched_n_idle > 0)
+		g_cond_broadcast (&sched_cond);
+
+	if (sched_count_runnable_locked () > sched_n_idle) {
+		GThread *thread;
+
+		/* When this fails, the running workers pick the message
+		 * once they are done, and the next push tries again */
+		thread = g_thread_try_new ("mail-msg-worker", sched_worker_thread, NULL, NULL);
+		if (thread) {
+			sched_n_threads++;
+			g_thread_unref (thread);
+		} else if (!sched_n_threads) {
+			g_warning ("%s: Failed to create a worker thread, running the message in the calling thread", G_STRFUNC);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static void
+sched_init (void)
+{
+	static GOnce once = G_ONCE_INIT;
+
+	g_once (&once, sched_init_once, NULL);
 }
 
 void
@@ -454,31 +889,145 @@ mail_msg_main_loop_push (gpointer msg)
 void
 mail_msg_unordered_push (gpointer msg)
 {
-	static GOnce once = G_ONCE_INIT;
+	gboolean pushed;
+
+	sched_init ();
 
-	g_once (&once, (GThreadFunc) create_thread_pool, GINT_TO_POINTER (10));
+	g_mutex_lock (&sched_lock);
+	pushed = sched_push (msg, sched_unordered_lane, NULL);
+	g_mutex_unlock (&sched_lock);
 
-	g_thread_pool_push ((GThreadPool *) once.retval, msg, NULL);
+	if (!pushed)
+		sched_run_here ();
 }
 
 void
 mail_msg_fast_ordered_push (gpointer msg)
 {
-	static GOnce once = G_ONCE_INIT;
+	gboolean pushed;
 
-	g_once (&once, (GThreadFunc) create_thread_pool, GINT_TO_POINTER (1));
+	sched_init ();
 
-	g_thread_pool_push ((GThreadPool *) once.retval, msg, NULL);
+	g_mutex_lock (&sched_lock);
+	pushed = sched_push (msg, sched_fast_lane, NULL);
+	g_mutex_unlock (&sched_lock);
+
+	if (!pushed)
+		sched_run_here ();
 }
 
 void
 mail_msg_slow_ordered_push (gpointer msg)
 {
-	static GOnce once = G_ONCE_INIT;
+	gboolean pushed;
+
+	sched_init ();
+
+	g_mutex_lock (&sched_lock);
+	pushed = sched_push (msg, sched_slow_lane, NULL);
+	g_mutex_unlock (&sched_lock);
+
+	if (!pushed)
+		sched_run_here ();
+}
+
+/* Called with the sched_lock held */
+static MailMsgLane *
+sched_ref_store_lane_locked (CamelStore *store)
+{
+	MailMsgLane *lane;
+
+	lane = g_hash_table_lookup (sched_store_lanes, store);
+	if (!lane) {
+		lane = sched_lane_new (store, 1);
+		g_hash_table_insert (sched_store_lanes, store, lane);
+	}
+
+	return lane;
+}
+
+/* Like mail_msg_slow_ordered_push(), only the message is ordered
+ * with other messages for the same 'store' only, thus a slow account
+ * does not block the others. */
+void
+mail_msg_slow_ordered_push_for_store (gpointer msg,
+                                      CamelStore *store)
+{
+	mail_msg_slow_ordered_push_for_stores (msg, store, NULL);
+}
+
+/* Like mail_msg_slow_ordered_push_for_store(), only the message is
+ * ordered with the messages of both stores, like a transfer between
+ * two accounts.  The 'other_store' can be NULL or the same as 'store'. */
+void
+mail_msg_slow_ordered_push_for_stores (gpointer msg,
+                                       CamelStore *store,
+                                       CamelStore *other_store)
+{
+	gboolean pushed;
+
+	if (!store) {
+		store = other_store;
+		other_store = NULL;
+	}
+
+	if (!store) {
+		mail_msg_slow_ordered_push (msg);
+		return;
+	}
+
+	sched_init ();
+
+	g_mutex_lock (&sched_lock);
+
+	pushed = sched_push (
+		msg, sched_ref_store_lane_locked (store),
+		other_store ? sched_ref_store_lane_locked (other_store) : NULL);
+
+	g_mutex_unlock (&sched_lock);
+
+	if (!pushed)
+		sched_run_here ();
+}
+
+/* Returns a text with the scheduler counters, for diagnostics.
+ * Free it with g_free(), when no longer needed. */
+gchar *
+mail_msg_dup_stats (void)
+{
+	GString *str;
+	GHashTableIter iter;
+	gpointer value;
+
+	sched_init ();
+
+	str = g_string_new ("");
+
+	g_mutex_lock (&sched_lock);
+
+	g_string_append_printf (
+		str, "threads: %u, idle: %u, lanes: %u, runnable: %u\n",
+		sched_n_threads, sched_n_idle, sched_lanes->len,
+		sched_count_runnable_locked ());
+
+	g_hash_table_iter_init (&iter, sched_stats);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		MailMsgStats *stats = value;
+		gdouble n_started = stats->n_done + stats->n_running;
+
+		g_string_append_printf (
+			str, "%s: queued: %u, running: %u, done: %" G_GUINT64_FORMAT
+			", avg wait: %.1f ms, max wait: %.1f ms, avg run: %.1f ms\n",
+			stats->desc ? stats->desc : "(unknown)",
+			stats->n_queued, stats->n_running, stats->n_done,
+			n_started > 0 ? stats->wait_time / n_started / 1000.0 : 0.0,
+			stats->max_wait_time / 1000.0,
+			stats->n_done > 0 ? stats->run_time / (gdouble) stats->n_done / 1000.0 : 0.0);
+	}
 
-	g_once (&once, (GThreadFunc) create_thread_pool, GINT_TO_POINTER (1));
+	g_mutex_unlock (&sched_lock);
 
-	g_thread_pool_push ((GThreadPool *) once.retval, msg, NULL);
+	return g_string_free (str, FALSE);
 }
 
 gboolean
@@ -27,6 +27,7 @@
 #include "evolution-config.h"
 
 #include <errno.h>
+#include <string.h>
 
 #include <glib/gstdio.h>
 #include <glib/gi18n.h>
@@ -1224,12 +1225,326 @@ transfer_messages_desc (struct _transfer_msg *m)
 
 }
 
+/* Transfers of more messages than this are done in chunks; a failure keeps
+ * the chunks done so far and reports how many messages were transferred */
+#define TRANSFER_CHUNK_SIZE 250
+
+/* How long a failed chunked transfer remembers the messages it transferred */
+#define TRANSFER_CHECKPOINT_EXPIRY (30 * 60 * G_TIME_SPAN_SECOND)
+
+/* UIDs transferred by a failed chunked transfer, thus a retry of the same
+ * transfer continues where it stopped, instead of copying them again */
+typedef struct _TransferCheckpoint {
+	GHashTable *done_uids;	/* gchar *uid */
+	gint64 updated;		/* monotonic time of the last change */
+} TransferCheckpoint;
+
+/* gchar *key ~> TransferCheckpoint * */
+static GHashTable *transfer_checkpoints = NULL;
+G_LOCK_DEFINE_STATIC (transfer_checkpoints);
+
+static void
+transfer_checkpoint_free (gpointer ptr)
+{
+	TransferCheckpoint *tc = ptr;
+
+	if (tc) {
+		g_hash_table_destroy (tc->done_uids);
+		g_slice_free (TransferCheckpoint, tc);
+	}
+}
+
+static gint
+transfer_checkpoint_compare_uids (gconstpointer ptr1,
+                                  gconstpointer ptr2)
+{
+	return strcmp (*((const gchar **) ptr1), *((const gchar **) ptr2));
+}
+
+/* The key consists of the source and destination folder URIs and a digest
+ * of the set of the UIDs, thus a different transfer between the same
+ * folders does not skip any message. */
+static gchar *
+transfer_checkpoint_dup_key (CamelFolder *source,
+                             const gchar *dest_uri,
+                             GPtrArray *uids)
+{
+	GChecksum *checksum;
+	GPtrArray *sorted;
+	gchar *source_uri, *key;
+	guint ii;
+
+	sorted = g_ptr_array_sized_new (uids->len);
+	for (ii = 0; ii < uids->len; ii++)
+		g_ptr_array_add (sorted, uids->pdata[ii]);
+	g_ptr_array_sort (sorted, transfer_checkpoint_compare_uids);
+
+	checksum = g_checksum_new (G_CHECKSUM_SHA1);
+	for (ii = 0; ii < sorted->len; ii++) {
+		const gchar *uid = sorted->pdata[ii];
+
+		/* Including the terminating NUL, which separates the UIDs */
+		g_checksum_update (checksum, (const guchar *) uid, strlen (uid) + 1);
+	}
+
+	source_uri = e_mail_folder_uri_from_folder (source);
+	key = g_strdup_printf ("%s\n%s\n%s", source_uri, dest_uri, g_checksum_get_string (checksum));
+
+	g_checksum_free (checksum);
+	g_ptr_array_free (sorted, TRUE);
+	g_free (source_uri);
+
+	return key;
+}
+
+/* Returns the 'uids' not transferred yet by an earlier attempt,
+ * with the strings not copied; drops expired checkpoints */
+static GPtrArray *
+transfer_checkpoint_filter (const gchar *key,
+                            GPtrArray *uids)
+{
+	TransferCheckpoint *tc = NULL;
+	GPtrArray *pending;
+	guint ii;
+
+	G_LOCK (transfer_checkpoints);
+
+	if (transfer_checkpoints) {
+		GHashTableIter iter;
+		gpointer value;
+		gint64 now = g_get_monotonic_time ();
+
+		g_hash_table_iter_init (&iter, transfer_checkpoints);
+		while (g_hash_table_iter_next (&iter, NULL, &value)) {
+			TransferCheckpoint *stale = value;
+
+			if (now - stale->updated > TRANSFER_CHECKPOINT_EXPIRY)
+				g_hash_table_iter_remove (&iter);
+		}
+
+		tc = g_hash_table_lookup (transfer_checkpoints, key);
+	}
+
+	pending = g_ptr_array_sized_new (uids->len);
+
+	for (ii = 0; ii < uids->len; ii++) {
+		if (!tc || !g_hash_table_contains (tc->done_uids, uids->pdata[ii]))
+			g_ptr_array_add (pending, uids->pdata[ii]);
+	}
+
+	G_UNLOCK (transfer_checkpoints);
+
+	return pending;
+}
+
+static void
+transfer_checkpoint_add (const gchar *key,
+                         GPtrArray *chunk)
+{
+	TransferCheckpoint *tc;
+	guint ii;
+
+	G_LOCK (transfer_checkpoints);
+
+	if (!transfer_checkpoints)
+		transfer_checkpoints = g_hash_table_new_full (
+			g_str_hash, g_str_equal, g_free, transfer_checkpoint_free);
+
+	tc = g_hash_table_lookup (transfer_checkpoints, key);
+
+	if (!tc) {
+		tc = g_slice_new0 (TransferCheckpoint);
+		tc->done_uids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+		g_hash_table_insert (transfer_checkpoints, g_strdup (key), tc);
+	}
+
+	for (ii = 0; ii < chunk->len; ii++)
+		g_hash_table_add (tc->done_uids, g_strdup (chunk->pdata[ii]));
+
+	tc->updated = g_get_monotonic_time ();
+
+	G_UNLOCK (transfer_checkpoints);
+}
+
+static void
+transfer_checkpoint_remove (const gchar *key)
+{
+	G_LOCK (transfer_checkpoints);
+
+	if (transfer_checkpoints)
+		g_hash_table_remove (transfer_checkpoints, key);
+
+	G_UNLOCK (transfer_checkpoints);
+}
+
+/* One chunk of messages downloaded from a remote source folder. The next chunk
+ * is downloaded while the current one is stored to the destination folder, thus
+ * each of the two folders is used by one thread at a time. */
+typedef struct _TransferPrefetch {
+	CamelFolder *folder;
+	GPtrArray *uids;
+	GPtrArray *messages;	/* CamelMimeMessage * */
+	GPtrArray *infos;	/* CamelMessageInfo * */
+	GCancellable *cancellable;
+	GError *error;
+} TransferPrefetch;
+
+static void
+transfer_prefetch_init (TransferPrefetch *tp,
+                        CamelFolder *folder,
+                        GPtrArray *uids,
+                        GCancellable *cancellable)
+{
+	tp->folder = folder;
+	tp->uids = uids;
+	tp->messages = g_ptr_array_new_with_free_func (g_object_unref);
+	tp->infos = g_ptr_array_new_with_free_func (g_object_unref);
+	tp->cancellable = cancellable;
+	tp->error = NULL;
+}
+
+static void
+transfer_prefetch_clear (TransferPrefetch *tp)
+{
+	g_ptr_array_unref (tp->messages);
+	g_ptr_array_unref (tp->infos);
+	g_clear_error (&tp->error);
+}
+
+static gpointer
+transfer_prefetch_thread (gpointer user_data)
+{
+	TransferPrefetch *tp = user_data;
+	guint ii;
+
+	for (ii = 0; ii < tp->uids->len; ii++) {
+		CamelMimeMessage *message;
+		CamelMessageInfo *info, *clone;
+
+		message = camel_folder_get_message_sync (
+			tp->folder, tp->uids->pdata[ii],
+			tp->cancellable, &tp->error);
+		if (!message)
+			break;
+
+		info = camel_folder_get_message_info (tp->folder, tp->uids->pdata[ii]);
+		if (info) {
+			clone = camel_message_info_clone (info, NULL);
+			g_object_unref (info);
+		} else {
+			clone = camel_message_info_new (NULL);
+		}
+
+		/* The copy is not deleted, even when the original is */
+		camel_message_info_set_flags (clone, CAMEL_MESSAGE_DELETED, 0);
+
+		g_ptr_array_add (tp->messages, message);
+		g_ptr_array_add (tp->infos, clone);
+	}
+
+	return NULL;
+}
+
+/* Stores messages downloaded by transfer_prefetch_thread() into 'dest'.
+ * The caller flags the originals once no download runs on the source. */
+static gboolean
+transfer_prefetch_store (TransferPrefetch *tp,
+                         CamelFolder *dest,
+                         GCancellable *cancellable,
+                         GError **error)
+{
+	guint ii;
+
+	if (tp->error) {
+		g_propagate_error (error, tp->error);
+		tp->error = NULL;
+		return FALSE;
+	}
+
+	for (ii = 0; ii < tp->messages->len; ii++) {
+		if (!camel_folder_append_message_sync (
+			dest, tp->messages->pdata[ii], tp->infos->pdata[ii],
+			NULL, cancellable, error))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+transfer_prefetch_cancelled_cb (GCancellable *cancellable,
+                                gpointer user_data)
+{
+	g_cancellable_cancel (user_data);
+}
+
+/* Returns the next up to TRANSFER_CHUNK_SIZE UIDs from 'uids', from the 'index',
+ * which is moved after them. The strings are not copied. */
+static GPtrArray *
+transfer_messages_next_chunk (GPtrArray *uids,
+                              guint *index)
+{
+	GPtrArray *chunk;
+	guint n_uids;
+
+	n_uids = MIN (uids->len - *index, TRANSFER_CHUNK_SIZE);
+
+	/* Do not leave a tiny chunk at the end */
+	if (uids->len - *index - n_uids < TRANSFER_CHUNK_SIZE / 5)
+		n_uids = uids->len - *index;
+
+	chunk = g_ptr_array_sized_new (n_uids);
+
+	while (n_uids > 0) {
+		g_ptr_array_add (chunk, uids->pdata[*index]);
+		(*index)++;
+		n_uids--;
+	}
+
+	return chunk;
+}
+
+static guint64
+transfer_messages_count_bytes (CamelFolder *folder,
+                               GPtrArray *uids)
+{
+	guint64 n_bytes = 0;
+	guint ii;
+
+	for (ii = 0; ii < uids->len; ii++) {
+		CamelMessageInfo *info;
+
+		info = camel_folder_get_message_info (folder, uids->pdata[ii]);
+		if (info) {
+			n_bytes += camel_message_info_get_size (info);
+			g_object_unref (info);
+		}
+	}
+
+	return n_bytes;
+}
+
 static void
 transfer_messages_exec (struct _transfer_msg *m,
                         GCancellable *cancellable,
                         GError **error)
 {
 	CamelFolder *dest;
+	CamelStore *source_store;
+	CamelProvider *provider;
+	CamelMessageFlags done_flags;
+	TransferPrefetch tp;
+	GPtrArray *pending, *chunk;
+	GCancellable *prefetch_cancellable = NULL;
+	gchar *checkpoint_key = NULL;
+	gboolean pushed_message = FALSE;
+	gboolean have_prefetch = FALSE;
+	gboolean success = TRUE;
+	gulong prefetch_handler_id = 0;
+	guint64 n_bytes = 0;
+	gint64 started;
+	guint ii, index = 0, n_done = 0, n_skipped;
 
 	dest = e_mail_session_uri_to_folder_sync (
 		m->session, m->dest_uri, m->dest_flags,
@@ -1243,27 +1558,167 @@ transfer_messages_exec (struct _transfer_msg *m,
 		return;
 	}
 
+	/* Skip messages transferred by a previous, failed attempt */
+	if (m->uids->len > TRANSFER_CHUNK_SIZE) {
+		checkpoint_key = transfer_checkpoint_dup_key (m->source, m->dest_uri, m->uids);
+		pending = transfer_checkpoint_filter (checkpoint_key, m->uids);
+	} else {
+		pending = g_ptr_array_ref (m->uids);
+	}
+
+	n_skipped = m->uids->len - pending->len;
+
+	/* Download the next chunk from a remote account while the current
+	 * one is being stored; within one account the server copies them. */
+	source_store = camel_folder_get_parent_store (m->source);
+	provider = camel_service_get_provider (CAMEL_SERVICE (source_store));
+
+	if (pending->len > TRANSFER_CHUNK_SIZE &&
+	    source_store != camel_folder_get_parent_store (dest) &&
+	    provider && (provider->flags & CAMEL_PROVIDER_IS_REMOTE) != 0) {
+		prefetch_cancellable = g_cancellable_new ();
+
+		if (cancellable)
+			prefetch_handler_id = g_cancellable_connect (
+				cancellable,
+				G_CALLBACK (transfer_prefetch_cancelled_cb),
+				prefetch_cancellable, NULL);
+	}
+
+	/* make sure all deleted messages are marked as seen; the folder
+	 * does not delete the originals of the prefetched messages */
+	if (!m->delete)
+		done_flags = 0;
+	else if (prefetch_cancellable)
+		done_flags = CAMEL_MESSAGE_DELETED | CAMEL_MESSAGE_SEEN;
+	else
+		done_flags = CAMEL_MESSAGE_SEEN;
+
 	camel_folder_freeze (m->source);
 	camel_folder_freeze (dest);
 
-	camel_folder_transfer_messages_to_sync (
-		m->source, m->uids, dest, m->delete, NULL,
-		cancellable, error);
+	started = g_get_monotonic_time ();
+	chunk = transfer_messages_next_chunk (pending, &index);
+
+	if (prefetch_cancellable && chunk->len > 0) {
+		transfer_prefetch_init (&tp, m->source, chunk, prefetch_cancellable);
+		transfer_prefetch_thread (&tp);
+		have_prefetch = TRUE;
+	}
+
+	while (success && chunk->len > 0) {
+		TransferPrefetch next_tp;
+		GThread *prefetch_thread = NULL;
+		GPtrArray *next_chunk;
+		guint64 chunk_bytes;
+
+		next_chunk = transfer_messages_next_chunk (pending, &index);
+		chunk_bytes = transfer_messages_count_bytes (m->source, chunk);
 
-	/* make sure all deleted messages are marked as seen */
+		if (have_prefetch) {
+			if (next_chunk->len > 0) {
+				transfer_prefetch_init (&next_tp, m->source, next_chunk, prefetch_cancellable);
 
-	if (m->delete) {
-		gint i;
+				prefetch_thread = g_thread_try_new (
+					"mail-transfer-prefetch",
+					transfer_prefetch_thread, &next_tp, NULL);
+			}
+
+			success = transfer_prefetch_store (&tp, dest, cancellable, error);
+
+			if (prefetch_thread) {
+				if (!success)
+					g_cancellable_cancel (prefetch_cancellable);
+				g_thread_join (prefetch_thread);
+			} else if (success && next_chunk->len > 0) {
+				transfer_prefetch_thread (&next_tp);
+			}
+
+			transfer_prefetch_clear (&tp);
+			have_prefetch = next_chunk->len > 0;
+			if (have_prefetch)
+				tp = next_tp;
+		} else {
+			success = camel_folder_transfer_messages_to_sync (
+				m->source, chunk, dest, m->delete, NULL,
+				cancellable, error);
+		}
 
-		for (i = 0; i < m->uids->len; i++)
-			camel_folder_set_message_flags (
-				m->source, m->uids->pdata[i],
-				CAMEL_MESSAGE_SEEN, CAMEL_MESSAGE_SEEN);
+		if (success) {
+			gdouble elapsed;
+
+			if (checkpoint_key)
+				transfer_checkpoint_add (checkpoint_key, chunk);
+
+			for (ii = 0; ii < chunk->len && done_flags; ii++) {
+				camel_folder_set_message_flags (
+					m->source, chunk->pdata[ii],
+					done_flags, done_flags);
+			}
+
+			n_done += chunk->len;
+			n_bytes += chunk_bytes;
+
+			elapsed = (g_get_monotonic_time () - started) / (gdouble) G_USEC_PER_SEC;
+
+			/* Report throughput when transferring in chunks */
+			if (m->uids->len > chunk->len) {
+				if (pushed_message)
+					camel_operation_pop_message (cancellable);
+
+				camel_operation_push_message (
+					cancellable,
+					ngettext (
+						"Transferred %u of %u message (%.1f messages/s, %.1f MB/s)",
+						"Transferred %u of %u messages (%.1f messages/s, %.1f MB/s)",
+						m->uids->len),
+					n_skipped + n_done, m->uids->len,
+					elapsed > 0 ? n_done / elapsed : 0.0,
+					elapsed > 0 ? n_bytes / elapsed / (1024.0 * 1024.0) : 0.0);
+				camel_operation_progress (cancellable, 100 * (n_skipped + n_done) / m->uids->len);
+
+				pushed_message = TRUE;
+			}
+
+			d (printf ("%s: %u of %u messages, %" G_GUINT64_FORMAT " bytes in %.1fs\n",
+				G_STRFUNC, n_done, m->uids->len, n_bytes, elapsed));
+		}
+
+		g_ptr_array_free (chunk, TRUE);
+		chunk = next_chunk;
 	}
 
+	g_ptr_array_free (chunk, TRUE);
+
+	if (have_prefetch)
+		transfer_prefetch_clear (&tp);
+
+	if (pushed_message)
+		camel_operation_pop_message (cancellable);
+
 	camel_folder_thaw (m->source);
 	camel_folder_thaw (dest);
 
+	if (!success && n_skipped + n_done > 0)
+		g_prefix_error (
+			error,
+			ngettext (
+				"Transferred %u of %u message before the failure: ",
+				"Transferred %u of %u messages before the failure: ",
+				m->uids->len),
+			n_skipped + n_done, m->uids->len);
+
+	/* All is done, nothing to resume */
+	if (success && checkpoint_key)
+		transfer_checkpoint_remove (checkpoint_key);
+
+	g_ptr_array_unref (pending);
+	g_free (checkpoint_key);
+
+	if (prefetch_handler_id)
+		g_cancellable_disconnect (cancellable, prefetch_handler_id);
+	g_clear_object (&prefetch_cancellable);
+
 	/* FIXME Not passing a GCancellable or GError here. */
 	camel_folder_synchronize_sync (dest, FALSE, NULL, NULL);
 	g_object_unref (dest);
@@ -1305,6 +1760,7 @@ mail_transfer_messages (EMailSession *session,
                         gpointer data)
 {
 	struct _transfer_msg *m;
+	CamelStore *dest_store = NULL;
 
 	g_return_if_fail (CAMEL_IS_FOLDER (source));
 	g_return_if_fail (uids != NULL);
@@ -1320,7 +1776,186 @@ mail_transfer_messages (EMailSession *session,
 	m->done = done;
 	m->data = data;
 
-	mail_msg_slow_ordered_push (m);
+	/* A transfer between two accounts is ordered also with the
+	 * destination account's operations, like emptying its Trash. */
+	e_mail_folder_uri_parse (
+		CAMEL_SESSION (session), dest_uri,
+		&dest_store, NULL, NULL);
+
+	mail_msg_slow_ordered_push_for_stores (
+		m, camel_folder_get_parent_store (source), dest_store);
+
+	g_clear_object (&dest_store);
+}
+
+/* ** FOLDERS FAN-OUT ****************************************************** */
+
+/* Upper bound of folders being worked on at once for one store */
+#define MAIL_FOLDERS_MAX_CONCURRENCY 8
+
+typedef struct _FoldersRun {
+	GMutex lock;
+	GPtrArray *items;
+	guint next_index;
+	guint n_done;
+	gboolean stop;
+
+	MailFolderWorkFunc func;
+	gpointer user_data;
+	GCancellable *progress;
+	GCancellable *cancellable;
+} FoldersRun;
+
+/* Returns how many folders of the store can be worked on at once; this
+ * follows the account's "concurrent-connections" setting, if any. */
+guint
+mail_store_get_folder_concurrency (CamelStore *store)
+{
+	CamelSettings *settings;
+	guint n_connections = 1;
+
+	g_return_val_if_fail (CAMEL_IS_STORE (store), 1);
+
+	settings = camel_service_ref_settings (CAMEL_SERVICE (store));
+	if (!settings)
+		return 1;
+
+	/* XXX This is an IMAPX-specific setting; the store serves
+	 *     the requests of different folders on different
+	 *     connections, up to this count. */
+	if (g_object_class_find_property (G_OBJECT_GET_CLASS (settings), "concurrent-connections") != NULL)
+		g_object_get (settings, "concurrent-connections", &n_connections, NULL);
+
+	g_object_unref (settings);
+
+	return CLAMP (n_connections, 1, MAIL_FOLDERS_MAX_CONCURRENCY);
+}
+
+static void
+folders_run_worker (FoldersRun *run,
+                    GCancellable *cancellable)
+{
+	while (TRUE) {
+		gpointer item;
+		gboolean can_continue;
+
+		g_mutex_lock (&run->lock);
+
+		if (run->stop || run->next_index >= run->items->len ||
+		    g_cancellable_is_cancelled (cancellable)) {
+			g_mutex_unlock (&run->lock);
+			break;
+		}
+
+		item = run->items->pdata[run->next_index];
+		run->next_index++;
+
+		g_mutex_unlock (&run->lock);
+
+		can_continue = run->func (item, run->user_data, cancellable);
+
+		g_mutex_lock (&run->lock);
+
+		run->n_done++;
+
+		if (!can_continue)
+			run->stop = TRUE;
+		else if (run->progress && !g_cancellable_is_cancelled (run->progress))
+			camel_operation_progress (run->progress, 100 * run->n_done / run->items->len);
+
+		g_mutex_unlock (&run->lock);
+	}
+}
+
+static void
+folders_run_cancelled_cb (GCancellable *cancellable,
+                          gpointer user_data)
+{
+	g_cancellable_cancel (user_data);
+}
+
+static gpointer
+folders_run_thread (gpointer user_data)
+{
+	FoldersRun *run = user_data;
+	GCancellable *cancellable;
+	gulong handler_id = 0;
+
+	/* Each helper thread has its own operation, thus the status
+	 * messages of the folders being worked on at once do not mix;
+	 * the overall progress is reported by folders_run_worker(). */
+	cancellable = camel_operation_new ();
+
+	if (run->cancellable)
+		handler_id = g_cancellable_connect (
+			run->cancellable,
+			G_CALLBACK (folders_run_cancelled_cb),
+			cancellable, NULL);
+
+	folders_run_worker (run, cancellable);
+
+	if (handler_id)
+		g_cancellable_disconnect (run->cancellable, handler_id);
+
+	g_object_unref (cancellable);
+
+	return NULL;
+}
+
+/* Calls 'func' for each of the 'items', with up to 'max_concurrency' of
+ * them being worked on at once, the calling thread included; the overall
+ * progress is reported to the 'progress' operation.  No other item is
+ * started once the 'func' returns FALSE or the 'cancellable' is cancelled.
+ * With 'max_concurrency' 1 the items are processed in order in the calling
+ * thread, otherwise the 'func' is called from helper threads as well. */
+void
+mail_folders_foreach_sync (GPtrArray *items,
+                           guint max_concurrency,
+                           MailFolderWorkFunc func,
+                           gpointer user_data,
+                           GCancellable *progress,
+                           GCancellable *cancellable)
+{
+	FoldersRun run;
+	GPtrArray *threads;
+	guint ii, n_threads;
+
+	g_return_if_fail (items != NULL);
+	g_return_if_fail (func != NULL);
+
+	if (!items->len)
+		return;
+
+	g_mutex_init (&run.lock);
+	run.items = items;
+	run.next_index = 0;
+	run.n_done = 0;
+	run.stop = FALSE;
+	run.func = func;
+	run.user_data = user_data;
+	run.progress = progress;
+	run.cancellable = cancellable;
+
+	n_threads = CLAMP (max_concurrency, 1, items->len);
+	threads = g_ptr_array_new ();
+
+	for (ii = 1; ii < n_threads; ii++) {
+		GThread *thread;
+
+		thread = g_thread_try_new ("mail-folders", folders_run_thread, &run, NULL);
+		if (!thread)
+			break;
+
+		g_ptr_array_add (threads, thread);
+	}
+
+	folders_run_worker (&run, cancellable);
+
+	for (ii = 0; ii < threads->len; ii++)
+		g_thread_join (threads->pdata[ii]);
+
+	g_ptr_array_free (threads, TRUE);
+	g_mutex_clear (&run.lock);
 }
 
 /* ** SYNC FOLDER ********************************************************* */
@@ -1440,7 +2075,7 @@ mail_sync_folder (CamelFolder *folder,
 	m->data = data;
 	m->done = done;
 
-	mail_msg_slow_ordered_push (m);
+	mail_msg_slow_ordered_push_for_store (m, camel_folder_get_parent_store (folder));
 }
 
 /* ** SYNC STORE ********************************************************* */
@@ -1475,14 +2110,78 @@ sync_store_desc (struct _sync_store_msg *m)
 	return description;
 }
 
+typedef struct _SyncStoreData {
+	GMutex lock;
+	GError *error;
+} SyncStoreData;
+
+static gboolean
+sync_store_folder_cb (gpointer item,
+                      gpointer user_data,
+                      GCancellable *cancellable)
+{
+	CamelFolder *folder = item;
+	SyncStoreData *ssd = user_data;
+	GError *local_error = NULL;
+
+	/* The other folders are stored even when this one fails,
+	 * the same as the store synchronization does */
+	if (!camel_folder_synchronize_sync (folder, FALSE, cancellable, &local_error)) {
+		g_mutex_lock (&ssd->lock);
+
+		if (!ssd->error)
+			g_propagate_error (&ssd->error, local_error);
+		else
+			g_clear_error (&local_error);
+
+		g_mutex_unlock (&ssd->lock);
+	}
+
+	return !g_cancellable_is_cancelled (cancellable);
+}
+
 static void
 sync_store_exec (struct _sync_store_msg *m,
                  GCancellable *cancellable,
                  GError **error)
 {
-	camel_store_synchronize_sync (
-		m->store, m->expunge,
-		cancellable, error);
+	GPtrArray *folders = NULL;
+	guint concurrency;
+
+	concurrency = mail_store_get_folder_concurrency (m->store);
+
+	/* Store the opened folders on multiple connections instead of
+	 * one by one in the store synchronization. The expunge covers
+	 * also folders not opened, thus it is left on the store. */
+	if (!m->expunge && concurrency > 1 && CAMEL_IS_OFFLINE_STORE (m->store) &&
+	    camel_offline_store_get_online (CAMEL_OFFLINE_STORE (m->store)))
+		folders = camel_store_dup_opened_folders (m->store);
+
+	if (folders) {
+		SyncStoreData ssd;
+
+		g_mutex_init (&ssd.lock);
+		ssd.error = NULL;
+
+		mail_folders_foreach_sync (
+			folders, concurrency,
+			sync_store_folder_cb, &ssd,
+			cancellable, cancellable);
+
+		if (ssd.error)
+			g_propagate_error (error, ssd.error);
+		else
+			g_cancellable_set_error_if_cancelled (cancellable, error);
+
+		g_mutex_clear (&ssd.lock);
+
+		g_ptr_array_foreach (folders, (GFunc) g_object_unref, NULL);
+		g_ptr_array_free (folders, TRUE);
+	} else {
+		camel_store_synchronize_sync (
+			m->store, m->expunge,
+			cancellable, error);
+	}
 }
 
 static void
@@ -1521,7 +2220,7 @@ mail_sync_store (CamelStore *store,
 	m->data = data;
 	m->done = done;
 
-	mail_msg_slow_ordered_push (m);
+	mail_msg_slow_ordered_push_for_store (m, store);
 }
 
 /* ******************************************************************************** */
@@ -1597,7 +2296,7 @@ mail_empty_trash (CamelStore *store)
 	m = mail_msg_new (&empty_trash_info);
 	m->store = g_object_ref (store);
 
-	mail_msg_slow_ordered_push (m);
+	mail_msg_slow_ordered_push_for_store (m, store);
 }
 
 /* ** Execute Shell Command ************************************************ */
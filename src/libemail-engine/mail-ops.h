@@ -105,6 +105,20 @@ void		mail_process_folder_changes	(CamelFolder *folder,
 						 void (* done) (gpointer user_data),
 						 gpointer user_data);
 
+/* Returns TRUE to continue with the other items, FALSE to stop */
+typedef gboolean (*MailFolderWorkFunc)		(gpointer item,
+						 gpointer user_data,
+						 GCancellable *cancellable);
+
+guint		mail_store_get_folder_concurrency
+						(CamelStore *store);
+void		mail_folders_foreach_sync	(GPtrArray *items,
+						 guint max_concurrency,
+						 MailFolderWorkFunc func,
+						 gpointer user_data,
+						 GCancellable *progress,
+						 GCancellable *cancellable);
+
 /* filter driver execute shell command async callback */
 void mail_execute_shell_command (CamelFilterDriver *driver, gint argc, gchar **argv, gpointer data);
 
@@ -32,6 +32,8 @@
 
 #include <shell/e-shell.h>
 
+#include <em-format/e-mail-part-list.h>
+
 #include <mail/e-mail-migrate.h>
 #include <mail/e-mail-ui-session.h>
 #include <mail/em-event.h>
@@ -601,6 +603,9 @@ mail_backend_folder_deleted_cb (MailFolderCache *folder_cache,
 	const gchar *local_sent_folder_uri;
 	gchar *uri;
 
+	/* Parsed messages of the deleted folder are useless now */
+	e_mail_part_list_cache_clear ();
+
 	/* Check whether the deleted folder was a designated Drafts or
 	 * Sent folder for any mail account, and if so revert the setting
 	 * to the equivalent local folder, which is always present. */
@@ -1167,6 +1172,9 @@ mail_backend_remove_store (EMailSession *session,
 
 	model = em_folder_tree_model_get_default ();
 	em_folder_tree_model_remove_store (model, store);
+
+	/* Do not keep parsed messages of a removed account */
+	e_mail_part_list_cache_clear ();
 }
 
 #define SET_ACTIVITY(cancellable, activity) \
@@ -2644,7 +2644,6 @@ e_mail_reader_reply_to_message_with_selection (EMailReader *reader,
 	const gchar *uid;
 	gint length;
 	gchar *mail_uri;
-	CamelObjectBag *registry;
 	CreateComposerData *ccd;
 	EMailPartValidityFlags validity_pgp_sum = 0;
 	EMailPartValidityFlags validity_smime_sum = 0;
@@ -2698,9 +2697,8 @@ e_mail_reader_reply_to_message_with_selection (EMailReader *reader,
 	if (!gtk_widget_get_visible (GTK_WIDGET (web_view)))
 		goto whole_message;
 
-	registry = e_mail_part_list_get_registry ();
 	mail_uri = e_mail_part_build_uri (folder, uid, NULL, NULL);
-	part_list = camel_object_bag_get (registry, mail_uri);
+	part_list = e_mail_part_list_registry_get (mail_uri);
 	g_free (mail_uri);
 
 	if (!part_list) {
@@ -2923,7 +2921,7 @@ e_mail_reader_reply_to_message (EMailReader *reader,
 
 		folder = e_mail_reader_ref_folder (reader);
 		mail_uri = e_mail_part_build_uri (folder, uid, NULL, NULL);
-		part_list = camel_object_bag_get (e_mail_part_list_get_registry (), mail_uri);
+		part_list = e_mail_part_list_registry_get (mail_uri);
 		g_clear_object (&folder);
 		g_free (mail_uri);
 
@@ -3388,7 +3386,7 @@ mail_reader_parse_message_run (GSimpleAsyncResult *simple,
 		async_context->folder,
 		async_context->message_uid, NULL, NULL);
 
-	part_list = camel_object_bag_reserve (registry, mail_uri);
+	part_list = e_mail_part_list_registry_reserve (mail_uri);
 
 	if (!part_list && is_source) {
 		EMailPart *mail_part;
@@ -3424,7 +3422,7 @@ mail_reader_parse_message_run (GSimpleAsyncResult *simple,
 		if (part_list == NULL)
 			camel_object_bag_abort (registry, mail_uri);
 		else
-			camel_object_bag_add (registry, mail_uri, part_list);
+			e_mail_part_list_registry_add (mail_uri, part_list);
 	}
 
 	g_free (mail_uri);
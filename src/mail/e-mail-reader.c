@@ -4029,6 +4029,10 @@ mail_reader_set_display_formatter_for_message (EMailReader *reader,
 	parts = camel_object_bag_peek (registry, mail_uri);
 	g_free (mail_uri);
 
+	/* Misses are counted when the message is being parsed */
+	if (parts)
+		e_mail_part_list_cache_hold (parts);
+
 	if (parts == NULL) {
 		if (!priv->retrieving_message)
 			priv->retrieving_message = camel_operation_new ();
@@ -89,6 +89,336 @@ save_gicon_to_stream (GIcon *icon,
 	g_object_unref (icon);
 }
 
+/* State shared by the input stream of a message being formatted in steps
+ * and its formatting thread, thus WebKit can show the first parts while
+ * the rest is being formatted. All the steps run in that thread, thus the
+ * formatter run and its context are never used from two threads. The
+ * thread does not reference the stream, thus the stream is finalized as
+ * soon as the reader drops it, even without closing it, which stops the
+ * formatting. */
+typedef struct _MailRequestPipeData {
+	volatile gint ref_count;
+
+	GMutex lock;
+	GCond cond;		/* signals changes of the below */
+	GQueue chunks;		/* GBytes *, formatted, not read yet */
+	gsize chunk_offset;	/* already read bytes of the head chunk */
+	gsize n_pending;	/* bytes in 'chunks' not read yet */
+	gboolean eof;
+	gboolean closed;	/* closed or no reader left */
+
+	/* Used in the formatting thread only */
+	EMailFormatterRun *run;
+	GCancellable *cancellable;
+	gsize n_written;
+	gint64 started;
+} MailRequestPipeData;
+
+typedef struct _MailRequestPipe {
+	GInputStream parent;
+
+	MailRequestPipeData *data;
+} MailRequestPipe;
+
+typedef struct _MailRequestPipeClass {
+	GInputStreamClass parent_class;
+} MailRequestPipeClass;
+
+/* Formatting pauses while this many bytes wait to be read */
+#define PIPE_MAX_PENDING (256 * 1024)
+
+/* How long one formatting step runs before its output is given to the reader */
+#define PIPE_STEP_BUDGET (20 * G_TIME_SPAN_MILLISECOND)
+
+GType mail_request_pipe_get_type (void) G_GNUC_CONST;
+
+G_DEFINE_TYPE (MailRequestPipe, mail_request_pipe, G_TYPE_INPUT_STREAM)
+
+static MailRequestPipeData *
+mail_request_pipe_data_ref (MailRequestPipeData *pdata)
+{
+	g_atomic_int_inc (&pdata->ref_count);
+
+	return pdata;
+}
+
+static void
+mail_request_pipe_data_unref (MailRequestPipeData *pdata)
+{
+	if (!g_atomic_int_dec_and_test (&pdata->ref_count))
+		return;
+
+	g_clear_pointer (&pdata->run, e_mail_formatter_run_free);
+	g_clear_object (&pdata->cancellable);
+
+	while (!g_queue_is_empty (&pdata->chunks))
+		g_bytes_unref (g_queue_pop_head (&pdata->chunks));
+
+	g_mutex_clear (&pdata->lock);
+	g_cond_clear (&pdata->cond);
+
+	g_slice_free (MailRequestPipeData, pdata);
+}
+
+/* Stops the formatting after its current step */
+static void
+mail_request_pipe_data_close (MailRequestPipeData *pdata)
+{
+	g_mutex_lock (&pdata->lock);
+	pdata->closed = TRUE;
+	g_cond_broadcast (&pdata->cond);
+	g_mutex_unlock (&pdata->lock);
+}
+
+/* Call with the lock held */
+static void
+mail_request_pipe_push_locked (MailRequestPipeData *pdata,
+			       GBytes *bytes)
+{
+	if (g_bytes_get_size (bytes) > 0) {
+		pdata->n_pending += g_bytes_get_size (bytes);
+		pdata->n_written += g_bytes_get_size (bytes);
+		g_queue_push_tail (&pdata->chunks, g_bytes_ref (bytes));
+	}
+}
+
+/* Formats the next parts; returns whether there is more to format */
+static gboolean
+mail_request_pipe_run_step (MailRequestPipeData *pdata)
+{
+	GOutputStream *output_stream;
+	GBytes *bytes;
+	gboolean again;
+
+	output_stream = g_memory_output_stream_new_resizable ();
+
+	again = e_mail_formatter_run_step (
+		pdata->run, output_stream,
+		PIPE_STEP_BUDGET, pdata->cancellable);
+
+	g_output_stream_close (output_stream, NULL, NULL);
+
+	bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (output_stream));
+	g_object_unref (output_stream);
+
+	g_mutex_lock (&pdata->lock);
+	mail_request_pipe_push_locked (pdata, bytes);
+	g_cond_broadcast (&pdata->cond);
+	g_mutex_unlock (&pdata->lock);
+
+	g_bytes_unref (bytes);
+
+	return again;
+}
+
+static gpointer
+mail_request_pipe_thread (gpointer user_data)
+{
+	MailRequestPipeData *pdata = user_data;
+	gboolean again = TRUE, first = TRUE;
+
+	while (again) {
+		gboolean closed;
+
+		g_mutex_lock (&pdata->lock);
+		while (pdata->n_pending >= PIPE_MAX_PENDING && !pdata->closed &&
+		       !g_cancellable_is_cancelled (pdata->cancellable)) {
+			g_cond_wait_until (&pdata->cond, &pdata->lock,
+				g_get_monotonic_time () + 100 * G_TIME_SPAN_MILLISECOND);
+		}
+		closed = pdata->closed;
+		g_mutex_unlock (&pdata->lock);
+
+		if (closed)
+			break;
+
+		again = mail_request_pipe_run_step (pdata);
+
+		if (first && camel_debug_start ("emformat:requests")) {
+			printf ("%s: first part of %p formatted in %.3f seconds\n", G_STRFUNC, pdata,
+				(g_get_monotonic_time () - pdata->started) / (gdouble) G_USEC_PER_SEC);
+			camel_debug_end ();
+		}
+
+		first = FALSE;
+	}
+
+	g_clear_pointer (&pdata->run, e_mail_formatter_run_free);
+
+	g_mutex_lock (&pdata->lock);
+
+	if (!pdata->n_written && !pdata->closed) {
+		GBytes *bytes;
+		gchar *data;
+
+		data = g_strdup_printf (
+			"<p align='center'>%s</p>",
+			_("The message has no text content."));
+
+		/* Takes ownership of the string. */
+		bytes = g_bytes_new_take (data, strlen (data) + 1);
+		mail_request_pipe_push_locked (pdata, bytes);
+		g_bytes_unref (bytes);
+	}
+
+	pdata->eof = TRUE;
+	g_cond_broadcast (&pdata->cond);
+	g_mutex_unlock (&pdata->lock);
+
+	if (camel_debug_start ("emformat:requests")) {
+		printf ("%s: formatted %p in %.3f seconds\n", G_STRFUNC, pdata,
+			(g_get_monotonic_time () - pdata->started) / (gdouble) G_USEC_PER_SEC);
+		camel_debug_end ();
+	}
+
+	mail_request_pipe_data_unref (pdata);
+
+	return NULL;
+}
+
+static gssize
+mail_request_pipe_read (GInputStream *stream,
+			gpointer buffer,
+			gsize count,
+			GCancellable *cancellable,
+			GError **error)
+{
+	MailRequestPipeData *pdata = ((MailRequestPipe *) stream)->data;
+	gsize n_read = 0;
+
+	g_mutex_lock (&pdata->lock);
+
+	/* Wait for the formatter; check for cancellation regularly */
+	while (g_queue_is_empty (&pdata->chunks) && !pdata->eof &&
+	       !g_cancellable_is_cancelled (cancellable)) {
+		g_cond_wait_until (&pdata->cond, &pdata->lock,
+			g_get_monotonic_time () + 100 * G_TIME_SPAN_MILLISECOND);
+	}
+
+	if (g_queue_is_empty (&pdata->chunks) && !pdata->eof) {
+		g_mutex_unlock (&pdata->lock);
+		g_cancellable_set_error_if_cancelled (cancellable, error);
+		return -1;
+	}
+
+	while (n_read < count && !g_queue_is_empty (&pdata->chunks)) {
+		GBytes *bytes = g_queue_peek_head (&pdata->chunks);
+		const gchar *data;
+		gsize size, n_copy;
+
+		data = g_bytes_get_data (bytes, &size);
+		n_copy = MIN (count - n_read, size - pdata->chunk_offset);
+
+		memcpy ((gchar *) buffer + n_read, data + pdata->chunk_offset, n_copy);
+
+		n_read += n_copy;
+		pdata->chunk_offset += n_copy;
+
+		if (pdata->chunk_offset == size) {
+			g_bytes_unref (g_queue_pop_head (&pdata->chunks));
+			pdata->chunk_offset = 0;
+		}
+	}
+
+	pdata->n_pending -= n_read;
+
+	/* Resume the formatting once half of the pending data is read */
+	if (pdata->n_pending < PIPE_MAX_PENDING / 2)
+		g_cond_broadcast (&pdata->cond);
+
+	g_mutex_unlock (&pdata->lock);
+
+	return n_read;
+}
+
+static gboolean
+mail_request_pipe_close (GInputStream *stream,
+			 GCancellable *cancellable,
+			 GError **error)
+{
+	MailRequestPipe *mpipe = (MailRequestPipe *) stream;
+
+	mail_request_pipe_data_close (mpipe->data);
+
+	return TRUE;
+}
+
+static void
+mail_request_pipe_finalize (GObject *object)
+{
+	MailRequestPipe *mpipe = (MailRequestPipe *) object;
+
+	/* No reader is left, even when the stream was not closed */
+	mail_request_pipe_data_close (mpipe->data);
+	mail_request_pipe_data_unref (mpipe->data);
+
+	/* Chain up to parent's finalize() method. */
+	G_OBJECT_CLASS (mail_request_pipe_parent_class)->finalize (object);
+}
+
+static void
+mail_request_pipe_class_init (MailRequestPipeClass *class)
+{
+	GObjectClass *object_class;
+	GInputStreamClass *input_stream_class;
+
+	object_class = G_OBJECT_CLASS (class);
+	object_class->finalize = mail_request_pipe_finalize;
+
+	input_stream_class = G_INPUT_STREAM_CLASS (class);
+	input_stream_class->read_fn = mail_request_pipe_read;
+	input_stream_class->close_fn = mail_request_pipe_close;
+}
+
+static void
+mail_request_pipe_init (MailRequestPipe *mpipe)
+{
+	mpipe->data = g_slice_new0 (MailRequestPipeData);
+	mpipe->data->ref_count = 1;
+
+	g_mutex_init (&mpipe->data->lock);
+	g_cond_init (&mpipe->data->cond);
+	g_queue_init (&mpipe->data->chunks);
+}
+
+/* Starts formatting the 'part_list' in a new thread. Returns NULL when
+ * the thread cannot be created; the caller formats the message itself
+ * then. */
+static GInputStream *
+mail_request_pipe_new (EMailFormatter *formatter,
+		       EMailPartList *part_list,
+		       EMailFormatterHeaderFlags flags,
+		       EMailFormatterMode mode,
+		       GCancellable *cancellable)
+{
+	MailRequestPipe *mpipe;
+	MailRequestPipeData *pdata;
+	GThread *thread;
+
+	mpipe = g_object_new (mail_request_pipe_get_type (), NULL);
+
+	pdata = mpipe->data;
+	pdata->run = e_mail_formatter_run_new (formatter, part_list, flags, mode);
+	pdata->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+	pdata->started = g_get_monotonic_time ();
+
+	thread = g_thread_try_new (
+		"mail-request-format", mail_request_pipe_thread,
+		mail_request_pipe_data_ref (pdata), NULL);
+
+	if (!thread) {
+		/* Drop the reference meant for the thread and the stream itself */
+		mail_request_pipe_data_unref (pdata);
+		g_object_unref (mpipe);
+
+		return NULL;
+	}
+
+	g_thread_unref (thread);
+
+	return G_INPUT_STREAM (mpipe);
+}
+
 static gboolean
 mail_request_process_mail_sync (EContentRequest *request,
 				SoupURI *suri,
@@ -104,6 +434,7 @@ mail_request_process_mail_sync (EContentRequest *request,
 	EMailPartList *part_list;
 	CamelObjectBag *registry;
 	GOutputStream *output_stream;
+	GInputStream *pipe_stream = NULL;
 	GBytes *bytes;
 	gchar *tmp, *use_mime_type = NULL;
 	const gchar *val;
@@ -266,14 +597,45 @@ mail_request_process_mail_sync (EContentRequest *request,
 		g_object_unref (part);
 
 	} else {
-		e_mail_formatter_format_sync (
-			formatter, part_list, output_stream,
+		/* Stream the message, thus the first screen can be shown
+		 * while the rest of a large message is being formatted. */
+		pipe_stream = mail_request_pipe_new (
+			formatter, part_list,
 			context.flags, context.mode, cancellable);
+
+		if (!pipe_stream) {
+			e_mail_formatter_format_sync (
+				formatter, part_list, output_stream,
+				context.flags, context.mode, cancellable);
+		}
 	}
 
  no_part:
 	g_clear_object (&context.part_list);
 
+	if (!use_mime_type)
+		use_mime_type = g_strdup ("text/html");
+
+	if (part_converted_to_utf8 && g_strcmp0 (use_mime_type, "text/html") == 0) {
+		tmp = g_strconcat (use_mime_type, "; charset=\"UTF-8\"", NULL);
+		g_free (use_mime_type);
+		use_mime_type = tmp;
+	}
+
+	if (pipe_stream) {
+		/* The pipe writes the "no text content" notice itself */
+		*out_stream = pipe_stream;
+		*out_stream_length = -1;
+		*out_mime_type = use_mime_type;
+
+		g_object_unref (output_stream);
+		g_object_unref (part_list);
+		g_object_unref (formatter);
+		g_free (context.uri);
+
+		return TRUE;
+	}
+
 	g_output_stream_close (output_stream, NULL, NULL);
 
 	bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (output_stream));
@@ -291,15 +653,6 @@ mail_request_process_mail_sync (EContentRequest *request,
 		bytes = g_bytes_new_take (data, strlen (data) + 1);
 	}
 
-	if (!use_mime_type)
-		use_mime_type = g_strdup ("text/html");
-
-	if (part_converted_to_utf8 && g_strcmp0 (use_mime_type, "text/html") == 0) {
-		tmp = g_strconcat (use_mime_type, "; charset=\"UTF-8\"", NULL);
-		g_free (use_mime_type);
-		use_mime_type = tmp;
-	}
-
 	*out_stream = g_memory_input_stream_new_from_bytes (bytes);
 	*out_stream_length = g_bytes_get_size (bytes);
 	*out_mime_type = use_mime_type;
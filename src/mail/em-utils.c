@@ -43,6 +43,7 @@
 #include <shell/e-shell.h>
 
 #include <em-format/e-mail-parser.h>
+#include <em-format/e-mail-part-utils.h>
 #include <em-format/e-mail-formatter-quote.h>
 
 #include "e-mail-printer.h"
@@ -482,6 +483,7 @@ em_utils_print_messages_to_file (CamelFolder *folder,
 	CamelStore *parent_store;
 	CamelSession *session;
 	gboolean success = FALSE;
+	gchar *mail_uri;
 
 	message = camel_folder_get_message_sync (folder, uid, NULL, NULL);
 	if (message == NULL)
@@ -492,11 +494,17 @@ em_utils_print_messages_to_file (CamelFolder *folder,
 
 	parser = e_mail_parser_new (session);
 
+	/* Reuse the message parsed for the preview, if any */
+	mail_uri = e_mail_part_build_uri (folder, uid, NULL, NULL);
+	parts_list = e_mail_part_list_registry_get (mail_uri);
+	g_free (mail_uri);
+
 	/* XXX em_utils_selection_set_urilist() is synchronous,
 	 *     so this function has to be synchronous as well.
 	 *     That means potentially blocking for awhile. */
-	parts_list = e_mail_parser_parse_sync (
-		parser, folder, uid, message, NULL);
+	if (parts_list == NULL)
+		parts_list = e_mail_parser_parse_sync (
+			parser, folder, uid, message, NULL);
 	if (parts_list != NULL) {
 		EMailBackend *mail_backend;
 		EAsyncClosure *closure;
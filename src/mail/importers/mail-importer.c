@@ -102,20 +102,44 @@ decode_mozilla_status (const gchar *tmp)
 	return flags;
 }
 
-static void
-import_mbox_add_message (CamelFolder *folder,
-			 CamelMimeMessage *msg,
-			 GCancellable *cancellable,
-			 GError **error)
+/* Number of messages handed to the parser threads at once. */
+#define IMPORT_MBOX_BATCH_SIZE 64
+
+/* How often the checkpoint is written and the throughput reported. */
+#define IMPORT_MBOX_CHECKPOINT_INTERVAL (5 * G_USEC_PER_SEC)
+#define IMPORT_MBOX_REPORT_INTERVAL (G_USEC_PER_SEC)
+
+typedef struct _ImportMboxJob {
+	GCancellable *cancellable;
+
+	/* The message text, without the "From " line */
+	const gchar *data;
+	gsize len;
+
+	/* Where the message after this one starts */
+	gsize next_offset;
+
+	/* Set by the parser thread */
+	CamelMimeMessage *message;
+	guint32 flags;
+} ImportMboxJob;
+
+typedef struct _ImportMboxBatch {
+	EUtilBatch *parser; /* parses the jobs */
+
+	ImportMboxJob jobs[IMPORT_MBOX_BATCH_SIZE];
+	guint n_jobs;
+} ImportMboxBatch;
+
+static GMutex import_mbox_checkpoint_lock;
+
+static guint32
+import_mbox_decode_flags (CamelMimeMessage *msg)
 {
-	CamelMessageInfo *info;
 	CamelMedium *medium;
 	guint32 flags = 0;
 	const gchar *tmp;
 
-	g_return_if_fail (CAMEL_IS_FOLDER (folder));
-	g_return_if_fail (CAMEL_IS_MIME_MESSAGE (msg));
-
 	medium = CAMEL_MEDIUM (msg);
 
 	tmp = camel_medium_get_header (medium, "X-Mozilla-Status");
@@ -128,6 +152,18 @@ import_mbox_add_message (CamelFolder *folder,
 	if (tmp)
 		flags |= decode_status (tmp);
 
+	return flags;
+}
+
+static void
+import_mbox_append_message (CamelFolder *folder,
+			    CamelMimeMessage *msg,
+			    guint32 flags,
+			    GCancellable *cancellable,
+			    GError **error)
+{
+	CamelMessageInfo *info;
+
 	info = camel_message_info_new (NULL);
 
 	camel_message_info_set_flags (info, flags, ~0);
@@ -137,15 +173,493 @@ import_mbox_add_message (CamelFolder *folder,
 	g_clear_object (&info);
 }
 
+static void
+import_mbox_add_message (CamelFolder *folder,
+			 CamelMimeMessage *msg,
+			 GCancellable *cancellable,
+			 GError **error)
+{
+	g_return_if_fail (CAMEL_IS_FOLDER (folder));
+	g_return_if_fail (CAMEL_IS_MIME_MESSAGE (msg));
+
+	import_mbox_append_message (
+		folder, msg, import_mbox_decode_flags (msg),
+		cancellable, error);
+}
+
+static gchar *
+import_mbox_checkpoint_filename (void)
+{
+	return g_build_filename (
+		e_get_user_cache_dir (), "mail-import-checkpoints.ini", NULL);
+}
+
+/* Group of the 'path' in the checkpoint file; the path itself can contain
+ * characters not allowed in a group name, like the brackets of "[Gmail]" */
+static gchar *
+import_mbox_checkpoint_group (const gchar *path)
+{
+	gchar *checksum, *group;
+
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, path, -1);
+	group = g_strconcat ("Import ", checksum, NULL);
+	g_free (checksum);
+
+	return group;
+}
+
+/* Returns the offset a previous, interrupted import of the same file
+ * into the same folder got to, or 0 to start from the beginning. The
+ * 'out_n_messages' is set to how many messages were imported by then. */
+static gsize
+import_mbox_checkpoint_load (const gchar *path,
+			     const gchar *uri,
+			     const struct stat *st,
+			     guint *out_n_messages)
+{
+	GKeyFile *key_file;
+	gchar *filename, *group, *stored_path, *folder_uri;
+	gsize offset = 0;
+
+	*out_n_messages = 0;
+
+	filename = import_mbox_checkpoint_filename ();
+	group = import_mbox_checkpoint_group (path);
+	key_file = g_key_file_new ();
+
+	g_mutex_lock (&import_mbox_checkpoint_lock);
+
+	if (g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE, NULL) &&
+	    g_key_file_get_int64 (key_file, group, "Size", NULL) == (gint64) st->st_size &&
+	    g_key_file_get_int64 (key_file, group, "Modified", NULL) == (gint64) st->st_mtime) {
+		gint64 value;
+
+		stored_path = g_key_file_get_string (key_file, group, "Path", NULL);
+		folder_uri = g_key_file_get_string (key_file, group, "Folder", NULL);
+		value = g_key_file_get_int64 (key_file, group, "Offset", NULL);
+
+		if (g_strcmp0 (stored_path, path) == 0 &&
+		    g_strcmp0 (folder_uri, uri ? uri : "") == 0 &&
+		    value > 0 && value <= (gint64) st->st_size) {
+			offset = (gsize) value;
+			*out_n_messages = g_key_file_get_integer (key_file, group, "Messages", NULL);
+		}
+
+		g_free (stored_path);
+		g_free (folder_uri);
+	}
+
+	g_mutex_unlock (&import_mbox_checkpoint_lock);
+
+	g_key_file_free (key_file);
+	g_free (group);
+	g_free (filename);
+
+	return offset;
+}
+
+/* Remembers how far the import of the file got and how many messages
+ * were imported by then; an offset of 0 forgets the checkpoint, once
+ * the import is complete. */
+static void
+import_mbox_checkpoint_save (const gchar *path,
+			     const gchar *uri,
+			     const struct stat *st,
+			     gsize offset,
+			     guint n_messages)
+{
+	GKeyFile *key_file;
+	gchar *filename, *group;
+	gboolean changed = TRUE;
+	GError *local_error = NULL;
+
+	filename = import_mbox_checkpoint_filename ();
+	group = import_mbox_checkpoint_group (path);
+	key_file = g_key_file_new ();
+
+	g_mutex_lock (&import_mbox_checkpoint_lock);
+
+	g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE, NULL);
+
+	if (offset > 0) {
+		g_key_file_set_string (key_file, group, "Path", path);
+		g_key_file_set_int64 (key_file, group, "Size", st->st_size);
+		g_key_file_set_int64 (key_file, group, "Modified", st->st_mtime);
+		g_key_file_set_string (key_file, group, "Folder", uri ? uri : "");
+		g_key_file_set_int64 (key_file, group, "Offset", offset);
+		g_key_file_set_integer (key_file, group, "Messages", n_messages);
+	} else {
+		changed = g_key_file_remove_group (key_file, group, NULL);
+	}
+
+	if (changed && !g_key_file_save_to_file (key_file, filename, &local_error)) {
+		g_warning (
+			"%s: Failed to save '%s': %s", G_STRFUNC,
+			filename, local_error ? local_error->message : "Unknown error");
+		g_clear_error (&local_error);
+	}
+
+	g_mutex_unlock (&import_mbox_checkpoint_lock);
+
+	g_key_file_free (key_file);
+	g_free (group);
+	g_free (filename);
+}
+
+/* Returns the offset of the first "From " line at or after 'offset',
+ * which should be at the start of a line, or 'len' if there is none. */
+static gsize
+import_mbox_find_from (const gchar *data,
+		       gsize len,
+		       gsize offset)
+{
+	while (offset + 5 <= len) {
+		const gchar *nl;
+
+		if (memcmp (data + offset, "From ", 5) == 0)
+			return offset;
+
+		nl = memchr (data + offset, '\n', len - offset);
+		if (!nl)
+			break;
+
+		offset = nl - data + 1;
+	}
+
+	return len;
+}
+
+static void
+import_mbox_parse_job_cb (gpointer data,
+			  gpointer user_data)
+{
+	ImportMboxJob *job = data;
+
+	if (!g_cancellable_is_cancelled (job->cancellable)) {
+		CamelStream *stream;
+		CamelMimeMessage *msg;
+
+		stream = camel_stream_mem_new_with_buffer (job->data, job->len);
+		msg = camel_mime_message_new ();
+
+		if (camel_data_wrapper_construct_from_stream_sync (
+			CAMEL_DATA_WRAPPER (msg), stream, NULL, NULL)) {
+			job->flags = import_mbox_decode_flags (msg);
+			job->message = msg;
+		} else {
+			g_object_unref (msg);
+		}
+
+		g_object_unref (stream);
+	}
+}
+
+/* Splits up to IMPORT_MBOX_BATCH_SIZE messages starting at 'offset' off
+ * the mapped file and queues them for parsing. Returns the offset of the
+ * first message not included in the batch. */
+static gsize
+import_mbox_batch_fill (ImportMboxBatch *batch,
+			const gchar *data,
+			gsize len,
+			gsize offset,
+			GCancellable *cancellable)
+{
+	guint ii;
+
+	batch->n_jobs = 0;
+
+	while (offset < len && batch->n_jobs < IMPORT_MBOX_BATCH_SIZE) {
+		ImportMboxJob *job = &batch->jobs[batch->n_jobs++];
+		const gchar *nl;
+		gsize start, end;
+
+		/* Skip the "From " line itself. */
+		nl = memchr (data + offset, '\n', len - offset);
+		start = nl ? nl - data + 1 : len;
+
+		job->next_offset = import_mbox_find_from (data, len, start);
+
+		/* The empty line before the next "From " line is
+		 * a separator, not part of this message. */
+		end = job->next_offset;
+		if (end < len && end > start && data[end - 1] == '\n')
+			end--;
+
+		job->cancellable = cancellable;
+		job->data = data + start;
+		job->len = end - start;
+		job->message = NULL;
+		job->flags = 0;
+
+		offset = job->next_offset;
+	}
+
+	for (ii = 0; ii < batch->n_jobs; ii++)
+		e_util_batch_push (batch->parser, &batch->jobs[ii]);
+
+	return offset;
+}
+
+static void
+import_mbox_batch_wait (ImportMboxBatch *batch)
+{
+	e_util_batch_wait (batch->parser);
+}
+
+static void
+import_mbox_batch_clear (ImportMboxBatch *batch)
+{
+	guint ii;
+
+	for (ii = 0; ii < batch->n_jobs; ii++)
+		g_clear_object (&batch->jobs[ii].message);
+
+	batch->n_jobs = 0;
+}
+
+static void
+import_mbox_report (GCancellable *cancellable,
+		    CamelFolder *folder,
+		    gsize n_bytes,
+		    guint n_messages,
+		    gint64 elapsed)
+{
+	gdouble seconds = (gdouble) elapsed / G_USEC_PER_SEC;
+
+	if (seconds <= 0.0)
+		return;
+
+	camel_operation_pop_message (cancellable);
+	camel_operation_push_message (
+		cancellable,
+		/* Translators: The first '%s' is a folder name, then follow
+		 * the import speed in megabytes and in messages per second */
+		_("Importing “%s” (%.1f MB/s, %.0f messages/s)"),
+		camel_folder_get_display_name (folder),
+		n_bytes / seconds / (1024.0 * 1024.0),
+		n_messages / seconds);
+}
+
+/* Imports the messages of a memory-mapped mbox file. The file is split
+ * into messages here, while the messages themselves are parsed by a pool
+ * of threads, one batch ahead of the messages being added to the folder.
+ * Returns whether any message was found in the file. */
+static gboolean
+import_mbox_pipeline (struct _import_mbox_msg *m,
+		      CamelFolder *folder,
+		      GMappedFile *mapped,
+		      const struct stat *st,
+		      GCancellable *cancellable,
+		      GError **error)
+{
+	ImportMboxBatch batches[2], *current, *next;
+	const gchar *data;
+	gsize len, offset, start_offset, done_offset;
+	gint64 started, last_report, last_checkpoint;
+	guint n_imported = 0, n_earlier = 0, ii;
+	gboolean stop = FALSE, any_read;
+
+	data = g_mapped_file_get_contents (mapped);
+	len = g_mapped_file_get_length (mapped);
+
+	done_offset = import_mbox_checkpoint_load (m->path, m->uri, st, &n_earlier);
+
+	/* Resume only when the messages imported earlier are still there;
+	 * the folder could be deleted and created again, or emptied. */
+	if (done_offset > 0 && (!n_earlier ||
+	    camel_folder_get_message_count (folder) < (gint) n_earlier)) {
+		done_offset = 0;
+		n_earlier = 0;
+	}
+
+	any_read = done_offset > 0;
+
+	if (done_offset > 0) {
+		camel_operation_pop_message (cancellable);
+		camel_operation_push_message (
+			cancellable,
+			/* Translators: The '%s' is a folder name, the '%u' is
+			 * a count of messages imported by an interrupted import */
+			ngettext (
+				"Resuming import into “%s” after %u message imported earlier",
+				"Resuming import into “%s” after %u messages imported earlier",
+				n_earlier),
+			camel_folder_get_display_name (folder), n_earlier);
+	}
+
+	start_offset = import_mbox_find_from (data, len, done_offset);
+	if (start_offset >= len)
+		return any_read;
+
+	any_read = TRUE;
+
+	for (ii = 0; ii < G_N_ELEMENTS (batches); ii++) {
+		batches[ii].parser = e_util_batch_new (import_mbox_parse_job_cb, NULL);
+		batches[ii].n_jobs = 0;
+	}
+
+	current = &batches[0];
+	next = &batches[1];
+
+	started = g_get_monotonic_time ();
+	last_report = started;
+	last_checkpoint = started;
+
+	offset = import_mbox_batch_fill (
+		current, data, len, start_offset, cancellable);
+
+	while (current->n_jobs > 0) {
+		ImportMboxBatch *tmp;
+		gint64 now;
+
+		/* Let the next batch get parsed while this one is added. */
+		if (offset < len && !stop)
+			offset = import_mbox_batch_fill (
+				next, data, len, offset, cancellable);
+
+		import_mbox_batch_wait (current);
+
+		for (ii = 0; ii < current->n_jobs && !stop; ii++) {
+			ImportMboxJob *job = &current->jobs[ii];
+
+			if (g_cancellable_is_cancelled (cancellable) || !job->message) {
+				/* set exception? */
+				stop = TRUE;
+				break;
+			}
+
+			import_mbox_append_message (
+				folder, job->message, job->flags,
+				cancellable, error);
+
+			if (error && *error != NULL) {
+				stop = TRUE;
+				break;
+			}
+
+			done_offset = job->next_offset;
+			n_imported++;
+		}
+
+		import_mbox_batch_clear (current);
+
+		now = g_get_monotonic_time ();
+
+		if (st->st_size > 0)
+			camel_operation_progress (
+				cancellable, (gint) (100.0 *
+				((gdouble) done_offset / (gdouble) st->st_size)));
+
+		if (now - last_report >= IMPORT_MBOX_REPORT_INTERVAL) {
+			import_mbox_report (
+				cancellable, folder,
+				done_offset - start_offset,
+				n_imported, now - started);
+			last_report = now;
+		}
+
+		if (!stop && done_offset < len &&
+		    now - last_checkpoint >= IMPORT_MBOX_CHECKPOINT_INTERVAL) {
+			import_mbox_checkpoint_save (m->path, m->uri, st, done_offset, n_earlier + n_imported);
+			last_checkpoint = now;
+		}
+
+		if (stop) {
+			import_mbox_batch_wait (next);
+			import_mbox_batch_clear (next);
+			break;
+		}
+
+		tmp = current;
+		current = next;
+		next = tmp;
+	}
+
+	for (ii = 0; ii < G_N_ELEMENTS (batches); ii++)
+		e_util_batch_free (batches[ii].parser);
+
+	/* Resume from the first message not added, next time. */
+	import_mbox_checkpoint_save (
+		m->path, m->uri, st, done_offset < len ? done_offset : 0,
+		n_earlier + n_imported);
+
+	return any_read;
+}
+
+/* Fallback for files which cannot be mapped into memory. */
+static gboolean
+import_mbox_sequential (struct _import_mbox_msg *m,
+			CamelFolder *folder,
+			const struct stat *st,
+			GCancellable *cancellable,
+			GError **error)
+{
+	CamelMimeParser *mp;
+	gboolean any_read = FALSE;
+	gint fd;
+
+	fd = g_open (m->path, O_RDONLY | O_BINARY, 0);
+	if (fd == -1) {
+		g_warning (
+			"cannot find source file to import '%s': %s",
+			m->path, g_strerror (errno));
+		return FALSE;
+	}
+
+	mp = camel_mime_parser_new ();
+	camel_mime_parser_scan_from (mp, TRUE);
+	if (camel_mime_parser_init_with_fd (mp, fd) == -1) {
+		/* will never happen - 0 is unconditionally returned */
+		g_object_unref (mp);
+		return FALSE;
+	}
+
+	while (camel_mime_parser_step (mp, NULL, NULL) == CAMEL_MIME_PARSER_STATE_FROM &&
+	       !g_cancellable_is_cancelled (cancellable)) {
+
+		CamelMimeMessage *msg;
+		gint pc = 0;
+
+		any_read = TRUE;
+
+		if (st->st_size > 0)
+			pc = (gint) (100.0 * ((gdouble)
+				camel_mime_parser_tell (mp) /
+				(gdouble) st->st_size));
+		camel_operation_progress (cancellable, pc);
+
+		msg = camel_mime_message_new ();
+		if (!camel_mime_part_construct_from_parser_sync (
+			(CamelMimePart *) msg, mp, NULL, NULL)) {
+			/* set exception? */
+			g_object_unref (msg);
+			break;
+		}
+
+		import_mbox_add_message (folder, msg, cancellable, error);
+
+		g_object_unref (msg);
+
+		if (error && *error != NULL)
+			break;
+
+		camel_mime_parser_step (mp, NULL, NULL);
+	}
+
+	/* 'fd' is freed together with 'mp' */
+	/* coverity[leaked_handle] */
+	g_object_unref (mp);
+
+	return any_read;
+}
+
 static void
 import_mbox_exec (struct _import_mbox_msg *m,
                   GCancellable *cancellable,
                   GError **error)
 {
 	CamelFolder *folder;
-	CamelMimeParser *mp = NULL;
 	struct stat st;
-	gint fd;
 
 	if (g_stat (m->path, &st) == -1) {
 		g_warning (
@@ -169,57 +683,22 @@ import_mbox_exec (struct _import_mbox_msg *m,
 		return;
 
 	if (S_ISREG (st.st_mode)) {
-		gboolean any_read = FALSE;
-
-		fd = g_open (m->path, O_RDONLY | O_BINARY, 0);
-		if (fd == -1) {
-			g_warning (
-				"cannot find source file to import '%s': %s",
-				m->path, g_strerror (errno));
-			goto fail1;
-		}
-
-		mp = camel_mime_parser_new ();
-		camel_mime_parser_scan_from (mp, TRUE);
-		if (camel_mime_parser_init_with_fd (mp, fd) == -1) {
-			/* will never happen - 0 is unconditionally returned */
-			goto fail2;
-		}
+		GMappedFile *mapped;
+		gboolean any_read;
 
 		camel_operation_push_message (
 			cancellable, _("Importing “%s”"),
 			camel_folder_get_display_name (folder));
 		camel_folder_freeze (folder);
-		while (camel_mime_parser_step (mp, NULL, NULL) == CAMEL_MIME_PARSER_STATE_FROM &&
-		       !g_cancellable_is_cancelled (cancellable)) {
-
-			CamelMimeMessage *msg;
-			gint pc = 0;
-
-			any_read = TRUE;
 
-			if (st.st_size > 0)
-				pc = (gint) (100.0 * ((gdouble)
-					camel_mime_parser_tell (mp) /
-					(gdouble) st.st_size));
-			camel_operation_progress (cancellable, pc);
-
-			msg = camel_mime_message_new ();
-			if (!camel_mime_part_construct_from_parser_sync (
-				(CamelMimePart *) msg, mp, NULL, NULL)) {
-				/* set exception? */
-				g_object_unref (msg);
-				break;
-			}
-
-			import_mbox_add_message (folder, msg, cancellable, error);
-
-			g_object_unref (msg);
-
-			if (error && *error != NULL)
-				break;
-
-			camel_mime_parser_step (mp, NULL, NULL);
+		mapped = g_mapped_file_new (m->path, FALSE, NULL);
+		if (mapped) {
+			any_read = import_mbox_pipeline (
+				m, folder, mapped, &st, cancellable, error);
+			g_mapped_file_unref (mapped);
+		} else {
+			any_read = import_mbox_sequential (
+				m, folder, &st, cancellable, error);
 		}
 
 		if (!any_read && !g_cancellable_is_cancelled (cancellable)) {
@@ -242,15 +721,11 @@ import_mbox_exec (struct _import_mbox_msg *m,
 		camel_folder_synchronize_sync (folder, FALSE, NULL, NULL);
 		camel_folder_thaw (folder);
 		camel_operation_pop_message (cancellable);
-	fail2:
-		g_object_unref (mp);
 	}
-fail1:
+
 	/* Not passing a GCancellable or GError here. */
 	camel_folder_synchronize_sync (folder, FALSE, NULL, NULL);
 	g_object_unref (folder);
-	/* 'fd' is freed together with 'mp' */
-	/* coverity[leaked_handle] */
 }
 
 static void
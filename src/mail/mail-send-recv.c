@@ -1426,6 +1426,15 @@ struct _refresh_folders_msg {
 	CamelFolderInfo *finfo;
 };
 
+typedef struct _RefreshFolderData {
+	struct _refresh_folders_msg *m;
+	EMailBackend *mail_backend;
+	gboolean expunge;
+
+	GMutex lock;
+	GHashTable *known_errors;
+} RefreshFolderData;
+
 static gchar *
 refresh_folders_desc (struct _refresh_folders_msg *m)
 {
@@ -1434,17 +1443,80 @@ refresh_folders_desc (struct _refresh_folders_msg *m)
 		camel_service_get_display_name (CAMEL_SERVICE (m->store)));
 }
 
+static gboolean
+refresh_folder_cb (gpointer item,
+                   gpointer user_data,
+                   GCancellable *cancellable)
+{
+	RefreshFolderData *rfd = user_data;
+	struct _refresh_folders_msg *m = rfd->m;
+	const gchar *folder_uri = item;
+	CamelFolder *folder;
+	gboolean can_continue = TRUE;
+	GError *local_error = NULL;
+
+	folder = e_mail_session_uri_to_folder_sync (
+		E_MAIL_SESSION (m->info->session),
+		folder_uri, 0,
+		cancellable, &local_error);
+	if (folder && camel_folder_synchronize_sync (folder, rfd->expunge, cancellable, &local_error))
+		camel_folder_refresh_info_sync (folder, cancellable, &local_error);
+
+	if (folder && !local_error && rfd->mail_backend) {
+		em_utils_process_autoarchive_sync (rfd->mail_backend, folder, folder_uri, cancellable, &local_error);
+	}
+
+	if (local_error != NULL) {
+		const gchar *error_message = local_error->message ? local_error->message : _("Unknown error");
+
+		g_mutex_lock (&rfd->lock);
+
+		if (g_hash_table_contains (rfd->known_errors, error_message)) {
+			/* Received the same error message multiple times; there can be some
+			   connection issue probably, thus skip the rest folder updates for now */
+			can_continue = FALSE;
+		} else if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			CamelStore *store;
+			const gchar *full_name;
+
+			if (folder) {
+				store = camel_folder_get_parent_store (folder);
+				full_name = camel_folder_get_full_name (folder);
+			} else {
+				store = m->store;
+				full_name = folder_uri;
+			}
+
+			report_error_to_ui (CAMEL_SERVICE (store), full_name, local_error, NULL);
+
+			/* To not report one error for multiple folders multiple times */
+			g_hash_table_insert (rfd->known_errors, g_strdup (error_message), GINT_TO_POINTER (1));
+		}
+
+		g_mutex_unlock (&rfd->lock);
+
+		g_clear_error (&local_error);
+	}
+
+	if (folder)
+		g_object_unref (folder);
+
+	if (g_cancellable_is_cancelled (m->info->cancellable) ||
+	    g_cancellable_is_cancelled (cancellable) ||
+	    m->info->state == SEND_CANCELLED)
+		can_continue = FALSE;
+
+	return can_continue;
+}
+
 static void
 refresh_folders_exec (struct _refresh_folders_msg *m,
                       GCancellable *cancellable,
                       GError **error)
 {
-	CamelFolder *folder;
-	gint i;
+	RefreshFolderData rfd;
 	gboolean success;
 	gboolean delete_junk = FALSE, expunge = FALSE;
-	GHashTable *known_errors;
-	EMailBackend *mail_backend;
 	GError *local_error = NULL;
 	gulong handler_id = 0;
 
@@ -1473,66 +1545,23 @@ refresh_folders_exec (struct _refresh_folders_msg *m,
 		goto exit;
 	}
 
-	mail_backend = E_MAIL_BACKEND (e_shell_get_backend_by_name (e_shell_get_default (), "mail"));
-
-	known_errors = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-
-	for (i = 0; i < m->folders->len; i++) {
-		folder = e_mail_session_uri_to_folder_sync (
-			E_MAIL_SESSION (m->info->session),
-			m->folders->pdata[i], 0,
-			cancellable, &local_error);
-		if (folder && camel_folder_synchronize_sync (folder, expunge, cancellable, &local_error))
-			camel_folder_refresh_info_sync (folder, cancellable, &local_error);
-
-		if (folder && !local_error && mail_backend) {
-			em_utils_process_autoarchive_sync (mail_backend, folder, m->folders->pdata[i], cancellable, &local_error);
-		}
-
-		if (local_error != NULL) {
-			const gchar *error_message = local_error->message ? local_error->message : _("Unknown error");
-
-			if (g_hash_table_contains (known_errors, error_message)) {
-				/* Received the same error message multiple times; there can be some
-				   connection issue probably, thus skip the rest folder updates for now */
-				g_clear_object (&folder);
-				g_clear_error (&local_error);
-				break;
-			} else if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
-				CamelStore *store;
-				const gchar *full_name;
-
-				if (folder) {
-					store = camel_folder_get_parent_store (folder);
-					full_name = camel_folder_get_full_name (folder);
-				} else {
-					store = m->store;
-					full_name = (const gchar *) m->folders->pdata[i];
-				}
+	rfd.m = m;
+	rfd.mail_backend = E_MAIL_BACKEND (e_shell_get_backend_by_name (e_shell_get_default (), "mail"));
+	rfd.expunge = expunge;
+	rfd.known_errors = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	g_mutex_init (&rfd.lock);
 
-				report_error_to_ui (CAMEL_SERVICE (store), full_name, local_error, NULL);
-
-				/* To not report one error for multiple folders multiple times */
-				g_hash_table_insert (known_errors, g_strdup (error_message), GINT_TO_POINTER (1));
-			}
-
-			g_clear_error (&local_error);
-		}
-
-		if (folder)
-			g_object_unref (folder);
-
-		if (g_cancellable_is_cancelled (m->info->cancellable) ||
-		    g_cancellable_is_cancelled (cancellable))
-			break;
-
-		if (m->info->state != SEND_CANCELLED)
-			camel_operation_progress (
-				m->info->cancellable, 100 * i / m->folders->len);
-	}
+	/* With more connections allowed, refresh that many folders at once */
+	mail_folders_foreach_sync (
+		m->folders,
+		mail_store_get_folder_concurrency (m->store),
+		refresh_folder_cb, &rfd,
+		m->info->cancellable, cancellable);
 
 	camel_operation_pop_message (m->info->cancellable);
-	g_hash_table_destroy (known_errors);
+
+	g_mutex_clear (&rfd.lock);
+	g_hash_table_destroy (rfd.known_errors);
 
 exit:
 	if (handler_id > 0)
@@ -73,6 +73,7 @@
 
 typedef struct _ExtendedGNode ExtendedGNode;
 typedef struct _RegenData RegenData;
+typedef struct _MLSortKeys MLSortKeys;
 
 struct _MLSelection {
 	GPtrArray *uids;
@@ -110,6 +111,15 @@ struct _MessageListPrivate {
 	gboolean show_subject_above_sender;
 	gboolean regen_selects_unread;
 
+	/* Options the currently shown content had been built with.
+	 * Folder changes can be applied on top of the content only
+	 * when none of these changed since the last full regen. */
+	gboolean regen_built_valid;
+	gboolean regen_built_group_by_threads;
+	gboolean regen_built_thread_subject;
+	gboolean regen_built_hide_deleted;
+	gboolean regen_built_hide_junk;
+
 	GtkTargetList *copy_target_list;
 	GtkTargetList *paste_target_list;
 
@@ -130,6 +140,9 @@ struct _MessageListPrivate {
 	gchar **re_separators;
 	GMutex re_prefixes_lock;
 
+	/* Normalised strings of the shown messages, for sorting */
+	MLSortKeys *sort_keys;
+
 	GdkRGBA *new_mail_bg_color;
 	gchar *new_mail_fg_color;
 
@@ -157,6 +170,8 @@ struct _RegenData {
 	gboolean group_by_threads;
 	gboolean thread_subject;
 	gboolean select_unread;
+	gboolean hide_deleted;
+	gboolean hide_junk;
 
 	CamelFolderThread *thread_tree;
 
@@ -165,6 +180,23 @@ struct _RegenData {
 	gboolean folder_changed;
 	GHashTable *removed_uids; /* gchar *~>NULL */
 
+	/* Accumulated folder changes; NULL when a full regen is needed. */
+	CamelFolderChangeInfo *changes;
+	/* Set when only the 'changes' are applied on top of the shown
+	 * content, instead of searching and threading the whole folder. */
+	gboolean incremental;
+	GPtrArray *shown_infos; /* CamelMessageInfo *, shown before the regen */
+	GHashTable *drop_uids; /* gchar *~>NULL, shown UIDs to be removed */
+	GHashTable *shown_roots; /* const gchar *uid ~> const gchar *uid of its top-level thread message */
+	GHashTable *rethread_roots; /* gchar *~>NULL, top-level UIDs of the threads replaced by the 'thread_tree'; NULL when it replaces all */
+
+	/* Sort keys of the NORMALISED_... columns the view sorts by
+	 * (a bit-mask of 1 << NORMALISED_...), computed in the thread. */
+	guint sort_key_columns;
+	MLSortKeys *sort_keys;
+	gchar **re_prefixes;
+	gchar **re_separators;
+
 	CamelFolder *folder;
 	GPtrArray *summary;
 
@@ -277,6 +309,251 @@ enum {
 	NORMALISED_LAST
 };
 
+#define ML_SORT_KEYS_BLOCK_SIZE 1024
+
+/* Size of the string chunks of the list's keys; the keys of an incremental
+ * regen use small chunks, because they are copied into the list's keys. */
+#define ML_SORT_KEYS_CHUNK_SIZE 65536
+#define ML_SORT_KEYS_SMALL_CHUNK_SIZE 4096
+
+/* Normalised sort strings of the messages, kept in arenas which are
+ * released all at once.  A NULL string means it was not computed yet. */
+typedef struct _MLSortKey {
+	const gchar *strings[NORMALISED_LAST];
+} MLSortKey;
+
+struct _MLSortKeys {
+	GHashTable *keys;	/* const gchar *uid ~> MLSortKey * */
+	GSList *chunks;		/* GStringChunk * */
+	GSList *blocks;		/* MLSortKey[ML_SORT_KEYS_BLOCK_SIZE] */
+	guint block_used;
+	guint n_used;		/* used MLSortKey-s, including removed */
+};
+
+static MLSortKeys *
+ml_sort_keys_new (gsize chunk_size)
+{
+	MLSortKeys *sort_keys;
+
+	sort_keys = g_slice_new0 (MLSortKeys);
+	sort_keys->keys = g_hash_table_new (g_str_hash, g_str_equal);
+	sort_keys->chunks = g_slist_prepend (NULL, g_string_chunk_new (chunk_size));
+	sort_keys->block_used = ML_SORT_KEYS_BLOCK_SIZE;
+
+	return sort_keys;
+}
+
+static void
+ml_sort_keys_free (MLSortKeys *sort_keys)
+{
+	if (!sort_keys)
+		return;
+
+	g_hash_table_destroy (sort_keys->keys);
+	g_slist_free_full (sort_keys->chunks, (GDestroyNotify) g_string_chunk_free);
+	g_slist_free_full (sort_keys->blocks, g_free);
+	g_slice_free (MLSortKeys, sort_keys);
+}
+
+static MLSortKey *
+ml_sort_keys_add (MLSortKeys *sort_keys,
+                  const gchar *uid)
+{
+	MLSortKey *key;
+
+	key = g_hash_table_lookup (sort_keys->keys, uid);
+	if (key)
+		return key;
+
+	if (sort_keys->block_used == ML_SORT_KEYS_BLOCK_SIZE) {
+		sort_keys->blocks = g_slist_prepend (sort_keys->blocks, g_new (MLSortKey, ML_SORT_KEYS_BLOCK_SIZE));
+		sort_keys->block_used = 0;
+	}
+
+	key = ((MLSortKey *) sort_keys->blocks->data) + sort_keys->block_used;
+	sort_keys->block_used++;
+	sort_keys->n_used++;
+
+	memset (key, 0, sizeof (MLSortKey));
+
+	uid = g_string_chunk_insert (sort_keys->chunks->data, uid);
+	g_hash_table_insert (sort_keys->keys, (gpointer) uid, key);
+
+	return key;
+}
+
+/* Copies the key of the 'uid' with its strings into the 'dest' arenas. */
+static void
+ml_sort_keys_copy_key (MLSortKeys *dest,
+                       const gchar *uid,
+                       const MLSortKey *src_key)
+{
+	GStringChunk *chunk = dest->chunks->data;
+	MLSortKey *key;
+	gint ii;
+
+	/* A replaced key counts as removed, thus also its
+	 * strings are reclaimed by the compaction. */
+	g_hash_table_remove (dest->keys, uid);
+	key = ml_sort_keys_add (dest, uid);
+
+	for (ii = 0; ii < NORMALISED_LAST; ii++) {
+		const gchar *string = src_key->strings[ii];
+
+		if (!string || !*string)
+			key->strings[ii] = string;
+		else if (ii == NORMALISED_SUBJECT)
+			key->strings[ii] = g_string_chunk_insert (chunk, string);
+		else
+			key->strings[ii] = g_string_chunk_insert_const (chunk, string);
+	}
+}
+
+/* Copies the keys still in use into new arenas once the removed keys
+ * take more than the used ones, thus the memory does not grow with
+ * each folder change during a long session. */
+static void
+ml_sort_keys_maybe_compact (MLSortKeys *sort_keys)
+{
+	MLSortKeys *copy, tmp;
+	GHashTableIter iter;
+	gpointer key, value;
+	guint n_live, n_dead;
+
+	n_live = g_hash_table_size (sort_keys->keys);
+	n_dead = sort_keys->n_used - n_live;
+
+	if (n_dead <= n_live || n_dead < ML_SORT_KEYS_BLOCK_SIZE)
+		return;
+
+	copy = ml_sort_keys_new (ML_SORT_KEYS_CHUNK_SIZE);
+
+	g_hash_table_iter_init (&iter, sort_keys->keys);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		ml_sort_keys_copy_key (copy, key, value);
+	}
+
+	/* Swap the content, thus the 'sort_keys' pointer stays valid. */
+	tmp = *sort_keys;
+	*sort_keys = *copy;
+	*copy = tmp;
+
+	ml_sort_keys_free (copy);
+}
+
+static void
+ml_sort_keys_remove (MLSortKeys *sort_keys,
+                     const gchar *uid)
+{
+	/* The memory is reclaimed by the compaction or with the whole arena. */
+	if (g_hash_table_remove (sort_keys->keys, uid))
+		ml_sort_keys_maybe_compact (sort_keys);
+}
+
+/* Copies all keys from 'src' into the arenas of 'dest'; the keys
+ * from 'src' win.  Frees 'src'. */
+static void
+ml_sort_keys_merge (MLSortKeys *dest,
+                    MLSortKeys *src)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_hash_table_iter_init (&iter, src->keys);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		ml_sort_keys_copy_key (dest, key, value);
+	}
+
+	ml_sort_keys_free (src);
+
+	ml_sort_keys_maybe_compact (dest);
+}
+
+static const gchar *
+ml_skip_re_prefixes (const gchar *subject,
+                     const gchar * const *re_prefixes,
+                     const gchar * const *re_separators)
+{
+	gboolean found_re = TRUE;
+
+	while (found_re) {
+		gint skip_len;
+
+		found_re = em_utils_is_re_in_subject (
+			subject, &skip_len, re_prefixes, re_separators) && skip_len > 0;
+
+		if (found_re)
+			subject += skip_len;
+
+		/* jump over any spaces */
+		while (*subject && isspace ((gint) *subject))
+			subject++;
+	}
+
+	return subject;
+}
+
+static const gchar *
+ml_sort_keys_set_string (MLSortKeys *sort_keys,
+                         MLSortKey *key,
+                         gint index,
+                         const gchar *string,
+                         const gchar * const *re_prefixes,
+                         const gchar * const *re_separators)
+{
+	GStringChunk *chunk = sort_keys->chunks->data;
+
+	/* slight optimisation */
+	if (string == NULL || string[0] == '\0') {
+		key->strings[index] = "";
+	} else if (index == NORMALISED_SUBJECT) {
+		gchar *collate_key;
+
+		string = ml_skip_re_prefixes (string, re_prefixes, re_separators);
+
+		collate_key = g_utf8_collate_key (string, -1);
+		key->strings[index] = g_string_chunk_insert (chunk, collate_key);
+		g_free (collate_key);
+	} else {
+		/* because addresses require strings, not collate keys */
+		key->strings[index] = g_string_chunk_insert_const (chunk, string);
+	}
+
+	return key->strings[index];
+}
+
+/* Fills the 'columns' (a bit-mask of 1 << NORMALISED_...) of the 'info'
+ * sort key.  This is safe to call from a thread, with own 'sort_keys'. */
+static void
+ml_sort_keys_fill (MLSortKeys *sort_keys,
+                   CamelMessageInfo *info,
+                   guint columns,
+                   const gchar * const *re_prefixes,
+                   const gchar * const *re_separators)
+{
+	MLSortKey *key;
+
+	key = ml_sort_keys_add (sort_keys, camel_message_info_get_uid (info));
+
+	if ((columns & (1 << NORMALISED_SUBJECT)) != 0)
+		ml_sort_keys_set_string (
+			sort_keys, key, NORMALISED_SUBJECT,
+			camel_message_info_get_subject (info),
+			re_prefixes, re_separators);
+
+	if ((columns & (1 << NORMALISED_FROM)) != 0)
+		ml_sort_keys_set_string (
+			sort_keys, key, NORMALISED_FROM,
+			camel_message_info_get_from (info),
+			re_prefixes, re_separators);
+
+	if ((columns & (1 << NORMALISED_TO)) != 0)
+		ml_sort_keys_set_string (
+			sort_keys, key, NORMALISED_TO,
+			camel_message_info_get_to (info),
+			re_prefixes, re_separators);
+}
+
 static void	on_cursor_activated_cmd		(ETree *tree,
 						 gint row,
 						 GNode *node,
@@ -501,6 +778,31 @@ regen_data_new (MessageList *message_list,
 			g_object_ref (regen_data->full_header);
 	}
 
+	if (regen_data->sort_info) {
+		guint ii, count;
+
+		count = e_table_sort_info_sorting_get_count (regen_data->sort_info);
+
+		for (ii = 0; ii < count; ii++) {
+			ETableColumnSpecification *spec;
+
+			spec = e_table_sort_info_sorting_get_nth (regen_data->sort_info, ii, NULL);
+			if (!spec)
+				continue;
+
+			if (spec->compare_col == COL_SUBJECT_NORM)
+				regen_data->sort_key_columns |= 1 << NORMALISED_SUBJECT;
+			else if (spec->compare_col == COL_FROM_NORM)
+				regen_data->sort_key_columns |= 1 << NORMALISED_FROM;
+			else if (spec->compare_col == COL_TO_NORM)
+				regen_data->sort_key_columns |= 1 << NORMALISED_TO;
+		}
+	}
+
+	/* The thread uses its own copy, to not need to lock */
+	regen_data->re_prefixes = g_strdupv (message_list->priv->re_prefixes);
+	regen_data->re_separators = g_strdupv (message_list->priv->re_separators);
+
 	if (message_list->just_set_folder)
 		regen_data->select_uid = g_strdup (message_list->cursor_uid);
 
@@ -557,6 +859,19 @@ regen_data_unref (RegenData *regen_data)
 
 		if (regen_data->removed_uids)
 			g_hash_table_destroy (regen_data->removed_uids);
+		if (regen_data->changes)
+			camel_folder_change_info_free (regen_data->changes);
+		if (regen_data->shown_infos)
+			g_ptr_array_unref (regen_data->shown_infos);
+		if (regen_data->drop_uids)
+			g_hash_table_destroy (regen_data->drop_uids);
+		if (regen_data->shown_roots)
+			g_hash_table_destroy (regen_data->shown_roots);
+		if (regen_data->rethread_roots)
+			g_hash_table_destroy (regen_data->rethread_roots);
+		ml_sort_keys_free (regen_data->sort_keys);
+		g_strfreev (regen_data->re_prefixes);
+		g_strfreev (regen_data->re_separators);
 		g_clear_object (&regen_data->folder);
 
 		if (regen_data->expand_state != NULL)
@@ -756,9 +1071,8 @@ get_normalised_string (MessageList *message_list,
                        CamelMessageInfo *info,
                        gint col)
 {
-	const gchar *string, *str;
-	gchar *normalised;
-	EPoolv *poolv;
+	const gchar *string;
+	MLSortKey *key;
 	gint index;
 
 	switch (col) {
@@ -775,60 +1089,24 @@ get_normalised_string (MessageList *message_list,
 		index = NORMALISED_TO;
 		break;
 	default:
-		string = NULL;
-		index = NORMALISED_LAST;
 		g_warning ("Should not be reached\n");
+		return "";
 	}
 
 	/* slight optimisation */
 	if (string == NULL || string[0] == '\0')
 		return "";
 
-	poolv = g_hash_table_lookup (message_list->normalised_hash, camel_message_info_get_uid (info));
-	if (poolv == NULL) {
-		poolv = e_poolv_new (NORMALISED_LAST);
-		g_hash_table_insert (message_list->normalised_hash, (gchar *) camel_message_info_get_uid (info), poolv);
-	} else {
-		str = e_poolv_get (poolv, index);
-		if (*str)
-			return str;
-	}
-
-	if (col == COL_SUBJECT_NORM) {
-		gint skip_len;
-		const gchar *subject;
-		gboolean found_re = TRUE;
-
-		subject = string;
-		while (found_re) {
-			g_mutex_lock (&message_list->priv->re_prefixes_lock);
-			found_re = em_utils_is_re_in_subject (
-				subject, &skip_len, (const gchar * const *) message_list->priv->re_prefixes,
-				(const gchar * const *) message_list->priv->re_separators) && skip_len > 0;
-			g_mutex_unlock (&message_list->priv->re_prefixes_lock);
+	key = ml_sort_keys_add (message_list->priv->sort_keys, camel_message_info_get_uid (info));
+	if (key->strings[index])
+		return key->strings[index];
 
-			if (found_re)
-				subject += skip_len;
-
-			/* jump over any spaces */
-			while (*subject && isspace ((gint) *subject))
-				subject++;
-		}
-
-		/* jump over any spaces */
-		while (*subject && isspace ((gint) *subject))
-			subject++;
-
-		string = subject;
-		normalised = g_utf8_collate_key (string, -1);
-	} else {
-		/* because addresses require strings, not collate keys */
-		normalised = g_strdup (string);
-	}
-
-	e_poolv_set (poolv, index, normalised, TRUE);
-
-	return e_poolv_get (poolv, index);
+	/* The re_prefixes are changed only in the main thread,
+	 * the same as this is called, thus no need to lock. */
+	return ml_sort_keys_set_string (
+		message_list->priv->sort_keys, key, index, string,
+		(const gchar * const *) message_list->priv->re_prefixes,
+		(const gchar * const *) message_list->priv->re_separators);
 }
 
 static void
@@ -1763,27 +2041,15 @@ get_trimmed_subject (CamelMessageInfo *info,
 			mlist_len = strlen (mlist);
 	}
 
-	do {
-		gint skip_len;
-		gboolean found_re = TRUE;
+	g_mutex_lock (&message_list->priv->re_prefixes_lock);
 
+	do {
 		found_mlist = FALSE;
 
-		while (found_re) {
-			found_re = FALSE;
-
-			g_mutex_lock (&message_list->priv->re_prefixes_lock);
-			found_re = em_utils_is_re_in_subject (
-				subject, &skip_len, (const gchar * const *) message_list->priv->re_prefixes,
-				(const gchar * const *) message_list->priv->re_separators) && skip_len > 0;
-			g_mutex_unlock (&message_list->priv->re_prefixes_lock);
-			if (found_re)
-				subject += skip_len;
-
-			/* jump over any spaces */
-			while (*subject && isspace ((gint) *subject))
-				subject++;
-		}
+		subject = ml_skip_re_prefixes (
+			subject,
+			(const gchar * const *) message_list->priv->re_prefixes,
+			(const gchar * const *) message_list->priv->re_separators);
 
 		if (mlist_len &&
 		    *subject == '[' &&
@@ -1798,6 +2064,8 @@ get_trimmed_subject (CamelMessageInfo *info,
 		}
 	} while (found_mlist);
 
+	g_mutex_unlock (&message_list->priv->re_prefixes_lock);
+
 	/* jump over any spaces */
 	while (*subject && isspace ((gint) *subject))
 		subject++;
@@ -3257,7 +3525,7 @@ message_list_finalize (GObject *object)
 {
 	MessageList *message_list = MESSAGE_LIST (object);
 
-	g_hash_table_destroy (message_list->normalised_hash);
+	ml_sort_keys_free (message_list->priv->sort_keys);
 
 	if (message_list->priv->thread_tree != NULL)
 		camel_folder_thread_messages_unref (
@@ -3981,10 +4249,7 @@ message_list_init (MessageList *message_list)
 
 	message_list->priv = MESSAGE_LIST_GET_PRIVATE (message_list);
 
-	message_list->normalised_hash = g_hash_table_new_full (
-		g_str_hash, g_str_equal,
-		(GDestroyNotify) NULL,
-		(GDestroyNotify) e_poolv_destroy);
+	message_list->priv->sort_keys = ml_sort_keys_new (ML_SORT_KEYS_CHUNK_SIZE);
 
 	message_list->uid_nodemap = g_hash_table_new (g_str_hash, g_str_equal);
 
@@ -4523,27 +4788,34 @@ ml_uid_nodemap_insert (MessageList *message_list,
 
 static void
 ml_uid_nodemap_remove (MessageList *message_list,
-                       CamelMessageInfo *info)
+                       GNode *node)
 {
 	CamelFolder *folder;
+	CamelMessageInfo *info;
 	const gchar *uid;
 
 	folder = message_list_ref_folder (message_list);
 	g_return_if_fail (folder != NULL);
 
+	info = node->data;
 	uid = camel_message_info_get_uid (info);
 
-	if (uid == message_list->priv->newest_read_uid) {
-		message_list->priv->newest_read_date = 0;
-		message_list->priv->newest_read_uid = NULL;
-	}
+	/* The UID can be mapped to a node which already replaced
+	 * this one, when the message moved within the tree. */
+	if (g_hash_table_lookup (message_list->uid_nodemap, uid) == node) {
+		if (uid == message_list->priv->newest_read_uid) {
+			message_list->priv->newest_read_date = 0;
+			message_list->priv->newest_read_uid = NULL;
+		}
 
-	if (uid == message_list->priv->oldest_unread_uid) {
-		message_list->priv->oldest_unread_date = 0;
-		message_list->priv->oldest_unread_uid = NULL;
+		if (uid == message_list->priv->oldest_unread_uid) {
+			message_list->priv->oldest_unread_date = 0;
+			message_list->priv->oldest_unread_uid = NULL;
+		}
+
+		g_hash_table_remove (message_list->uid_nodemap, uid);
 	}
 
-	g_hash_table_remove (message_list->uid_nodemap, uid);
 	g_clear_object (&info);
 
 	g_object_unref (folder);
@@ -4561,6 +4833,7 @@ static void	build_subtree_diff		(MessageList *message_list,
 						 GNode *parent,
 						 GNode *node,
 						 CamelFolderThreadNode *c,
+						 GHashTable *drop_uids,
 						 gint *row);
 
 static void
@@ -4620,6 +4893,45 @@ build_tree (MessageList *message_list,
 #endif
 }
 
+/* applies a new thread tree on top of the current tree content, thus
+ * the nodes which did not change are kept, including their expanded
+ * state; drop_uids can contain UIDs known to be gone from the tree */
+static void
+build_tree_diff (MessageList *message_list,
+                 CamelFolderThread *thread,
+                 GHashTable *drop_uids,
+                 gboolean folder_changed)
+{
+	gint row = 0;
+	ETableItem *table_item = e_tree_get_item (E_TREE (message_list));
+
+	if (message_list->priv->tree_model_root == NULL) {
+		build_tree (message_list, thread, folder_changed);
+		return;
+	}
+
+	if (table_item)
+		e_table_item_freeze (table_item);
+
+	message_list_tree_model_freeze (message_list);
+
+	build_subtree_diff (
+		message_list,
+		message_list->priv->tree_model_root,
+		g_node_first_child (message_list->priv->tree_model_root),
+		thread ? thread->tree : NULL, drop_uids, &row);
+
+	message_list_tree_model_thaw (message_list);
+
+	if (table_item) {
+		/* Show the cursor unless we're responding to a
+		 * "folder-changed" signal from our CamelFolder. */
+		if (folder_changed)
+			table_item->queue_show_cursor = FALSE;
+		e_table_item_thaw (table_item);
+	}
+}
+
 /* this is about 20% faster than build_subtree_diff,
  * entirely because e_tree_model_node_insert (xx, -1 xx)
  * is faster than inserting to the right row :( */
@@ -4681,14 +4993,14 @@ add_node_diff (MessageList *message_list,
 	/* XXX Casting away constness. */
 	info = (CamelMessageInfo *) c->message;
 
-	/* we just update the hashtable key */
-	ml_uid_nodemap_remove (message_list, info);
+	/* this also updates the hashtable value, when the message
+	 * is moving from another place of the tree */
 	new_node = ml_uid_nodemap_insert (message_list, info, parent, myrow);
 	(*row)++;
 
 	if (c->child) {
 		build_subtree_diff (
-			message_list, new_node, NULL, c->child, row);
+			message_list, new_node, NULL, c->child, NULL, row);
 	}
 }
 
@@ -4713,13 +5025,95 @@ remove_node_diff (MessageList *message_list,
 
 	/* and the rowid entry - if and only if it is referencing this node */
 	info = node->data;
+	g_return_if_fail (info);
+
+	ml_uid_nodemap_remove (message_list, node);
 
 	/* and only at the toplevel, remove the node (etree should optimise this remove somewhat) */
 	if (depth == 0)
 		message_list_tree_model_remove (message_list, node);
+}
 
-	g_return_if_fail (info);
-	ml_uid_nodemap_remove (message_list, info);
+static void
+remember_expanded_state (ETreeTableAdapter *adapter,
+                         GNode *node,
+                         GHashTable *expanded)
+{
+	GNode *child;
+
+	if (G_NODE_IS_LEAF (node))
+		return;
+
+	g_hash_table_insert (
+		expanded,
+		(gpointer) camel_pstring_strdup (camel_message_info_get_uid (node->data)),
+		GINT_TO_POINTER (e_tree_table_adapter_node_is_expanded (adapter, node) ? 1 : 0));
+
+	for (child = node->children; child; child = child->next)
+		remember_expanded_state (adapter, child, expanded);
+}
+
+/* replaces the threads with the top-level UIDs in rethread_roots with
+ * the threads of the partial thread tree; the other threads are not
+ * touched and the model is not frozen, thus the table adapter places
+ * only the changed nodes, instead of building all rows again */
+static void
+build_tree_threads (MessageList *message_list,
+                    CamelFolderThread *thread,
+                    GHashTable *rethread_roots,
+                    gboolean folder_changed)
+{
+	ETreeTableAdapter *adapter;
+	ETableItem *table_item = e_tree_get_item (E_TREE (message_list));
+	GHashTable *expanded; /* gchar *uid ~> GINT_TO_POINTER (expanded) */
+	GHashTableIter iter;
+	gpointer key, value;
+	gint row = 0;
+
+	g_return_if_fail (message_list->priv->tree_model_root != NULL);
+
+	adapter = e_tree_get_table_adapter (E_TREE (message_list));
+	expanded = g_hash_table_new_full (g_str_hash, g_str_equal, (GDestroyNotify) camel_pstring_free, NULL);
+
+	if (table_item)
+		e_table_item_freeze (table_item);
+
+	g_hash_table_iter_init (&iter, rethread_roots);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		GNode *node;
+
+		node = g_hash_table_lookup (message_list->uid_nodemap, key);
+		if (!node)
+			continue;
+
+		remember_expanded_state (adapter, node, expanded);
+		remove_node_diff (message_list, node, 0);
+	}
+
+	build_subtree (
+		message_list,
+		message_list->priv->tree_model_root,
+		thread ? thread->tree : NULL, &row);
+
+	/* the messages shown before keep their expand state */
+	g_hash_table_iter_init (&iter, expanded);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		GNode *node;
+
+		node = g_hash_table_lookup (message_list->uid_nodemap, key);
+		if (node && !G_NODE_IS_LEAF (node))
+			e_tree_table_adapter_node_set_expanded (adapter, node, GPOINTER_TO_INT (value) != 0);
+	}
+
+	g_hash_table_destroy (expanded);
+
+	if (table_item) {
+		/* Show the cursor unless we're responding to a
+		 * "folder-changed" signal from our CamelFolder. */
+		if (folder_changed)
+			table_item->queue_show_cursor = FALSE;
+		e_table_item_thaw (table_item);
+	}
 }
 
 /* applies a new tree structure to an existing tree, but only by changing things
@@ -4729,6 +5123,7 @@ build_subtree_diff (MessageList *message_list,
                     GNode *parent,
                     GNode *node,
                     CamelFolderThreadNode *c,
+                    GHashTable *drop_uids,
                     gint *row)
 {
 	ETreeModel *tree_model;
@@ -4763,10 +5158,23 @@ build_subtree_diff (MessageList *message_list,
 			/* make child lists match (if either has one) */
 			if (bp->child || tmp) {
 				build_subtree_diff (
-					message_list, ap, tmp, bp->child, row);
+					message_list, ap, tmp, bp->child, drop_uids, row);
 			}
 			ap = g_node_next_sibling (ap);
 			bp = bp->next;
+		} else if (drop_uids && g_hash_table_contains (drop_uids, get_message_uid (message_list, ap))) {
+			t (printf ("removing gone node\n"));
+			/* known to be gone, no need to search for it */
+			tmp = g_node_next_sibling (ap);
+			remove_node_diff (message_list, ap, 0);
+			ap = tmp;
+		} else if (bp->message && !g_hash_table_contains (message_list->uid_nodemap, camel_message_info_get_uid (bp->message))) {
+			t (printf ("adding not shown node\n"));
+			/* not anywhere in the tree yet, no need to search for it */
+			add_node_diff (
+				message_list, parent, NULL, bp, row, myrow);
+			myrow++;
+			bp = bp->next;
 		} else {
 			t (printf ("searching for matches\n"));
 			/* we have to scan each side for a match */
@@ -4824,9 +5232,13 @@ build_subtree_diff (MessageList *message_list,
 	}
 }
 
+/* when incremental is TRUE, the summary contains only messages to be
+ * added and the drop_uids messages to be removed from the current list */
 static void
 build_flat (MessageList *message_list,
             GPtrArray *summary,
+            GHashTable *drop_uids,
+            gboolean incremental,
             gboolean folder_changed,
 	    GHashTable *removed_uids)
 {
@@ -4848,11 +5260,28 @@ build_flat (MessageList *message_list,
 
 	message_list_tree_model_freeze (message_list);
 
-	clear_tree (message_list, FALSE);
+	if (!incremental) {
+		clear_tree (message_list, FALSE);
+	} else if (drop_uids) {
+		GHashTableIter iter;
+		gpointer key;
+
+		g_hash_table_iter_init (&iter, drop_uids);
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			GNode *node;
+
+			node = g_hash_table_lookup (message_list->uid_nodemap, key);
+			if (node != NULL)
+				remove_node_diff (message_list, node, 0);
+		}
+	}
 
 	for (i = 0; i < summary->len; i++) {
 		CamelMessageInfo *info = summary->pdata[i];
 
+		if (incremental && g_hash_table_contains (message_list->uid_nodemap, camel_message_info_get_uid (info)))
+			continue;
+
 		ml_uid_nodemap_insert (message_list, info, NULL, -1);
 	}
 
@@ -5002,8 +5431,8 @@ message_list_folder_changed (CamelFolder *folder,
 		hide_deleted = message_list_get_hide_deleted (message_list, folder);
 
 		for (i = 0; i < changes->uid_removed->len; i++)
-			g_hash_table_remove (
-				message_list->normalised_hash,
+			ml_sort_keys_remove (
+				message_list->priv->sort_keys,
 				changes->uid_removed->pdata[i]);
 
 		/* Check if the hidden state has changed.
@@ -5173,7 +5602,8 @@ message_list_set_folder (MessageList *message_list,
 	}
 
 	/* reset the normalised sort performance hack */
-	g_hash_table_remove_all (message_list->normalised_hash);
+	ml_sort_keys_free (message_list->priv->sort_keys);
+	message_list->priv->sort_keys = ml_sort_keys_new (ML_SORT_KEYS_CHUNK_SIZE);
 
 	if (message_list->priv->folder != NULL)
 		save_tree_state (message_list, message_list->priv->folder);
@@ -5182,6 +5612,8 @@ message_list_set_folder (MessageList *message_list,
 	clear_tree (message_list, TRUE);
 	message_list_tree_model_thaw (message_list);
 
+	message_list->priv->regen_built_valid = FALSE;
+
 	/* remove the cursor activate idle handler */
 	if (message_list->idle_id != 0) {
 		g_source_remove (message_list->idle_id);
@@ -6063,6 +6495,399 @@ message_list_regen_tweak_search_results (MessageList *message_list,
 	g_clear_object (&info);
 }
 
+static void
+message_list_regen_fill_thread_sort_keys (RegenData *regen_data,
+                                          CamelFolderThreadNode *node)
+{
+	for (; node; node = node->next) {
+		if (node->message)
+			ml_sort_keys_fill (
+				regen_data->sort_keys,
+				(CamelMessageInfo *) node->message,
+				regen_data->sort_key_columns,
+				(const gchar * const *) regen_data->re_prefixes,
+				(const gchar * const *) regen_data->re_separators);
+
+		if (node->child)
+			message_list_regen_fill_thread_sort_keys (regen_data, node->child);
+	}
+}
+
+/* Precomputes the normalised strings of the regen result, thus
+ * the sort in the main thread can use them without computing. */
+static void
+message_list_regen_fill_sort_keys (RegenData *regen_data,
+                                   GPtrArray *infos)
+{
+	guint ii;
+
+	if (!regen_data->sort_key_columns)
+		return;
+
+	if (!regen_data->sort_keys)
+		regen_data->sort_keys = ml_sort_keys_new (
+			regen_data->incremental ?
+			ML_SORT_KEYS_SMALL_CHUNK_SIZE :
+			ML_SORT_KEYS_CHUNK_SIZE);
+
+	if (!infos) {
+		if (regen_data->thread_tree)
+			message_list_regen_fill_thread_sort_keys (regen_data, regen_data->thread_tree->tree);
+		return;
+	}
+
+	for (ii = 0; ii < infos->len; ii++) {
+		ml_sort_keys_fill (
+			regen_data->sort_keys,
+			g_ptr_array_index (infos, ii),
+			regen_data->sort_key_columns,
+			(const gchar * const *) regen_data->re_prefixes,
+			(const gchar * const *) regen_data->re_separators);
+	}
+}
+
+static void
+message_list_regen_add_thread_ids (GHashTable *ids,
+                                   CamelMessageInfo *info)
+{
+	GArray *references;
+	guint64 id;
+	guint ii;
+
+	id = camel_message_info_get_message_id (info);
+	if (id)
+		g_hash_table_add (ids, g_memdup (&id, sizeof (guint64)));
+
+	references = camel_message_info_dup_references (info);
+	if (references) {
+		for (ii = 0; ii < references->len; ii++) {
+			id = g_array_index (references, guint64, ii);
+			if (id)
+				g_hash_table_add (ids, g_memdup (&id, sizeof (guint64)));
+		}
+
+		g_array_unref (references);
+	}
+}
+
+static gboolean
+message_list_regen_has_thread_id (GHashTable *ids,
+                                  CamelMessageInfo *info)
+{
+	GArray *references;
+	guint64 id;
+	guint ii;
+	gboolean found;
+
+	id = camel_message_info_get_message_id (info);
+	if (id && g_hash_table_contains (ids, &id))
+		return TRUE;
+
+	references = camel_message_info_dup_references (info);
+	if (!references)
+		return FALSE;
+
+	for (ii = 0, found = FALSE; ii < references->len && !found; ii++) {
+		id = g_array_index (references, guint64, ii);
+		found = id && g_hash_table_contains (ids, &id);
+	}
+
+	g_array_unref (references);
+
+	return found;
+}
+
+/* Finds the shown threads the changes can restructure, those with a removed
+ * message and those related to an added message by the Message-ID or
+ * the References. Returns NULL when the whole list has to be threaded. */
+static GHashTable *
+message_list_regen_collect_rethread_roots (RegenData *regen_data,
+                                           CamelFolder *folder,
+                                           GHashTable *shown,
+                                           GHashTable *matched)
+{
+	GHashTable *roots;	/* gchar *uid ~> NULL */
+	GHashTable *ids;	/* guint64 *message_id ~> NULL */
+	GHashTableIter iter;
+	gpointer key;
+	const gchar *root;
+	guint ii;
+
+	/* Threading by subject can join any threads */
+	if (regen_data->thread_subject || !regen_data->shown_roots)
+		return NULL;
+
+	roots = g_hash_table_new_full (
+		g_str_hash, g_str_equal,
+		(GDestroyNotify) camel_pstring_free, NULL);
+	ids = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
+
+	g_hash_table_iter_init (&iter, regen_data->drop_uids);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		root = g_hash_table_lookup (regen_data->shown_roots, key);
+		if (root && !g_hash_table_contains (roots, root))
+			g_hash_table_add (roots, (gpointer) camel_pstring_strdup (root));
+	}
+
+	g_hash_table_iter_init (&iter, matched);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		CamelMessageInfo *info;
+
+		if (g_hash_table_contains (shown, key))
+			continue;
+
+		info = camel_folder_get_message_info (folder, key);
+		if (info != NULL) {
+			message_list_regen_add_thread_ids (ids, info);
+			g_clear_object (&info);
+		}
+	}
+
+	/* A shown message can be a parent, a child or a sibling
+	 * of an added message, or be in the same thread with it. */
+	if (g_hash_table_size (ids) > 0) {
+		for (ii = 0; ii < regen_data->shown_infos->len; ii++) {
+			CamelMessageInfo *info = g_ptr_array_index (regen_data->shown_infos, ii);
+
+			root = g_hash_table_lookup (regen_data->shown_roots, camel_message_info_get_uid (info));
+			if (!root || g_hash_table_contains (roots, root))
+				continue;
+
+			if (message_list_regen_has_thread_id (ids, info))
+				g_hash_table_add (roots, (gpointer) camel_pstring_strdup (root));
+		}
+	}
+
+	g_hash_table_destroy (ids);
+
+	return roots;
+}
+
+/* The UIDs to thread: the matched messages, which are not being dropped,
+ * limited to those in the threads with top-level UIDs in 'roots', if set */
+static GPtrArray *
+message_list_regen_collect_thread_uids (RegenData *regen_data,
+                                        GHashTable *shown,
+                                        GHashTable *matched,
+                                        GHashTable *roots)
+{
+	GPtrArray *uids;
+	GHashTableIter iter;
+	gpointer key;
+
+	uids = g_ptr_array_sized_new (g_hash_table_size (shown) + g_hash_table_size (matched));
+
+	g_hash_table_iter_init (&iter, shown);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		if (g_hash_table_contains (regen_data->drop_uids, key))
+			continue;
+
+		if (roots) {
+			const gchar *root;
+
+			root = g_hash_table_lookup (regen_data->shown_roots, key);
+			if (!root || !g_hash_table_contains (roots, root))
+				continue;
+		}
+
+		g_ptr_array_add (uids, key);
+	}
+
+	g_hash_table_iter_init (&iter, matched);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		if (!g_hash_table_contains (shown, key))
+			g_ptr_array_add (uids, key);
+	}
+
+	return uids;
+}
+
+/* Derives the new list content from the shown content and the accumulated
+ * folder changes, evaluating the search expression only on the touched UIDs.
+ * The result is stored in the regen_data, the same way as the full regen does,
+ * only the flat summary contains just the messages to be added. */
+static void
+message_list_regen_apply_changes (MessageList *message_list,
+                                  RegenData *regen_data,
+                                  CamelFolder *folder,
+                                  const gchar *expr,
+                                  GCancellable *cancellable,
+                                  GError **error)
+{
+	CamelFolderChangeInfo *changes = regen_data->changes;
+	GPtrArray *sources[2];
+	GPtrArray *touched_uids;
+	GHashTable *shown;	/* const gchar *uid ~> CamelMessageInfo * */
+	GHashTable *removed;	/* const gchar *uid ~> NULL */
+	GHashTable *touched;	/* const gchar *uid ~> NULL */
+	GHashTable *matched;	/* const gchar *uid ~> NULL */
+	GHashTableIter iter;
+	gpointer key;
+	guint ii, jj;
+
+	shown = g_hash_table_new (g_str_hash, g_str_equal);
+	removed = g_hash_table_new (g_str_hash, g_str_equal);
+	touched = g_hash_table_new (g_str_hash, g_str_equal);
+	matched = g_hash_table_new (g_str_hash, g_str_equal);
+	touched_uids = g_ptr_array_new ();
+
+	regen_data->drop_uids = g_hash_table_new_full (
+		g_str_hash, g_str_equal,
+		(GDestroyNotify) camel_pstring_free, NULL);
+
+	for (ii = 0; ii < regen_data->shown_infos->len; ii++) {
+		CamelMessageInfo *info = g_ptr_array_index (regen_data->shown_infos, ii);
+
+		g_hash_table_insert (shown, (gpointer) camel_message_info_get_uid (info), info);
+	}
+
+	for (ii = 0; ii < changes->uid_removed->len; ii++) {
+		const gchar *uid = g_ptr_array_index (changes->uid_removed, ii);
+
+		g_hash_table_add (removed, (gpointer) uid);
+
+		if (g_hash_table_contains (shown, uid))
+			g_hash_table_add (regen_data->drop_uids, (gpointer) camel_pstring_strdup (uid));
+	}
+
+	sources[0] = changes->uid_added;
+	sources[1] = changes->uid_changed;
+
+	for (jj = 0; jj < G_N_ELEMENTS (sources); jj++) {
+		for (ii = 0; ii < sources[jj]->len; ii++) {
+			const gchar *uid = g_ptr_array_index (sources[jj], ii);
+
+			if (g_hash_table_contains (removed, uid) ||
+			    g_hash_table_contains (touched, uid))
+				continue;
+
+			g_hash_table_add (touched, (gpointer) uid);
+			g_ptr_array_add (touched_uids, (gpointer) uid);
+		}
+	}
+
+	if (touched_uids->len > 0 && expr != NULL) {
+		GPtrArray *search_uids;
+
+		search_uids = camel_folder_search_by_uids (
+			folder, expr, touched_uids, cancellable, error);
+
+		if (search_uids != NULL) {
+			message_list_regen_tweak_search_results (
+				message_list,
+				search_uids, folder,
+				regen_data->folder_changed,
+				!regen_data->hide_deleted,
+				!regen_data->hide_junk);
+
+			for (ii = 0; ii < search_uids->len; ii++) {
+				gpointer orig_key = NULL;
+
+				/* Use the UID from the change info, which lives longer. */
+				if (g_hash_table_lookup_extended (touched, search_uids->pdata[ii], &orig_key, NULL))
+					g_hash_table_add (matched, orig_key);
+			}
+
+			camel_folder_search_free (folder, search_uids);
+		}
+	} else {
+		for (ii = 0; ii < touched_uids->len; ii++) {
+			CamelMessageInfo *info;
+
+			info = camel_folder_get_message_info (folder, touched_uids->pdata[ii]);
+			if (info != NULL) {
+				g_hash_table_add (matched, touched_uids->pdata[ii]);
+				g_clear_object (&info);
+			}
+		}
+	}
+
+	if (error && *error)
+		goto exit;
+
+	/* Shown messages which do not match the search anymore. */
+	for (ii = 0; ii < touched_uids->len; ii++) {
+		const gchar *uid = g_ptr_array_index (touched_uids, ii);
+
+		if (!g_hash_table_contains (matched, uid) &&
+		    g_hash_table_contains (shown, uid))
+			g_hash_table_add (regen_data->drop_uids, (gpointer) camel_pstring_strdup (uid));
+	}
+
+	if (regen_data->group_by_threads) {
+		GPtrArray *uids;
+		GHashTable *roots;
+
+		/* Only the threads the changes can restructure are threaded
+		 * again and replaced in the shown tree, unless they cover
+		 * most of the list, when the whole list is threaded and
+		 * applied as a difference to the shown tree, which is
+		 * faster than replacing its many nodes one by one. */
+		roots = message_list_regen_collect_rethread_roots (regen_data, folder, shown, matched);
+		uids = message_list_regen_collect_thread_uids (regen_data, shown, matched, roots);
+
+		if (roots && uids->len > g_hash_table_size (shown) / 2) {
+			g_clear_pointer (&roots, g_hash_table_destroy);
+			g_ptr_array_free (uids, TRUE);
+
+			uids = message_list_regen_collect_thread_uids (regen_data, shown, matched, NULL);
+		}
+
+		regen_data->rethread_roots = roots;
+
+		camel_folder_sort_uids (folder, uids);
+
+		/* Threading works with in-memory summary data only */
+		regen_data->thread_tree = camel_folder_thread_messages_new (
+			folder, uids, regen_data->thread_subject);
+
+		g_ptr_array_free (uids, TRUE);
+
+		if (regen_data->sort_key_columns) {
+			GPtrArray *infos;
+
+			/* Only the touched messages, the rest is known already. */
+			infos = g_ptr_array_new_with_free_func (g_object_unref);
+
+			g_hash_table_iter_init (&iter, matched);
+			while (g_hash_table_iter_next (&iter, &key, NULL)) {
+				CamelMessageInfo *info;
+
+				info = camel_folder_get_message_info (folder, key);
+				if (info != NULL)
+					g_ptr_array_add (infos, info);
+			}
+
+			message_list_regen_fill_sort_keys (regen_data, infos);
+
+			g_ptr_array_unref (infos);
+		}
+	} else {
+		regen_data->summary = g_ptr_array_new ();
+
+		g_hash_table_iter_init (&iter, matched);
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			CamelMessageInfo *info;
+
+			if (g_hash_table_contains (shown, key))
+				continue;
+
+			info = camel_folder_get_message_info (folder, key);
+			if (info != NULL)
+				g_ptr_array_add (regen_data->summary, info);
+		}
+
+		message_list_regen_fill_sort_keys (regen_data, regen_data->summary);
+	}
+
+exit:
+	g_ptr_array_free (touched_uids, TRUE);
+	g_hash_table_destroy (matched);
+	g_hash_table_destroy (touched);
+	g_hash_table_destroy (removed);
+	g_hash_table_destroy (shown);
+}
+
 static void
 message_list_regen_thread (GSimpleAsyncResult *simple,
                            GObject *source_object,
@@ -6070,7 +6895,7 @@ message_list_regen_thread (GSimpleAsyncResult *simple,
 {
 	MessageList *message_list;
 	RegenData *regen_data;
-	GPtrArray *uids, *searchuids = NULL;
+	GPtrArray *uids = NULL, *searchuids = NULL;
 	CamelMessageInfo *info;
 	CamelFolder *folder;
 	GNode *cursor;
@@ -6089,8 +6914,8 @@ message_list_regen_thread (GSimpleAsyncResult *simple,
 	/* Just for convenience. */
 	folder = g_object_ref (regen_data->folder);
 
-	hide_junk = message_list_get_hide_junk (message_list, folder);
-	hide_deleted = message_list_get_hide_deleted (message_list, folder);
+	hide_junk = regen_data->hide_junk;
+	hide_deleted = regen_data->hide_deleted;
 
 	tree = E_TREE (message_list);
 	cursor = e_tree_get_cursor (tree);
@@ -6129,6 +6954,27 @@ message_list_regen_thread (GSimpleAsyncResult *simple,
 		}
 	}
 
+	if (regen_data->incremental) {
+		message_list_regen_apply_changes (
+			message_list, regen_data, folder,
+			expr->len ? expr->str : NULL,
+			cancellable, &local_error);
+
+		g_string_free (expr, TRUE);
+
+		if (local_error == NULL) {
+			/* coverity[unchecked_value] */
+			if (g_cancellable_set_error_if_cancelled (cancellable, &local_error)) {
+				;
+			}
+		}
+
+		if (local_error != NULL)
+			g_simple_async_result_take_error (simple, local_error);
+
+		goto exit;
+	}
+
 	/* Execute the search. */
 
 	if (expr->len == 0) {
@@ -6205,6 +7051,8 @@ message_list_regen_thread (GSimpleAsyncResult *simple,
 		 * gets invalidated before regen post-processing. */
 		regen_data->thread_tree = thread_tree;
 
+		message_list_regen_fill_sort_keys (regen_data, NULL);
+
 	} else {
 		guint ii;
 
@@ -6220,6 +7068,8 @@ message_list_regen_thread (GSimpleAsyncResult *simple,
 			if (info != NULL)
 				g_ptr_array_add (regen_data->summary, info);
 		}
+
+		message_list_regen_fill_sort_keys (regen_data, regen_data->summary);
 	}
 
 exit:
@@ -6432,6 +7282,28 @@ message_list_regen_done_cb (GObject *source_object,
 		}
 	}
 
+	/* Use the sort keys computed in the thread.  A full regen
+	 * replaces the old keys, which frees those not shown anymore. */
+	if (regen_data->incremental) {
+		if (regen_data->drop_uids) {
+			GHashTableIter iter;
+			gpointer key;
+
+			g_hash_table_iter_init (&iter, regen_data->drop_uids);
+			while (g_hash_table_iter_next (&iter, &key, NULL)) {
+				ml_sort_keys_remove (message_list->priv->sort_keys, key);
+			}
+		}
+
+		if (regen_data->sort_keys)
+			ml_sort_keys_merge (message_list->priv->sort_keys, regen_data->sort_keys);
+	} else {
+		ml_sort_keys_free (message_list->priv->sort_keys);
+		message_list->priv->sort_keys = regen_data->sort_keys ? regen_data->sort_keys : ml_sort_keys_new (ML_SORT_KEYS_CHUNK_SIZE);
+	}
+
+	regen_data->sort_keys = NULL;
+
 	if (regen_data->group_by_threads) {
 		ETableItem *table_item = e_tree_get_item (E_TREE (message_list));
 		GPtrArray *selected;
@@ -6471,10 +7343,23 @@ message_list_regen_done_cb (GObject *source_object,
 
 		/* Show the cursor unless we're responding to a
 		 * "folder-changed" signal from our CamelFolder. */
-		build_tree (
-			message_list,
-			regen_data->thread_tree,
-			regen_data->folder_changed);
+		if (regen_data->incremental && regen_data->rethread_roots)
+			build_tree_threads (
+				message_list,
+				regen_data->thread_tree,
+				regen_data->rethread_roots,
+				regen_data->folder_changed);
+		else if (regen_data->incremental)
+			build_tree_diff (
+				message_list,
+				regen_data->thread_tree,
+				regen_data->drop_uids,
+				regen_data->folder_changed);
+		else
+			build_tree (
+				message_list,
+				regen_data->thread_tree,
+				regen_data->folder_changed);
 
 		message_list_set_thread_tree (
 			message_list, regen_data->thread_tree);
@@ -6485,6 +7370,8 @@ message_list_regen_done_cb (GObject *source_object,
 
 			/* Disable forced expand/collapse state. */
 			e_tree_table_adapter_force_expanded_state (adapter, 0);
+		} else if (regen_data->incremental) {
+			/* The kept nodes preserved their expand state */
 		} else if (was_searching && !is_searching) {
 			/* Load expand state from disk */
 			load_tree_state (
@@ -6571,10 +7458,18 @@ message_list_regen_done_cb (GObject *source_object,
 		build_flat (
 			message_list,
 			regen_data->summary,
+			regen_data->drop_uids,
+			regen_data->incremental,
 			regen_data->folder_changed,
 			regen_data->removed_uids);
 	}
 
+	message_list->priv->regen_built_valid = TRUE;
+	message_list->priv->regen_built_group_by_threads = regen_data->group_by_threads;
+	message_list->priv->regen_built_thread_subject = regen_data->thread_subject;
+	message_list->priv->regen_built_hide_deleted = regen_data->hide_deleted;
+	message_list->priv->regen_built_hide_junk = regen_data->hide_junk;
+
 	row_count = e_table_model_row_count (E_TABLE_MODEL (adapter));
 
 	if (start_selection_uid) {
@@ -6751,6 +7646,41 @@ message_list_regen_done_cb (GObject *source_object,
 	}
 }
 
+static gboolean
+message_list_regen_can_be_incremental (MessageList *message_list,
+                                       RegenData *regen_data)
+{
+	CamelFolderChangeInfo *changes = regen_data->changes;
+	guint n_changes, n_shown;
+
+	if (changes == NULL || !message_list->priv->regen_built_valid)
+		return FALSE;
+
+	if (message_list->just_set_folder ||
+	    message_list->expand_all ||
+	    message_list->collapse_all ||
+	    regen_data->folder != message_list->priv->folder)
+		return FALSE;
+
+	/* Any change of the search expression or of the threading
+	 * options requires to regenerate the whole list. */
+	if (g_strcmp0 (regen_data->search, message_list->search) != 0 ||
+	    regen_data->group_by_threads != message_list->priv->regen_built_group_by_threads ||
+	    regen_data->thread_subject != message_list->priv->regen_built_thread_subject ||
+	    regen_data->hide_deleted != message_list->priv->regen_built_hide_deleted ||
+	    regen_data->hide_junk != message_list->priv->regen_built_hide_junk)
+		return FALSE;
+
+	n_changes =
+		changes->uid_added->len +
+		changes->uid_changed->len +
+		changes->uid_removed->len;
+	n_shown = g_hash_table_size (message_list->uid_nodemap);
+
+	/* Searching in most of the folder is faster done at once. */
+	return n_changes <= n_shown / 2;
+}
+
 static gboolean
 message_list_regen_idle_cb (gpointer user_data)
 {
@@ -6779,6 +7709,13 @@ message_list_regen_idle_cb (gpointer user_data)
 	regen_data->select_unread =
 		message_list_get_regen_selects_unread (message_list);
 
+	regen_data->hide_deleted =
+		message_list_get_hide_deleted (message_list, regen_data->folder);
+	regen_data->hide_junk =
+		message_list_get_hide_junk (message_list, regen_data->folder);
+	regen_data->incremental =
+		message_list_regen_can_be_incremental (message_list, regen_data);
+
 	if (regen_data->select_unread)
 		message_list_set_regen_selects_unread (message_list, FALSE);
 
@@ -6787,7 +7724,42 @@ message_list_regen_idle_cb (gpointer user_data)
 	adapter = e_tree_get_table_adapter (E_TREE (message_list));
 	row_count = e_table_model_row_count (E_TABLE_MODEL (adapter));
 
-	if (row_count <= 0) {
+	if (regen_data->incremental) {
+		GHashTableIter iter;
+		gpointer value;
+
+		/* The nodes are kept, thus also their expand state,
+		 * just remember what is shown right now. */
+		regen_data->shown_infos = g_ptr_array_new_full (
+			g_hash_table_size (message_list->uid_nodemap),
+			(GDestroyNotify) g_object_unref);
+
+		if (regen_data->group_by_threads)
+			regen_data->shown_roots = g_hash_table_new (g_str_hash, g_str_equal);
+
+		g_hash_table_iter_init (&iter, message_list->uid_nodemap);
+		while (g_hash_table_iter_next (&iter, NULL, &value)) {
+			GNode *node = value, *root;
+
+			if (node->data == NULL)
+				continue;
+
+			g_ptr_array_add (regen_data->shown_infos, g_object_ref (node->data));
+
+			if (regen_data->shown_roots) {
+				/* the top-level message of the thread */
+				root = node;
+				while (root->parent && root->parent != message_list->priv->tree_model_root)
+					root = root->parent;
+
+				if (root->data) {
+					g_hash_table_insert (regen_data->shown_roots,
+						(gpointer) camel_message_info_get_uid (node->data),
+						(gpointer) camel_message_info_get_uid (root->data));
+				}
+			}
+		}
+	} else if (row_count <= 0) {
 		if (gtk_widget_get_visible (GTK_WIDGET (message_list)))
 			e_tree_set_info_message (E_TREE (message_list), _("Generating message list…"));
 	} else if (regen_data->group_by_threads &&
@@ -6926,6 +7898,16 @@ mail_regen_list (MessageList *message_list,
 		   the regen was done for folder-changed signal, while the initial regen
 		   request would be due to change of the folder in the view (or other similar
 		   reasons). */
+		/* Without folder changes the whole list is regenerated. */
+		if (!folder_changes) {
+			if (old_regen_data->changes) {
+				camel_folder_change_info_free (old_regen_data->changes);
+				old_regen_data->changes = NULL;
+			}
+		} else if (old_regen_data->changes) {
+			camel_folder_change_info_cat (old_regen_data->changes, folder_changes);
+		}
+
 		if (!folder_changes) {
 			old_regen_data->folder_changed = FALSE;
 		} else if (folder_changes->uid_removed) {
@@ -6952,6 +7934,17 @@ mail_regen_list (MessageList *message_list,
 	/* Make sure the folder_changes won't reset currently running regen, which would scroll to the selection in the UI */
 	new_regen_data->folder_changed = folder_changes != NULL && (!old_regen_data || old_regen_data->folder_changed);
 
+	/* The cancelled regen did not apply its changes, thus take them over;
+	 * a cancelled full regen requires the full regen also here. */
+	if (folder_changes && (!old_regen_data || old_regen_data->changes)) {
+		new_regen_data->changes = camel_folder_change_info_new ();
+
+		if (old_regen_data)
+			camel_folder_change_info_cat (new_regen_data->changes, old_regen_data->changes);
+
+		camel_folder_change_info_cat (new_regen_data->changes, folder_changes);
+	}
+
 	if (folder_changes && folder_changes->uid_removed && new_regen_data->folder_changed) {
 		guint ii;
 
@@ -111,8 +111,6 @@ struct _MessageList {
 
 	GHashTable *uid_nodemap; /* uid (from info) -> tree node mapping */
 
-	GHashTable *normalised_hash;
-
 	/* Current search string, or %NULL */
 	gchar *search;
 
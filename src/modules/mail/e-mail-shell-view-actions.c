@@ -918,6 +918,131 @@ action_mail_popup_folder_mark_all_as_read_cb (GtkAction *action,
 	g_free (folder_name);
 }
 
+static void
+account_remove_duplicates_done_cb (GObject *source_object,
+                                   GAsyncResult *result,
+                                   gpointer user_data)
+{
+	CamelStore *store;
+	EShellWindow *shell_window;
+	GHashTable *duplicates;
+	GHashTableIter iter;
+	gpointer key, value;
+	AsyncContext *context;
+	guint n_duplicates = 0;
+	GError *local_error = NULL;
+
+	store = CAMEL_STORE (source_object);
+	context = user_data;
+
+	duplicates = e_mail_store_find_duplicate_messages_finish (
+		store, result, &local_error);
+
+	if (e_activity_handle_cancellation (context->activity, local_error)) {
+		async_context_free (context);
+		g_error_free (local_error);
+		return;
+
+	} else if (local_error != NULL) {
+		e_alert_submit (
+			e_activity_get_alert_sink (context->activity),
+			"mail:find-duplicate-messages",
+			local_error->message, NULL);
+		async_context_free (context);
+		g_error_free (local_error);
+		return;
+	}
+
+	/* Finalize the activity here so we don't leave a message in
+	 * the task bar while prompting the user for confirmation. */
+	e_activity_set_state (context->activity, E_ACTIVITY_COMPLETED);
+
+	shell_window = e_shell_view_get_shell_window (E_SHELL_VIEW (context->mail_shell_view));
+
+	g_hash_table_iter_init (&iter, duplicates);
+
+	while (g_hash_table_iter_next (&iter, NULL, &value))
+		n_duplicates += ((GPtrArray *) value)->len;
+
+	if (n_duplicates == 0) {
+		e_util_prompt_user (
+			GTK_WINDOW (shell_window), "org.gnome.evolution.mail", NULL,
+			"mail:info-no-remove-account-duplicates",
+			camel_service_get_display_name (CAMEL_SERVICE (store)), NULL);
+	} else {
+		gchar *confirmation;
+
+		confirmation = g_strdup_printf (ngettext (
+			/* Translators: %s is replaced with an account
+			 * name %u with count of duplicate messages. */
+			"Account “%s” contains %u duplicate message. "
+			"Are you sure you want to delete it?",
+			"Account “%s” contains %u duplicate messages. "
+			"Are you sure you want to delete them?",
+			n_duplicates),
+			camel_service_get_display_name (CAMEL_SERVICE (store)),
+			n_duplicates);
+
+		if (e_util_prompt_user (
+			GTK_WINDOW (shell_window), "org.gnome.evolution.mail", NULL,
+			"mail:ask-remove-duplicates",
+			confirmation, NULL)) {
+			g_hash_table_iter_init (&iter, duplicates);
+
+			/* Mark duplicate messages for deletion. */
+			while (g_hash_table_iter_next (&iter, &key, &value)) {
+				CamelFolder *folder = key;
+				GPtrArray *uids = value;
+				guint ii;
+
+				camel_folder_freeze (folder);
+
+				for (ii = 0; ii < uids->len; ii++)
+					camel_folder_delete_message (folder, g_ptr_array_index (uids, ii));
+
+				camel_folder_thaw (folder);
+			}
+		}
+
+		g_free (confirmation);
+	}
+
+	g_hash_table_unref (duplicates);
+	async_context_free (context);
+}
+
+static void
+action_mail_account_remove_duplicates_cb (GtkAction *action,
+                                          EMailShellView *mail_shell_view)
+{
+	EMailShellContent *mail_shell_content;
+	EMailShellSidebar *mail_shell_sidebar;
+	EMFolderTree *folder_tree;
+	EMailView *mail_view;
+	AsyncContext *context;
+	CamelStore *store;
+
+	mail_shell_content = mail_shell_view->priv->mail_shell_content;
+	mail_shell_sidebar = mail_shell_view->priv->mail_shell_sidebar;
+
+	folder_tree = e_mail_shell_sidebar_get_folder_tree (mail_shell_sidebar);
+	store = em_folder_tree_ref_selected_store (folder_tree);
+	g_return_if_fail (store != NULL);
+
+	mail_view = e_mail_shell_content_get_mail_view (mail_shell_content);
+
+	context = g_slice_new0 (AsyncContext);
+	context->activity = e_mail_reader_new_activity (E_MAIL_READER (mail_view));
+	context->mail_shell_view = g_object_ref (mail_shell_view);
+
+	e_mail_store_find_duplicate_messages (
+		store, FALSE, G_PRIORITY_DEFAULT,
+		e_activity_get_cancellable (context->activity),
+		account_remove_duplicates_done_cb, context);
+
+	g_object_unref (store);
+}
+
 static void
 action_mail_folder_move_cb (GtkAction *action,
                             EMailShellView *mail_shell_view)
@@ -1602,6 +1727,13 @@ static GtkActionEntry mail_entries[] = {
 	  N_("Refresh list of folders of this account"),
 	  G_CALLBACK (action_mail_account_refresh_cb) },
 
+	{ "mail-account-remove-duplicates",
+	  NULL,
+	  N_("Remove Du_plicate Messages"),
+	  NULL,
+	  N_("Checks all folders of this account for duplicate messages"),
+	  G_CALLBACK (action_mail_account_remove_duplicates_cb) },
+
 	{ "mail-download",
 	  NULL,
 	  N_("_Download Messages for Offline Usage"),
@@ -1876,6 +2008,10 @@ static EPopupActionEntry mail_popup_entries[] = {
 	  NULL,
 	  "mail-account-properties" },
 
+	{ "mail-popup-account-remove-duplicates",
+	  NULL,
+	  "mail-account-remove-duplicates" },
+
 	{ "mail-popup-flush-outbox",
 	  NULL,
 	  "mail-flush-outbox" },
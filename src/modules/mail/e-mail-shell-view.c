@@ -1493,6 +1493,10 @@ mail_shell_view_update_actions (EShellView *shell_view)
 	sensitive = folder_is_store;
 	gtk_action_set_sensitive (action, sensitive);
 
+	action = ACTION (MAIL_ACCOUNT_REMOVE_DUPLICATES);
+	sensitive = folder_is_store;
+	gtk_action_set_sensitive (action, sensitive);
+
 	action = ACTION (MAIL_FLUSH_OUTBOX);
 	sensitive = folder_is_outbox;
 	gtk_action_set_sensitive (action, sensitive);
@@ -23,6 +23,7 @@
 #include <em-format/e-mail-extension-registry.h>
 #include <em-format/e-mail-parser-extension.h>
 #include <em-format/e-mail-part.h>
+#include <em-format/e-mail-part-list.h>
 #include <em-format/e-mail-part-utils.h>
 
 #include <libebackend/libebackend.h>
@@ -429,10 +430,17 @@ e_mail_parser_prefer_plain_set_property (GObject *object,
 
 	switch (property_id) {
 		case PROP_MODE:
-			parser->mode = g_value_get_int (value);
+			if (parser->mode != g_value_get_int (value)) {
+				parser->mode = g_value_get_int (value);
+				/* Parsed messages depend on it */
+				e_mail_part_list_cache_invalidate ();
+			}
 			return;
 		case PROP_SHOW_SUPPRESSED:
-			parser->show_suppressed = g_value_get_boolean (value);
+			if (parser->show_suppressed != g_value_get_boolean (value)) {
+				parser->show_suppressed = g_value_get_boolean (value);
+				e_mail_part_list_cache_invalidate ();
+			}
 			return;
 	}
 
@@ -46,6 +46,8 @@
 #include <mail/em-folder-selection-button.h>
 #include <mail/em-utils.h>
 
+#include <addressbook/importers/evolution-addressbook-importers.h>
+
 #include <libpst/libpst.h>
 #include <libpst/timeconv.h>
 
@@ -58,23 +60,31 @@
 
 typedef struct _PstImporter PstImporter;
 
+typedef enum {
+	PST_KIND_MAIL,
+	PST_KIND_CONTACT,
+	PST_KIND_APPOINTMENT,
+	PST_KIND_TASK,
+	PST_KIND_JOURNAL,
+	PST_N_KINDS
+} PstItemKind;
+
 gint pst_init (pst_file *pst, gchar *filename);
 gchar *get_pst_rootname (pst_file *pst, gchar *filename);
 static void pst_error_msg (const gchar *fmt, ...);
 static void pst_import_folders (PstImporter *m, pst_desc_tree *topitem);
 static void pst_process_item (PstImporter *m, pst_desc_tree *d_ptr, gchar **previouss_folder);
 static void pst_process_folder (PstImporter *m, pst_item *item);
-static void pst_process_email (PstImporter *m, pst_item *item);
-static void pst_process_contact (PstImporter *m, pst_item *item);
-static void pst_process_appointment (PstImporter *m, pst_item *item);
-static void pst_process_task (PstImporter *m, pst_item *item);
-static void pst_process_journal (PstImporter *m, pst_item *item);
+static void pst_queue_item (PstImporter *m, pst_item *item, PstItemKind kind);
+static void pst_flush_items (PstImporter *m);
+static void pst_convert_job_cb (gpointer data, gpointer user_data);
+static void pst_report_stats (PstImporter *m, gint64 elapsed);
 
 static void pst_import_file (PstImporter *m);
 gchar *foldername_to_utf8 (const gchar *pstname);
 gchar *string_to_utf8 (const gchar *string);
 void contact_set_date (EContact *contact, EContactField id, FILETIME *date);
-static void fill_calcomponent (PstImporter *m, pst_item *item, ECalComponent *ec, const gchar *type);
+static void fill_calcomponent (pst_item *item, ECalComponent *ec, const gchar *type);
 ICalTime *get_ical_date (FILETIME *date, gboolean is_date);
 gchar *rfc2445_datetime_format (FILETIME *ft);
 
@@ -91,6 +101,44 @@ gint e_plugin_lib_enable (EPlugin *ep, gint enable);
 
 static guchar pst_signature[] = { '!', 'B', 'D', 'N' };
 
+/* Items are read from the file on the import thread only, because libpst
+ * is not thread safe, then converted on a thread pool in batches of this
+ * many. Each converted batch is submitted with one call per address book
+ * or calendar and one folder synchronization per destination folder. */
+#define PST_BATCH_SIZE 100
+
+static const struct {
+	const gchar *name;
+	ECalComponentVType vtype;
+} pst_kinds[PST_N_KINDS] = {
+	{ "mail", E_CAL_COMPONENT_NO_TYPE },
+	{ "contact", E_CAL_COMPONENT_NO_TYPE },
+	{ "appointment", E_CAL_COMPONENT_EVENT },
+	{ "task", E_CAL_COMPONENT_TODO },
+	{ "journal", E_CAL_COMPONENT_JOURNAL }
+};
+
+typedef struct _PstJob {
+	GCancellable *cancellable;
+	PstItemKind kind;
+	pst_item *item;
+	CamelFolder *folder; /* destination of mail */
+	ECalClient *cal; /* destination of calendar items */
+
+	/* results of the conversion */
+	CamelMimeMessage *message;
+	CamelMessageInfo *info;
+	EContact *contact;
+	ECalComponent *comp;
+	gint64 convert_time;
+} PstJob;
+
+typedef struct _PstBatch {
+	EUtilBatch *converter; /* converts the jobs */
+	guint n_jobs;
+	PstJob jobs[PST_BATCH_SIZE];
+} PstBatch;
+
 struct _PstImporter {
 	MailMsg base;
 
@@ -120,6 +168,16 @@ struct _PstImporter {
 	/* progress indicator */
 	gint position;
 	gint total;
+
+	/* one batch is filled while the other one is converted */
+	PstBatch batches[2];
+	PstBatch *filling_batch;
+	PstBatch *converting_batch;
+
+	/* per-kind statistics, reported at the end */
+	guint stats_count[PST_N_KINDS];
+	gint64 stats_convert_time[PST_N_KINDS];
+	gint64 stats_submit_time[PST_N_KINDS];
 };
 
 gboolean
@@ -742,6 +800,8 @@ pst_import_file (PstImporter *m)
 	gchar *filename;
 	pst_item *item = NULL;
 	pst_desc_tree *d_ptr;
+	gint64 started;
+	guint ii;
 
 	/* XXX Dig up the EMailSession from the default EShell.
 	 *     Since the EImport framework doesn't allow for user
@@ -787,7 +847,24 @@ pst_import_file (PstImporter *m)
 
 	camel_operation_progress (m->cancellable, 3);
 	count_items (m, d_ptr);
+
+	for (ii = 0; ii < G_N_ELEMENTS (m->batches); ii++) {
+		m->batches[ii].converter = e_util_batch_new (pst_convert_job_cb, NULL);
+		m->batches[ii].n_jobs = 0;
+	}
+
+	m->filling_batch = &m->batches[0];
+	m->converting_batch = &m->batches[1];
+
+	started = g_get_monotonic_time ();
+
 	pst_import_folders (m, d_ptr);
+	pst_flush_items (m);
+
+	pst_report_stats (m, g_get_monotonic_time () - started);
+
+	for (ii = 0; ii < G_N_ELEMENTS (m->batches); ii++)
+		g_clear_pointer (&m->batches[ii].converter, e_util_batch_free);
 
 	camel_operation_progress (m->cancellable, 100);
 
@@ -899,33 +976,45 @@ pst_process_item (PstImporter *m,
 	} else {
 		switch (item->type) {
 		case PST_TYPE_CONTACT:
-			if (item->contact && m->addressbook && GPOINTER_TO_INT (g_datalist_get_data (&m->target->data, "pst-do-addr")))
-				pst_process_contact (m, item);
+			if (item->contact && m->addressbook && GPOINTER_TO_INT (g_datalist_get_data (&m->target->data, "pst-do-addr"))) {
+				pst_queue_item (m, item, PST_KIND_CONTACT);
+				item = NULL;
+			}
 			break;
 		case PST_TYPE_APPOINTMENT:
-			if (item->appointment && m->calendar && GPOINTER_TO_INT (g_datalist_get_data (&m->target->data, "pst-do-appt")))
-				pst_process_appointment (m, item);
+			if (item->appointment && m->calendar && GPOINTER_TO_INT (g_datalist_get_data (&m->target->data, "pst-do-appt"))) {
+				pst_queue_item (m, item, PST_KIND_APPOINTMENT);
+				item = NULL;
+			}
 			break;
 		case PST_TYPE_TASK:
-			if (item->appointment && m->tasks && GPOINTER_TO_INT (g_datalist_get_data (&m->target->data, "pst-do-task")))
-				pst_process_task (m, item);
+			if (item->appointment && m->tasks && GPOINTER_TO_INT (g_datalist_get_data (&m->target->data, "pst-do-task"))) {
+				pst_queue_item (m, item, PST_KIND_TASK);
+				item = NULL;
+			}
 			break;
 		case PST_TYPE_JOURNAL:
-			if (item->appointment && m->journal && GPOINTER_TO_INT (g_datalist_get_data (&m->target->data, "pst-do-journal")))
-				pst_process_journal (m, item);
+			if (item->appointment && m->journal && GPOINTER_TO_INT (g_datalist_get_data (&m->target->data, "pst-do-journal"))) {
+				pst_queue_item (m, item, PST_KIND_JOURNAL);
+				item = NULL;
+			}
 			break;
 		case PST_TYPE_NOTE:
 		case PST_TYPE_SCHEDULE:
 		case PST_TYPE_REPORT:
-			if (item->email && GPOINTER_TO_INT (g_datalist_get_data (&m->target->data, "pst-do-mail")))
-				pst_process_email (m, item);
+			if (item->email && GPOINTER_TO_INT (g_datalist_get_data (&m->target->data, "pst-do-mail"))) {
+				pst_queue_item (m, item, PST_KIND_MAIL);
+				item = NULL;
+			}
 			break;
 		}
 
 		m->current_item++;
 	}
 
-	pst_freeItem (item);
+	/* queued items are freed once converted */
+	if (item)
+		pst_freeItem (item);
 }
 
 /**
@@ -1074,16 +1163,15 @@ pst_create_folder (PstImporter *m)
 
 /**
  * attachment_to_part:
- * @m: a #PstImporter
- * @attach: attachment to convert
+ * @attach: attachment to convert, with its data already loaded
  *
- * Create a #CamelMimePart from given PST attachment
+ * Create a #CamelMimePart from given PST attachment. This does not read
+ * the PST file, thus it can be called from the conversion threads.
  *
  * Returns: #CamelMimePart containing data and mime type
  */
 static CamelMimePart *
-attachment_to_part (PstImporter *m,
-                    pst_item_attach *attach)
+attachment_to_part (pst_item_attach *attach)
 {
 	CamelMimePart *part;
 	const gchar *mimetype;
@@ -1104,15 +1192,7 @@ attachment_to_part (PstImporter *m,
 		mimetype = "application/octet-stream";
 	}
 
-	if (attach->data.data != NULL) {
-		camel_mime_part_set_content (part, attach->data.data, attach->data.size, mimetype);
-	} else {
-		pst_binary attach_rc;
-		attach_rc = pst_attach_to_mem (&m->pst, attach);
-
-		camel_mime_part_set_content (part, (gchar *) attach_rc.data, attach_rc.size, mimetype);
-		free (attach_rc.data);
-	}
+	camel_mime_part_set_content (part, attach->data.data, attach->data.size, mimetype);
 
 	return part;
 }
@@ -1175,9 +1255,9 @@ strip_smtp (const gchar *str)
 	return str;
 }
 
-static void
-pst_process_email (PstImporter *m,
-                   pst_item *item)
+static CamelMimeMessage *
+pst_convert_email (pst_item *item,
+                   CamelMessageInfo **out_info)
 {
 	CamelMimeMessage *msg;
 	CamelInternetAddress *addr;
@@ -1187,13 +1267,6 @@ pst_process_email (PstImporter *m,
 	pst_item_attach *attach;
 	gboolean has_attachments;
 	gchar *comp_str = NULL;
-	gboolean success;
-
-	if (m->folder == NULL) {
-		pst_create_folder (m);
-		if (!m->folder)
-			return;
-	}
 
 	/* stops on the first valid attachment */
 	for (attach = item->attach; attach; attach = attach->next) {
@@ -1210,7 +1283,7 @@ pst_process_email (PstImporter *m,
 
 		comp = e_cal_component_new ();
 		e_cal_component_set_new_vtype (comp, E_CAL_COMPONENT_EVENT);
-		fill_calcomponent (m, item, comp, "meeting-request");
+		fill_calcomponent (item, comp, "meeting-request");
 
 		vcal = e_cal_util_new_top_level ();
 
@@ -1239,8 +1312,6 @@ pst_process_email (PstImporter *m,
 		}
 	}
 
-	camel_folder_freeze (m->folder);
-
 	msg = camel_mime_message_new ();
 
 	if (item->subject.str != NULL) {
@@ -1358,7 +1429,7 @@ pst_process_email (PstImporter *m,
 
 	for (attach = item->attach; attach; attach = attach->next) {
 		if (attach->data.data || attach->i_id) {
-			part = attachment_to_part (m, attach);
+			part = attachment_to_part (attach);
 			camel_multipart_add_part (mp, part);
 			g_object_unref (part);
 		}
@@ -1389,23 +1460,12 @@ pst_process_email (PstImporter *m,
 	if (item->flags & 0x08)
 		camel_message_info_set_flags (info, CAMEL_MESSAGE_DRAFT, ~0);
 
-	/* FIXME Not passing a GCancellable or GError here. */
-	success = camel_folder_append_message_sync (
-		m->folder, msg, info, NULL, NULL, NULL);
-	g_clear_object (&info);
-	g_object_unref (msg);
-
-	/* FIXME Not passing a GCancellable or GError here. */
-	camel_folder_synchronize_sync (m->folder, FALSE, NULL, NULL);
-	camel_folder_thaw (m->folder);
-
+	g_object_unref (mp);
 	g_free (comp_str);
 
-	if (!success) {
-		g_debug ("%s: Exception!", G_STRFUNC);
-		return;
-	}
+	*out_info = info;
 
+	return msg;
 }
 
 static void
@@ -1497,14 +1557,12 @@ contact_set_date (EContact *contact,
 	}
 }
 
-static void
-pst_process_contact (PstImporter *m,
-                     pst_item *item)
+static EContact *
+pst_convert_contact (pst_item *item)
 {
 	pst_item_contact *c;
 	EContact *ec;
 	GString *notes;
-	GError *error = NULL;
 
 	c = item->contact;
 	notes = g_string_sized_new (2048);
@@ -1644,17 +1702,7 @@ pst_process_contact (PstImporter *m,
 	contact_set_string (ec, E_CONTACT_NOTE, notes->str);
 	g_string_free (notes, TRUE);
 
-	e_book_client_add_contact_sync (
-		m->addressbook, ec, E_BOOK_OPERATION_FLAG_NONE, NULL, NULL, &error);
-
-	g_object_unref (ec);
-
-	if (error != NULL) {
-		g_warning (
-			"%s: Failed to add contact: %s",
-			G_STRFUNC, error->message);
-		g_error_free (error);
-	}
+	return ec;
 }
 
 /**
@@ -1683,7 +1731,6 @@ get_ical_date (FILETIME *date,
 static void
 set_cal_attachments (ECalClient *cal,
                      ECalComponent *ec,
-                     PstImporter *m,
                      pst_item_attach *attach)
 {
 	GSList *list = NULL;
@@ -1705,7 +1752,7 @@ set_cal_attachments (ECalClient *cal,
 		CamelStream *stream;
 		struct stat st;
 
-		part = attachment_to_part (m, attach);
+		part = attachment_to_part (attach);
 
 		orig_filename = camel_mime_part_get_filename (part);
 
@@ -1782,8 +1829,7 @@ set_cal_attachments (ECalClient *cal,
 }
 
 static void
-fill_calcomponent (PstImporter *m,
-                   pst_item *item,
+fill_calcomponent (pst_item *item,
                    ECalComponent *ec,
                    const gchar *type)
 {
@@ -2012,57 +2058,374 @@ fill_calcomponent (PstImporter *m,
 	e_cal_component_commit_sequence	 (ec);
 }
 
-static void
-pst_process_component (PstImporter *m,
-                       pst_item *item,
-                       const gchar *comp_type,
-                       ECalComponentVType vtype,
+static ECalComponent *
+pst_convert_component (pst_item *item,
+                       PstItemKind kind,
                        ECalClient *cal)
 {
 	ECalComponent *ec;
-	GError *error = NULL;
 
-	g_return_if_fail (item->appointment != NULL);
+	g_return_val_if_fail (item->appointment != NULL, NULL);
 
 	ec = e_cal_component_new ();
-	e_cal_component_set_new_vtype (ec, vtype);
+	e_cal_component_set_new_vtype (ec, pst_kinds[kind].vtype);
+
+	fill_calcomponent (item, ec, pst_kinds[kind].name);
+	set_cal_attachments (cal, ec, item->attach);
 
-	fill_calcomponent (m, item, ec, comp_type);
-	set_cal_attachments (cal, ec, m, item->attach);
+	return ec;
+}
 
-	e_cal_client_create_object_sync (
-		cal, e_cal_component_get_icalcomponent (ec),
-		E_CAL_OPERATION_FLAG_NONE, NULL, NULL, &error);
+static void
+pst_convert_job_cb (gpointer data,
+                    gpointer user_data)
+{
+	PstJob *job = data;
 
-	if (error != NULL) {
-		g_warning (
-			"Creation of %s failed: %s",
-			comp_type, error->message);
-		g_error_free (error);
+	if (!g_cancellable_is_cancelled (job->cancellable)) {
+		gint64 started = g_get_monotonic_time ();
+
+		switch (job->kind) {
+		case PST_KIND_MAIL:
+			job->message = pst_convert_email (job->item, &job->info);
+			break;
+		case PST_KIND_CONTACT:
+			job->contact = pst_convert_contact (job->item);
+			break;
+		case PST_KIND_APPOINTMENT:
+		case PST_KIND_TASK:
+		case PST_KIND_JOURNAL:
+			job->comp = pst_convert_component (job->item, job->kind, job->cal);
+			break;
+		case PST_N_KINDS:
+			g_warn_if_reached ();
+			break;
+		}
+
+		job->convert_time = g_get_monotonic_time () - started;
+	}
+}
+
+/* Reads the attachment data into the item, because the conversion
+ * threads cannot read from the PST file themselves. */
+static void
+pst_load_attachments (PstImporter *m,
+                      pst_item *item)
+{
+	pst_item_attach *attach;
+
+	for (attach = item->attach; attach; attach = attach->next) {
+		if (!attach->data.data && attach->i_id)
+			attach->data = pst_attach_to_mem (&m->pst, attach);
+	}
+}
+
+static ECalClient *
+pst_kind_to_cal_client (PstImporter *m,
+                        PstItemKind kind)
+{
+	switch (kind) {
+	case PST_KIND_APPOINTMENT:
+		return m->calendar;
+	case PST_KIND_TASK:
+		return m->tasks;
+	case PST_KIND_JOURNAL:
+		return m->journal;
+	default:
+		break;
+	}
+
+	return NULL;
+}
+
+static void
+pst_submit_contacts (PstImporter *m,
+                     GSList *contacts)
+{
+	GSList *uids = NULL, *link;
+
+	evolution_contact_importer_add_contacts_sync (
+		m->addressbook, contacts, &uids, NULL, NULL);
+
+	for (link = uids; link; link = g_slist_next (link)) {
+		if (link->data)
+			m->stats_count[PST_KIND_CONTACT]++;
+	}
+
+	g_slist_free_full (uids, g_free);
+}
+
+static void
+pst_submit_components (PstImporter *m,
+                       PstItemKind kind,
+                       GSList *icomps)
+{
+	ECalClient *cal = pst_kind_to_cal_client (m, kind);
+	GSList *link;
+	GError *error = NULL;
+
+	/* With known UIDs a retry can tell which components were stored */
+	for (link = icomps; link; link = g_slist_next (link)) {
+		if (!i_cal_component_get_uid (link->data)) {
+			gchar *uid = e_util_generate_uid ();
+
+			i_cal_component_set_uid (link->data, uid);
+			g_free (uid);
+		}
+	}
+
+	if (e_cal_client_create_objects_sync (
+		cal, icomps, E_CAL_OPERATION_FLAG_NONE,
+		NULL, NULL, &error)) {
+		m->stats_count[kind] += g_slist_length (icomps);
+		return;
+	}
+
+	/* One broken component fails the whole batch, thus create them
+	 * one by one to keep the others; those stored before the failure
+	 * are skipped as existing ones. */
+	g_clear_error (&error);
+
+	for (link = icomps; link; link = g_slist_next (link)) {
+		if (e_cal_client_create_object_sync (
+			cal, link->data, E_CAL_OPERATION_FLAG_NONE,
+			NULL, NULL, &error) ||
+		    g_error_matches (error, E_CAL_CLIENT_ERROR, E_CAL_CLIENT_ERROR_OBJECT_ID_ALREADY_EXISTS)) {
+			m->stats_count[kind]++;
+			g_clear_error (&error);
+		} else {
+			g_warning (
+				"Creation of %s failed: %s",
+				pst_kinds[kind].name, error ? error->message : "Unknown error");
+			g_clear_error (&error);
+		}
+	}
+}
+
+static void
+pst_finish_folder (CamelFolder *folder)
+{
+	/* FIXME Not passing a GCancellable or GError here. */
+	camel_folder_synchronize_sync (folder, FALSE, NULL, NULL);
+	camel_folder_thaw (folder);
+}
+
+/* Stores the converted items of the batch, in the order they were read. */
+static void
+pst_batch_submit (PstImporter *m,
+                  PstBatch *batch)
+{
+	GSList *objects[PST_N_KINDS] = { NULL, };
+	CamelFolder *folder = NULL;
+	gint64 started;
+	guint ii;
+	gint kind;
+
+	started = g_get_monotonic_time ();
+
+	for (ii = 0; ii < batch->n_jobs; ii++) {
+		PstJob *job = &batch->jobs[ii];
+
+		m->stats_convert_time[job->kind] += job->convert_time;
+
+		switch (job->kind) {
+		case PST_KIND_MAIL:
+			if (!job->message)
+				break;
+
+			/* Consecutive messages for the same folder are
+			 * appended between one freeze and thaw. */
+			if (folder != job->folder) {
+				if (folder)
+					pst_finish_folder (folder);
+				folder = job->folder;
+				camel_folder_freeze (folder);
+			}
+
+			/* FIXME Not passing a GCancellable or GError here. */
+			if (camel_folder_append_message_sync (
+				folder, job->message, job->info, NULL, NULL, NULL))
+				m->stats_count[PST_KIND_MAIL]++;
+			else
+				g_debug ("%s: Exception!", G_STRFUNC);
+			break;
+		case PST_KIND_CONTACT:
+			if (job->contact)
+				objects[job->kind] = g_slist_prepend (objects[job->kind], job->contact);
+			break;
+		case PST_KIND_APPOINTMENT:
+		case PST_KIND_TASK:
+		case PST_KIND_JOURNAL:
+			if (job->comp)
+				objects[job->kind] = g_slist_prepend (
+					objects[job->kind],
+					e_cal_component_get_icalcomponent (job->comp));
+			break;
+		case PST_N_KINDS:
+			break;
+		}
+	}
+
+	if (folder)
+		pst_finish_folder (folder);
+
+	m->stats_submit_time[PST_KIND_MAIL] += g_get_monotonic_time () - started;
+
+	for (kind = PST_KIND_CONTACT; kind < PST_N_KINDS; kind++) {
+		if (!objects[kind])
+			continue;
+
+		objects[kind] = g_slist_reverse (objects[kind]);
+		started = g_get_monotonic_time ();
+
+		if (kind == PST_KIND_CONTACT)
+			pst_submit_contacts (m, objects[kind]);
+		else
+			pst_submit_components (m, kind, objects[kind]);
+
+		m->stats_submit_time[kind] += g_get_monotonic_time () - started;
+
+		/* the objects are owned by the jobs */
+		g_slist_free (objects[kind]);
+	}
+}
+
+static void
+pst_batch_clear (PstBatch *batch)
+{
+	guint ii;
+
+	for (ii = 0; ii < batch->n_jobs; ii++) {
+		PstJob *job = &batch->jobs[ii];
+
+		pst_freeItem (job->item);
+		g_clear_object (&job->folder);
+		g_clear_object (&job->message);
+		g_clear_object (&job->info);
+		g_clear_object (&job->contact);
+		g_clear_object (&job->comp);
 	}
 
-	g_object_unref (ec);
+	batch->n_jobs = 0;
 }
 
+/* Waits for the conversion of the batch, then submits and frees it. */
 static void
-pst_process_appointment (PstImporter *m,
-                         pst_item *item)
+pst_batch_finish (PstImporter *m,
+                  PstBatch *batch)
 {
-	pst_process_component (m, item, "appointment", E_CAL_COMPONENT_EVENT, m->calendar);
+	if (!batch->n_jobs)
+		return;
+
+	e_util_batch_wait (batch->converter);
+
+	if (!g_cancellable_is_cancelled (m->cancellable))
+		pst_batch_submit (m, batch);
+
+	pst_batch_clear (batch);
+}
+
+/* Starts converting the filled batch and submits the previous one
+ * in the meantime, thus the next batch can be read while this one
+ * is being converted. */
+static void
+pst_batch_dispatch (PstImporter *m)
+{
+	PstBatch *batch = m->filling_batch;
+	guint ii;
+
+	for (ii = 0; ii < batch->n_jobs; ii++)
+		e_util_batch_push (batch->converter, &batch->jobs[ii]);
+
+	pst_batch_finish (m, m->converting_batch);
+
+	m->filling_batch = m->converting_batch;
+	m->converting_batch = batch;
+}
+
+static void
+pst_queue_item (PstImporter *m,
+                pst_item *item,
+                PstItemKind kind)
+{
+	PstJob *job;
+
+	if (kind == PST_KIND_MAIL && m->folder == NULL) {
+		pst_create_folder (m);
+		if (!m->folder) {
+			pst_freeItem (item);
+			return;
+		}
+	}
+
+	pst_load_attachments (m, item);
+
+	job = &m->filling_batch->jobs[m->filling_batch->n_jobs++];
+	memset (job, 0, sizeof (PstJob));
+
+	job->cancellable = m->cancellable;
+	job->kind = kind;
+	job->item = item;
+
+	if (kind == PST_KIND_MAIL)
+		job->folder = g_object_ref (m->folder);
+	else
+		job->cal = pst_kind_to_cal_client (m, kind);
+
+	if (m->filling_batch->n_jobs == PST_BATCH_SIZE)
+		pst_batch_dispatch (m);
 }
 
 static void
-pst_process_task (PstImporter *m,
-                  pst_item *item)
+pst_flush_items (PstImporter *m)
 {
-	pst_process_component (m, item, "task", E_CAL_COMPONENT_TODO, m->tasks);
+	if (m->filling_batch->n_jobs)
+		pst_batch_dispatch (m);
+
+	pst_batch_finish (m, m->converting_batch);
 }
 
+/* With CAMEL_DEBUG=pst:stats the throughput is printed when the import ends */
 static void
-pst_process_journal (PstImporter *m,
-                     pst_item *item)
+pst_report_stats (PstImporter *m,
+                  gint64 elapsed)
 {
-	pst_process_component (m, item, "journal", E_CAL_COMPONENT_JOURNAL, m->journal);
+	GString *str;
+	guint total = 0;
+	gint kind;
+
+	if (!camel_debug ("pst:stats"))
+		return;
+
+	str = g_string_new (NULL);
+
+	for (kind = 0; kind < PST_N_KINDS; kind++) {
+		guint count = m->stats_count[kind];
+
+		if (!count)
+			continue;
+
+		total += count;
+
+		/* The conversion rate is per thread, because the
+		 * conversion time is summed over all the threads. */
+		g_string_append_printf (
+			str, "\n  %s: %u items, %.0f/s converted per thread, %.0f/s submitted",
+			pst_kinds[kind].name, count,
+			count * (gdouble) G_USEC_PER_SEC / MAX (m->stats_convert_time[kind], 1),
+			count * (gdouble) G_USEC_PER_SEC / MAX (m->stats_submit_time[kind], 1));
+	}
+
+	if (camel_debug_start ("pst:stats")) {
+		printf (
+			"PST import: %u items in %.1f s (%.0f items/s)%s\n",
+			total, elapsed / (gdouble) G_USEC_PER_SEC,
+			total * (gdouble) G_USEC_PER_SEC / MAX (elapsed, 1),
+			str->str);
+		camel_debug_end ();
+	}
+
+	g_string_free (str, TRUE);
 }
 
 /* Print an error message - maybe later bring up an error dialog? */